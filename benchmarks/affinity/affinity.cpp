@@ -0,0 +1,119 @@
+/* FiberTaskingLib - A tasking library that uses fibers for efficient task switching
+ *
+ * This library was created as a proof of concept of the ideas presented by
+ * Christian Gyrling in his 2015 GDC Talk 'Parallelizing the Naughty Dog Engine Using Fibers'
+ *
+ * http://gdcvault.com/play/1022186/Parallelizing-the-Naughty-Dog-Engine
+ *
+ * FiberTaskingLib is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2015 - 2017
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "ftl/task_scheduler.h"
+#include "ftl/atomic_counter.h"
+
+#include <nonius/nonius.hpp>
+
+#include <vector>
+
+
+ // Constants
+/* Each partition is 256 KB, so a worker's share stays in its cache between iterations */
+const uint kStencilPartitionSize = 32768;
+const uint kStencilPartitionsPerThread = 4;
+const uint kStencilIterations = 20;
+
+struct StencilState {
+	std::vector<double> Buffers[2];
+	/* Which buffer holds the current values */
+	uint Current;
+};
+
+struct StencilPartition {
+	StencilState *State;
+	uint Begin;
+	uint End;
+};
+
+/* One step of a 3-point stencil over a partition. The neighbouring partitions are only read at the edges */
+void StencilStep(ftl::TaskScheduler *taskScheduler, void *arg) {
+	(void)taskScheduler;
+	StencilPartition *partition = reinterpret_cast<StencilPartition *>(arg);
+	const std::vector<double> &in = partition->State->Buffers[partition->State->Current];
+	std::vector<double> &out = partition->State->Buffers[partition->State->Current ^ 1];
+	const std::size_t last = in.size() - 1;
+
+	for (uint i = partition->Begin; i < partition->End; ++i) {
+		const double left = in[i == 0 ? last : i - 1];
+		const double right = in[i == last ? 0 : i + 1];
+		out[i] = (left + in[i] + right) * (1.0 / 3.0);
+	}
+}
+
+void RunStencil(ftl::TaskScheduler *taskScheduler, nonius::chronometer *meter, bool useAffinity) {
+	const uint numThreads = static_cast<uint>(taskScheduler->GetNumThreads());
+	const uint numPartitions = numThreads * kStencilPartitionsPerThread;
+
+	StencilState state;
+	state.Buffers[0].assign(numPartitions * kStencilPartitionSize, 1.0);
+	state.Buffers[1].assign(numPartitions * kStencilPartitionSize, 0.0);
+	state.Current = 0;
+
+	std::vector<StencilPartition> partitions(numPartitions);
+	std::vector<ftl::Task> tasks(numPartitions);
+	std::vector<ftl::Affinity> affinities(numPartitions);
+	for (uint i = 0; i < numPartitions; ++i) {
+		partitions[i] = {&state, i * kStencilPartitionSize, (i + 1) * kStencilPartitionSize};
+		tasks[i] = {StencilStep, &partitions[i]};
+		// Partition i always goes back to the same worker, which still has it in cache
+		affinities[i] = {i % numThreads, false};
+	}
+
+	meter->measure([&] {
+		for (uint iteration = 0; iteration < kStencilIterations; ++iteration) {
+			ftl::AtomicCounter counter(taskScheduler);
+			if (useAffinity) {
+				taskScheduler->AddTasks(numPartitions, tasks.data(), &counter, affinities.data());
+			} else {
+				taskScheduler->AddTasks(numPartitions, tasks.data(), &counter);
+			}
+			taskScheduler->WaitForCounter(&counter, 0);
+			state.Current ^= 1;
+		}
+	});
+}
+
+void StencilAnywhereMainTask(ftl::TaskScheduler *taskScheduler, void *arg) {
+	RunStencil(taskScheduler, reinterpret_cast<nonius::chronometer *>(arg), false);
+}
+
+void StencilAffinityMainTask(ftl::TaskScheduler *taskScheduler, void *arg) {
+	RunStencil(taskScheduler, reinterpret_cast<nonius::chronometer *>(arg), true);
+}
+
+void RunStencilBenchmark(nonius::chronometer meter, ftl::TaskFunction mainTask) {
+	ftl::TaskScheduler *taskScheduler = new ftl::TaskScheduler();
+	taskScheduler->Run(400, mainTask, &meter);
+	delete taskScheduler;
+}
+
+NONIUS_BENCHMARK("StencilAnywhere", [](nonius::chronometer meter) {
+	RunStencilBenchmark(meter, StencilAnywhereMainTask);
+});
+
+NONIUS_BENCHMARK("StencilAffinity", [](nonius::chronometer meter) {
+	RunStencilBenchmark(meter, StencilAffinityMainTask);
+});
@@ -0,0 +1,112 @@
+/* FiberTaskingLib - A tasking library that uses fibers for efficient task switching
+ *
+ * This library was created as a proof of concept of the ideas presented by
+ * Christian Gyrling in his 2015 GDC Talk 'Parallelizing the Naughty Dog Engine Using Fibers'
+ *
+ * http://gdcvault.com/play/1022186/Parallelizing-the-Naughty-Dog-Engine
+ *
+ * FiberTaskingLib is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2015 - 2017
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ftl/task_scheduler.h"
+#include "ftl/atomic_counter.h"
+
+#include <nonius/nonius.hpp>
+
+#include <cstdio>
+
+#if defined(FTL_OS_LINUX)
+	#include <unistd.h>
+#endif
+
+
+ // Constants
+const uint kNumBurstTasks = 1000000;
+const uint kNumSteadyTasks = 100;
+const uint kNumSteadyIterations = 1000;
+
+void BurstMemoryBenchmarkTask(ftl::TaskScheduler *taskScheduler, void *arg) {
+	// No-Op
+}
+
+/**
+ * Gets the resident set size of the process
+ *
+ * @return    The resident set size in bytes. 0 if the platform isn't supported
+ */
+std::size_t GetResidentMemory() {
+	#if defined(FTL_OS_LINUX)
+		FILE *file = fopen("/proc/self/statm", "r");
+		if (file == nullptr) {
+			return 0;
+		}
+
+		unsigned long size = 0;
+		unsigned long resident = 0;
+		int numRead = fscanf(file, "%lu %lu", &size, &resident);
+		fclose(file);
+
+		return numRead == 2 ? resident * static_cast<std::size_t>(sysconf(_SC_PAGESIZE)) : 0;
+	#else
+		return 0;
+	#endif
+}
+
+void BurstMemoryBenchmarkMainTask(ftl::TaskScheduler *taskScheduler, void *arg) {
+	auto& meter = *reinterpret_cast<nonius::chronometer*>(arg);
+
+	ftl::Task *tasks = new ftl::Task[kNumBurstTasks];
+	for (uint i = 0; i < kNumBurstTasks; ++i) {
+		tasks[i] = {BurstMemoryBenchmarkTask, nullptr};
+	}
+
+	std::size_t memoryBeforeBurst = GetResidentMemory();
+
+	// Grow the task queues with one large burst
+	ftl::AtomicCounter burstCounter(taskScheduler);
+	taskScheduler->AddTasks(kNumBurstTasks, tasks, &burstCounter);
+	taskScheduler->WaitForCounter(&burstCounter, 0);
+
+	std::size_t memoryAfterBurst = GetResidentMemory();
+
+	// Then measure a long steady state of small batches, giving the queues the chance to shrink
+	meter.measure([=] {
+		for (uint i = 0; i < kNumSteadyIterations; ++i) {
+			ftl::AtomicCounter counter(taskScheduler);
+			taskScheduler->AddTasks(kNumSteadyTasks, tasks, &counter);
+
+			taskScheduler->WaitForCounter(&counter, 0);
+		}
+	});
+
+	std::size_t memorySteadyState = GetResidentMemory();
+
+	static bool reported = false;
+	if (!reported && memoryBeforeBurst != 0) {
+		printf("BurstMemory: resident memory %zu KB before burst, %zu KB after burst, %zu KB at steady state\n",
+		       memoryBeforeBurst / 1024, memoryAfterBurst / 1024, memorySteadyState / 1024);
+		reported = true;
+	}
+
+	// Cleanup
+	delete[] tasks;
+}
+
+NONIUS_BENCHMARK("BurstMemory", [](nonius::chronometer meter) {
+	ftl::TaskScheduler* taskScheduler = new ftl::TaskScheduler();
+	taskScheduler->Run(20, BurstMemoryBenchmarkMainTask, &meter);
+	delete taskScheduler;
+});
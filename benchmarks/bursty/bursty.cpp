@@ -0,0 +1,105 @@
+/* FiberTaskingLib - A tasking library that uses fibers for efficient task switching
+ *
+ * This library was created as a proof of concept of the ideas presented by
+ * Christian Gyrling in his 2015 GDC Talk 'Parallelizing the Naughty Dog Engine Using Fibers'
+ *
+ * http://gdcvault.com/play/1022186/Parallelizing-the-Naughty-Dog-Engine
+ *
+ * FiberTaskingLib is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2015 - 2017
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ftl/task_scheduler.h"
+#include "ftl/atomic_counter.h"
+
+#include <nonius/nonius.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <thread>
+
+
+ // Constants
+const uint kNumBursts = 10;
+const uint kNumTasksPerBurst = 1000;
+const uint kNumSpinsPerTask = 2000;
+const uint kIdleMsBetweenBursts = 20;
+
+struct BurstyBenchmarkArgs {
+	nonius::chronometer *Meter;
+	const char *Name;
+};
+
+void BurstyBenchmarkTask(ftl::TaskScheduler *taskScheduler, void *arg) {
+	volatile uint spins = 0;
+	for (uint i = 0; i < kNumSpinsPerTask; ++i) {
+		spins = spins + 1;
+	}
+}
+
+/**
+ * Runs short bursts of work, separated by idle periods, like a server with a diurnal load
+ * Measures the wall time, and reports the CPU time spent by the whole process. With a fixed set of threads,
+ * the idle threads spin through the quiet periods. With parking, they sleep
+ */
+void BurstyBenchmarkMainTask(ftl::TaskScheduler *taskScheduler, void *arg) {
+	BurstyBenchmarkArgs *args = reinterpret_cast<BurstyBenchmarkArgs *>(arg);
+	nonius::chronometer &meter = *args->Meter;
+
+	ftl::Task *tasks = new ftl::Task[kNumTasksPerBurst];
+	for (uint i = 0; i < kNumTasksPerBurst; ++i) {
+		tasks[i] = {BurstyBenchmarkTask, nullptr};
+	}
+
+	std::clock_t cpuStart = std::clock();
+	meter.measure([=] {
+		for (uint i = 0; i < kNumBursts; ++i) {
+			ftl::AtomicCounter counter(taskScheduler, 0, true);
+			taskScheduler->AddTasks(kNumTasksPerBurst, tasks, &counter);
+			taskScheduler->WaitForCounter(&counter, 0);
+
+			std::this_thread::sleep_for(std::chrono::milliseconds(kIdleMsBetweenBursts));
+		}
+	});
+	std::clock_t cpuEnd = std::clock();
+
+	double cpuMsPerRun = 1000.0 * static_cast<double>(cpuEnd - cpuStart) / CLOCKS_PER_SEC / meter.runs();
+	printf("%s: %.1f ms of CPU time per run, %u threads active at the end\n", args->Name, cpuMsPerRun, taskScheduler->GetNumActiveThreads());
+
+	// Cleanup
+	delete[] tasks;
+}
+
+NONIUS_BENCHMARK("BurstyFixed", [](nonius::chronometer meter) {
+	BurstyBenchmarkArgs args = {&meter, "BurstyFixed"};
+
+	ftl::TaskScheduler* taskScheduler = new ftl::TaskScheduler();
+	taskScheduler->Run(20, BurstyBenchmarkMainTask, &args);
+	delete taskScheduler;
+});
+
+NONIUS_BENCHMARK("BurstyElastic", [](nonius::chronometer meter) {
+	BurstyBenchmarkArgs args = {&meter, "BurstyElastic"};
+
+	ftl::SchedulerOptions options;
+	options.FiberPoolSize = 20;
+	options.MinActiveThreads = 1;
+	options.ParkDelayMs = 5;
+
+	ftl::TaskScheduler* taskScheduler = new ftl::TaskScheduler();
+	taskScheduler->Run(options, BurstyBenchmarkMainTask, &args);
+	delete taskScheduler;
+});
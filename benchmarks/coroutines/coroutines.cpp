@@ -0,0 +1,111 @@
+/* FiberTaskingLib - A tasking library that uses fibers for efficient task switching
+ *
+ * This library was created as a proof of concept of the ideas presented by
+ * Christian Gyrling in his 2015 GDC Talk 'Parallelizing the Naughty Dog Engine Using Fibers'
+ *
+ * http://gdcvault.com/play/1022186/Parallelizing-the-Naughty-Dog-Engine
+ *
+ * FiberTaskingLib is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2015 - 2017
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "suspended_co_tasks.h"
+
+#include "ftl/task_scheduler.h"
+#include "ftl/atomic_counter.h"
+
+#include <nonius/nonius.hpp>
+
+
+ // Constants
+const uint kNumSuspendedFibers = 1000;
+const uint kNumSmallCoTasks = 1000;
+const uint kNumLargeCoTasks = 1000000;
+
+struct SuspendedFiberArgs {
+	ftl::AtomicCounter *Started;
+	ftl::AtomicCounter *Gate;
+};
+
+void SuspendedFiberTask(ftl::TaskScheduler *taskScheduler, void *arg) {
+	SuspendedFiberArgs *args = reinterpret_cast<SuspendedFiberArgs *>(arg);
+
+	args->Started->FetchSub(1);
+	// A counter only has NUM_WAITING_FIBER_SLOTS slots. Pinned waits don't use them, so any number of fibers can wait
+	taskScheduler->WaitForCounter(args->Gate, 0, true);
+}
+
+/**
+ * Suspends kNumSuspendedFibers fibers on a single counter, then releases them
+ * Every suspended fiber holds on to a fiber from the pool, and its stack
+ */
+void SuspendedFibersMainTask(ftl::TaskScheduler *taskScheduler, void *arg) {
+	auto& meter = *reinterpret_cast<nonius::chronometer*>(arg);
+
+	ftl::Task *tasks = new ftl::Task[kNumSuspendedFibers];
+	meter.measure([=] {
+		ftl::AtomicCounter started(taskScheduler, kNumSuspendedFibers);
+		ftl::AtomicCounter gate(taskScheduler, 1);
+		SuspendedFiberArgs args = {&started, &gate};
+		for (uint i = 0; i < kNumSuspendedFibers; ++i) {
+			tasks[i] = {SuspendedFiberTask, &args};
+		}
+
+		ftl::AtomicCounter done(taskScheduler);
+		taskScheduler->AddTasks(kNumSuspendedFibers, tasks, &done);
+
+		taskScheduler->WaitForCounter(&started, 0);
+		gate.Store(0);
+		taskScheduler->WaitForCounter(&done, 0);
+	});
+	delete[] tasks;
+}
+
+/**
+ * The same, with CoTasks. A suspended CoTask only holds on to its coroutine frame
+ */
+void SuspendedCoTasksMainTask(nonius::chronometer &meter, ftl::TaskScheduler *taskScheduler, uint numTasks) {
+	meter.measure([=] {
+		RunSuspendedCoTasks(taskScheduler, numTasks);
+	});
+}
+
+void SmallSuspendedCoTasksMainTask(ftl::TaskScheduler *taskScheduler, void *arg) {
+	SuspendedCoTasksMainTask(*reinterpret_cast<nonius::chronometer*>(arg), taskScheduler, kNumSmallCoTasks);
+}
+
+void LargeSuspendedCoTasksMainTask(ftl::TaskScheduler *taskScheduler, void *arg) {
+	SuspendedCoTasksMainTask(*reinterpret_cast<nonius::chronometer*>(arg), taskScheduler, kNumLargeCoTasks);
+}
+
+NONIUS_BENCHMARK("SuspendedFibers1K", [](nonius::chronometer meter) {
+	ftl::TaskScheduler* taskScheduler = new ftl::TaskScheduler();
+	// Every suspended task needs its own fiber, plus a few for the worker threads
+	taskScheduler->Run(kNumSuspendedFibers + 64, SuspendedFibersMainTask, &meter);
+	delete taskScheduler;
+});
+
+NONIUS_BENCHMARK("SuspendedCoTasks1K", [](nonius::chronometer meter) {
+	ftl::TaskScheduler* taskScheduler = new ftl::TaskScheduler();
+	taskScheduler->Run(20, SmallSuspendedCoTasksMainTask, &meter);
+	delete taskScheduler;
+});
+
+NONIUS_BENCHMARK("SuspendedCoTasks1M", [](nonius::chronometer meter) {
+	ftl::TaskScheduler* taskScheduler = new ftl::TaskScheduler();
+	taskScheduler->Run(20, LargeSuspendedCoTasksMainTask, &meter);
+	delete taskScheduler;
+});
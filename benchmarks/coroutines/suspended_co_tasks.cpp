@@ -0,0 +1,56 @@
+/* FiberTaskingLib - A tasking library that uses fibers for efficient task switching
+ *
+ * This library was created as a proof of concept of the ideas presented by
+ * Christian Gyrling in his 2015 GDC Talk 'Parallelizing the Naughty Dog Engine Using Fibers'
+ *
+ * http://gdcvault.com/play/1022186/Parallelizing-the-Naughty-Dog-Engine
+ *
+ * FiberTaskingLib is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2015 - 2017
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "suspended_co_tasks.h"
+
+#include "ftl/co_task.h"
+#include "ftl/task_scheduler.h"
+#include "ftl/atomic_counter.h"
+
+#include <vector>
+
+
+static ftl::CoTask SuspendedCoTask(ftl::AtomicCounter *started, ftl::AtomicCounter *gate) {
+	started->FetchSub(1);
+	co_await ftl::CoWaitForCounter(gate, 0);
+}
+
+void RunSuspendedCoTasks(ftl::TaskScheduler *taskScheduler, uint numTasks) {
+	ftl::AtomicCounter started(taskScheduler, numTasks);
+	ftl::AtomicCounter gate(taskScheduler, 1);
+
+	std::vector<ftl::CoTask> tasks;
+	tasks.reserve(numTasks);
+	for (uint i = 0; i < numTasks; ++i) {
+		tasks.push_back(SuspendedCoTask(&started, &gate));
+	}
+
+	ftl::AtomicCounter done(taskScheduler);
+	ftl::AddCoTasks(taskScheduler, numTasks, tasks.data(), &done);
+
+	// Once every task has started, they're all suspended at the same time
+	taskScheduler->WaitForCounter(&started, 0);
+	gate.Store(0);
+	taskScheduler->WaitForCounter(&done, 0);
+}
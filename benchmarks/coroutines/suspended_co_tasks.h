@@ -0,0 +1,42 @@
+/* FiberTaskingLib - A tasking library that uses fibers for efficient task switching
+ *
+ * This library was created as a proof of concept of the ideas presented by
+ * Christian Gyrling in his 2015 GDC Talk 'Parallelizing the Naughty Dog Engine Using Fibers'
+ *
+ * http://gdcvault.com/play/1022186/Parallelizing-the-Naughty-Dog-Engine
+ *
+ * FiberTaskingLib is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2015 - 2017
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+
+#include "ftl/typedefs.h"
+
+
+namespace ftl {
+class TaskScheduler;
+} // End of namespace ftl
+
+/**
+ * Suspends 'numTasks' CoTasks on a single counter, then releases them and waits for them to finish
+ *
+ * This lives in its own file because CoTask needs C++20, and nonius doesn't build as C++20
+ *
+ * @param taskScheduler    The TaskScheduler to run the CoTasks on
+ * @param numTasks         The number of CoTasks to suspend at once
+ */
+void RunSuspendedCoTasks(ftl::TaskScheduler *taskScheduler, uint numTasks);
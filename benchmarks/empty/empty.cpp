@@ -35,8 +35,15 @@ void EmptyBenchmarkTask(ftl::TaskScheduler *taskScheduler, void *arg) {
 	// No-Op
 }
 
+struct EmptyBenchmarkArgs {
+	nonius::chronometer *Meter;
+	bool FanIn;
+};
+
 void EmptyBenchmarkMainTask(ftl::TaskScheduler *taskScheduler, void *arg) {
-	auto& meter = *reinterpret_cast<nonius::chronometer*>(arg);
+	EmptyBenchmarkArgs *benchmarkArgs = reinterpret_cast<EmptyBenchmarkArgs *>(arg);
+	auto& meter = *benchmarkArgs->Meter;
+	bool fanIn = benchmarkArgs->FanIn;
 
 	ftl::Task *tasks = new ftl::Task[kNumTasks];
 	for (uint i = 0; i < kNumTasks; ++i) {
@@ -45,7 +52,7 @@ void EmptyBenchmarkMainTask(ftl::TaskScheduler *taskScheduler, void *arg) {
 
 	meter.measure([=] {
 		for (uint i = 0; i < kNumIterations; ++i) {
-			ftl::AtomicCounter counter(taskScheduler);
+			ftl::AtomicCounter counter(taskScheduler, 0, fanIn);
 			taskScheduler->AddTasks(kNumTasks, tasks, &counter);
 
 			taskScheduler->WaitForCounter(&counter, 0);
@@ -57,7 +64,17 @@ void EmptyBenchmarkMainTask(ftl::TaskScheduler *taskScheduler, void *arg) {
 }
 
 NONIUS_BENCHMARK("Empty", [](nonius::chronometer meter) {
+	EmptyBenchmarkArgs args = {&meter, false};
+
+	ftl::TaskScheduler* taskScheduler = new ftl::TaskScheduler();
+	taskScheduler->Run(20, EmptyBenchmarkMainTask, &args);
+	delete taskScheduler;
+});
+
+NONIUS_BENCHMARK("EmptyFanIn", [](nonius::chronometer meter) {
+	EmptyBenchmarkArgs args = {&meter, true};
+
 	ftl::TaskScheduler* taskScheduler = new ftl::TaskScheduler();
-	taskScheduler->Run(20, EmptyBenchmarkMainTask, &meter);
+	taskScheduler->Run(20, EmptyBenchmarkMainTask, &args);
 	delete taskScheduler;
 });
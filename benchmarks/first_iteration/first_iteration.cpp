@@ -0,0 +1,117 @@
+/* FiberTaskingLib - A tasking library that uses fibers for efficient task switching
+ *
+ * This library was created as a proof of concept of the ideas presented by
+ * Christian Gyrling in his 2015 GDC Talk 'Parallelizing the Naughty Dog Engine Using Fibers'
+ *
+ * http://gdcvault.com/play/1022186/Parallelizing-the-Naughty-Dog-Engine
+ *
+ * FiberTaskingLib is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2015 - 2017
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "ftl/task_scheduler.h"
+#include "ftl/atomic_counter.h"
+
+#include <nonius/nonius.hpp>
+
+#include <cstdio>
+
+#if defined(__GLIBC__)
+	#include <malloc.h>
+#endif
+
+
+ // Constants
+const uint kNumTasks = 300;
+/* How much stack each task uses. Deep enough that a cold stack takes several page faults */
+const uint kStackUseSize = 64 * 1024;
+
+struct BurstArgs {
+	ftl::AtomicCounter *Started;
+	ftl::AtomicCounter *Gate;
+};
+
+void StackHeavyTask(ftl::TaskScheduler *taskScheduler, void *arg) {
+	BurstArgs *args = reinterpret_cast<BurstArgs *>(arg);
+
+	volatile char stackData[kStackUseSize];
+	for (uint i = 0; i < kStackUseSize; i += 1024) {
+		stackData[i] = static_cast<char>(i);
+	}
+
+	// Hold on to this fiber until all the tasks have started, so every task runs on a different stack
+	// Pinned waits don't use the counter's waiting fiber slots, so any number of fibers can wait
+	args->Started->FetchSub(1);
+	taskScheduler->WaitForCounter(args->Gate, 0, true);
+
+	// The other tasks ran on their own stacks in the meantime, so ours should be untouched
+	for (uint i = 0; i < kStackUseSize; i += 1024) {
+		if (stackData[i] != static_cast<char>(i)) {
+			printf("Error: The stack of a waiting fiber changed\n");
+			break;
+		}
+	}
+}
+
+/**
+ * Runs one burst of tasks right after Run() starts, while the fiber stacks are still cold
+ * A new TaskScheduler is created for every sample, so each sample measures a first iteration
+ */
+void FirstIterationMainTask(ftl::TaskScheduler *taskScheduler, void *arg) {
+	auto& meter = *reinterpret_cast<nonius::chronometer*>(arg);
+
+	ftl::Task *tasks = new ftl::Task[kNumTasks];
+	meter.measure([=] {
+		ftl::AtomicCounter started(taskScheduler, kNumTasks);
+		ftl::AtomicCounter gate(taskScheduler, 1);
+		BurstArgs args = {&started, &gate};
+		for (uint i = 0; i < kNumTasks; ++i) {
+			tasks[i] = {StackHeavyTask, &args};
+		}
+
+		ftl::AtomicCounter counter(taskScheduler);
+		taskScheduler->AddTasks(kNumTasks, tasks, &counter);
+		taskScheduler->WaitForCounter(&started, 0);
+		gate.Store(0);
+		taskScheduler->WaitForCounter(&counter, 0);
+	});
+	delete[] tasks;
+}
+
+void RunFirstIterationBenchmark(nonius::chronometer &meter, uint prefaultStackBytes) {
+	#if defined(__GLIBC__)
+		// glibc raises its mmap threshold once a large block is freed, and then keeps the freed stacks of the previous
+		// TaskScheduler around for the next one. Pin the threshold, so every TaskScheduler gets fresh stacks, like a
+		// newly started process would
+		mallopt(M_MMAP_THRESHOLD, 128 * 1024);
+	#endif
+
+	ftl::SchedulerOptions options;
+	options.FiberPoolSize = 400;
+	options.PrefaultStackBytes = prefaultStackBytes;
+
+	ftl::TaskScheduler* taskScheduler = new ftl::TaskScheduler();
+	taskScheduler->Run(options, FirstIterationMainTask, &meter);
+	delete taskScheduler;
+}
+
+NONIUS_BENCHMARK("FirstIteration", [](nonius::chronometer meter) {
+	RunFirstIterationBenchmark(meter, 0);
+});
+
+NONIUS_BENCHMARK("FirstIterationPrefaulted", [](nonius::chronometer meter) {
+	RunFirstIterationBenchmark(meter, kStackUseSize + 32 * 1024);
+});
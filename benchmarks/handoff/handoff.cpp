@@ -0,0 +1,87 @@
+/* FiberTaskingLib - A tasking library that uses fibers for efficient task switching
+ *
+ * This library was created as a proof of concept of the ideas presented by
+ * Christian Gyrling in his 2015 GDC Talk 'Parallelizing the Naughty Dog Engine Using Fibers'
+ *
+ * http://gdcvault.com/play/1022186/Parallelizing-the-Naughty-Dog-Engine
+ *
+ * FiberTaskingLib is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2015 - 2017
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ftl/task_scheduler.h"
+#include "ftl/atomic_counter.h"
+
+#include <nonius/nonius.hpp>
+
+
+// Constants
+const uint kNumChainLinks = 10000;
+/* Each link works on the data the link before it wrote. Small enough to stay in L1 */
+const uint kLinkDataSize = 1024;
+
+struct ChainData {
+	uint64 Values[kLinkDataSize];
+};
+
+void ChainLink(ftl::TaskScheduler *taskScheduler, void *arg) {
+	ChainData *data = reinterpret_cast<ChainData *>(arg);
+	for (uint i = 0; i < kLinkDataSize; ++i) {
+		data->Values[i] = data->Values[i] * 3 + i;
+	}
+}
+
+struct HandoffBenchmarkArgs {
+	nonius::chronometer *Meter;
+};
+
+void HandoffBenchmarkMainTask(ftl::TaskScheduler *taskScheduler, void *arg) {
+	HandoffBenchmarkArgs *benchmarkArgs = reinterpret_cast<HandoffBenchmarkArgs *>(arg);
+	auto& meter = *benchmarkArgs->Meter;
+
+	ChainData *data = new ChainData();
+
+	// Each link only starts once the one before it is done, so the chain measures the latency of waking up the waiter
+	meter.measure([=] {
+		ftl::AtomicCounter counter(taskScheduler);
+		for (uint i = 0; i < kNumChainLinks; ++i) {
+			taskScheduler->AddTask({ChainLink, data}, &counter);
+			taskScheduler->WaitForCounter(&counter, 0);
+		}
+	});
+
+	// Cleanup
+	delete data;
+}
+
+void RunHandoffBenchmark(nonius::chronometer &meter, ftl::ResumePolicy resume) {
+	HandoffBenchmarkArgs args = {&meter};
+
+	ftl::SchedulerOptions options;
+	options.FiberPoolSize = 20;
+	options.Resume = resume;
+
+	ftl::TaskScheduler *taskScheduler = new ftl::TaskScheduler();
+	taskScheduler->Run(options, HandoffBenchmarkMainTask, &args);
+	delete taskScheduler;
+}
+
+NONIUS_BENCHMARK("ChainDeferred", [](nonius::chronometer meter) {
+	RunHandoffBenchmark(meter, ftl::ResumePolicy::Deferred);
+});
+
+NONIUS_BENCHMARK("ChainHandoff", [](nonius::chronometer meter) {
+	RunHandoffBenchmark(meter, ftl::ResumePolicy::Handoff);
+});
@@ -0,0 +1,100 @@
+/* FiberTaskingLib - A tasking library that uses fibers for efficient task switching
+ *
+ * This library was created as a proof of concept of the ideas presented by
+ * Christian Gyrling in his 2015 GDC Talk 'Parallelizing the Naughty Dog Engine Using Fibers'
+ *
+ * http://gdcvault.com/play/1022186/Parallelizing-the-Naughty-Dog-Engine
+ *
+ * FiberTaskingLib is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2015 - 2017
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "ftl/task_scheduler.h"
+#include "ftl/atomic_counter.h"
+
+#include <nonius/nonius.hpp>
+
+#include <cstdio>
+
+
+ // Constants
+const uint kNumTasks = 300;
+const uint kNumWaits = 20;
+/* How much stack each task touches between waits. A few pages, like a task with a moderately deep call stack */
+const uint kStackTouchSize = 16384;
+
+void EmptyTask(ftl::TaskScheduler *taskScheduler, void *arg) {
+	(void)taskScheduler;
+	(void)arg;
+}
+
+void SwitchHeavyTask(ftl::TaskScheduler *taskScheduler, void *arg) {
+	(void)arg;
+
+	volatile char stackData[kStackTouchSize];
+	for (uint i = 0; i < kNumWaits; ++i) {
+		// Read back what we wrote before the last wait, then write again, so the stack is touched both ways
+		for (uint j = 0; j < kStackTouchSize; j += 1024) {
+			if (i > 0 && stackData[j] != static_cast<char>(i - 1)) {
+				printf("Error: The stack of a waiting fiber changed\n");
+				break;
+			}
+			stackData[j] = static_cast<char>(i);
+		}
+
+		// Every wait switches to a different fiber, and so a different stack
+		ftl::AtomicCounter counter(taskScheduler);
+		taskScheduler->AddTask({EmptyTask, nullptr}, &counter);
+		taskScheduler->WaitForCounter(&counter, 0);
+	}
+}
+
+/**
+ * Keeps a few hundred fibers in flight, each waiting over and over
+ * With normal pages, every switch lands on a stack whose pages are probably not in the TLB
+ */
+void FiberSwitchMainTask(ftl::TaskScheduler *taskScheduler, void *arg) {
+	auto& meter = *reinterpret_cast<nonius::chronometer*>(arg);
+
+	ftl::Task tasks[kNumTasks];
+	for (uint i = 0; i < kNumTasks; ++i) {
+		tasks[i] = {SwitchHeavyTask, nullptr};
+	}
+
+	meter.measure([=, &tasks] {
+		ftl::AtomicCounter counter(taskScheduler);
+		taskScheduler->AddTasks(kNumTasks, tasks, &counter);
+		taskScheduler->WaitForCounter(&counter, 0);
+	});
+}
+
+void RunFiberSwitchBenchmark(nonius::chronometer &meter, ftl::HugePagePolicy hugePages) {
+	ftl::SchedulerOptions options;
+	options.FiberPoolSize = 400;
+	options.HugePages = hugePages;
+
+	ftl::TaskScheduler* taskScheduler = new ftl::TaskScheduler();
+	taskScheduler->Run(options, FiberSwitchMainTask, &meter);
+	delete taskScheduler;
+}
+
+NONIUS_BENCHMARK("FiberSwitches", [](nonius::chronometer meter) {
+	RunFiberSwitchBenchmark(meter, ftl::HugePagePolicy::Off);
+});
+
+NONIUS_BENCHMARK("FiberSwitchesHugePages", [](nonius::chronometer meter) {
+	RunFiberSwitchBenchmark(meter, ftl::HugePagePolicy::Explicit);
+});
@@ -0,0 +1,144 @@
+/* FiberTaskingLib - A tasking library that uses fibers for efficient task switching
+ *
+ * This library was created as a proof of concept of the ideas presented by
+ * Christian Gyrling in his 2015 GDC Talk 'Parallelizing the Naughty Dog Engine Using Fibers'
+ *
+ * http://gdcvault.com/play/1022186/Parallelizing-the-Naughty-Dog-Engine
+ *
+ * FiberTaskingLib is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2015 - 2017
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ftl/task_scheduler.h"
+#include "ftl/atomic_counter.h"
+#include "ftl/cpu_topology.h"
+
+#include <nonius/nonius.hpp>
+
+#include <vector>
+
+
+ // Constants
+const uint kNumTasks = 256;
+const uint kBlockSize = 16 * 1024;
+const uint kNumPasses = 32;
+
+struct PinningBlock {
+	uint64 Data[kBlockSize];
+	uint64 Sum;
+};
+
+struct PinningBenchmarkArgs {
+	nonius::chronometer *Meter;
+	PinningBlock *Blocks;
+};
+
+/**
+ * Repeatedly sums a block that fits in L2. This is sensitive to cores sharing caches and execution units,
+ * so it shows the difference between packing threads onto SMT siblings and spreading them out
+ */
+void PinningBenchmarkTask(ftl::TaskScheduler *taskScheduler, void *arg) {
+	PinningBlock *block = reinterpret_cast<PinningBlock *>(arg);
+
+	uint64 sum = 0;
+	for (uint pass = 0; pass < kNumPasses; ++pass) {
+		for (uint i = 0; i < kBlockSize; ++i) {
+			sum += block->Data[i] ^ pass;
+		}
+	}
+	block->Sum = sum;
+}
+
+void PinningBenchmarkMainTask(ftl::TaskScheduler *taskScheduler, void *arg) {
+	PinningBenchmarkArgs *args = reinterpret_cast<PinningBenchmarkArgs *>(arg);
+
+	ftl::Task *tasks = new ftl::Task[kNumTasks];
+	for (uint i = 0; i < kNumTasks; ++i) {
+		tasks[i] = {PinningBenchmarkTask, &args->Blocks[i]};
+	}
+
+	args->Meter->measure([=] {
+		ftl::AtomicCounter counter(taskScheduler);
+		taskScheduler->AddTasks(kNumTasks, tasks, &counter);
+
+		taskScheduler->WaitForCounter(&counter, 0);
+	});
+
+	// Cleanup
+	delete[] tasks;
+}
+
+/**
+ * Runs the benchmark with a pinning policy, and a fraction of the available threads
+ *
+ * @param meter         The nonius chronometer
+ * @param pinning       The pinning policy to use
+ * @param numThreads    The number of worker threads. 0 runs one thread per available CPU
+ */
+void RunPinningBenchmark(nonius::chronometer meter, ftl::PinningPolicy pinning, uint numThreads) {
+	std::vector<PinningBlock> blocks(kNumTasks);
+	for (uint i = 0; i < kNumTasks; ++i) {
+		for (uint j = 0; j < kBlockSize; ++j) {
+			blocks[i].Data[j] = i + j;
+		}
+	}
+	PinningBenchmarkArgs args = {&meter, blocks.data()};
+
+	ftl::SchedulerOptions options;
+	options.FiberPoolSize = 20;
+	options.ThreadPoolSize = numThreads;
+	options.Pinning = pinning;
+
+	ftl::TaskScheduler* taskScheduler = new ftl::TaskScheduler();
+	taskScheduler->Run(options, PinningBenchmarkMainTask, &args);
+	delete taskScheduler;
+}
+
+static uint GetHalfThreads() {
+	uint numThreads = ftl::GetNumAvailableThreads() / 2;
+	return numThreads == 0 ? 1 : numThreads;
+}
+
+NONIUS_BENCHMARK("PinningNoneHalf", [](nonius::chronometer meter) {
+	RunPinningBenchmark(meter, ftl::PinningPolicy::None, GetHalfThreads());
+});
+
+NONIUS_BENCHMARK("PinningSequentialHalf", [](nonius::chronometer meter) {
+	RunPinningBenchmark(meter, ftl::PinningPolicy::Sequential, GetHalfThreads());
+});
+
+NONIUS_BENCHMARK("PinningCompactHalf", [](nonius::chronometer meter) {
+	RunPinningBenchmark(meter, ftl::PinningPolicy::Compact, GetHalfThreads());
+});
+
+NONIUS_BENCHMARK("PinningScatterHalf", [](nonius::chronometer meter) {
+	RunPinningBenchmark(meter, ftl::PinningPolicy::Scatter, GetHalfThreads());
+});
+
+NONIUS_BENCHMARK("PinningNoneAll", [](nonius::chronometer meter) {
+	RunPinningBenchmark(meter, ftl::PinningPolicy::None, 0);
+});
+
+NONIUS_BENCHMARK("PinningSequentialAll", [](nonius::chronometer meter) {
+	RunPinningBenchmark(meter, ftl::PinningPolicy::Sequential, 0);
+});
+
+NONIUS_BENCHMARK("PinningCompactAll", [](nonius::chronometer meter) {
+	RunPinningBenchmark(meter, ftl::PinningPolicy::Compact, 0);
+});
+
+NONIUS_BENCHMARK("PinningScatterAll", [](nonius::chronometer meter) {
+	RunPinningBenchmark(meter, ftl::PinningPolicy::Scatter, 0);
+});
@@ -0,0 +1,169 @@
+/* FiberTaskingLib - A tasking library that uses fibers for efficient task switching
+ *
+ * This library was created as a proof of concept of the ideas presented by
+ * Christian Gyrling in his 2015 GDC Talk 'Parallelizing the Naughty Dog Engine Using Fibers'
+ *
+ * http://gdcvault.com/play/1022186/Parallelizing-the-Naughty-Dog-Engine
+ *
+ * FiberTaskingLib is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2015 - 2017
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "ftl/task_scheduler.h"
+#include "ftl/atomic_counter.h"
+#include "ftl/pipeline.h"
+
+#include <nonius/nonius.hpp>
+
+#include <vector>
+
+
+ // Constants
+const uint kNumLogRecords = 20000;
+const uint kNumParseSpins = 2000;
+const uint kNumEnrichSpins = 2000;
+const uint kNumPipelineTokens = 64;
+
+/* A stand-in for a log record on its way through ingest */
+struct LogRecord {
+	uint Index;
+	uint Parsed;
+	uint Enriched;
+};
+
+void SpinFor(uint numSpins) {
+	volatile uint spins = 0;
+	for (uint i = 0; i < numSpins; ++i) {
+		spins = spins + 1;
+	}
+}
+
+void ParseRecord(LogRecord *record) {
+	SpinFor(kNumParseSpins);
+	record->Parsed = record->Index * 3;
+}
+
+void EnrichRecord(LogRecord *record) {
+	SpinFor(kNumEnrichSpins);
+	record->Enriched = record->Parsed + 1;
+}
+
+struct IngestState {
+	nonius::chronometer *Meter;
+	std::vector<LogRecord> Records;
+	uint NextRecord;
+	/* What the serial write stage produces. Order matters */
+	uint64 Checksum;
+};
+
+void WriteRecord(IngestState *state, LogRecord *record) {
+	state->Checksum = state->Checksum * 31 + record->Enriched;
+}
+
+void *ReadRecord(ftl::TaskScheduler *taskScheduler, void *arg) {
+	IngestState *state = reinterpret_cast<IngestState *>(arg);
+	if (state->NextRecord == kNumLogRecords) {
+		return nullptr;
+	}
+	return &state->Records[state->NextRecord++];
+}
+
+void *ParseStage(ftl::TaskScheduler *taskScheduler, void *item, void *arg) {
+	ParseRecord(reinterpret_cast<LogRecord *>(item));
+	return item;
+}
+
+void *EnrichStage(ftl::TaskScheduler *taskScheduler, void *item, void *arg) {
+	EnrichRecord(reinterpret_cast<LogRecord *>(item));
+	return item;
+}
+
+void *WriteStage(ftl::TaskScheduler *taskScheduler, void *item, void *arg) {
+	WriteRecord(reinterpret_cast<IngestState *>(arg), reinterpret_cast<LogRecord *>(item));
+	return item;
+}
+
+void PipelineIngestMainTask(ftl::TaskScheduler *taskScheduler, void *arg) {
+	IngestState *state = reinterpret_cast<IngestState *>(arg);
+
+	state->Meter->measure([=] {
+		state->NextRecord = 0;
+		state->Checksum = 0;
+
+		ftl::Pipeline pipeline(taskScheduler);
+		pipeline.SetInput(ReadRecord, state);
+		pipeline.AddStage(ftl::PipelineStageMode::Parallel, ParseStage);
+		pipeline.AddStage(ftl::PipelineStageMode::Parallel, EnrichStage);
+		pipeline.AddStage(ftl::PipelineStageMode::SerialInOrder, WriteStage, state);
+		pipeline.Run(kNumPipelineTokens);
+	});
+}
+
+void ParseAndEnrichTask(ftl::TaskScheduler *taskScheduler, void *arg) {
+	LogRecord *record = reinterpret_cast<LogRecord *>(arg);
+	ParseRecord(record);
+	EnrichRecord(record);
+}
+
+/**
+ * The way the ingest path is built by hand: fan a batch out, wait for all of it, then write it out in order
+ * The batch is the size of the pipeline's token count, so both keep as many records in flight
+ */
+void HandRolledIngestMainTask(ftl::TaskScheduler *taskScheduler, void *arg) {
+	IngestState *state = reinterpret_cast<IngestState *>(arg);
+
+	ftl::Task *tasks = new ftl::Task[kNumPipelineTokens];
+	state->Meter->measure([=] {
+		state->Checksum = 0;
+
+		for (uint batchStart = 0; batchStart < kNumLogRecords; batchStart += kNumPipelineTokens) {
+			const uint batchSize = std::min<uint>(kNumPipelineTokens, kNumLogRecords - batchStart);
+			for (uint i = 0; i < batchSize; ++i) {
+				tasks[i] = {ParseAndEnrichTask, &state->Records[batchStart + i]};
+			}
+
+			ftl::AtomicCounter counter(taskScheduler);
+			taskScheduler->AddTasks(batchSize, tasks, &counter);
+			taskScheduler->WaitForCounter(&counter, 0);
+
+			for (uint i = 0; i < batchSize; ++i) {
+				WriteRecord(state, &state->Records[batchStart + i]);
+			}
+		}
+	});
+	delete[] tasks;
+}
+
+void RunIngestBenchmark(nonius::chronometer meter, ftl::TaskFunction mainTask) {
+	IngestState state;
+	state.Meter = &meter;
+	state.Records.resize(kNumLogRecords);
+	for (uint i = 0; i < kNumLogRecords; ++i) {
+		state.Records[i].Index = i;
+	}
+
+	ftl::TaskScheduler *taskScheduler = new ftl::TaskScheduler();
+	taskScheduler->Run(400, mainTask, &state);
+	delete taskScheduler;
+}
+
+NONIUS_BENCHMARK("PipelineIngest", [](nonius::chronometer meter) {
+	RunIngestBenchmark(meter, PipelineIngestMainTask);
+});
+
+NONIUS_BENCHMARK("HandRolledIngest", [](nonius::chronometer meter) {
+	RunIngestBenchmark(meter, HandRolledIngestMainTask);
+});
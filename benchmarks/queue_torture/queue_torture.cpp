@@ -0,0 +1,173 @@
+/* FiberTaskingLib - A tasking library that uses fibers for efficient task switching
+ *
+ * This library was created as a proof of concept of the ideas presented by
+ * Christian Gyrling in his 2015 GDC Talk 'Parallelizing the Naughty Dog Engine Using Fibers'
+ *
+ * http://gdcvault.com/play/1022186/Parallelizing-the-Naughty-Dog-Engine
+ *
+ * FiberTaskingLib is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2015 - 2017
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "ftl/task_queue.h"
+
+#include <nonius/nonius.hpp>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+
+ // Constants
+const uint kNumTortureItems = 100000;
+/* The owner pushes this many items at a time, then pops them back, unless a thief got there first */
+const uint kTortureBurstSize = 32;
+const uint kNumLatencyRounds = 10000;
+
+/**
+ * The owner pushes and pops in bursts, like a worker spawning and running tasks, while 'numThieves' threads steal
+ * Every item is taken exactly once, by either the owner or a thief
+ */
+template<typename Queue>
+void TortureQueue(nonius::chronometer meter, uint numThieves) {
+	meter.measure([=] {
+		Queue queue;
+		std::atomic<uint> numTaken(0);
+		std::atomic<bool> done(false);
+
+		std::vector<std::thread> thieves;
+		for (uint i = 0; i < numThieves; ++i) {
+			thieves.emplace_back([&queue, &numTaken, &done] {
+				uint32 value;
+				while (!done.load(std::memory_order_acquire)) {
+					if (queue.Steal(&value)) {
+						numTaken.fetch_add(1, std::memory_order_relaxed);
+					} else {
+						std::this_thread::yield();
+					}
+				}
+			});
+		}
+
+		uint32 value;
+		for (uint pushed = 0; pushed < kNumTortureItems; pushed += kTortureBurstSize) {
+			for (uint i = 0; i < kTortureBurstSize; ++i) {
+				queue.Push(pushed + i);
+			}
+			for (uint i = 0; i < kTortureBurstSize; ++i) {
+				if (queue.Pop(&value)) {
+					numTaken.fetch_add(1, std::memory_order_relaxed);
+				}
+			}
+		}
+		while (queue.Pop(&value)) {
+			numTaken.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		// A thief may still be finishing the last steal
+		while (numTaken.load(std::memory_order_relaxed) != kNumTortureItems) {
+			std::this_thread::yield();
+		}
+		done.store(true, std::memory_order_release);
+		for (std::thread &thief : thieves) {
+			thief.join();
+		}
+	});
+}
+
+/**
+ * The owner pushes one item at a time, and waits for a thief to steal it. So each round is the time it takes
+ * for a pushed task to be picked up by an idle worker
+ */
+template<typename Queue>
+void StealLatency(nonius::chronometer meter) {
+	meter.measure([=] {
+		Queue queue;
+		std::atomic<uint> numStolen(0);
+
+		std::thread thief([&queue, &numStolen] {
+			uint32 value;
+			while (numStolen.load(std::memory_order_relaxed) != kNumLatencyRounds) {
+				if (queue.Steal(&value)) {
+					numStolen.fetch_add(1, std::memory_order_release);
+				} else {
+					std::this_thread::yield();
+				}
+			}
+		});
+
+		for (uint i = 0; i < kNumLatencyRounds; ++i) {
+			queue.Push(i);
+			while (numStolen.load(std::memory_order_acquire) == i) {
+				std::this_thread::yield();
+			}
+		}
+		thief.join();
+	});
+}
+
+typedef ftl::WaitFreeQueue<uint32> ChaseLevQueue;
+typedef ftl::BoundedDeque<uint32> BoundedQueue;
+typedef ftl::MpmcTaskQueue<uint32> MpmcQueue;
+
+NONIUS_BENCHMARK("QueueTortureChaseLev0Thieves", [](nonius::chronometer meter) {
+	TortureQueue<ChaseLevQueue>(meter, 0);
+});
+NONIUS_BENCHMARK("QueueTortureChaseLev1Thief", [](nonius::chronometer meter) {
+	TortureQueue<ChaseLevQueue>(meter, 1);
+});
+NONIUS_BENCHMARK("QueueTortureChaseLev3Thieves", [](nonius::chronometer meter) {
+	TortureQueue<ChaseLevQueue>(meter, 3);
+});
+NONIUS_BENCHMARK("QueueTortureChaseLev7Thieves", [](nonius::chronometer meter) {
+	TortureQueue<ChaseLevQueue>(meter, 7);
+});
+
+NONIUS_BENCHMARK("QueueTortureBounded0Thieves", [](nonius::chronometer meter) {
+	TortureQueue<BoundedQueue>(meter, 0);
+});
+NONIUS_BENCHMARK("QueueTortureBounded1Thief", [](nonius::chronometer meter) {
+	TortureQueue<BoundedQueue>(meter, 1);
+});
+NONIUS_BENCHMARK("QueueTortureBounded3Thieves", [](nonius::chronometer meter) {
+	TortureQueue<BoundedQueue>(meter, 3);
+});
+NONIUS_BENCHMARK("QueueTortureBounded7Thieves", [](nonius::chronometer meter) {
+	TortureQueue<BoundedQueue>(meter, 7);
+});
+
+NONIUS_BENCHMARK("QueueTortureMpmc0Thieves", [](nonius::chronometer meter) {
+	TortureQueue<MpmcQueue>(meter, 0);
+});
+NONIUS_BENCHMARK("QueueTortureMpmc1Thief", [](nonius::chronometer meter) {
+	TortureQueue<MpmcQueue>(meter, 1);
+});
+NONIUS_BENCHMARK("QueueTortureMpmc3Thieves", [](nonius::chronometer meter) {
+	TortureQueue<MpmcQueue>(meter, 3);
+});
+NONIUS_BENCHMARK("QueueTortureMpmc7Thieves", [](nonius::chronometer meter) {
+	TortureQueue<MpmcQueue>(meter, 7);
+});
+
+NONIUS_BENCHMARK("QueueStealLatencyChaseLev", [](nonius::chronometer meter) {
+	StealLatency<ChaseLevQueue>(meter);
+});
+NONIUS_BENCHMARK("QueueStealLatencyBounded", [](nonius::chronometer meter) {
+	StealLatency<BoundedQueue>(meter);
+});
+NONIUS_BENCHMARK("QueueStealLatencyMpmc", [](nonius::chronometer meter) {
+	StealLatency<MpmcQueue>(meter);
+});
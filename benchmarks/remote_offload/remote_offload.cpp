@@ -0,0 +1,185 @@
+/* FiberTaskingLib - A tasking library that uses fibers for efficient task switching
+ *
+ * This library was created as a proof of concept of the ideas presented by
+ * Christian Gyrling in his 2015 GDC Talk 'Parallelizing the Naughty Dog Engine Using Fibers'
+ *
+ * http://gdcvault.com/play/1022186/Parallelizing-the-Naughty-Dog-Engine
+ *
+ * FiberTaskingLib is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2015 - 2017
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "ftl/task_scheduler.h"
+#include "ftl/remote_task_transport.h"
+#include "ftl/atomic_counter.h"
+
+#include <nonius/nonius.hpp>
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#if defined(FTL_OS_LINUX) || defined(FTL_OS_MAC)
+#	include <sys/wait.h>
+#	include <unistd.h>
+#endif
+
+
+ // Constants
+const uint kNumRemoteTasks = 1000;
+const uint kNumRemoteTaskSpins = 20000;
+const uint32 kRemoteSpinFunctionId = 1;
+
+uint32 RemoteSpinTask(ftl::TaskScheduler *taskScheduler, const void *args, uint32 argsSize, void *result, uint32 resultCapacity) {
+	(void)taskScheduler;
+	(void)argsSize;
+	(void)resultCapacity;
+
+	uint numSpins;
+	memcpy(&numSpins, args, sizeof(numSpins));
+
+	volatile uint spins = 0;
+	for (uint i = 0; i < numSpins; ++i) {
+		spins = spins + 1;
+	}
+
+	const uint32 finalSpins = spins;
+	memcpy(result, &finalSpins, sizeof(finalSpins));
+	return sizeof(finalSpins);
+}
+
+/**
+ * Measures how long it takes to get through a batch of CPU bound remote tasks
+ */
+void RemoteOffloadBenchmarkMainTask(ftl::TaskScheduler *taskScheduler, void *arg) {
+	nonius::chronometer *meter = reinterpret_cast<nonius::chronometer *>(arg);
+
+	uint32 *results = new uint32[kNumRemoteTasks];
+	ftl::RemoteTask *tasks = new ftl::RemoteTask[kNumRemoteTasks];
+	for (uint i = 0; i < kNumRemoteTasks; ++i) {
+		tasks[i].FunctionId = kRemoteSpinFunctionId;
+		tasks[i].ArgsSize = sizeof(kNumRemoteTaskSpins);
+		memcpy(tasks[i].Args, &kNumRemoteTaskSpins, sizeof(kNumRemoteTaskSpins));
+		tasks[i].Result = &results[i];
+		tasks[i].ResultCapacity = sizeof(uint32);
+	}
+
+	meter->measure([=] {
+		ftl::AtomicCounter counter(taskScheduler);
+		taskScheduler->AddRemoteTasks(kNumRemoteTasks, tasks, &counter);
+		taskScheduler->WaitForCounter(&counter, 0);
+	});
+
+	delete[] tasks;
+	delete[] results;
+}
+
+void RemoteWorkerMainTask(ftl::TaskScheduler *taskScheduler, void *arg) {
+	ftl::RemoteTaskTransport *transport = reinterpret_cast<ftl::RemoteTaskTransport *>(arg);
+	transport->Serve(taskScheduler);
+}
+
+/**
+ * Runs the benchmark with a single threaded process, shipping all of its tasks to single threaded worker
+ * processes. The workers stand in for other machines
+ *
+ * @param meter         The nonius chronometer
+ * @param numWorkers    The number of worker processes. 0 runs every task locally
+ */
+void RunRemoteOffloadBenchmark(nonius::chronometer meter, uint numWorkers) {
+	ftl::RemoteTaskTransport transport;
+	transport.RegisterFunction(kRemoteSpinFunctionId, RemoteSpinTask);
+
+	ftl::SchedulerOptions options;
+	options.ThreadPoolSize = 1;
+	options.FiberPoolSize = 20;
+	options.Transport = &transport;
+	options.RemoteOffloadThreshold = numWorkers > 0 ? 0 : UINT_MAX;
+
+#if defined(FTL_OS_LINUX) || defined(FTL_OS_MAC)
+	std::vector<pid_t> workers;
+	for (uint i = 0; i < numWorkers; ++i) {
+		char address[128];
+		snprintf(address, sizeof(address), "unix:/tmp/ftl-benchmark-%d-%u.sock", static_cast<int>(getpid()), i);
+
+		int ready[2];
+		if (pipe(ready) != 0) {
+			break;
+		}
+		const pid_t worker = fork();
+		if (worker == 0) {
+			close(ready[0]);
+			ftl::RemoteTaskTransport workerTransport;
+			workerTransport.RegisterFunction(kRemoteSpinFunctionId, RemoteSpinTask);
+			const char listening = workerTransport.Listen(address) ? 1 : 0;
+			if (write(ready[1], &listening, 1) != 1 || listening == 0) {
+				_exit(1);
+			}
+			close(ready[1]);
+
+			ftl::SchedulerOptions workerOptions;
+			workerOptions.ThreadPoolSize = 1;
+			workerOptions.FiberPoolSize = 20;
+			ftl::TaskScheduler *taskScheduler = new ftl::TaskScheduler();
+			taskScheduler->Run(workerOptions, RemoteWorkerMainTask, &workerTransport);
+			delete taskScheduler;
+			_exit(0);
+		}
+
+		close(ready[1]);
+		char listening = 0;
+		if (worker > 0 && read(ready[0], &listening, 1) == 1 && listening == 1) {
+			transport.Connect(address);
+			workers.push_back(worker);
+		}
+		close(ready[0]);
+	}
+#else
+	(void)numWorkers;
+#endif
+
+	ftl::TaskScheduler *taskScheduler = new ftl::TaskScheduler();
+	taskScheduler->Run(options, RemoteOffloadBenchmarkMainTask, &meter);
+	delete taskScheduler;
+
+	// The workers return from Serve() once we disconnect
+	transport.Close();
+#if defined(FTL_OS_LINUX) || defined(FTL_OS_MAC)
+	for (pid_t worker : workers) {
+		waitpid(worker, nullptr, 0);
+	}
+#endif
+}
+
+NONIUS_BENCHMARK("RemoteOffloadLocal", [](nonius::chronometer meter) {
+	RunRemoteOffloadBenchmark(meter, 0);
+});
+
+NONIUS_BENCHMARK("RemoteOffload1Worker", [](nonius::chronometer meter) {
+	RunRemoteOffloadBenchmark(meter, 1);
+});
+
+NONIUS_BENCHMARK("RemoteOffload2Workers", [](nonius::chronometer meter) {
+	RunRemoteOffloadBenchmark(meter, 2);
+});
+
+NONIUS_BENCHMARK("RemoteOffload3Workers", [](nonius::chronometer meter) {
+	RunRemoteOffloadBenchmark(meter, 3);
+});
+
+NONIUS_BENCHMARK("RemoteOffload4Workers", [](nonius::chronometer meter) {
+	RunRemoteOffloadBenchmark(meter, 4);
+});
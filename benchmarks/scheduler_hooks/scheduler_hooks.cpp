@@ -0,0 +1,113 @@
+/* FiberTaskingLib - A tasking library that uses fibers for efficient task switching
+ *
+ * This library was created as a proof of concept of the ideas presented by
+ * Christian Gyrling in his 2015 GDC Talk 'Parallelizing the Naughty Dog Engine Using Fibers'
+ *
+ * http://gdcvault.com/play/1022186/Parallelizing-the-Naughty-Dog-Engine
+ *
+ * FiberTaskingLib is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2015 - 2017
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ftl/task_scheduler.h"
+#include "ftl/atomic_counter.h"
+#include "ftl/sampling_profiler.h"
+
+#include <nonius/nonius.hpp>
+
+#include <atomic>
+
+
+// Constants
+const uint kNumHookedTasks = 65000;
+
+void HookedBenchmarkTask(ftl::TaskScheduler *taskScheduler, void *arg) {
+	// No-Op
+}
+
+/* Roughly what a profiler does per event: bump a per-thread slot */
+struct alignas(64) HookedThreadCount {
+	std::atomic<uint64> Events;
+};
+HookedThreadCount g_hookedThreadCounts[64];
+
+void CountFiberEvent(void *context, std::size_t threadIndex, std::size_t fiberIndex) {
+	g_hookedThreadCounts[threadIndex % 64].Events.fetch_add(1, std::memory_order_relaxed);
+}
+
+void CountTaskEvent(void *context, std::size_t threadIndex, std::size_t fiberIndex, const ftl::Task &task) {
+	g_hookedThreadCounts[threadIndex % 64].Events.fetch_add(1, std::memory_order_relaxed);
+}
+
+void CountWaitEvent(void *context, std::size_t threadIndex, std::size_t fiberIndex, const ftl::AtomicCounter *counter) {
+	g_hookedThreadCounts[threadIndex % 64].Events.fetch_add(1, std::memory_order_relaxed);
+}
+
+void HookedBenchmarkMainTask(ftl::TaskScheduler *taskScheduler, void *arg) {
+	auto& meter = *reinterpret_cast<nonius::chronometer *>(arg);
+
+	ftl::Task *tasks = new ftl::Task[kNumHookedTasks];
+	for (uint i = 0; i < kNumHookedTasks; ++i) {
+		tasks[i] = {HookedBenchmarkTask, nullptr};
+	}
+
+	meter.measure([=] {
+		ftl::AtomicCounter counter(taskScheduler);
+		taskScheduler->AddTasks(kNumHookedTasks, tasks, &counter);
+
+		taskScheduler->WaitForCounter(&counter, 0);
+	});
+
+	// Cleanup
+	delete[] tasks;
+}
+
+/* The Empty benchmark, with no hooks set. Compare with HooksEnabled, and with a build without FTL_SCHEDULER_HOOKS */
+NONIUS_BENCHMARK("HooksUnset", [](nonius::chronometer meter) {
+	ftl::TaskScheduler *taskScheduler = new ftl::TaskScheduler();
+	taskScheduler->Run(20, HookedBenchmarkMainTask, &meter);
+	delete taskScheduler;
+});
+
+NONIUS_BENCHMARK("HooksEnabled", [](nonius::chronometer meter) {
+	ftl::SchedulerOptions options;
+	options.FiberPoolSize = 20;
+	options.Hooks.FiberSwitchIn = CountFiberEvent;
+	options.Hooks.FiberSwitchOut = CountFiberEvent;
+	options.Hooks.TaskBegin = CountTaskEvent;
+	options.Hooks.TaskEnd = CountTaskEvent;
+	options.Hooks.WaitBegin = CountWaitEvent;
+	options.Hooks.WaitEnd = CountWaitEvent;
+
+	ftl::TaskScheduler *taskScheduler = new ftl::TaskScheduler();
+	taskScheduler->Run(options, HookedBenchmarkMainTask, &meter);
+	delete taskScheduler;
+});
+
+/* The hooks of the SamplingProfiler, plus a sampling thread at its default interval */
+NONIUS_BENCHMARK("SamplingProfiler", [](nonius::chronometer meter) {
+	ftl::SchedulerOptions options;
+	options.FiberPoolSize = 20;
+
+	ftl::SamplingProfiler profiler;
+	profiler.Attach(&options);
+	profiler.Start();
+
+	ftl::TaskScheduler *taskScheduler = new ftl::TaskScheduler();
+	taskScheduler->Run(options, HookedBenchmarkMainTask, &meter);
+	delete taskScheduler;
+
+	profiler.Stop();
+});
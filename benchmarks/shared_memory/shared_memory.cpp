@@ -0,0 +1,181 @@
+/* FiberTaskingLib - A tasking library that uses fibers for efficient task switching
+ *
+ * This library was created as a proof of concept of the ideas presented by
+ * Christian Gyrling in his 2015 GDC Talk 'Parallelizing the Naughty Dog Engine Using Fibers'
+ *
+ * http://gdcvault.com/play/1022186/Parallelizing-the-Naughty-Dog-Engine
+ *
+ * FiberTaskingLib is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2015 - 2017
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "ftl/task_scheduler.h"
+#include "ftl/shared_task_pool.h"
+#include "ftl/cpu_topology.h"
+
+#include <nonius/nonius.hpp>
+
+#include <cstdio>
+#include <cstring>
+
+#if defined(FTL_OS_LINUX) || defined(FTL_OS_MAC)
+#	include <sys/wait.h>
+#	include <unistd.h>
+#endif
+
+
+ // Constants
+const uint kNumSharedTasks = 2000;
+const uint kNumSharedTaskSpins = 20000;
+const uint32 kSpinFunctionId = 1;
+
+void SpinTask(ftl::TaskScheduler *taskScheduler, const void *payload, uint32 payloadSize) {
+	(void)taskScheduler;
+	(void)payloadSize;
+
+	uint numSpins;
+	memcpy(&numSpins, payload, sizeof(numSpins));
+
+	volatile uint spins = 0;
+	for (uint i = 0; i < numSpins; ++i) {
+		spins = spins + 1;
+	}
+}
+
+struct SharedMemoryBenchmarkArgs {
+	nonius::chronometer *Meter;
+	/* Set to 0 once the measurement is done, so the helper process quits */
+	ftl::SharedCounter Stop;
+};
+
+/**
+ * Measures how long it takes to get through a batch of CPU bound shared tasks
+ */
+void SharedMemoryBenchmarkMainTask(ftl::TaskScheduler *taskScheduler, void *arg) {
+	SharedMemoryBenchmarkArgs *args = reinterpret_cast<SharedMemoryBenchmarkArgs *>(arg);
+	ftl::SharedTaskPool *pool = taskScheduler->GetSharedPool();
+
+	ftl::SharedTask *tasks = new ftl::SharedTask[kNumSharedTasks];
+	for (uint i = 0; i < kNumSharedTasks; ++i) {
+		tasks[i].FunctionId = kSpinFunctionId;
+		tasks[i].PayloadSize = sizeof(kNumSharedTaskSpins);
+		memcpy(tasks[i].Payload, &kNumSharedTaskSpins, sizeof(kNumSharedTaskSpins));
+	}
+
+	ftl::SharedCounter counter;
+	pool->AllocateCounter(0, &counter);
+
+	args->Meter->measure([=] {
+		taskScheduler->AddSharedTasks(kNumSharedTasks, tasks, &counter);
+		taskScheduler->WaitForSharedCounter(counter, 0);
+	});
+
+	pool->FreeCounter(counter);
+	pool->StoreCounter(args->Stop, 0);
+	delete[] tasks;
+}
+
+void HelperMainTask(ftl::TaskScheduler *taskScheduler, void *arg) {
+	SharedMemoryBenchmarkArgs *args = reinterpret_cast<SharedMemoryBenchmarkArgs *>(arg);
+
+	// Our own queue stays empty, so we spend the whole time stealing from the other process
+	taskScheduler->WaitForSharedCounter(args->Stop, 0);
+}
+
+/**
+ * Runs the benchmark in a process that only gets half of the cores, with or without a second process
+ * that uses the other half to help it out
+ *
+ * @param meter     The nonius chronometer
+ * @param helped    Whether to start the helper process
+ */
+void RunSharedMemoryBenchmark(nonius::chronometer meter, bool helped) {
+	uint numThreads = ftl::GetNumAvailableThreads() / 2;
+	if (numThreads < 1) {
+		numThreads = 1;
+	}
+
+	char name[64];
+#if defined(FTL_OS_LINUX) || defined(FTL_OS_MAC)
+	snprintf(name, sizeof(name), "/ftl-benchmark-%d", static_cast<int>(getpid()));
+#else
+	snprintf(name, sizeof(name), "/ftl-benchmark");
+#endif
+
+	ftl::SharedTaskPool pool;
+	if (!pool.Open(name, 4096, 16)) {
+		printf("Shared memory isn't available. Skipping the benchmark\n");
+		meter.measure([] {});
+		return;
+	}
+	pool.RegisterFunction(kSpinFunctionId, SpinTask);
+
+	SharedMemoryBenchmarkArgs args;
+	args.Meter = &meter;
+	pool.AllocateCounter(1, &args.Stop);
+
+	ftl::SchedulerOptions options;
+	options.ThreadPoolSize = numThreads;
+	options.FiberPoolSize = 20;
+
+#if defined(FTL_OS_LINUX) || defined(FTL_OS_MAC)
+	pid_t helper = -1;
+	if (helped) {
+		helper = fork();
+		if (helper == 0) {
+			ftl::SharedTaskPool helperPool;
+			if (!helperPool.Open(name)) {
+				_exit(1);
+			}
+			helperPool.RegisterFunction(kSpinFunctionId, SpinTask);
+
+			ftl::SchedulerOptions helperOptions = options;
+			helperOptions.SharedPool = &helperPool;
+			ftl::TaskScheduler *taskScheduler = new ftl::TaskScheduler();
+			taskScheduler->Run(helperOptions, HelperMainTask, &args);
+			delete taskScheduler;
+
+			helperPool.Close();
+			_exit(0);
+		}
+	}
+#else
+	(void)helped;
+#endif
+
+	options.SharedPool = &pool;
+	ftl::TaskScheduler *taskScheduler = new ftl::TaskScheduler();
+	taskScheduler->Run(options, SharedMemoryBenchmarkMainTask, &args);
+	delete taskScheduler;
+
+#if defined(FTL_OS_LINUX) || defined(FTL_OS_MAC)
+	if (helper > 0) {
+		waitpid(helper, nullptr, 0);
+	}
+#endif
+
+	pool.FreeCounter(args.Stop);
+	pool.Close();
+	ftl::SharedTaskPool::Unlink(name);
+}
+
+NONIUS_BENCHMARK("SharedPoolImbalanceAlone", [](nonius::chronometer meter) {
+	RunSharedMemoryBenchmark(meter, false);
+});
+
+NONIUS_BENCHMARK("SharedPoolImbalanceHelped", [](nonius::chronometer meter) {
+	RunSharedMemoryBenchmark(meter, true);
+});
@@ -0,0 +1,64 @@
+/* FiberTaskingLib - A tasking library that uses fibers for efficient task switching
+ *
+ * This library was created as a proof of concept of the ideas presented by
+ * Christian Gyrling in his 2015 GDC Talk 'Parallelizing the Naughty Dog Engine Using Fibers'
+ *
+ * http://gdcvault.com/play/1022186/Parallelizing-the-Naughty-Dog-Engine
+ *
+ * FiberTaskingLib is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2015 - 2017
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ftl/task_scheduler.h"
+#include "ftl/atomic_counter.h"
+
+#include <nonius/nonius.hpp>
+
+
+ // Constants
+const uint kNumSpawns = 10000;
+const uint kNumIterations = 1;
+
+void SpawnWaitChildTask(ftl::TaskScheduler *taskScheduler, void *arg) {
+	uint64 *sum = reinterpret_cast<uint64 *>(arg);
+	*sum += 1;
+}
+
+/**
+ * Spawns a single task and immediately waits for it, over and over
+ * This is the common "fork off some work, then wait for it" pattern, where the child is best run by the
+ * same thread, while its arguments are still in cache
+ */
+void SpawnWaitBenchmarkMainTask(ftl::TaskScheduler *taskScheduler, void *arg) {
+	auto& meter = *reinterpret_cast<nonius::chronometer*>(arg);
+
+	meter.measure([=] {
+		uint64 sum = 0;
+		for (uint i = 0; i < kNumIterations * kNumSpawns; ++i) {
+			ftl::AtomicCounter counter(taskScheduler);
+			taskScheduler->AddTask({SpawnWaitChildTask, &sum}, &counter);
+
+			taskScheduler->WaitForCounter(&counter, 0);
+		}
+
+		return sum;
+	});
+}
+
+NONIUS_BENCHMARK("SpawnWait", [](nonius::chronometer meter) {
+	ftl::TaskScheduler* taskScheduler = new ftl::TaskScheduler();
+	taskScheduler->Run(20, SpawnWaitBenchmarkMainTask, &meter);
+	delete taskScheduler;
+});
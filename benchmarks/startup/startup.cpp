@@ -0,0 +1,56 @@
+/* FiberTaskingLib - A tasking library that uses fibers for efficient task switching
+ *
+ * This library was created as a proof of concept of the ideas presented by
+ * Christian Gyrling in his 2015 GDC Talk 'Parallelizing the Naughty Dog Engine Using Fibers'
+ *
+ * http://gdcvault.com/play/1022186/Parallelizing-the-Naughty-Dog-Engine
+ *
+ * FiberTaskingLib is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2015 - 2017
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ftl/task_scheduler.h"
+
+#include <nonius/nonius.hpp>
+
+
+// Constants
+const uint kStartupFiberPoolSize = 4000;
+
+void StartupMainTask(ftl::TaskScheduler *taskScheduler, void *arg) {
+	// Returning right away makes Run() measure the scheduler's own startup and shutdown
+}
+
+/**
+ * Starts and stops a whole TaskScheduler with a large fiber pool, and nothing to run
+ */
+void RunStartupBenchmark(nonius::chronometer &meter, ftl::FiberCreationPolicy fiberCreation) {
+	ftl::SchedulerOptions options;
+	options.FiberPoolSize = kStartupFiberPoolSize;
+	options.FiberCreation = fiberCreation;
+
+	meter.measure([&] {
+		ftl::TaskScheduler taskScheduler;
+		taskScheduler.Run(options, StartupMainTask, nullptr);
+	});
+}
+
+NONIUS_BENCHMARK("StartupEagerFibers", [](nonius::chronometer meter) {
+	RunStartupBenchmark(meter, ftl::FiberCreationPolicy::Eager);
+});
+
+NONIUS_BENCHMARK("StartupLazyFibers", [](nonius::chronometer meter) {
+	RunStartupBenchmark(meter, ftl::FiberCreationPolicy::Lazy);
+});
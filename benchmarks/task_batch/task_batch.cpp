@@ -0,0 +1,115 @@
+/* FiberTaskingLib - A tasking library that uses fibers for efficient task switching
+ *
+ * This library was created as a proof of concept of the ideas presented by
+ * Christian Gyrling in his 2015 GDC Talk 'Parallelizing the Naughty Dog Engine Using Fibers'
+ *
+ * http://gdcvault.com/play/1022186/Parallelizing-the-Naughty-Dog-Engine
+ *
+ * FiberTaskingLib is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2015 - 2017
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ftl/task_scheduler.h"
+#include "ftl/atomic_counter.h"
+
+#include <nonius/nonius.hpp>
+
+
+// Constants
+const uint kNumBatchTasks = 65000;
+
+/* The triangle number test's task: add up a range of numbers */
+struct BatchSubset {
+	uint64 Start;
+	uint64 End;
+	uint64 Total;
+};
+
+void AddSubset(ftl::TaskScheduler *taskScheduler, void *arg) {
+	BatchSubset *subset = reinterpret_cast<BatchSubset *>(arg);
+	uint64 total = 0;
+	for (uint64 i = subset->Start; i < subset->End; ++i) {
+		total += i;
+	}
+	subset->Total = total;
+}
+
+enum class BatchMode {
+	/* One Task per element, through AddTasks() */
+	PerTask,
+	/* AddTaskBatch(), calling through the function pointer */
+	Indirect,
+	/* AddTaskBatch<Function>(), which can inline the function */
+	Inlined
+};
+
+struct BatchBenchmarkArgs {
+	nonius::chronometer *Meter;
+	BatchMode Mode;
+};
+
+void BatchBenchmarkMainTask(ftl::TaskScheduler *taskScheduler, void *arg) {
+	BatchBenchmarkArgs *benchmarkArgs = reinterpret_cast<BatchBenchmarkArgs *>(arg);
+	auto& meter = *benchmarkArgs->Meter;
+	BatchMode mode = benchmarkArgs->Mode;
+
+	BatchSubset *subsets = new BatchSubset[kNumBatchTasks];
+	ftl::Task *tasks = new ftl::Task[kNumBatchTasks];
+	for (uint i = 0; i < kNumBatchTasks; ++i) {
+		subsets[i] = {i * 10ull, i * 10ull + 10, 0};
+		tasks[i] = {AddSubset, &subsets[i]};
+	}
+
+	meter.measure([=] {
+		ftl::AtomicCounter counter(taskScheduler);
+		switch (mode) {
+		case BatchMode::PerTask:
+			taskScheduler->AddTasks(kNumBatchTasks, tasks, &counter);
+			break;
+		case BatchMode::Indirect:
+			taskScheduler->AddTaskBatch(AddSubset, subsets, sizeof(BatchSubset), kNumBatchTasks, &counter);
+			break;
+		case BatchMode::Inlined:
+			taskScheduler->AddTaskBatch<AddSubset>(subsets, sizeof(BatchSubset), kNumBatchTasks, &counter);
+			break;
+		}
+
+		taskScheduler->WaitForCounter(&counter, 0);
+	});
+
+	// Cleanup
+	delete[] tasks;
+	delete[] subsets;
+}
+
+void RunBatchBenchmark(nonius::chronometer &meter, BatchMode mode) {
+	BatchBenchmarkArgs args = {&meter, mode};
+
+	ftl::TaskScheduler *taskScheduler = new ftl::TaskScheduler();
+	taskScheduler->Run(20, BatchBenchmarkMainTask, &args);
+	delete taskScheduler;
+}
+
+NONIUS_BENCHMARK("BatchPerTask", [](nonius::chronometer meter) {
+	RunBatchBenchmark(meter, BatchMode::PerTask);
+});
+
+NONIUS_BENCHMARK("BatchIndirect", [](nonius::chronometer meter) {
+	RunBatchBenchmark(meter, BatchMode::Indirect);
+});
+
+NONIUS_BENCHMARK("BatchInlined", [](nonius::chronometer meter) {
+	RunBatchBenchmark(meter, BatchMode::Inlined);
+});
@@ -0,0 +1,165 @@
+/* FiberTaskingLib - A tasking library that uses fibers for efficient task switching
+ *
+ * This library was created as a proof of concept of the ideas presented by
+ * Christian Gyrling in his 2015 GDC Talk 'Parallelizing the Naughty Dog Engine Using Fibers'
+ *
+ * http://gdcvault.com/play/1022186/Parallelizing-the-Naughty-Dog-Engine
+ *
+ * FiberTaskingLib is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2015 - 2017
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "ftl/task_scheduler.h"
+#include "ftl/atomic_counter.h"
+#include "ftl/task_group.h"
+
+#include <nonius/nonius.hpp>
+
+
+ // Constants
+const uint64 kFibN = 24;
+/* Below this, fib is computed serially, so each task does a little work */
+const uint64 kFibCutoff = 8;
+const uint kTreeDepth = 5;
+const uint kTreeFanOut = 8;
+
+uint64 SerialFib(uint64 n) {
+	return n < 2 ? n : SerialFib(n - 1) + SerialFib(n - 2);
+}
+
+uint64 GroupFib(ftl::TaskScheduler *taskScheduler, uint64 n) {
+	if (n < kFibCutoff) {
+		return SerialFib(n);
+	}
+
+	uint64 x;
+	uint64 y;
+	ftl::TaskGroup group(taskScheduler);
+	group.Run([taskScheduler, n, &x]() {
+		x = GroupFib(taskScheduler, n - 1);
+	});
+	group.Run([taskScheduler, n, &y]() {
+		y = GroupFib(taskScheduler, n - 2);
+	});
+	group.Wait();
+
+	return x + y;
+}
+
+struct RawFibArgs {
+	uint64 N;
+	uint64 Result;
+};
+
+void RawFibTask(ftl::TaskScheduler *taskScheduler, void *arg) {
+	RawFibArgs *args = reinterpret_cast<RawFibArgs *>(arg);
+	if (args->N < kFibCutoff) {
+		args->Result = SerialFib(args->N);
+		return;
+	}
+
+	RawFibArgs children[2] = {{args->N - 1, 0}, {args->N - 2, 0}};
+	ftl::Task tasks[2] = {{RawFibTask, &children[0]}, {RawFibTask, &children[1]}};
+
+	ftl::AtomicCounter counter(taskScheduler);
+	taskScheduler->AddTasks(2, tasks, &counter);
+	taskScheduler->WaitForCounter(&counter, 0);
+
+	args->Result = children[0].Result + children[1].Result;
+}
+
+void GroupTree(ftl::TaskScheduler *taskScheduler, uint depth) {
+	if (depth == 0) {
+		SerialFib(kFibCutoff);
+		return;
+	}
+
+	ftl::TaskGroup group(taskScheduler);
+	for (uint i = 0; i < kTreeFanOut; ++i) {
+		group.Run([taskScheduler, depth]() {
+			GroupTree(taskScheduler, depth - 1);
+		});
+	}
+}
+
+void RawTreeTask(ftl::TaskScheduler *taskScheduler, void *arg) {
+	uint depth = static_cast<uint>(reinterpret_cast<uintptr_t>(arg));
+	if (depth == 0) {
+		SerialFib(kFibCutoff);
+		return;
+	}
+
+	ftl::Task tasks[kTreeFanOut];
+	for (uint i = 0; i < kTreeFanOut; ++i) {
+		tasks[i] = {RawTreeTask, reinterpret_cast<void *>(static_cast<uintptr_t>(depth - 1))};
+	}
+
+	ftl::AtomicCounter counter(taskScheduler);
+	taskScheduler->AddTasks(kTreeFanOut, tasks, &counter);
+	taskScheduler->WaitForCounter(&counter, 0);
+}
+
+void GroupFibMainTask(ftl::TaskScheduler *taskScheduler, void *arg) {
+	nonius::chronometer *meter = reinterpret_cast<nonius::chronometer *>(arg);
+	meter->measure([=] {
+		return GroupFib(taskScheduler, kFibN);
+	});
+}
+
+void RawFibMainTask(ftl::TaskScheduler *taskScheduler, void *arg) {
+	nonius::chronometer *meter = reinterpret_cast<nonius::chronometer *>(arg);
+	meter->measure([=] {
+		RawFibArgs args = {kFibN, 0};
+		RawFibTask(taskScheduler, &args);
+		return args.Result;
+	});
+}
+
+void GroupTreeMainTask(ftl::TaskScheduler *taskScheduler, void *arg) {
+	nonius::chronometer *meter = reinterpret_cast<nonius::chronometer *>(arg);
+	meter->measure([=] {
+		GroupTree(taskScheduler, kTreeDepth);
+	});
+}
+
+void RawTreeMainTask(ftl::TaskScheduler *taskScheduler, void *arg) {
+	nonius::chronometer *meter = reinterpret_cast<nonius::chronometer *>(arg);
+	meter->measure([=] {
+		RawTreeTask(taskScheduler, reinterpret_cast<void *>(static_cast<uintptr_t>(kTreeDepth)));
+	});
+}
+
+void RunRecursiveSpawnBenchmark(nonius::chronometer meter, ftl::TaskFunction mainTask) {
+	ftl::TaskScheduler *taskScheduler = new ftl::TaskScheduler();
+	taskScheduler->Run(400, mainTask, &meter);
+	delete taskScheduler;
+}
+
+NONIUS_BENCHMARK("TaskGroupFib", [](nonius::chronometer meter) {
+	RunRecursiveSpawnBenchmark(meter, GroupFibMainTask);
+});
+
+NONIUS_BENCHMARK("RawFib", [](nonius::chronometer meter) {
+	RunRecursiveSpawnBenchmark(meter, RawFibMainTask);
+});
+
+NONIUS_BENCHMARK("TaskGroupTree", [](nonius::chronometer meter) {
+	RunRecursiveSpawnBenchmark(meter, GroupTreeMainTask);
+});
+
+NONIUS_BENCHMARK("RawTree", [](nonius::chronometer meter) {
+	RunRecursiveSpawnBenchmark(meter, RawTreeMainTask);
+});
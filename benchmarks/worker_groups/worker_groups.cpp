@@ -0,0 +1,135 @@
+/* FiberTaskingLib - A tasking library that uses fibers for efficient task switching
+ *
+ * This library was created as a proof of concept of the ideas presented by
+ * Christian Gyrling in his 2015 GDC Talk 'Parallelizing the Naughty Dog Engine Using Fibers'
+ *
+ * http://gdcvault.com/play/1022186/Parallelizing-the-Naughty-Dog-Engine
+ *
+ * FiberTaskingLib is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2015 - 2017
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ftl/task_scheduler.h"
+#include "ftl/atomic_counter.h"
+#include "ftl/cpu_topology.h"
+
+#include <nonius/nonius.hpp>
+
+#include <atomic>
+
+
+ // Constants
+const uint kNumBackgroundTasks = 100000;
+const uint kNumBackgroundSpins = 20000;
+const uint kNumLatencyTasks = 8;
+const uint kNumLatencySpins = 100;
+
+struct WorkerGroupsBenchmarkArgs {
+	nonius::chronometer *Meter;
+	/* The group to flood with background work */
+	const char *BackgroundGroup;
+	/* Set once the measurement is done, so the remaining background tasks can return early */
+	std::atomic<bool> Stop;
+};
+
+void Spin(uint numSpins) {
+	volatile uint spins = 0;
+	for (uint i = 0; i < numSpins; ++i) {
+		spins = spins + 1;
+	}
+}
+
+void BackgroundTask(ftl::TaskScheduler *taskScheduler, void *arg) {
+	WorkerGroupsBenchmarkArgs *args = reinterpret_cast<WorkerGroupsBenchmarkArgs *>(arg);
+	if (!args->Stop.load(std::memory_order_relaxed)) {
+		Spin(kNumBackgroundSpins);
+	}
+}
+
+void LatencyTask(ftl::TaskScheduler *taskScheduler, void *arg) {
+	Spin(kNumLatencySpins);
+}
+
+/**
+ * Floods the background group with long tasks, then measures how long it takes to fan out, and wait for,
+ * a handful of short latency-critical tasks
+ */
+void WorkerGroupsBenchmarkMainTask(ftl::TaskScheduler *taskScheduler, void *arg) {
+	WorkerGroupsBenchmarkArgs *args = reinterpret_cast<WorkerGroupsBenchmarkArgs *>(arg);
+
+	ftl::Task *backgroundTasks = new ftl::Task[kNumBackgroundTasks];
+	for (uint i = 0; i < kNumBackgroundTasks; ++i) {
+		backgroundTasks[i] = {BackgroundTask, args};
+	}
+	ftl::AtomicCounter backgroundCounter(taskScheduler, 0, true);
+	taskScheduler->AddTasks(kNumBackgroundTasks, backgroundTasks, &backgroundCounter, taskScheduler->GetWorkerGroup(args->BackgroundGroup));
+	delete[] backgroundTasks;
+
+	ftl::Task latencyTasks[kNumLatencyTasks];
+	for (uint i = 0; i < kNumLatencyTasks; ++i) {
+		latencyTasks[i] = {LatencyTask, nullptr};
+	}
+
+	args->Meter->measure([=] {
+		ftl::AtomicCounter counter(taskScheduler);
+		taskScheduler->AddTasks(kNumLatencyTasks, const_cast<ftl::Task *>(latencyTasks), &counter);
+
+		taskScheduler->WaitForCounter(&counter, 0);
+	});
+
+	args->Stop.store(true, std::memory_order_relaxed);
+	taskScheduler->WaitForCounter(&backgroundCounter, 0);
+}
+
+/**
+ * Runs the benchmark with the latency and background work sharing one pool, or in separate worker groups
+ *
+ * @param meter       The nonius chronometer
+ * @param isolated    Whether to give the background work its own group
+ */
+void RunWorkerGroupsBenchmark(nonius::chronometer meter, bool isolated) {
+	uint numThreads = ftl::GetNumAvailableThreads();
+	if (numThreads < 2) {
+		numThreads = 2;
+	}
+
+	ftl::SchedulerOptions options;
+	options.FiberPoolSize = 20;
+
+	WorkerGroupsBenchmarkArgs args;
+	args.Meter = &meter;
+	args.Stop.store(false);
+
+	if (isolated) {
+		options.Groups.emplace_back("latency", numThreads / 2);
+		options.Groups.emplace_back("background", numThreads - numThreads / 2);
+		args.BackgroundGroup = "background";
+	} else {
+		options.Groups.emplace_back("shared", numThreads);
+		args.BackgroundGroup = "shared";
+	}
+
+	ftl::TaskScheduler* taskScheduler = new ftl::TaskScheduler();
+	taskScheduler->Run(options, WorkerGroupsBenchmarkMainTask, &args);
+	delete taskScheduler;
+}
+
+NONIUS_BENCHMARK("WorkerGroupsLatencyShared", [](nonius::chronometer meter) {
+	RunWorkerGroupsBenchmark(meter, false);
+});
+
+NONIUS_BENCHMARK("WorkerGroupsLatencyIsolated", [](nonius::chronometer meter) {
+	RunWorkerGroupsBenchmark(meter, true);
+});
@@ -78,6 +78,8 @@ function(GTEST_ADD_TESTS executable extra_args)
             continue()
           endif()
           add_test(NAME ${test_name} COMMAND ${executable} --gtest_filter=${test_name} ${extra_args})
+          # Tests that skip themselves print this marker. See tests/skip_test.h
+          set_tests_properties(${test_name} PROPERTIES SKIP_REGULAR_EXPRESSION "\\[  SKIPPED \\]")
         endforeach()
     endforeach()
 endfunction()
@@ -24,16 +24,19 @@
 #pragma once
 
 #include "ftl/typedefs.h"
+#include "ftl/task.h"
 
 #include <atomic>
 #include <vector>
 #include <mutex>
 #include <memory>
+#include <thread>
 
 
 namespace ftl {
 
 class TaskScheduler;
+class CoTask;
 
 /** 
  * AtomicCounter is a wrapper over a C++11 atomic_uint
@@ -50,9 +53,23 @@ class AtomicCounter {
 #define NUM_WAITING_FIBER_SLOTS 4
 
 public:
-	AtomicCounter(TaskScheduler *taskScheduler, uint initialValue = 0) 
+	/**
+	 * Creates a counter
+	 *
+	 * @param taskScheduler    The TaskScheduler this counter is associated with
+	 * @param initialValue     The initial value of the counter
+	 * @param fanIn            If true, task completions are batched per worker thread before being subtracted
+	 *                         from the counter. This greatly reduces contention for large task groups.
+	 *                         However, the counter will skip intermediate values, so WaitForCounter() should only
+	 *                         target 0. See TaskScheduler::DecrementTaskCounter()
+	 */
+	AtomicCounter(TaskScheduler *taskScheduler, uint initialValue = 0, bool fanIn = false) 
 			: m_taskScheduler(taskScheduler),
-			  m_value(initialValue) {
+			  m_value(initialValue),
+			  m_numCheckers(0),
+			  m_fanIn(fanIn),
+			  m_taskWaiters(nullptr),
+			  m_taskWaitersLock(false) {
 		for (uint i = 0; i < NUM_WAITING_FIBER_SLOTS; ++i) {
 			m_freeSlots[i].store(true);
 			// We initialize InUse to true to prevent CheckWaitingFibers() from checking garbage
@@ -62,12 +79,26 @@ public:
 			m_waitingFibers[i].InUse.store(true);
 		}
 	}
+	/**
+	 * A waiting fiber can see the final value, and destroy the counter, while the thread that changed the value
+	 * is still checking the waiting fibers. So we wait for any checks in flight to finish
+	 */
+	~AtomicCounter() {
+		while (m_numCheckers.load(std::memory_order_acquire) != 0) {
+			// The checker may be on a thread that was preempted, so give it a chance to run
+			std::this_thread::yield();
+		}
+	}
 
 private:
 	/* The TaskScheduler this counter is associated with */
 	TaskScheduler *m_taskScheduler;
 	/* The atomic counter holding our data */
 	std::atomic_uint m_value;
+	/* The number of threads that have modified m_value, and haven't finished calling CheckWaitingFibers() yet */
+	std::atomic_uint m_numCheckers;
+	/* If true, task completions are accumulated per worker thread and subtracted in batches */
+	bool m_fanIn;
 
 	/* An array that signals which slots in m_waitingFibers are free to be used
 	 * True: Free
@@ -100,11 +131,36 @@ private:
 	};
 	WaitingFiberBundle m_waitingFibers[NUM_WAITING_FIBER_SLOTS];
 
+	/**
+	 * A task to add to the TaskScheduler once the counter reaches TargetValue. This is how coroutines wait, since
+	 * they don't have a fiber to switch out of. See CoTask
+	 *
+	 * Unlike waiting fibers, any number of tasks can wait. The waiters are linked into an intrusive list, so each
+	 * one has to stay alive until its task has been added. Once it's linked, the waiter belongs to the counter
+	 */
+	struct TaskWaiter {
+		/* The task to add */
+		Task ResumeTask;
+		/* The value the task is waiting for */
+		uint TargetValue;
+		/* The worker group to add the task to */
+		uint Group;
+		TaskWaiter *Next;
+	};
+	/* The head of the list of waiting tasks */
+	std::atomic<TaskWaiter *> m_taskWaiters;
+	/* A spin lock guarding m_taskWaiters. It's only held to link or unlink waiters */
+	std::atomic<bool> m_taskWaitersLock;
+
 	/**
 	* We friend TaskScheduler so we can keep AddFiberToWaitingList() private
 	* This makes the public API cleaner
 	*/
 	friend class TaskScheduler;
+	/* And CoTask, so its awaiters can use AddTaskToWaitingList() */
+	friend class CoTask;
+	/* And TaskGroup, so spawning can skip checking the waiting fibers */
+	friend class TaskGroup;
 
 public:
 	/**
@@ -127,8 +183,10 @@ public:
 	 * @param memoryOrder    The memory order to use for the store
 	 */
 	void Store(uint x, std::memory_order memoryOrder = std::memory_order_seq_cst) {
+		m_numCheckers.fetch_add(1, std::memory_order_acquire);
 		m_value.store(x, memoryOrder);
 		CheckWaitingFibers(x);
+		m_numCheckers.fetch_sub(1, std::memory_order_release);
 	}
 	/**
 	 * A wrapper over std::atomic_uint::fetch_add()
@@ -140,8 +198,10 @@ public:
 	 * @return               The value of the counter before the addition
 	 */
 	uint FetchAdd(uint x, std::memory_order memoryOrder = std::memory_order_seq_cst) {
+		m_numCheckers.fetch_add(1, std::memory_order_acquire);
 		uint prev = m_value.fetch_add(x, memoryOrder);
 		CheckWaitingFibers(prev + x);
+		m_numCheckers.fetch_sub(1, std::memory_order_release);
 
 		return prev;
 	}
@@ -155,11 +215,21 @@ public:
 	 * @return               The value of the counter before the subtraction
 	 */
 	uint FetchSub(uint x, std::memory_order memoryOrder = std::memory_order_seq_cst) {
+		m_numCheckers.fetch_add(1, std::memory_order_acquire);
 		uint prev = m_value.fetch_sub(x, memoryOrder);
 		CheckWaitingFibers(prev - x);
+		m_numCheckers.fetch_sub(1, std::memory_order_release);
 
 		return prev;
 	}
+	/**
+	 * Whether this counter batches task completions per worker thread
+	 *
+	 * @return    True if the counter was created in fan-in mode
+	 */
+	bool IsFanIn() const {
+		return m_fanIn;
+	}
 
 private:
 	/**
@@ -178,6 +248,15 @@ private:
 	 * @return                   True: The counter value changed to equal targetValue while we were adding the fiber to the wait list
 	 */
 	bool AddFiberToWaitingList(std::size_t fiberIndex, uint targetValue, std::atomic<bool> *fiberStoredFlag);
+	/**
+	 * Add a task to the list of waiting tasks
+	 *
+	 * NOTE: Called by the CoTask awaiters
+	 *
+	 * @param waiter    The waiter to link into the list. ResumeTask, TargetValue and Group must be filled in
+	 * @return          True: The counter value already equals TargetValue. The waiter was not added
+	 */
+	bool AddTaskToWaitingList(TaskWaiter *waiter);
 
 	/**
 	 * Checks all the waiting fibers in the list to see if value == targetValue
@@ -187,6 +266,21 @@ private:
 	 * @param value    The value to check
 	 */
 	void CheckWaitingFibers(uint value);
+	/**
+	 * Unlinks all the waiting tasks whose TargetValue == value, and adds them to the TaskScheduler
+	 *
+	 * @param value    The value to check
+	 */
+	void CheckWaitingTasks(uint value);
+
+	void LockTaskWaiters() {
+		while (m_taskWaitersLock.exchange(true, std::memory_order_acquire)) {
+			// Spin
+		}
+	}
+	void UnlockTaskWaiters() {
+		m_taskWaitersLock.store(false, std::memory_order_release);
+	}
 };
 
 } // End of namespace ftl
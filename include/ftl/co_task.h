@@ -0,0 +1,310 @@
+/* FiberTaskingLib - A tasking library that uses fibers for efficient task switching
+ *
+ * This library was created as a proof of concept of the ideas presented by
+ * Christian Gyrling in his 2015 GDC Talk 'Parallelizing the Naughty Dog Engine Using Fibers'
+ *
+ * http://gdcvault.com/play/1022186/Parallelizing-the-Naughty-Dog-Engine
+ *
+ * FiberTaskingLib is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2015 - 2017
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+
+#if !defined(__cpp_impl_coroutine)
+	#error "ftl/co_task.h requires C++20 coroutines"
+#endif
+
+#include "ftl/typedefs.h"
+#include "ftl/task.h"
+#include "ftl/task_scheduler.h"
+#include "ftl/atomic_counter.h"
+
+#include <chrono>
+#include <coroutine>
+#include <exception>
+#include <utility>
+
+
+namespace ftl {
+
+/**
+ * A stackless coroutine task
+ *
+ * CoTasks run on the same worker threads and task queues as normal tasks. The difference is that when a CoTask waits,
+ * it suspends its coroutine frame, rather than a whole fiber. So a suspended CoTask costs a heap allocated frame,
+ * instead of a pool fiber and its stack. This makes it possible to have millions of suspended CoTasks at once
+ *
+ * A CoTask can wait on an AtomicCounter with co_await CoWaitForCounter(), and sleep with co_await CoSleep(). Counters
+ * work in both directions; fiber tasks can WaitForCounter() on a counter decremented by CoTasks, and vice versa.
+ * A CoTask can also call WaitForCounter() directly, but that suspends the fiber it's running on, as usual
+ *
+ * CoTasks are created by calling a coroutine function, and started with AddCoTask() or AddCoTasks():
+ *
+ *     ftl::CoTask Work(ftl::TaskScheduler *taskScheduler, ftl::AtomicCounter *counter) {
+ *         co_await ftl::CoWaitForCounter(counter, 0);
+ *         co_await ftl::CoSleep(taskScheduler, std::chrono::milliseconds(1));
+ *     }
+ *
+ *     ftl::AddCoTask(taskScheduler, Work(taskScheduler, &counter));
+ *
+ * NOTE: This header needs C++20. The rest of the library doesn't, so only the files using CoTask have to be built as C++20
+ */
+class CoTask {
+public:
+	struct promise_type;
+	typedef std::coroutine_handle<promise_type> Handle;
+
+private:
+	/* Signals the CoTask's counter once the coroutine is done, and frees the frame */
+	struct FinalAwaiter {
+		bool await_ready() const noexcept {
+			return false;
+		}
+		void await_suspend(Handle handle) noexcept {
+			// Destroying the frame destroys the promise, so copy what we need out first
+			TaskScheduler *taskScheduler = handle.promise().Scheduler;
+			AtomicCounter *counter = handle.promise().Counter;
+			handle.destroy();
+
+			if (counter != nullptr) {
+				taskScheduler->DecrementTaskCounter(counter);
+			}
+		}
+		void await_resume() const noexcept {
+		}
+	};
+
+public:
+	struct promise_type {
+		/* The TaskScheduler running the CoTask. Set by AddCoTask() */
+		TaskScheduler *Scheduler = nullptr;
+		/* The counter to decrement when the coroutine finishes. Set by AddCoTask() */
+		AtomicCounter *Counter = nullptr;
+
+		CoTask get_return_object() {
+			return CoTask(Handle::from_promise(*this));
+		}
+		/* CoTasks don't start until they're added to the TaskScheduler */
+		std::suspend_always initial_suspend() const noexcept {
+			return {};
+		}
+		FinalAwaiter final_suspend() const noexcept {
+			return {};
+		}
+		void return_void() const noexcept {
+		}
+		/* Like normal tasks, CoTasks have nowhere to report exceptions to */
+		void unhandled_exception() const noexcept {
+			std::terminate();
+		}
+	};
+
+	/**
+	 * Suspends the CoTask until counter == value. Returned by CoWaitForCounter()
+	 *
+	 * The waiter lives in the coroutine frame, so any number of CoTasks can wait on the same counter
+	 */
+	class CounterAwaiter {
+	public:
+		CounterAwaiter(AtomicCounter *counter, uint value)
+			: m_counter(counter),
+			  m_value(value) {
+		}
+
+	private:
+		AtomicCounter *m_counter;
+		uint m_value;
+		AtomicCounter::TaskWaiter m_waiter;
+
+	public:
+		bool await_ready() const noexcept {
+			return m_counter->Load(std::memory_order_acquire) == m_value;
+		}
+		bool await_suspend(std::coroutine_handle<> handle) {
+			m_waiter.ResumeTask = {ResumeCoroutine, handle.address()};
+			m_waiter.TargetValue = m_value;
+			m_waiter.Group = m_counter->m_taskScheduler->GetCurrentWorkerGroup();
+
+			// If the counter got there first, don't suspend at all
+			return !m_counter->AddTaskToWaitingList(&m_waiter);
+		}
+		void await_resume() const noexcept {
+		}
+	};
+
+	/* Suspends the CoTask for a while. Returned by CoSleep() */
+	class SleepAwaiter {
+	public:
+		SleepAwaiter(TaskScheduler *taskScheduler, std::chrono::steady_clock::duration duration)
+			: m_taskScheduler(taskScheduler),
+			  m_duration(duration) {
+		}
+
+	private:
+		TaskScheduler *m_taskScheduler;
+		std::chrono::steady_clock::duration m_duration;
+
+	public:
+		bool await_ready() const noexcept {
+			return m_duration <= std::chrono::steady_clock::duration::zero();
+		}
+		void await_suspend(std::coroutine_handle<> handle) {
+			m_taskScheduler->AddDelayedTask({ResumeCoroutine, handle.address()}, m_duration);
+		}
+		void await_resume() const noexcept {
+		}
+	};
+
+	CoTask()
+		: m_handle(nullptr) {
+	}
+	CoTask(CoTask &&other) noexcept
+		: m_handle(std::exchange(other.m_handle, nullptr)) {
+	}
+	CoTask &operator=(CoTask &&other) noexcept {
+		if (this != &other) {
+			Destroy();
+			m_handle = std::exchange(other.m_handle, nullptr);
+		}
+		return *this;
+	}
+	CoTask(const CoTask &) = delete;
+	CoTask &operator=(const CoTask &) = delete;
+	/* A CoTask that was never added to a TaskScheduler is freed without running */
+	~CoTask() {
+		Destroy();
+	}
+
+private:
+	explicit CoTask(Handle handle)
+		: m_handle(handle) {
+	}
+
+	Handle m_handle;
+
+	void Destroy() {
+		if (m_handle) {
+			m_handle.destroy();
+			m_handle = nullptr;
+		}
+	}
+
+public:
+	/**
+	 * Hands the coroutine over to a TaskScheduler. After this, the CoTask is empty
+	 *
+	 * @param taskScheduler    The TaskScheduler that will run the coroutine
+	 * @param counter          The counter to decrement when the coroutine finishes. Can be nullptr
+	 * @return                 A task that starts the coroutine
+	 */
+	Task Release(TaskScheduler *taskScheduler, AtomicCounter *counter) {
+		Handle handle = std::exchange(m_handle, nullptr);
+		handle.promise().Scheduler = taskScheduler;
+		handle.promise().Counter = counter;
+
+		return {ResumeCoroutine, handle.address()};
+	}
+
+	/**
+	 * Whether the CoTask holds a coroutine that hasn't been added to a TaskScheduler
+	 *
+	 * @return    True if the CoTask can be added
+	 */
+	bool IsValid() const {
+		return static_cast<bool>(m_handle);
+	}
+
+	/**
+	 * The TaskFunction used to start and resume coroutines
+	 *
+	 * @param taskScheduler    Unused
+	 * @param arg              The address of the coroutine handle
+	 */
+	static void ResumeCoroutine(TaskScheduler *taskScheduler, void *arg) {
+		(void)taskScheduler;
+		std::coroutine_handle<>::from_address(arg).resume();
+	}
+};
+
+/**
+ * Adds a CoTask to the current thread's task queue
+ *
+ * @param taskScheduler    The TaskScheduler to run the CoTask on
+ * @param task             The CoTask to add
+ * @param counter          An atomic counter corresponding to this CoTask. Initially it will be set to 1. When the coroutine finishes, it will be decremented.
+ */
+inline void AddCoTask(TaskScheduler *taskScheduler, CoTask task, AtomicCounter *counter = nullptr) {
+	if (counter != nullptr) {
+		counter->Store(1);
+	}
+
+	// The counter is decremented when the coroutine finishes, not when the task that starts it returns
+	taskScheduler->AddTask(task.Release(taskScheduler, counter), nullptr);
+}
+
+/**
+ * Adds a group of CoTasks to the current thread's task queue. Afterwards, the CoTasks are empty
+ *
+ * @param taskScheduler    The TaskScheduler to run the CoTasks on
+ * @param numTasks         The number of CoTasks
+ * @param tasks            The CoTasks to add
+ * @param counter          An atomic counter corresponding to the CoTasks as a whole. Initially it will be set to numTasks. When each coroutine finishes, it will be decremented.
+ */
+inline void AddCoTasks(TaskScheduler *taskScheduler, uint numTasks, CoTask *tasks, AtomicCounter *counter = nullptr) {
+	if (counter != nullptr) {
+		counter->Store(numTasks);
+	}
+
+	// Add them in batches, so we don't need a Task array as big as the input
+	const uint batchSize = 256;
+	Task batch[batchSize];
+	for (uint i = 0; i < numTasks; i += batchSize) {
+		const uint count = numTasks - i < batchSize ? numTasks - i : batchSize;
+		for (uint j = 0; j < count; ++j) {
+			batch[j] = tasks[i + j].Release(taskScheduler, counter);
+		}
+		taskScheduler->AddTasks(count, batch, nullptr);
+	}
+}
+
+/**
+ * Suspends the calling CoTask until counter == value. Use it with co_await
+ *
+ * Unlike WaitForCounter(), this doesn't use a fiber from the pool, or one of the counter's waiting fiber slots
+ *
+ * @param counter    The counter to check
+ * @param value      The value to wait for
+ * @return           The awaiter
+ */
+inline CoTask::CounterAwaiter CoWaitForCounter(AtomicCounter *counter, uint value) {
+	return CoTask::CounterAwaiter(counter, value);
+}
+
+/**
+ * Suspends the calling CoTask for at least 'duration'. Use it with co_await
+ *
+ * The worker thread runs other tasks in the meantime. See TaskScheduler::AddDelayedTask()
+ *
+ * @param taskScheduler    The TaskScheduler running the CoTask
+ * @param duration         How long to sleep
+ * @return                 The awaiter
+ */
+inline CoTask::SleepAwaiter CoSleep(TaskScheduler *taskScheduler, std::chrono::steady_clock::duration duration) {
+	return CoTask::SleepAwaiter(taskScheduler, duration);
+}
+
+} // End of namespace ftl
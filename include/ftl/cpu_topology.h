@@ -0,0 +1,112 @@
+/* FiberTaskingLib - A tasking library that uses fibers for efficient task switching
+ *
+ * This library was created as a proof of concept of the ideas presented by
+ * Christian Gyrling in his 2015 GDC Talk 'Parallelizing the Naughty Dog Engine Using Fibers'
+ *
+ * http://gdcvault.com/play/1022186/Parallelizing-the-Naughty-Dog-Engine
+ *
+ * FiberTaskingLib is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2015 - 2017
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "ftl/typedefs.h"
+
+#include <vector>
+
+
+namespace ftl {
+
+/**
+ * Where a logical CPU sits in the machine
+ */
+struct CpuInfo {
+	/* The index of the logical CPU */
+	uint Cpu;
+	/* The socket the CPU is on */
+	uint Package;
+	/* The physical core the CPU belongs to. SMT siblings share the same core. Only unique within a package */
+	uint Core;
+};
+
+/**
+ * Gets the CPUs the current thread is allowed to run on
+ *
+ * On Linux, this respects the affinity mask (cpuset) the process was started with. On platforms where the
+ * affinity can't be queried, every logical processor is returned
+ *
+ * @return    The indices of the allowed CPUs, in ascending order. Never empty
+ */
+std::vector<uint> GetAllowedCpus();
+
+/**
+ * Restricts the current thread to a set of CPUs
+ *
+ * @param cpus    The indices of the CPUs the thread may run on
+ */
+void SetCurrentThreadCpus(const std::vector<uint> &cpus);
+
+/**
+ * Gets the CPU limit imposed by the cgroup CPU quota (cgroup v2 'cpu.max', or cgroup v1 'cpu.cfs_quota_us' and
+ * 'cpu.cfs_period_us'). This is how container runtimes like Docker and Kubernetes implement CPU limits
+ *
+ * A fractional limit is rounded up. Ie. a quota of 1.5 CPUs gives 2
+ *
+ * @param cgroupRoot    The directory the cgroup filesystem is mounted at
+ * @return              The number of CPUs worth of quota. 0 if there is no limit, or it couldn't be read
+ */
+uint GetCgroupCpuLimit(const char *cgroupRoot = "/sys/fs/cgroup");
+
+/**
+ * Gets the number of threads the process can actually run in parallel
+ * This is the number of allowed CPUs, further limited by the cgroup CPU quota
+ *
+ * @param cgroupRoot    The directory the cgroup filesystem is mounted at
+ * @return              The number of available threads. Always at least 1
+ */
+uint GetNumAvailableThreads(const char *cgroupRoot = "/sys/fs/cgroup");
+
+/**
+ * Looks up the package and core of each CPU
+ *
+ * On Linux, this reads the topology from sysfs. If it can't be read, each CPU is assumed to be its own core
+ * on a single package
+ *
+ * @param cpus          The indices of the CPUs to look up
+ * @param sysfsRoot     The sysfs directory holding the 'cpuN' directories
+ * @return              The topology of each CPU, in the same order as 'cpus'
+ */
+std::vector<CpuInfo> GetCpuTopology(const std::vector<uint> &cpus, const char *sysfsRoot = "/sys/devices/system/cpu");
+
+/**
+ * Orders CPUs so consecutive workers share as much as possible
+ * Fills all the SMT siblings of a core, then all the cores of a package, before moving to the next package
+ *
+ * @param cpus    The CPUs to order
+ * @return        The indices of the CPUs, in the order workers should be pinned to them
+ */
+std::vector<uint> CompactCpuOrder(const std::vector<CpuInfo> &cpus);
+
+/**
+ * Orders CPUs so consecutive workers share as little as possible
+ * Alternates between packages, and uses one CPU of every core before using any SMT siblings
+ *
+ * @param cpus    The CPUs to order
+ * @return        The indices of the CPUs, in the order workers should be pinned to them
+ */
+std::vector<uint> ScatterCpuOrder(const std::vector<CpuInfo> &cpus);
+
+} // End of namespace ftl
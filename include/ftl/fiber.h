@@ -84,7 +84,8 @@ public:
 		  m_systemPageSize(0),
 		  m_stackSize(0),
 		  m_context(nullptr),
-		  m_arg(0) {
+		  m_arg(0),
+		  m_ownsStack(false) {
 	}
 	/**
 	 * Allocates a stack and sets it up to start executing 'startRoutine' when first switched to
@@ -94,7 +95,8 @@ public:
 	 * @param arg              The argument to pass to 'startRoutine'
 	 */
 	Fiber(std::size_t stackSize, FiberStartRoutine startRoutine, void *arg)
-			: m_arg(arg) {
+			: m_arg(arg),
+			  m_ownsStack(true) {
 		#if defined(FTL_FIBER_STACK_GUARD_PAGES)
 			m_systemPageSize = SystemPageSize();
 		#else
@@ -112,6 +114,27 @@ public:
 			MemoryGuard(static_cast<char *>(m_stack) + m_systemPageSize + stackSize, m_systemPageSize);
 		#endif
 	}
+	/**
+	 * Sets up a fiber on a stack owned by the caller, to start executing 'startRoutine' when first switched to
+	 * The stack has to outlive the fiber. It doesn't get guard pages, even if FTL_FIBER_STACK_GUARD_PAGES is defined
+	 *
+	 * This lets many fibers share one large allocation. For example, one backed by huge pages
+	 *
+	 * @param stack           The lowest address of the stack
+	 * @param stackSize       The size of the stack
+	 * @param startRoutine    The function to run when the fiber first starts
+	 * @param arg             The argument to pass to 'startRoutine'
+	 */
+	Fiber(void *stack, std::size_t stackSize, FiberStartRoutine startRoutine, void *arg)
+			: m_stack(stack),
+			  m_systemPageSize(0),
+			  m_stackSize(stackSize),
+			  m_arg(arg),
+			  m_ownsStack(false) {
+		m_context = boost_context::make_fcontext(static_cast<char *>(m_stack) + stackSize, stackSize, startRoutine);
+
+		FTL_VALGRIND_REGISTER(static_cast<char *>(m_stack) + stackSize, m_stack);
+	}
 
 	/**
 	 * Deleted copy constructor
@@ -150,7 +173,9 @@ public:
 			}
 			FTL_VALGRIND_DEREGISTER();
 
-			AlignedFree(m_stack);
+			if (m_ownsStack) {
+				AlignedFree(m_stack);
+			}
 		}
 	}
 
@@ -160,6 +185,8 @@ private:
 	std::size_t m_stackSize;
 	boost_context::fcontext_t m_context;
 	void *m_arg;
+	/* False if the stack was given to us by the caller */
+	bool m_ownsStack;
 	FTL_VALGRIND_ID;
 
 public:
@@ -172,6 +199,26 @@ public:
 	void SwitchToFiber(Fiber *fiber) {
 		boost_context::jump_fcontext(&m_context, fiber->m_context, fiber->m_arg);
 	}
+	/**
+	 * Touches the top 'bytes' of the stack, so its pages are faulted in now, rather than the first time the fiber runs
+	 * The pages are allocated on the NUMA node of the calling thread, as per the usual first touch policy
+	 *
+	 * NOTE: This can NOT be called while the fiber is running
+	 *
+	 * @param bytes    How much of the stack to touch. Stacks grow down, so this is the part used first
+	 */
+	void PrefaultStack(std::size_t bytes) {
+		if (m_stack == nullptr) {
+			return;
+		}
+
+		// The context created by make_fcontext() lives at the top of the stack, so write back what's already there
+		volatile char *stackTop = static_cast<char *>(m_stack) + m_systemPageSize + m_stackSize;
+		const std::size_t numBytes = std::min(bytes, m_stackSize);
+		for (std::size_t offset = 1; offset <= numBytes; offset += 4096) {
+			stackTop[-static_cast<std::ptrdiff_t>(offset)] = stackTop[-static_cast<std::ptrdiff_t>(offset)];
+		}
+	}
 	/**
 	 * Re-initializes the stack with a new startRoutine and arg
 	 *
@@ -204,6 +251,7 @@ private:
 		swap(first.m_stackSize, second.m_stackSize);
 		swap(first.m_context, second.m_context);
 		swap(first.m_arg, second.m_arg);
+		swap(first.m_ownsStack, second.m_ownsStack);
 	}
 };
 
@@ -0,0 +1,89 @@
+/* FiberTaskingLib - A tasking library that uses fibers for efficient task switching
+ *
+ * This library was created as a proof of concept of the ideas presented by
+ * Christian Gyrling in his 2015 GDC Talk 'Parallelizing the Naughty Dog Engine Using Fibers'
+ *
+ * http://gdcvault.com/play/1022186/Parallelizing-the-Naughty-Dog-Engine
+ *
+ * FiberTaskingLib is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2015 - 2017
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+
+#include "ftl/typedefs.h"
+
+#include <cstddef>
+
+
+namespace ftl {
+
+/**
+ * Whether to back memory with huge pages
+ */
+enum class HugePagePolicy {
+	/* Use normal pages */
+	Off,
+	/* Ask the kernel to back the memory with transparent huge pages. On Linux, this is madvise(MADV_HUGEPAGE) */
+	Transparent,
+	/**
+	 * Use pages from the explicit huge page pool (hugetlbfs on Linux, large pages on Windows). These have to be
+	 * reserved by the administrator. If there aren't enough, fall back to Transparent
+	 */
+	Explicit
+};
+
+/**
+ * The kind of pages an allocation actually got
+ */
+enum class HugePageBacking {
+	/* Normal pages */
+	None,
+	/* The kernel was asked to use transparent huge pages. It's free to back some or all of the memory with normal pages anyway */
+	Transparent,
+	/* Pages from the explicit huge page pool */
+	Explicit
+};
+
+/**
+ * Gets the size of a huge page
+ *
+ * @return    The size in bytes. 0 if the platform has no huge pages
+ */
+std::size_t GetHugePageSize();
+
+/**
+ * Allocates memory, backed by huge pages if possible
+ *
+ * Each kind of page in 'policy' is tried in turn, down to normal pages. The memory is aligned to the huge page size,
+ * and its size is rounded up to a multiple of it, so it doesn't share any huge pages with other allocations
+ *
+ * @param size       The number of bytes to allocate
+ * @param policy     The kind of pages to try first
+ * @param backing    Filled with the kind of pages the memory got. Can be nullptr
+ * @return           The memory, or nullptr if even normal pages couldn't be allocated
+ */
+void *AllocateHugePages(std::size_t size, HugePagePolicy policy, HugePageBacking *backing = nullptr);
+
+/**
+ * Frees memory allocated with AllocateHugePages()
+ *
+ * @param memory    The memory to free. Can be nullptr
+ * @param size      The size that was passed to AllocateHugePages()
+ */
+void FreeHugePages(void *memory, std::size_t size);
+
+} // End of namespace ftl
@@ -0,0 +1,173 @@
+/* FiberTaskingLib - A tasking library that uses fibers for efficient task switching
+ *
+ * This library was created as a proof of concept of the ideas presented by
+ * Christian Gyrling in his 2015 GDC Talk 'Parallelizing the Naughty Dog Engine Using Fibers'
+ *
+ * http://gdcvault.com/play/1022186/Parallelizing-the-Naughty-Dog-Engine
+ *
+ * FiberTaskingLib is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2015 - 2017
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * This is an implementation of Dmitry Vyukov's 'Bounded MPMC queue'
+ *
+ * http://www.1024cores.net/home/lock-free-algorithms/queues/bounded-mpmc-queue
+ */
+
+#pragma once
+
+#include "ftl/typedefs.h"
+
+#include <atomic>
+#include <cassert>
+
+
+namespace ftl {
+
+/**
+ * A bounded queue that any number of threads can push to and pop from
+ *
+ * Each cell carries a sequence number, which tells producers and consumers whether the cell is ready for them.
+ * Pushes and pops only contend on their own position counter, and never block each other
+ */
+template<typename T>
+class MpmcQueue {
+public:
+	/**
+	 * Creates a queue
+	 *
+	 * @param capacity    The maximum number of items in the queue. Must be a power of 2
+	 */
+	explicit MpmcQueue(std::size_t capacity)
+		: m_cells(new Cell[capacity]),
+		  m_mask(capacity - 1),
+		  m_pushPosition(0),
+		  m_popPosition(0) {
+		assert(capacity >= 2 && !(capacity & (capacity - 1)) && "capacity must be a power of 2");
+		for (std::size_t i = 0; i < capacity; ++i) {
+			m_cells[i].Sequence.store(i, std::memory_order_relaxed);
+		}
+	}
+	~MpmcQueue() {
+		delete[] m_cells;
+	}
+
+	MpmcQueue(const MpmcQueue &) = delete;
+	MpmcQueue &operator=(const MpmcQueue &) = delete;
+
+private:
+	struct Cell {
+		/**
+		 * Equal to the position of the next push that can use this cell, or one past the position of the next pop
+		 * that can use it
+		 */
+		std::atomic<std::size_t> Sequence;
+		T Item;
+	};
+
+	Cell *m_cells;
+	std::size_t m_mask;
+	// Cache-line pad
+	char pad[64];
+	std::atomic<std::size_t> m_pushPosition;
+	// Cache-line pad
+	char pad2[64];
+	std::atomic<std::size_t> m_popPosition;
+	// Cache-line pad
+	char pad3[64];
+
+public:
+	/**
+	 * Adds an item to the back of the queue
+	 *
+	 * @param item    The item to add
+	 * @return        False if the queue is full
+	 */
+	bool TryPush(const T &item) {
+		Cell *cell;
+		std::size_t position = m_pushPosition.load(std::memory_order_relaxed);
+		for (;;) {
+			cell = &m_cells[position & m_mask];
+			std::size_t sequence = cell->Sequence.load(std::memory_order_acquire);
+			intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+
+			if (difference == 0) {
+				if (m_pushPosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+					break;
+				}
+			} else if (difference < 0) {
+				// The cell still holds the item from the previous lap
+				return false;
+			} else {
+				// Another producer took this position
+				position = m_pushPosition.load(std::memory_order_relaxed);
+			}
+		}
+
+		cell->Item = item;
+		cell->Sequence.store(position + 1, std::memory_order_release);
+
+		return true;
+	}
+
+	/**
+	 * Removes an item from the front of the queue
+	 *
+	 * @param item    The removed item. Untouched if the queue is empty
+	 * @return        False if the queue is empty
+	 */
+	bool TryPop(T *item) {
+		Cell *cell;
+		std::size_t position = m_popPosition.load(std::memory_order_relaxed);
+		for (;;) {
+			cell = &m_cells[position & m_mask];
+			std::size_t sequence = cell->Sequence.load(std::memory_order_acquire);
+			intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position + 1);
+
+			if (difference == 0) {
+				if (m_popPosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+					break;
+				}
+			} else if (difference < 0) {
+				// The cell hasn't been filled yet
+				return false;
+			} else {
+				// Another consumer took this position
+				position = m_popPosition.load(std::memory_order_relaxed);
+			}
+		}
+
+		*item = cell->Item;
+		cell->Sequence.store(position + m_mask + 1, std::memory_order_release);
+
+		return true;
+	}
+
+	/**
+	 * Gets the number of items in the queue
+	 *
+	 * NOTE: The value is only a snapshot. Other threads may be pushing and popping concurrently
+	 *
+	 * @return    The approximate number of items in the queue
+	 */
+	std::size_t Size() const {
+		std::size_t pushPosition = m_pushPosition.load(std::memory_order_relaxed);
+		std::size_t popPosition = m_popPosition.load(std::memory_order_relaxed);
+		return pushPosition > popPosition ? pushPosition - popPosition : 0;
+	}
+};
+
+} // End of namespace ftl
@@ -0,0 +1,173 @@
+/* FiberTaskingLib - A tasking library that uses fibers for efficient task switching
+ *
+ * This library was created as a proof of concept of the ideas presented by
+ * Christian Gyrling in his 2015 GDC Talk 'Parallelizing the Naughty Dog Engine Using Fibers'
+ *
+ * http://gdcvault.com/play/1022186/Parallelizing-the-Naughty-Dog-Engine
+ *
+ * FiberTaskingLib is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2015 - 2017
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+
+#include "ftl/typedefs.h"
+#include "ftl/atomic_counter.h"
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+
+namespace ftl {
+
+class TaskScheduler;
+
+/**
+ * Produces the items of a Pipeline. Calls are serial
+ *
+ * @param taskScheduler    The TaskScheduler running the pipeline
+ * @param arg              The arg passed to Pipeline::SetInput()
+ * @return                 The next item, or nullptr once there are no more
+ */
+typedef void *(*PipelineInputFunction)(TaskScheduler *taskScheduler, void *arg);
+
+/**
+ * Processes an item in one stage of a Pipeline
+ *
+ * @param taskScheduler    The TaskScheduler running the pipeline
+ * @param item             The item returned by the previous stage, or by the input
+ * @param arg              The arg passed to Pipeline::AddStage()
+ * @return                 The item to pass to the next stage. nullptr drops the item. The remaining stages are skipped
+ */
+typedef void *(*PipelineStageFunction)(TaskScheduler *taskScheduler, void *item, void *arg);
+
+enum class PipelineStageMode {
+	/* Any number of items can be in the stage at once, in any order */
+	Parallel,
+	/* One item at a time, in the order the input produced them */
+	SerialInOrder
+};
+
+/**
+ * Runs items through a series of stages on the TaskScheduler
+ *
+ * Every item in flight holds a token. Once all the tokens are taken, the input isn't called until an item leaves
+ * the pipeline, which bounds the memory the items in flight can use
+ *
+ * A task carries its item through as many stages as it can, so the item stays in that worker's cache. When the
+ * task finishes an item, it picks up the next one from the input. Serial stages keep a ring of slots, one per token.
+ * An item that arrives out of turn is left in its slot, and the task that finishes the item before it adds a task
+ * to carry it on. So serial stages are ordered without a lock
+ */
+class Pipeline {
+public:
+	/**
+	 * Creates an empty pipeline
+	 *
+	 * @param taskScheduler    The TaskScheduler to run the stages on
+	 */
+	explicit Pipeline(TaskScheduler *taskScheduler);
+	~Pipeline();
+
+	Pipeline(const Pipeline &) = delete;
+	Pipeline &operator=(const Pipeline &) = delete;
+
+private:
+	struct Item;
+	struct Stage;
+
+	TaskScheduler *m_taskScheduler;
+	PipelineInputFunction m_input;
+	void *m_inputArg;
+	std::vector<std::unique_ptr<Stage>> m_stages;
+	/* The number of tokens in Run() */
+	uint m_numTokens;
+
+	/* The tokens that aren't held by an item */
+	std::atomic<uint> m_freeTokens;
+	/* Set by the task calling the input, so only one does at a time */
+	std::atomic<bool> m_inputBusy;
+	/* Whether the input has returned nullptr. Guarded by m_inputBusy */
+	bool m_inputDone;
+	/* The sequence number of the next item. Guarded by m_inputBusy */
+	uint64 m_nextSequence;
+	/* The items in flight, plus 1 until the input is done */
+	std::atomic<uint> m_outstanding;
+	/* Set to 0 once m_outstanding reaches 0. Run() waits on it */
+	AtomicCounter m_finished;
+
+public:
+	/**
+	 * Sets the function producing the items
+	 *
+	 * @param input    The input function
+	 * @param arg      An arg passed to every call of the input function
+	 */
+	void SetInput(PipelineInputFunction input, void *arg = nullptr);
+	/**
+	 * Adds a stage after the existing ones
+	 *
+	 * @param mode        Whether items can go through the stage in parallel, or have to go through one at a time, in order
+	 * @param function    The function to run on each item
+	 * @param arg         An arg passed to every call of the function
+	 */
+	void AddStage(PipelineStageMode mode, PipelineStageFunction function, void *arg = nullptr);
+	/**
+	 * Runs every item through the stages, and waits for them to finish. Has to be called from a task
+	 *
+	 * @param maxTokens    The maximum number of items in flight at once
+	 */
+	void Run(uint maxTokens);
+
+private:
+	/**
+	 * Calls the input while there are free tokens, and adds a task to carry each new item, except the first
+	 *
+	 * @param spare    An item that left the pipeline, to reuse for the first new item. Can be nullptr
+	 * @return         The first new item, for the caller to carry. nullptr if there was none
+	 */
+	Item *ProduceItems(Item *spare);
+	/**
+	 * Releases a count on m_outstanding. The last one lets Run() return, so the pipeline can't be touched afterwards
+	 */
+	void ReleaseOutstanding();
+	/**
+	 * Takes an item through the stages, then takes on new items from the input, until an item has to wait
+	 * for its turn in a serial stage, or there are no items left
+	 *
+	 * @param item    The item to start with
+	 */
+	void CarryItems(Item *item);
+	/**
+	 * Takes an item through the stages, from item->NextStage
+	 *
+	 * @param item       The item
+	 * @param handoff    Set to an item whose turn in a serial stage this item handed it, if it's nullptr. Otherwise, a
+	 *                   task is added to carry that item on
+	 * @return           True if the item went through all the stages. False if it's waiting for its turn in a serial stage
+	 */
+	bool AdvanceItem(Item *item, Item **handoff);
+	/**
+	 * The TaskFunction that carries an item on
+	 *
+	 * @param taskScheduler    The TaskScheduler
+	 * @param arg              The Item
+	 */
+	static void CarryItemsTask(TaskScheduler *taskScheduler, void *arg);
+};
+
+} // End of namespace ftl
@@ -0,0 +1,226 @@
+/* FiberTaskingLib - A tasking library that uses fibers for efficient task switching
+ *
+ * This library was created as a proof of concept of the ideas presented by
+ * Christian Gyrling in his 2015 GDC Talk 'Parallelizing the Naughty Dog Engine Using Fibers'
+ *
+ * http://gdcvault.com/play/1022186/Parallelizing-the-Naughty-Dog-Engine
+ *
+ * FiberTaskingLib is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2015 - 2017
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+
+#include "ftl/typedefs.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+namespace ftl {
+
+class TaskScheduler;
+class AtomicCounter;
+
+/**
+ * The function run by a RemoteTask
+ *
+ * @param taskScheduler     The TaskScheduler of the process running the task
+ * @param args              The task's arguments. Only valid until the function returns
+ * @param argsSize          The size of the arguments
+ * @param result            Where to write the result. Only valid until the function returns
+ * @param resultCapacity    The size of result. RemoteTask::kMaxResultSize
+ * @return                  The number of bytes written to result
+ */
+typedef uint32 (*RemoteTaskFunction)(TaskScheduler *taskScheduler, const void *args, uint32 argsSize, void *result, uint32 resultCapacity);
+
+/**
+ * A task that can run in this process, or in a worker process on the other end of a RemoteTaskTransport
+ *
+ * Like SharedTask, the function is named by id, and the arguments are carried by value. See TaskScheduler::AddRemoteTasks()
+ */
+struct RemoteTask {
+	enum {
+		kMaxArgsSize = 112,
+		kMaxResultSize = 112
+	};
+
+	/* The id the function was registered with */
+	uint32 FunctionId;
+	/* The number of bytes of Args in use */
+	uint32 ArgsSize;
+	/* Plain old data for the function. It's copied byte for byte to the process that runs the task */
+	char Args[kMaxArgsSize];
+	/* Where to copy the result to once the task completes. Can be nullptr */
+	void *Result;
+	/* The size of Result. Any more of the result is dropped */
+	uint32 ResultCapacity;
+};
+
+/**
+ * Ships tasks to worker processes over sockets, and brings their results back
+ *
+ * The submitting process connects to one or more workers before calling TaskScheduler::Run(), and passes the
+ * transport in SchedulerOptions::Transport. A worker process listens, and calls Serve() from a task. The workers
+ * can be on other machines, or just other processes on this one
+ *
+ * Addresses have the form "unix:/path/to/socket" or "tcp:host:port"
+ *
+ * Every process has to register the same functions under the same ids. Args and results are copied as raw bytes,
+ * so the processes have to agree on their layout, and on endianness
+ *
+ * If a worker goes away, the tasks it hadn't returned yet are run in this process instead, and no more are shipped
+ * to it. Responses that don't match a task we're waiting on are dropped
+ *
+ * NOTE: Sockets are only implemented for POSIX systems
+ */
+class RemoteTaskTransport {
+public:
+	RemoteTaskTransport();
+	~RemoteTaskTransport();
+
+	RemoteTaskTransport(const RemoteTaskTransport &) = delete;
+	RemoteTaskTransport &operator=(const RemoteTaskTransport &) = delete;
+
+	enum {
+		/* How often Serve() checks whether its clients have gone, in microseconds */
+		kServePollUs = 1000
+	};
+
+private:
+	struct Connection;
+	struct PendingTask;
+	struct Request;
+	struct OrphanedTask;
+
+	/* The workers we ship tasks to */
+	std::vector<std::unique_ptr<Connection>> m_workers;
+
+	/* The listening socket of a worker, or -1 */
+	int m_listenSocket;
+	/* The path to remove once we stop listening on a Unix domain socket */
+	std::string m_listenPath;
+	/* The scheduler running the requests. Only set while serving */
+	TaskScheduler *m_taskScheduler;
+	std::thread m_acceptThread;
+	/* The processes we run tasks for */
+	std::vector<std::unique_ptr<Connection>> m_clients;
+	std::mutex m_clientsLock;
+	/* The number of clients that have connected, and the number that are still connected */
+	std::atomic<uint> m_numAcceptedClients;
+	std::atomic<uint> m_numConnectedClients;
+	/* The number of requests that have been received, but not answered */
+	std::atomic<uint> m_numRequestsInFlight;
+	/* Set by StopServing(), so Serve() returns */
+	std::atomic<bool> m_stopServing;
+
+	/* The functions, indexed by id */
+	std::vector<RemoteTaskFunction> m_functions;
+
+public:
+	/**
+	 * Connects to a worker. Call this before the transport is passed to TaskScheduler::Run()
+	 *
+	 * @param address    The address the worker is listening on
+	 * @return           False if the connection failed
+	 */
+	bool Connect(const char *address);
+	/**
+	 * Starts listening for processes that want to ship tasks to this one. See Serve()
+	 *
+	 * @param address    The address to listen on. With "tcp:host:0", a free port is chosen. See GetListenPort()
+	 * @return           False if the address couldn't be bound
+	 */
+	bool Listen(const char *address);
+	/**
+	 * Gets the port the transport is listening on
+	 *
+	 * @return    The port, or 0 if the transport isn't listening on a TCP socket
+	 */
+	uint16 GetListenPort() const;
+	/**
+	 * Runs the tasks shipped to this process, until every process that connected has disconnected again, or
+	 * StopServing() is called. Has to be called from a task, after Listen(). Stops listening before returning
+	 *
+	 * @param taskScheduler    The scheduler to run the tasks with
+	 */
+	void Serve(TaskScheduler *taskScheduler);
+	/**
+	 * Makes Serve() return, once the tasks it's running have finished. Can be called from any thread
+	 */
+	void StopServing();
+	/**
+	 * Disconnects from the workers, and stops listening. Tasks that were shipped, but haven't returned, are lost
+	 * Don't call this while Serve() is running. See StopServing()
+	 */
+	void Close();
+
+	/**
+	 * The number of workers connected to with Connect()
+	 *
+	 * @return    The number of workers
+	 */
+	uint GetNumWorkers() const {
+		return static_cast<uint>(m_workers.size());
+	}
+
+	/**
+	 * Registers a function that remote tasks can run
+	 *
+	 * @param functionId    The id to register the function under
+	 * @param function      The function
+	 */
+	void RegisterFunction(uint32 functionId, RemoteTaskFunction function);
+	/**
+	 * Runs a task in this process, and copies its result to task.Result
+	 *
+	 * @param taskScheduler    The TaskScheduler of this process
+	 * @param task             The task to run
+	 */
+	void RunTask(TaskScheduler *taskScheduler, const RemoteTask &task) const;
+	/**
+	 * Ships a task to the connected worker with the fewest tasks outstanding
+	 *
+	 * Once the result comes back, a task decrementing counter is added to the scheduler
+	 *
+	 * @param taskScheduler    The scheduler to add the completion to
+	 * @param task             The task to ship
+	 * @param counter          The counter to decrement once the task completes. Can be nullptr
+	 * @param group            The worker group to add the completion to
+	 * @return                 False if the task couldn't be sent. The caller should run it locally
+	 */
+	bool Submit(TaskScheduler *taskScheduler, const RemoteTask &task, AtomicCounter *counter, uint group);
+
+private:
+	uint32 CallFunction(TaskScheduler *taskScheduler, uint32 functionId, const void *args, uint32 argsSize, void *result) const;
+	void ReceiveResults(Connection *worker);
+	/**
+	 * Stops shipping tasks to a worker, and runs the tasks it hadn't returned in this process
+	 *
+	 * @param worker    The worker whose connection failed
+	 */
+	void OrphanPendingTasks(Connection *worker);
+	void AcceptClients();
+	void ReceiveRequests(Connection *client);
+	static void RunRequest(TaskScheduler *taskScheduler, void *arg);
+	static void RunOrphanedTask(TaskScheduler *taskScheduler, void *arg);
+};
+
+} // End of namespace ftl
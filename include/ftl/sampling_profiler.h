@@ -0,0 +1,240 @@
+/* FiberTaskingLib - A tasking library that uses fibers for efficient task switching
+ *
+ * This library was created as a proof of concept of the ideas presented by
+ * Christian Gyrling in his 2015 GDC Talk 'Parallelizing the Naughty Dog Engine Using Fibers'
+ *
+ * http://gdcvault.com/play/1022186/Parallelizing-the-Naughty-Dog-Engine
+ *
+ * FiberTaskingLib is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2015 - 2017
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+
+#include "ftl/scheduler_hooks.h"
+#include "ftl/task.h"
+#include "ftl/typedefs.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+
+namespace ftl {
+
+struct SchedulerOptions;
+
+/**
+ * Attributes the CPU time of the worker threads to the tasks they run, by sampling
+ *
+ * The profiler follows the scheduler through SchedulerHooks, and keeps the stack of tasks each fiber is running in
+ * a slot. A sampling thread wakes up every sample interval, and counts the stack of every fiber that's running on a
+ * worker. Tasks run by HelpUntilZero() show up nested in the task that called it. Time spent looking for work shows
+ * up as "[scheduler]"
+ *
+ * Tasks are named, in order of preference, by SetCurrentTaskName(), by NameTaskFunction(), or by the address of
+ * their TaskFunction. The result is written as folded stacks, which flamegraph.pl and speedscope read directly
+ *
+ * The overhead is bounded:
+ * - The workers only do a few relaxed stores when a task begins or ends, or a fiber switches
+ * - Each sample reads one slot per fiber in the pool, so the sampling thread's cost is FiberPoolSize / interval
+ * - At most maxStacks distinct stacks are kept. Any further ones are counted as "[truncated]"
+ *
+ * Usage:
+ *     ftl::SamplingProfiler profiler;
+ *     ftl::SchedulerOptions options;
+ *     profiler.Attach(&options);
+ *     profiler.Start();
+ *     taskScheduler.Run(options, MainTask, arg);
+ *     profiler.Stop();
+ *     profiler.WriteFoldedStacks("profile.folded");
+ *
+ * NOTE: The slots are read without locking, so a sample taken while a task begins or ends can be attributed to its
+ *       parent instead. That's noise at the level of a single sample. Parked threads are still counted as
+ *       "[scheduler]", even though they don't use the CPU
+ */
+class SamplingProfiler {
+public:
+	enum {
+		kDefaultSampleIntervalUs = 1000,
+		kDefaultMaxStacks = 4096,
+		/* Tasks nested deeper than this, through HelpUntilZero(), are attributed to their ancestor at this depth */
+		kMaxTaskDepth = 8
+	};
+
+	/**
+	 * @param sampleIntervalUs    How often to take a sample, in microseconds
+	 * @param maxStacks           The most distinct stacks to keep
+	 */
+	explicit SamplingProfiler(uint sampleIntervalUs = kDefaultSampleIntervalUs, uint maxStacks = kDefaultMaxStacks);
+	~SamplingProfiler();
+
+	SamplingProfiler(const SamplingProfiler &) = delete;
+	SamplingProfiler &operator=(const SamplingProfiler &) = delete;
+
+private:
+	/**
+	 * The tasks a fiber is running, outermost first. Only the fiber writes to it
+	 * The slots are allocated with new[], which doesn't honor extended alignment in C++11, so they're padded instead
+	 */
+	struct FiberSlot {
+		/* Whether the fiber is running on a worker thread */
+		std::atomic<bool> Running;
+		/* The number of tasks the fiber is running. Can be more than kMaxTaskDepth */
+		std::atomic<uint> Depth;
+		std::atomic<TaskFunction> Functions[kMaxTaskDepth];
+		std::atomic<const char *> Names[kMaxTaskDepth];
+		/* Cache-line pad, so neighbouring fibers don't share a line */
+		char pad[64];
+	};
+
+	/* A task in a sampled stack */
+	struct Frame {
+		TaskFunction Function;
+		const char *Name;
+
+		bool operator<(const Frame &other) const {
+			return Function != other.Function ? std::less<TaskFunction>()(Function, other.Function) : std::less<const char *>()(Name, other.Name);
+		}
+	};
+
+	/* One slot per fiber in the pool */
+	std::unique_ptr<FiberSlot[]> m_fibers;
+	std::size_t m_numFibers;
+	/* The hooks that were set before we attached. We call them after our own */
+	SchedulerHooks m_nextHooks;
+
+	std::chrono::microseconds m_sampleInterval;
+	std::size_t m_maxStacks;
+
+	std::thread m_samplingThread;
+	std::mutex m_samplingLock;
+	std::condition_variable m_stopCondition;
+	bool m_stopSampling;
+
+	/* The number of samples of each stack, and of the stacks that didn't fit. Guarded by m_samplesLock */
+	std::map<std::vector<Frame>, uint64> m_samples;
+	uint64 m_truncatedSamples;
+	uint64 m_numSamples;
+	mutable std::mutex m_samplesLock;
+
+	/* The names given to TaskFunctions by NameTaskFunction(). Guarded by m_namesLock */
+	std::unordered_map<TaskFunction, const char *> m_functionNames;
+	mutable std::mutex m_namesLock;
+
+public:
+	/**
+	 * Installs the profiler's hooks in the options. Hooks already in the options are still called, after the
+	 * profiler's. Call this before Run(), and keep the profiler alive until Run() returns
+	 *
+	 * @param options    The options the scheduler will be run with. FiberPoolSize has to be final
+	 * @return           False if the scheduler was built without hooks, so nothing would be sampled
+	 */
+	bool Attach(SchedulerOptions *options);
+
+	/**
+	 * Starts the sampling thread. Can be called before, or during, Run()
+	 */
+	void Start();
+	/**
+	 * Stops the sampling thread. The samples are kept until Clear()
+	 */
+	void Stop();
+	/**
+	 * Removes all the samples
+	 */
+	void Clear();
+
+	/**
+	 * Names every task that runs a function. Can be called at any time
+	 *
+	 * @param function    The task function
+	 * @param name        The name. It has to outlive the profiler
+	 */
+	void NameTaskFunction(TaskFunction function, const char *name);
+	/**
+	 * Names the task running on the calling fiber, until it returns. Overrides NameTaskFunction()
+	 *
+	 * Does nothing if called from outside a task, or if no profiler is attached
+	 *
+	 * @param name    The name. It has to outlive the profiler
+	 */
+	static void SetCurrentTaskName(const char *name);
+
+	/**
+	 * Gets the number of samples taken of running fibers
+	 *
+	 * @return    The number of samples
+	 */
+	uint64 GetNumSamples() const;
+	/**
+	 * Gets the number of samples in which the innermost task was named 'name'
+	 *
+	 * @param name    The name given by SetCurrentTaskName() or NameTaskFunction()
+	 * @return        The number of samples
+	 */
+	uint64 GetNumSamples(const char *name) const;
+	/**
+	 * Gets the number of samples in which the innermost task ran 'function'
+	 *
+	 * @param function    The task function
+	 * @return            The number of samples
+	 */
+	uint64 GetNumSamples(TaskFunction function) const;
+
+	/**
+	 * Writes the samples as folded stacks. One line per stack: the task names, outermost first, separated by ';',
+	 * then a space and the number of samples
+	 *
+	 * @param path    The path of the file
+	 * @return        True if the whole file was written
+	 */
+	bool WriteFoldedStacks(const char *path) const;
+
+private:
+	/**
+	 * The body of the sampling thread
+	 */
+	void SampleUntilStopped();
+	/**
+	 * Counts the stack of every running fiber once
+	 */
+	void TakeSample();
+	/**
+	 * Gets the name of a frame in the folded stacks
+	 *
+	 * @param frame    The frame
+	 * @return         The name
+	 */
+	std::string GetFrameName(const Frame &frame) const;
+
+	static void OnFiberSwitchIn(void *context, std::size_t threadIndex, std::size_t fiberIndex);
+	static void OnFiberSwitchOut(void *context, std::size_t threadIndex, std::size_t fiberIndex);
+	static void OnTaskBegin(void *context, std::size_t threadIndex, std::size_t fiberIndex, const Task &task);
+	static void OnTaskEnd(void *context, std::size_t threadIndex, std::size_t fiberIndex, const Task &task);
+	static void OnWaitBegin(void *context, std::size_t threadIndex, std::size_t fiberIndex, const AtomicCounter *counter);
+	static void OnWaitEnd(void *context, std::size_t threadIndex, std::size_t fiberIndex, const AtomicCounter *counter);
+};
+
+} // End of namespace ftl
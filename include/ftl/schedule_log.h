@@ -0,0 +1,160 @@
+/* FiberTaskingLib - A tasking library that uses fibers for efficient task switching
+ *
+ * This library was created as a proof of concept of the ideas presented by
+ * Christian Gyrling in his 2015 GDC Talk 'Parallelizing the Naughty Dog Engine Using Fibers'
+ *
+ * http://gdcvault.com/play/1022186/Parallelizing-the-Naughty-Dog-Engine
+ *
+ * FiberTaskingLib is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2015 - 2017
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "ftl/typedefs.h"
+
+#include <vector>
+
+
+namespace ftl {
+
+/**
+ * Whether the TaskScheduler records or replays its scheduling decisions. See SchedulerOptions::Schedule
+ */
+enum class ScheduleMode {
+	/* Schedule freely. Nothing is recorded */
+	Normal,
+	/* Schedule freely, and record every decision to SchedulerOptions::Log */
+	Record,
+	/* Force every thread to make the same decisions as in SchedulerOptions::Log */
+	Replay
+};
+
+/**
+ * The kind of scheduling decision a ScheduleEvent describes
+ */
+enum class ScheduleEventType : uint8 {
+	/* The thread started running the task 'Id' */
+	Task,
+	/* The thread switched out of the fiber waiting on 'Id' */
+	Wait,
+	/* The thread resumed the fiber waiting on 'Id' */
+	Resume,
+	/* The thread made the fiber waiting on 'Id' ready, and handed it to worker group 'Victim' */
+	Ready
+};
+
+/**
+ * Where a thread found the task of a ScheduleEventType::Task event
+ */
+enum class TaskSource : uint8 {
+	/* The thread's next task slot */
+	NextTask,
+	/* The thread's own task queue */
+	OwnQueue,
+	/* The injection queue of worker group 'Victim' */
+	Injection,
+	/* The task queue of thread 'Victim' */
+	Steal,
+	/* The task was handed out by the replay */
+	Replay,
+	/* The mailbox of thread 'Victim'. See Affinity */
+	Mailbox
+};
+
+/**
+ * A single scheduling decision
+ *
+ * Tasks and waits are identified by the thread that spawned them (or called WaitForCounter()), and how many
+ * ids that thread had handed out before. So ids stay the same from run to run, as long as each thread runs
+ * the same tasks in the same order
+ */
+struct ScheduleEvent {
+	/* The task, or wait, the decision is about */
+	uint64 Id;
+	/* The thread stolen from, or the worker group the task or fiber came from or went to */
+	uint32 Victim;
+	ScheduleEventType Type;
+	TaskSource Source;
+};
+
+/**
+ * A log of the scheduling decisions made by each worker thread
+ *
+ * Pass it to TaskScheduler::Run() with ScheduleMode::Record to fill it, and with ScheduleMode::Replay to
+ * re-execute the run with the same interleavings. For example, under a profiler
+ */
+class ScheduleLog {
+public:
+	ScheduleLog() = default;
+
+private:
+	/* The events of each thread, in the order they happened */
+	std::vector<std::vector<ScheduleEvent> > m_threads;
+
+	/**
+	 * We friend TaskScheduler so it can append to the per-thread logs without going through the public API
+	 */
+	friend class TaskScheduler;
+
+public:
+	/**
+	 * Removes all the events, and makes room for the events of 'numThreads' threads
+	 *
+	 * @param numThreads    The number of threads
+	 */
+	void Reset(std::size_t numThreads);
+
+	/**
+	 * Gets the number of threads the log has events for
+	 *
+	 * @return    The number of threads
+	 */
+	std::size_t GetNumThreads() const {
+		return m_threads.size();
+	}
+	/**
+	 * Gets the events of a single thread
+	 *
+	 * @param threadIndex    The index of the thread
+	 * @return               The events, in the order they happened
+	 */
+	const std::vector<ScheduleEvent> &GetEvents(std::size_t threadIndex) const {
+		return m_threads[threadIndex];
+	}
+	/**
+	 * Gets the total number of events of all the threads
+	 *
+	 * @return    The number of events
+	 */
+	std::size_t GetNumEvents() const;
+
+	/**
+	 * Writes the log to a file
+	 *
+	 * @param path    The path of the file
+	 * @return        True if the whole log was written
+	 */
+	bool Save(const char *path) const;
+	/**
+	 * Replaces the log with one written by Save()
+	 *
+	 * @param path    The path of the file
+	 * @return        True if the file was a valid log. On failure, the log is left empty
+	 */
+	bool Load(const char *path);
+};
+
+} // End of namespace ftl
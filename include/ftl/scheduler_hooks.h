@@ -0,0 +1,102 @@
+/* FiberTaskingLib - A tasking library that uses fibers for efficient task switching
+ *
+ * This library was created as a proof of concept of the ideas presented by
+ * Christian Gyrling in his 2015 GDC Talk 'Parallelizing the Naughty Dog Engine Using Fibers'
+ *
+ * http://gdcvault.com/play/1022186/Parallelizing-the-Naughty-Dog-Engine
+ *
+ * FiberTaskingLib is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2015 - 2017
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+
+#include "ftl/task.h"
+
+#include <cstddef>
+
+
+namespace ftl {
+
+class AtomicCounter;
+
+/**
+ * Called when a fiber starts, or stops, running on a worker thread
+ *
+ * @param context        SchedulerHooks::Context
+ * @param threadIndex    The index of the worker thread. See TaskScheduler::GetCurrentThreadIndex()
+ * @param fiberIndex     The index of the fiber in the fiber pool
+ */
+typedef void (*FiberHook)(void *context, std::size_t threadIndex, std::size_t fiberIndex);
+/**
+ * Called right before a task runs, and right after it returns
+ *
+ * @param context        SchedulerHooks::Context
+ * @param threadIndex    The index of the worker thread. A task that waits can end on a different thread than it began on
+ * @param fiberIndex     The index of the fiber running the task
+ * @param task           The task
+ */
+typedef void (*TaskHook)(void *context, std::size_t threadIndex, std::size_t fiberIndex, const Task &task);
+/**
+ * Called when a fiber has to wait on a counter, and when it resumes
+ *
+ * Waits that return right away, because the counter already has the value, aren't reported
+ *
+ * @param context        SchedulerHooks::Context
+ * @param threadIndex    The index of the worker thread. The wait can end on a different thread than it began on
+ * @param fiberIndex     The index of the waiting fiber
+ * @param counter        The counter being waited on. Only valid until WaitEnd returns
+ */
+typedef void (*WaitHook)(void *context, std::size_t threadIndex, std::size_t fiberIndex, const AtomicCounter *counter);
+
+/**
+ * Callbacks for profilers and other tools that need to follow the scheduler. See SchedulerOptions::Hooks
+ *
+ * Any of them can be nullptr. They're called on the worker threads, from inside the scheduler, so they have to be
+ * thread safe, and they mustn't add tasks, wait on counters, or block for long
+ *
+ * On a thread, FiberSwitchIn and FiberSwitchOut alternate, and every fiber switch reports the outgoing fiber before
+ * the incoming one. The first fiber on each thread is switched in at startup, and the last one is switched out at
+ * shutdown
+ *
+ * The hooks can be compiled out with the FTL_SCHEDULER_HOOKS CMake option, or with the Minimal scheduler policy
+ */
+struct SchedulerHooks {
+	SchedulerHooks()
+		: Context(nullptr),
+		  FiberSwitchIn(nullptr),
+		  FiberSwitchOut(nullptr),
+		  TaskBegin(nullptr),
+		  TaskEnd(nullptr),
+		  WaitBegin(nullptr),
+		  WaitEnd(nullptr) {
+	}
+
+	/* Passed to every hook */
+	void *Context;
+	/* A fiber started running on the thread */
+	FiberHook FiberSwitchIn;
+	/* A fiber is about to stop running on the thread */
+	FiberHook FiberSwitchOut;
+	TaskHook TaskBegin;
+	TaskHook TaskEnd;
+	/* Called before the fiber switches out to wait */
+	WaitHook WaitBegin;
+	/* Called once the fiber is running again, after its FiberSwitchIn */
+	WaitHook WaitEnd;
+};
+
+} // End of namespace ftl
@@ -0,0 +1,251 @@
+/* FiberTaskingLib - A tasking library that uses fibers for efficient task switching
+ *
+ * This library was created as a proof of concept of the ideas presented by
+ * Christian Gyrling in his 2015 GDC Talk 'Parallelizing the Naughty Dog Engine Using Fibers'
+ *
+ * http://gdcvault.com/play/1022186/Parallelizing-the-Naughty-Dog-Engine
+ *
+ * FiberTaskingLib is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2015 - 2017
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "ftl/typedefs.h"
+#include "ftl/schedule_log.h"
+#include "ftl/huge_pages.h"
+#include "ftl/shared_task_pool.h"
+#include "ftl/remote_task_transport.h"
+#include "ftl/scheduler_hooks.h"
+
+#include <string>
+#include <vector>
+
+
+namespace ftl {
+
+/**
+ * How worker threads are pinned to CPUs
+ */
+enum class PinningPolicy {
+	/* Don't pin the threads. The OS is free to move them between any of the allowed CPUs */
+	None,
+	/* Pin thread i to the i-th CPU the process is allowed to run on. This is the default, and how threads were always pinned */
+	Sequential,
+	/* Pin consecutive threads to SMT siblings, then to neighbouring cores, then to the next socket */
+	Compact,
+	/* Spread the threads across sockets and physical cores before doubling up on SMT siblings */
+	Scatter,
+	/* Pin thread i to SchedulerOptions::PinnedCpus[i] */
+	Explicit
+};
+
+/**
+ * When a thread resumes a fiber that one of its tasks made ready, by decrementing the counter the fiber waits on
+ */
+enum class ResumePolicy {
+	/* The fiber joins the thread's ready list. The oldest ready fiber is resumed the next time the thread looks for work */
+	Deferred,
+	/**
+	 * As soon as the task that made the fiber ready returns, the thread switches straight to the fiber, ahead of
+	 * older ready fibers and queued tasks. This keeps a chain of dependent tasks running back to back, with its
+	 * data in cache. If one task makes several fibers ready, only the first is handed off
+	 */
+	Handoff
+};
+
+/**
+ * When the fibers in the pool are created
+ */
+enum class FiberCreationPolicy {
+	/* Create every fiber in Run(), before the main task starts */
+	Eager,
+	/**
+	 * Create fibers as the pool needs them, up to FiberPoolSize. Threads that run out of work create a few fibers
+	 * ahead of time, so the ones waiting on counters rarely have to. Each time a waiting thread does have to, the
+	 * number created ahead of time doubles
+	 */
+	Lazy
+};
+
+/**
+ * A named set of worker threads with their own queues
+ *
+ * Tasks added from a thread in the group stay in the group. Tasks can be added to other groups with
+ * TaskScheduler::AddTask(task, counter, group)
+ */
+struct WorkerGroupOptions {
+	WorkerGroupOptions()
+		: NumThreads(1),
+		  StealFromOtherGroups(false) {
+	}
+	WorkerGroupOptions(const char *name, uint numThreads, bool stealFromOtherGroups = false)
+		: Name(name),
+		  NumThreads(numThreads),
+		  StealFromOtherGroups(stealFromOtherGroups) {
+	}
+
+	/* The name used to look up the group. See TaskScheduler::GetWorkerGroup() */
+	std::string Name;
+	/* The number of threads in the group. Must be at least 1 */
+	uint NumThreads;
+	/**
+	 * The CPUs to pin the group's threads to, in thread order. They are reused round robin if there are more
+	 * threads than CPUs. If empty, the threads are pinned according to SchedulerOptions::Pinning
+	 */
+	std::vector<uint> Cpus;
+	/* If true, the group's threads steal from the other groups when their own group runs out of work */
+	bool StealFromOtherGroups;
+};
+
+/**
+ * The options used by TaskScheduler::Run()
+ *
+ * The defaults match TaskScheduler::Run(fiberPoolSize, mainTask) with a fiber pool of 400
+ */
+struct SchedulerOptions {
+	SchedulerOptions()
+		: FiberPoolSize(400),
+		  ThreadPoolSize(0),
+		  MinActiveThreads(0),
+		  ParkDelayMs(50),
+		  Pinning(PinningPolicy::Sequential),
+		  Schedule(ScheduleMode::Normal),
+		  Log(nullptr),
+		  ReplayTimeoutMs(5000),
+		  HugePages(HugePagePolicy::Off),
+		  PrefaultStackBytes(0),
+		  SharedPool(nullptr),
+		  Transport(nullptr),
+		  RemoteOffloadThreshold(64),
+		  MailboxStealDelayUs(100),
+		  TrackParentTasks(false),
+		  Resume(ResumePolicy::Deferred),
+		  FiberCreation(FiberCreationPolicy::Eager) {
+	}
+
+	/* The size of the fiber pool. The fiber pool is used to run new tasks when the current task is waiting on a counter */
+	uint FiberPoolSize;
+	/* The size of the thread pool to run. 0 corresponds to GetNumHardwareThreads() */
+	uint ThreadPoolSize;
+	/**
+	 * The number of threads that are always kept active. 0 disables parking
+	 *
+	 * Threads beyond this number are parked once they have been idle for ParkDelayMs, and are woken back up
+	 * when tasks start to back up in the queues. See TaskScheduler::SetActiveThreadLimits()
+	 */
+	uint MinActiveThreads;
+	/* The number of milliseconds a thread has to be idle before it can be parked */
+	uint ParkDelayMs;
+	/**
+	 * How to pin the worker threads. The main thread counts as worker 0
+	 *
+	 * Defaults to PinningPolicy::Sequential. Compact and Scatter have to be asked for
+	 *
+	 * Only CPUs the process is allowed to run on are used. If there are more threads than CPUs, the CPUs are
+	 * reused round robin
+	 */
+	PinningPolicy Pinning;
+	/* The CPUs to pin the threads to, in thread order. Only used with PinningPolicy::Explicit */
+	std::vector<uint> PinnedCpus;
+	/**
+	 * CPUs the worker threads should never be pinned to. For example, core 0, or cores reserved for interrupt
+	 * handling or the network stack. Ignored by PinningPolicy::None
+	 */
+	std::vector<uint> ExcludedCpus;
+	/**
+	 * The worker groups to create. If empty, a single group with ThreadPoolSize threads is created
+	 * Otherwise, ThreadPoolSize is ignored, and the number of threads is the sum of the group sizes
+	 *
+	 * The thread calling Run() is the first thread of the first group, so the main task runs in that group
+	 */
+	std::vector<WorkerGroupOptions> Groups;
+	/**
+	 * Whether to record or replay the scheduling decisions. Record and Replay both need Log
+	 *
+	 * A replay needs the same options as the recorded run, and the tasks have to spawn the same tasks, and wait
+	 * on the same counters, as they did when recording. While replaying, threads never park
+	 */
+	ScheduleMode Schedule;
+	/* The log to record the decisions to, or to replay them from. Recording clears it first */
+	ScheduleLog *Log;
+	/**
+	 * If a replaying thread waits this long for the task or fiber it's supposed to run next, the run is assumed
+	 * to have diverged from the log. From then on, all the threads schedule freely. See TaskScheduler::HasReplayDiverged()
+	 */
+	uint ReplayTimeoutMs;
+	/**
+	 * Whether to back the fiber stacks and the per-thread scheduler state with huge pages
+	 *
+	 * Switching between many fibers touches many stacks, which costs a lot of TLB misses with normal pages. With huge
+	 * pages, all the stacks share one allocation. Any huge page a stack touches is committed in full, so this uses
+	 * more memory, and the stacks don't get guard pages. See TaskScheduler::GetHugePageBacking()
+	 */
+	HugePagePolicy HugePages;
+	/**
+	 * How many bytes at the top of each fiber stack to fault in before the main task starts. 0 disables it
+	 *
+	 * Otherwise, the stack pages are faulted in the first time each fiber runs, which shows up as latency spikes right
+	 * after Run() starts. The pool is split between the worker threads, and each thread touches the stacks it's most
+	 * likely to use, in parallel. With pinned threads, this puts the stacks on each thread's NUMA node
+	 */
+	uint PrefaultStackBytes;
+	/**
+	 * A pool of tasks shared with other processes. Can be nullptr. It has to be open before Run() is called
+	 *
+	 * Threads that run out of local work take tasks from the pool, including ones added by other processes. See
+	 * TaskScheduler::AddSharedTasks(). While recording or replaying, shared tasks only run in this process
+	 */
+	SharedTaskPool *SharedPool;
+	/**
+	 * The transport used to ship remote tasks to worker processes. Can be nullptr. It has to be connected to its
+	 * workers before Run() is called. See TaskScheduler::AddRemoteTasks()
+	 */
+	RemoteTaskTransport *Transport;
+	/**
+	 * Remote tasks are only shipped off once the task queue of the thread adding them holds at least this many tasks
+	 * Until then, they run locally. 0 ships every remote task
+	 */
+	uint RemoteOffloadThreshold;
+	/**
+	 * How long, in microseconds, a worker can leave tasks in its mailbox before other workers steal the ones that
+	 * aren't Strict. See Affinity
+	 *
+	 * Short delays keep tasks from waiting behind a long task, long ones keep more of them on the worker that
+	 * has their data in cache
+	 */
+	uint MailboxStealDelayUs;
+	/**
+	 * Callbacks on fiber switches, task begin and end, and waits, for profilers and other tools. See SchedulerHooks
+	 *
+	 * Ignored, with a warning, if the scheduler was built without hooks
+	 */
+	SchedulerHooks Hooks;
+	/**
+	 * Remember which task added each task, so profilers can stitch logical stacks together across fibers. See
+	 * TaskScheduler::GetParentTaskFunction()
+	 */
+	bool TrackParentTasks;
+	/* What a thread does with the fibers its tasks make ready. See ResumePolicy */
+	ResumePolicy Resume;
+	/**
+	 * When to create the fibers in the pool. With FiberCreationPolicy::Lazy, Run() starts the main task right away,
+	 * instead of first allocating and setting up a stack for every fiber. PrefaultStackBytes then applies to each
+	 * fiber as it's created
+	 */
+	FiberCreationPolicy FiberCreation;
+};
+
+} // End of namespace ftl
@@ -0,0 +1,83 @@
+/* FiberTaskingLib - A tasking library that uses fibers for efficient task switching
+ *
+ * This library was created as a proof of concept of the ideas presented by
+ * Christian Gyrling in his 2015 GDC Talk 'Parallelizing the Naughty Dog Engine Using Fibers'
+ *
+ * http://gdcvault.com/play/1022186/Parallelizing-the-Naughty-Dog-Engine
+ *
+ * FiberTaskingLib is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2015 - 2017
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+
+#include "ftl/task_queue.h"
+
+
+/**
+ * SchedulerHooks are compiled in unless FTL_DISABLE_SCHEDULER_HOOKS is defined. See the FTL_SCHEDULER_HOOKS CMake option
+ */
+#if defined(FTL_DISABLE_SCHEDULER_HOOKS)
+	#define FTL_SCHEDULER_HOOKS_ENABLED false
+#else
+	#define FTL_SCHEDULER_HOOKS_ENABLED true
+#endif
+
+namespace ftl {
+
+/**
+ * The features every TaskScheduler has. This is the default
+ */
+struct DefaultSchedulerPolicy {
+	/* The queue each worker keeps its task indices in. See TaskQueueBackend */
+	typedef TaskQueueBackend Queue;
+	/* Idle threads can be parked. Otherwise, they spin until they find work. See SchedulerOptions::MinActiveThreads */
+	static constexpr bool kParking = true;
+	/* Schedules can be recorded and replayed. See SchedulerOptions::Schedule */
+	static constexpr bool kScheduleLog = true;
+	/* Idle threads take tasks from other processes. See SchedulerOptions::SharedPool */
+	static constexpr bool kSharedPool = true;
+	/* Profilers and other tools can follow the fibers and tasks. See SchedulerOptions::Hooks */
+	static constexpr bool kHooks = FTL_SCHEDULER_HOOKS_ENABLED;
+};
+
+/**
+ * Only what's needed to run tasks. The checks for the other features compile to nothing
+ *
+ * Options asking for a disabled feature are ignored, with a warning
+ */
+struct MinimalSchedulerPolicy {
+	typedef TaskQueueBackend Queue;
+	static constexpr bool kParking = false;
+	static constexpr bool kScheduleLog = false;
+	static constexpr bool kSharedPool = false;
+	static constexpr bool kHooks = false;
+};
+
+/**
+ * The policy TaskScheduler is built with. Chosen at build time with the FTL_SCHEDULER_POLICY CMake option
+ *
+ * TaskScheduler is used through a pointer by every task, counter and helper, so it can't be a template without
+ * changing all of their signatures. Instead, the policy is fixed per build, and the scheduler checks its
+ * constants, which the compiler folds away
+ */
+#if defined(FTL_MINIMAL_SCHEDULER)
+	typedef MinimalSchedulerPolicy SchedulerPolicy;
+#else
+	typedef DefaultSchedulerPolicy SchedulerPolicy;
+#endif
+
+} // End of namespace ftl
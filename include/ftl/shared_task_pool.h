@@ -0,0 +1,240 @@
+/* FiberTaskingLib - A tasking library that uses fibers for efficient task switching
+ *
+ * This library was created as a proof of concept of the ideas presented by
+ * Christian Gyrling in his 2015 GDC Talk 'Parallelizing the Naughty Dog Engine Using Fibers'
+ *
+ * http://gdcvault.com/play/1022186/Parallelizing-the-Naughty-Dog-Engine
+ *
+ * FiberTaskingLib is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2015 - 2017
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+
+#include "ftl/typedefs.h"
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+
+namespace ftl {
+
+class TaskScheduler;
+
+/**
+ * The function run by a SharedTask
+ *
+ * @param taskScheduler    The TaskScheduler of the process running the task
+ * @param payload          The task's payload. Only valid until the function returns
+ * @param payloadSize      The size of the payload
+ */
+typedef void (*SharedTaskFunction)(TaskScheduler *taskScheduler, const void *payload, uint32 payloadSize);
+
+/**
+ * A task that can run in any process attached to a SharedTaskPool
+ *
+ * Function pointers and pointers in general mean nothing in another process, so a shared task names its function
+ * by id, and carries its data by value. See SharedTaskPool::RegisterFunction()
+ */
+struct SharedTask {
+	enum {
+		kMaxPayloadSize = 112
+	};
+
+	/* The id the function was registered with */
+	uint32 FunctionId;
+	/* The number of bytes of Payload in use */
+	uint32 PayloadSize;
+	/* Plain old data for the function. It's copied byte for byte between processes */
+	char Payload[kMaxPayloadSize];
+};
+
+/**
+ * A counter in a SharedTaskPool. It's only an index, so it can be passed to other processes in a payload
+ */
+struct SharedCounter {
+	uint32 Index;
+};
+
+/**
+ * A pool of tasks, and counters, in a shared memory segment
+ *
+ * Every process attached to the pool gets its own queue in the segment. A process adds its shared tasks to its own
+ * queue, and runs them when its threads run out of local work. Once its own queue is empty, it steals from the queues
+ * of the other processes. So an idle process helps out an overloaded one, rather than leaving its cores idle
+ *
+ * The segment is created by the first process to open it. Every process has to register the same functions under
+ * the same ids, and use the same pool options. See SchedulerOptions::SharedPool
+ *
+ * NOTE: Shared memory segments are only implemented for POSIX systems. If a process dies, the tasks it was running
+ *       are lost, and their counters never reach 0
+ */
+class SharedTaskPool {
+public:
+	SharedTaskPool();
+	~SharedTaskPool();
+
+	SharedTaskPool(const SharedTaskPool &) = delete;
+	SharedTaskPool &operator=(const SharedTaskPool &) = delete;
+
+	enum {
+		/* The maximum number of processes that can be attached at once */
+		kMaxProcesses = 16
+	};
+
+private:
+	struct SegmentHeader;
+	struct QueueHeader;
+	struct Cell;
+
+	/* The mapped segment */
+	void *m_segment;
+	std::size_t m_segmentSize;
+	SegmentHeader *m_header;
+	/* The index of this process's queue */
+	uint32 m_processIndex;
+	/* The queue to try first when stealing. Rotates, so the other processes are stolen from evenly */
+	std::atomic<uint32> m_nextVictim;
+	/* The functions, indexed by id */
+	std::vector<SharedTaskFunction> m_functions;
+
+public:
+	/**
+	 * Creates the segment, or attaches to it if another process already created it
+	 *
+	 * @param name             The name of the segment. On POSIX, this has the form "/name"
+	 * @param queueCapacity    The number of tasks each process's queue can hold. Must be a power of 2. Only used by the process that creates the segment
+	 * @param numCounters      The number of counters in the pool. Only used by the process that creates the segment
+	 * @return                 False if the segment couldn't be opened, or all the process slots are taken
+	 */
+	bool Open(const char *name, uint32 queueCapacity = 4096, uint32 numCounters = 1024);
+	/**
+	 * Detaches from the segment. Tasks left in this process's queue can still be stolen by the other processes
+	 * The segment itself lives on until it's unlinked
+	 */
+	void Close();
+	/**
+	 * Removes the segment's name, so the next Open() creates a new segment. Processes that are attached stay attached
+	 *
+	 * @param name    The name passed to Open()
+	 */
+	static void Unlink(const char *name);
+
+	/**
+	 * Whether the pool is open
+	 *
+	 * @return    True if Open() succeeded, and Close() hasn't been called since
+	 */
+	bool IsOpen() const {
+		return m_header != nullptr;
+	}
+	/**
+	 * Gets the index of this process's queue
+	 *
+	 * @return    The index, from 0 to kMaxProcesses - 1
+	 */
+	uint32 GetProcessIndex() const {
+		return m_processIndex;
+	}
+
+	/**
+	 * Registers a function that shared tasks can run
+	 *
+	 * @param functionId    The id to register the function under
+	 * @param function      The function
+	 */
+	void RegisterFunction(uint32 functionId, SharedTaskFunction function);
+	/**
+	 * Looks up a registered function
+	 *
+	 * @param functionId    The id the function was registered with
+	 * @return              The function, or nullptr if nothing was registered under that id
+	 */
+	SharedTaskFunction GetFunction(uint32 functionId) const;
+
+	/**
+	 * Allocates a counter
+	 *
+	 * @param initialValue    The initial value of the counter
+	 * @param counter         Filled with the counter
+	 * @return                False if all the counters are in use
+	 */
+	bool AllocateCounter(uint32 initialValue, SharedCounter *counter);
+	/**
+	 * Frees a counter allocated with AllocateCounter()
+	 *
+	 * @param counter    The counter to free
+	 */
+	void FreeCounter(SharedCounter counter);
+	/**
+	 * Gets the value of a counter
+	 *
+	 * @param counter    The counter
+	 * @return           The value of the counter
+	 */
+	uint32 LoadCounter(SharedCounter counter) const;
+	/**
+	 * Sets the value of a counter
+	 *
+	 * @param counter    The counter
+	 * @param value      The new value
+	 */
+	void StoreCounter(SharedCounter counter, uint32 value);
+	/**
+	 * Subtracts from a counter
+	 *
+	 * @param counter    The counter
+	 * @param value      The value to subtract
+	 * @return           The value of the counter before the subtraction
+	 */
+	uint32 FetchSubCounter(SharedCounter counter, uint32 value);
+
+	/**
+	 * Adds a task to this process's queue
+	 *
+	 * NOTE: This doesn't touch the counter. TaskScheduler::AddSharedTasks() sets it up before pushing
+	 *
+	 * @param task       The task to add
+	 * @param counter    The counter to decrement when the task finishes. Can be nullptr
+	 * @return           False if the queue is full
+	 */
+	bool TryPush(const SharedTask &task, const SharedCounter *counter);
+	/**
+	 * Takes a task. This process's queue is tried first, and then the queues of the other processes
+	 *
+	 * @param task            Filled with the task
+	 * @param counterIndex    Filled with the index of the task's counter, or UINT32_MAX if it has none
+	 * @param process         Filled with the index of the queue the task came from. Can be nullptr
+	 * @return                False if all the queues are empty
+	 */
+	bool TryPop(SharedTask *task, uint32 *counterIndex, uint32 *process = nullptr);
+	/**
+	 * Whether any of the queues hold tasks. The result is only a snapshot
+	 *
+	 * @return    True if there is a task to pop
+	 */
+	bool HasTasks() const;
+
+private:
+	QueueHeader *GetQueue(uint32 process) const;
+	Cell *GetCells(uint32 process) const;
+	std::atomic<uint32> *GetCounterValues() const;
+	std::atomic<uint32> *GetCountersInUse() const;
+	bool TryPopFrom(uint32 process, SharedTask *task, uint32 *counterIndex);
+};
+
+} // End of namespace ftl
@@ -0,0 +1,251 @@
+/* FiberTaskingLib - A tasking library that uses fibers for efficient task switching
+ *
+ * This library was created as a proof of concept of the ideas presented by
+ * Christian Gyrling in his 2015 GDC Talk 'Parallelizing the Naughty Dog Engine Using Fibers'
+ *
+ * http://gdcvault.com/play/1022186/Parallelizing-the-Naughty-Dog-Engine
+ *
+ * FiberTaskingLib is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2015 - 2017
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "ftl/typedefs.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+
+
+namespace ftl {
+
+/**
+ * A chunked pool of T, addressed by 32-bit indices
+ *
+ * Only the owner thread can allocate, but any thread can free. Chunks are never moved, so other threads
+ * can read an item through its index for as long as the item is allocated.
+ *
+ * Frees from other threads are pushed onto a lock-free stack, which the owner takes over in one exchange
+ * when its own free list runs dry. Since the owner only ever takes the whole stack, there is no ABA problem.
+ */
+template<typename T>
+class Slab {
+public:
+	Slab()
+		: m_numChunks(0),
+		  m_nextUnused(0),
+		  m_freeList(kInvalidIndex),
+		  m_numLive(0),
+		  m_peakLive(0),
+		  m_shrinkChecks(0),
+		  m_remoteFreeList(PackRemoteFreeList(kInvalidIndex, 0)) {
+		for (uint32 i = 0; i < kMaxChunks; ++i) {
+			m_chunks[i] = nullptr;
+		}
+	}
+	~Slab() {
+		for (uint32 i = 0; i < m_numChunks; ++i) {
+			delete[] m_chunks[i];
+		}
+	}
+
+	/* The index returned by Allocate() will never be equal to kInvalidIndex */
+	static const uint32 kInvalidIndex = ~0u;
+
+private:
+	enum : uint32 {
+		kChunkShift = 12,
+		kChunkSize = 1u << kChunkShift,
+		kMaxChunks = 4096,
+		/* The number of calls to TryShrink() over which the peak number of live items is measured */
+		kShrinkCheckInterval = 64
+	};
+
+	struct Slot {
+		T Item;
+		/* The next slot in whichever free list this slot is in */
+		uint32 Next;
+	};
+
+	Slot *m_chunks[kMaxChunks];
+	uint32 m_numChunks;
+	/* Slots at or above this index have never been allocated */
+	uint32 m_nextUnused;
+	/* Slots freed by the owner thread */
+	uint32 m_freeList;
+	/* The number of allocated items, as far as the owner knows. Remote frees are only counted once they're taken over */
+	uint32 m_numLive;
+	/* The highest value of m_numLive since the last shrink check */
+	uint32 m_peakLive;
+	/* The number of calls to TryShrink() since the last shrink check */
+	uint32 m_shrinkChecks;
+
+	/* Cache-line pad */
+	char pad[64];
+	/**
+	 * Slots freed by other threads
+	 * The upper 32 bits are the number of slots in the list, the lower 32 bits are the index of the first slot
+	 */
+	std::atomic<uint64> m_remoteFreeList;
+	/* Cache-line pad */
+	char pad2[64];
+
+public:
+	/**
+	 * Allocates an item
+	 *
+	 * NOTE: This can only be called by the owner thread
+	 *
+	 * @return    The index of the item
+	 */
+	uint32 Allocate() {
+		if (m_freeList == kInvalidIndex) {
+			TakeOverRemoteFrees();
+		}
+
+		uint32 index;
+		if (m_freeList != kInvalidIndex) {
+			index = m_freeList;
+			m_freeList = GetSlot(index).Next;
+		} else {
+			if (m_nextUnused == m_numChunks * kChunkSize) {
+				// Carrying on would write past m_chunks. Over 16 million live items on one thread is a bug anyway
+				if (m_numChunks == kMaxChunks) {
+					printf("Error: A slab ran out of room for more than %u live items\n", kMaxChunks * kChunkSize);
+					std::abort();
+				}
+				m_chunks[m_numChunks++] = new Slot[kChunkSize];
+			}
+			index = m_nextUnused++;
+		}
+
+		if (++m_numLive > m_peakLive) {
+			m_peakLive = m_numLive;
+		}
+		return index;
+	}
+
+	/**
+	 * Gets an allocated item
+	 *
+	 * @param index    The index returned by Allocate()
+	 * @return         The item
+	 */
+	T &Get(uint32 index) {
+		return GetSlot(index).Item;
+	}
+
+	/**
+	 * Frees an item
+	 *
+	 * NOTE: This can only be called by the owner thread. Other threads must use RemoteFree()
+	 *
+	 * @param index    The index returned by Allocate()
+	 */
+	void Free(uint32 index) {
+		GetSlot(index).Next = m_freeList;
+		m_freeList = index;
+		--m_numLive;
+	}
+
+	/**
+	 * Frees an item from a thread other than the owner
+	 *
+	 * @param index    The index returned by Allocate()
+	 */
+	void RemoteFree(uint32 index) {
+		Slot &slot = GetSlot(index);
+		uint64 head = m_remoteFreeList.load(std::memory_order_relaxed);
+		do {
+			slot.Next = static_cast<uint32>(head);
+		} while (!m_remoteFreeList.compare_exchange_weak(head, PackRemoteFreeList(index, static_cast<uint32>(head >> 32) + 1), std::memory_order_release, std::memory_order_relaxed));
+	}
+
+	/**
+	 * Releases the chunks that haven't been needed for a while
+	 *
+	 * Chunks can only be released while no items are allocated, since we can't tell which
+	 * chunks the live items are in. In practice, this happens whenever the owner's work runs dry
+	 *
+	 * NOTE: This can only be called by the owner thread
+	 *
+	 * @return    True if any chunks were released
+	 */
+	bool TryShrink() {
+		if (++m_shrinkChecks < kShrinkCheckInterval) {
+			return false;
+		}
+		m_shrinkChecks = 0;
+
+		TakeOverRemoteFrees();
+		uint32 peakLive = m_peakLive;
+		m_peakLive = m_numLive;
+
+		// Keep enough chunks for twice the recent peak
+		uint32 chunksToKeep = (peakLive * 2 + kChunkSize - 1) / kChunkSize;
+		if (chunksToKeep == 0) {
+			chunksToKeep = 1;
+		}
+		if (m_numLive != 0 || chunksToKeep >= m_numChunks) {
+			return false;
+		}
+
+		for (uint32 i = chunksToKeep; i < m_numChunks; ++i) {
+			delete[] m_chunks[i];
+			m_chunks[i] = nullptr;
+		}
+		m_numChunks = chunksToKeep;
+
+		// Nothing is allocated, so we can start from scratch
+		m_freeList = kInvalidIndex;
+		m_nextUnused = 0;
+
+		return true;
+	}
+
+private:
+	Slot &GetSlot(uint32 index) {
+		return m_chunks[index >> kChunkShift][index & (kChunkSize - 1)];
+	}
+
+	static uint64 PackRemoteFreeList(uint32 head, uint32 count) {
+		return (static_cast<uint64>(count) << 32) | head;
+	}
+
+	void TakeOverRemoteFrees() {
+		if (static_cast<uint32>(m_remoteFreeList.load(std::memory_order_relaxed)) == kInvalidIndex) {
+			return;
+		}
+
+		uint64 list = m_remoteFreeList.exchange(PackRemoteFreeList(kInvalidIndex, 0), std::memory_order_acquire);
+		uint32 head = static_cast<uint32>(list);
+		uint32 count = static_cast<uint32>(list >> 32);
+		if (head == kInvalidIndex) {
+			return;
+		}
+
+		// Splice the remote list in front of our own
+		uint32 tail = head;
+		while (GetSlot(tail).Next != kInvalidIndex) {
+			tail = GetSlot(tail).Next;
+		}
+		GetSlot(tail).Next = m_freeList;
+		m_freeList = head;
+		m_numLive -= count;
+	}
+};
+
+} // End of namespace ftl
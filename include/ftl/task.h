@@ -23,6 +23,11 @@
 
 #pragma once
 
+#include "ftl/typedefs.h"
+
+#include <cstddef>
+
+
 namespace ftl {
 
 class TaskScheduler;
@@ -34,4 +39,39 @@ struct Task {
 	void *ArgData;
 };
 
+/**
+ * Asks for a task to run on a specific worker thread. See TaskScheduler::AddTask(task, counter, affinity)
+ *
+ * The task goes to the worker's mailbox, which the worker drains before it steals. Use it to send a task to the
+ * worker whose cache already holds the task's data, or to a thread that an API requires
+ */
+struct Affinity {
+	/* The index of the worker thread. The main thread is 0. See TaskScheduler::GetCurrentThreadIndex() */
+	uint Worker;
+	/**
+	 * If true, only that worker can run the task. Otherwise, other workers can steal the task once the worker
+	 * has left its mailbox alone for SchedulerOptions::MailboxStealDelayUs
+	 */
+	bool Strict;
+};
+
+/**
+ * A callable stored in place, so it can be run as a task without allocating. See TaskGroup
+ *
+ * Closures come from a per-thread slab in the TaskScheduler, and are freed back to it once they've run
+ */
+struct TaskClosure {
+	enum {
+		kStorageSize = 64
+	};
+
+	/* Calls the callable in Storage, then destroys it */
+	void (*InvokeAndDestroy)(void *storage);
+	/* The index of the closure in its slab */
+	uint32 SlabIndex;
+	/* The index of the thread whose slab the closure came from */
+	uint32 OwnerThread;
+	alignas(std::max_align_t) char Storage[kStorageSize];
+};
+
 } // End of namespace ftl
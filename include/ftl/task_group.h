@@ -0,0 +1,131 @@
+/* FiberTaskingLib - A tasking library that uses fibers for efficient task switching
+ *
+ * This library was created as a proof of concept of the ideas presented by
+ * Christian Gyrling in his 2015 GDC Talk 'Parallelizing the Naughty Dog Engine Using Fibers'
+ *
+ * http://gdcvault.com/play/1022186/Parallelizing-the-Naughty-Dog-Engine
+ *
+ * FiberTaskingLib is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2015 - 2017
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+
+#include "ftl/task.h"
+#include "ftl/atomic_counter.h"
+#include "ftl/task_scheduler.h"
+
+#include <new>
+#include <type_traits>
+#include <utility>
+
+
+namespace ftl {
+
+/**
+ * Spawns callables as tasks, and waits for all of them to finish
+ *
+ * Unlike AddTask(), Run() only adds to the group's counter, so tasks can be spawned one at a time, by any task,
+ * while others are already running. Groups can be nested: a task started by one group can make its own group,
+ * and wait on it. The destructor waits for any tasks that are still running, so a group can't outlive its tasks
+ *
+ * Callables of up to TaskClosure::kStorageSize bytes are stored in a closure from the spawning thread's slab, so
+ * spawning doesn't allocate once the slab has warmed up. Bigger callables are moved to the heap
+ *
+ * NOTE: Groups can only be used from inside a task
+ */
+class TaskGroup {
+public:
+	/**
+	 * Creates an empty group
+	 *
+	 * @param taskScheduler    The TaskScheduler to run the tasks on
+	 */
+	explicit TaskGroup(TaskScheduler *taskScheduler)
+		: m_taskScheduler(taskScheduler),
+		  m_counter(taskScheduler) {
+	}
+	~TaskGroup() {
+		Wait();
+	}
+
+	TaskGroup(const TaskGroup &) = delete;
+	TaskGroup &operator=(const TaskGroup &) = delete;
+
+private:
+	TaskScheduler *m_taskScheduler;
+	/* The number of tasks in the group that haven't finished */
+	AtomicCounter m_counter;
+
+public:
+	/**
+	 * Spawns a task that calls 'function'
+	 *
+	 * @param function    A callable taking no arguments. It's moved, or copied, into the task
+	 */
+	template<typename F>
+	void Run(F &&function) {
+		typedef typename std::decay<F>::type Callable;
+
+		TaskClosure *closure = m_taskScheduler->AllocateClosure();
+		StoreCallable<Callable>(closure, std::forward<F>(function), std::integral_constant<bool, FitsInPlace<Callable>()>());
+
+		// Adding can't bring the counter to zero, which is the only value waited on, so there are no fibers to check
+		m_counter.m_value.fetch_add(1, std::memory_order_relaxed);
+		m_taskScheduler->SpawnClosure(closure, &m_counter);
+	}
+
+	/**
+	 * Waits for every task spawned so far to finish
+	 *
+	 * While it waits, the fiber runs the group's tasks spawned by this thread, instead of switching out right away
+	 */
+	void Wait() {
+		m_taskScheduler->HelpUntilZero(&m_counter);
+	}
+
+private:
+	template<typename Callable>
+	static constexpr bool FitsInPlace() {
+		return sizeof(Callable) <= TaskClosure::kStorageSize && alignof(Callable) <= alignof(std::max_align_t);
+	}
+
+	template<typename Callable, typename F>
+	static void StoreCallable(TaskClosure *closure, F &&function, std::true_type /* fitsInPlace */) {
+		new (closure->Storage) Callable(std::forward<F>(function));
+		closure->InvokeAndDestroy = InvokeInPlace<Callable>;
+	}
+	template<typename Callable, typename F>
+	static void StoreCallable(TaskClosure *closure, F &&function, std::false_type /* fitsInPlace */) {
+		*reinterpret_cast<Callable **>(closure->Storage) = new Callable(std::forward<F>(function));
+		closure->InvokeAndDestroy = InvokeOnHeap<Callable>;
+	}
+
+	template<typename Callable>
+	static void InvokeInPlace(void *storage) {
+		Callable *callable = reinterpret_cast<Callable *>(storage);
+		(*callable)();
+		callable->~Callable();
+	}
+	template<typename Callable>
+	static void InvokeOnHeap(void *storage) {
+		Callable *callable = *reinterpret_cast<Callable **>(storage);
+		(*callable)();
+		delete callable;
+	}
+};
+
+} // End of namespace ftl
@@ -0,0 +1,298 @@
+/* FiberTaskingLib - A tasking library that uses fibers for efficient task switching
+ *
+ * This library was created as a proof of concept of the ideas presented by
+ * Christian Gyrling in his 2015 GDC Talk 'Parallelizing the Naughty Dog Engine Using Fibers'
+ *
+ * http://gdcvault.com/play/1022186/Parallelizing-the-Naughty-Dog-Engine
+ *
+ * FiberTaskingLib is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2015 - 2017
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+
+#include "ftl/typedefs.h"
+#include "ftl/wait_free_queue.h"
+#include "ftl/mpmc_queue.h"
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+
+
+namespace ftl {
+
+/**
+ * The tasks that didn't fit in a bounded task queue
+ *
+ * Rarely used, so a lock is fine. OverflowSize lets the common, empty case skip the lock
+ */
+template<typename T>
+class OverflowList {
+public:
+	OverflowList()
+		: m_size(0) {
+	}
+
+private:
+	std::deque<T> m_items;
+	std::mutex m_lock;
+	std::atomic<std::size_t> m_size;
+
+public:
+	void PushBack(T value) {
+		std::lock_guard<std::mutex> lock(m_lock);
+		m_items.push_back(value);
+		m_size.store(m_items.size(), std::memory_order_release);
+	}
+
+	bool PopBack(T *value) {
+		if (m_size.load(std::memory_order_acquire) == 0) {
+			return false;
+		}
+
+		std::lock_guard<std::mutex> lock(m_lock);
+		if (m_items.empty()) {
+			return false;
+		}
+		*value = m_items.back();
+		m_items.pop_back();
+		m_size.store(m_items.size(), std::memory_order_release);
+		return true;
+	}
+
+	bool PopFront(T *value) {
+		if (m_size.load(std::memory_order_acquire) == 0) {
+			return false;
+		}
+
+		std::lock_guard<std::mutex> lock(m_lock);
+		if (m_items.empty()) {
+			return false;
+		}
+		*value = m_items.front();
+		m_items.pop_front();
+		m_size.store(m_items.size(), std::memory_order_release);
+		return true;
+	}
+
+	std::size_t Size() const {
+		return m_size.load(std::memory_order_relaxed);
+	}
+};
+
+/**
+ * A work-stealing deque on a fixed array, with an overflow list for the tasks that don't fit
+ *
+ * The same algorithm as WaitFreeQueue, but the array never grows or shrinks. So there are no retired arrays,
+ * and no epochs to track, at the cost of a lock once a thread has more than 'Capacity' tasks queued
+ */
+template<typename T, std::size_t Capacity = 1024>
+class BoundedDeque {
+	static_assert(Capacity >= 2 && !(Capacity & (Capacity - 1)), "Capacity must be a power of 2");
+
+public:
+	BoundedDeque()
+		: m_top(1), // m_top and m_bottom must start at 1
+		  m_bottom(1) { // Otherwise, the first Pop on an empty queue will underflow m_bottom
+	}
+
+	BoundedDeque(const BoundedDeque &) = delete;
+	BoundedDeque &operator=(const BoundedDeque &) = delete;
+
+private:
+	std::atomic<uint64> m_top;
+	// Cache-line pad
+	char pad[64];
+	std::atomic<uint64> m_bottom;
+	// Cache-line pad
+	char pad2[64];
+	T m_items[Capacity];
+	OverflowList<T> m_overflow;
+
+public:
+	void Push(T value) {
+		uint64 b = m_bottom.load(std::memory_order_relaxed);
+		uint64 t = m_top.load(std::memory_order_acquire);
+		// Once the array is full, keep going in the overflow until the owner has popped it empty, so Pop() stays LIFO
+		if (b - t >= Capacity || m_overflow.Size() != 0) {
+			m_overflow.PushBack(value);
+			return;
+		}
+		m_items[b & (Capacity - 1)] = value;
+
+		#if defined(FTL_STRONG_MEMORY_MODEL)
+			std::atomic_signal_fence(std::memory_order_release);
+		#else
+			std::atomic_thread_fence(std::memory_order_release);
+		#endif
+
+		m_bottom.store(b + 1, std::memory_order_relaxed);
+	}
+
+	bool Pop(T *value) {
+		// The overflow holds the newest tasks
+		if (m_overflow.PopBack(value)) {
+			return true;
+		}
+
+		uint64 b = m_bottom.load(std::memory_order_relaxed) - 1;
+		m_bottom.store(b, std::memory_order_relaxed);
+
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+
+		uint64 t = m_top.load(std::memory_order_relaxed);
+		bool result = true;
+		if (t <= b) {
+			/* Non-empty queue. */
+			*value = m_items[b & (Capacity - 1)];
+			if (t == b) {
+				/* Single last element in queue. */
+				if (!std::atomic_compare_exchange_strong_explicit(&m_top, &t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+					/* Failed race. */
+					result = false;
+				}
+				m_bottom.store(b + 1, std::memory_order_relaxed);
+			}
+		} else {
+			/* Empty queue. */
+			result = false;
+			m_bottom.store(b + 1, std::memory_order_relaxed);
+		}
+
+		return result;
+	}
+
+	bool Steal(T *value) {
+		uint64 t = m_top.load(std::memory_order_acquire);
+
+		#if defined(FTL_STRONG_MEMORY_MODEL)
+			std::atomic_signal_fence(std::memory_order_seq_cst);
+		#else
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+		#endif
+
+		uint64 b = m_bottom.load(std::memory_order_acquire);
+		if (t < b) {
+			/* Non-empty queue. */
+			*value = m_items[t & (Capacity - 1)];
+			return std::atomic_compare_exchange_strong_explicit(&m_top, &t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+		}
+
+		return m_overflow.PopFront(value);
+	}
+
+	/**
+	 * Gets the number of items in the queue
+	 *
+	 * NOTE: The value is only a snapshot. Other threads may be pushing and stealing concurrently
+	 *
+	 * @return    The approximate number of items in the queue
+	 */
+	std::size_t Size() const {
+		uint64 b = m_bottom.load(std::memory_order_relaxed);
+		uint64 t = m_top.load(std::memory_order_relaxed);
+		return (b > t ? static_cast<std::size_t>(b - t) : 0) + m_overflow.Size();
+	}
+
+	/* The array never changes size, so there is nothing to shrink or reclaim */
+	bool TryShrink() {
+		return false;
+	}
+	bool HasRetiredArrays() const {
+		return false;
+	}
+	void ReclaimRetiredArrays(std::atomic<uint64> *globalEpoch, uint64 safeEpoch) {
+		(void)globalEpoch;
+		(void)safeEpoch;
+	}
+};
+
+/**
+ * A task queue built on MpmcQueue, with an overflow list for the tasks that don't fit
+ *
+ * The owner and the thieves all take from the front, so the owner runs its tasks in the order they were queued,
+ * rather than newest first. Pushes from the owner never race with its own pops, but every operation is a CAS
+ */
+template<typename T, std::size_t Capacity = 1024>
+class MpmcTaskQueue {
+public:
+	MpmcTaskQueue()
+		: m_queue(Capacity) {
+	}
+
+	MpmcTaskQueue(const MpmcTaskQueue &) = delete;
+	MpmcTaskQueue &operator=(const MpmcTaskQueue &) = delete;
+
+private:
+	MpmcQueue<T> m_queue;
+	OverflowList<T> m_overflow;
+
+public:
+	void Push(T value) {
+		if (!m_queue.TryPush(value)) {
+			m_overflow.PushBack(value);
+		}
+	}
+
+	bool Pop(T *value) {
+		return m_queue.TryPop(value) || m_overflow.PopFront(value);
+	}
+
+	bool Steal(T *value) {
+		return Pop(value);
+	}
+
+	/**
+	 * Gets the number of items in the queue
+	 *
+	 * NOTE: The value is only a snapshot. Other threads may be pushing and popping concurrently
+	 *
+	 * @return    The approximate number of items in the queue
+	 */
+	std::size_t Size() const {
+		return m_queue.Size() + m_overflow.Size();
+	}
+
+	/* The queue never changes size, so there is nothing to shrink or reclaim */
+	bool TryShrink() {
+		return false;
+	}
+	bool HasRetiredArrays() const {
+		return false;
+	}
+	void ReclaimRetiredArrays(std::atomic<uint64> *globalEpoch, uint64 safeEpoch) {
+		(void)globalEpoch;
+		(void)safeEpoch;
+	}
+};
+
+/**
+ * The queue each worker thread keeps its task indices in. Chosen at build time with the FTL_TASK_QUEUE CMake option
+ *
+ * ChaseLev (the default): WaitFreeQueue. Grows and shrinks as needed
+ * Bounded:                BoundedDeque. A fixed array, and a locked overflow list
+ * Mpmc:                   MpmcTaskQueue. FIFO for the owner as well as the thieves
+ */
+#if defined(FTL_TASK_QUEUE_BOUNDED)
+	typedef BoundedDeque<uint32> TaskQueueBackend;
+#elif defined(FTL_TASK_QUEUE_MPMC)
+	typedef MpmcTaskQueue<uint32> TaskQueueBackend;
+#else
+	typedef WaitFreeQueue<uint32> TaskQueueBackend;
+#endif
+
+} // End of namespace ftl
@@ -27,12 +27,22 @@
 #include "ftl/thread_abstraction.h"
 #include "ftl/fiber.h"
 #include "ftl/task.h"
-#include "ftl/wait_free_queue.h"
+#include "ftl/scheduler_policy.h"
+#include "ftl/slab.h"
+#include "ftl/mpmc_queue.h"
+#include "ftl/scheduler_options.h"
+#include "ftl/schedule_log.h"
 
 #include <atomic>
 #include <vector>
 #include <climits>
 #include <memory>
+#include <string>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <deque>
+#include <unordered_map>
 
 
 namespace ftl {
@@ -52,7 +62,21 @@ public:
 
 private:
 	enum {
-		FTL_INVALID_INDEX = UINT_MAX
+		FTL_INVALID_INDEX = UINT_MAX,
+		/* A queue holding at least this many tasks has more work than its thread can start right away */
+		FTL_BACKLOG_SIZE = 2,
+		/* The capacity of each worker group's injection queue. Tasks that don't fit go to the group's overflow list */
+		FTL_INJECTION_QUEUE_SIZE = 4096,
+		/* The capacity of each of a worker's mailbox queues. Tasks that don't fit go to the queue's overflow list */
+		FTL_MAILBOX_SIZE = 256,
+		/* The stack size of the fibers in the pool */
+		FTL_FIBER_STACK_SIZE = 512000,
+		/* How often WaitForSharedCounter() checks its counter, in microseconds */
+		FTL_SHARED_COUNTER_POLL_US = 20,
+		/* How many tasks a fiber can have nested on its stack by helping in TaskGroup::Wait() */
+		FTL_MAX_HELP_DEPTH = 8,
+		/* How many elements of a task batch run between checks for whether to split the batch. See AddTaskBatch() */
+		FTL_BATCH_GRAIN = 64
 	};
 
 	std::size_t m_numThreads;
@@ -67,9 +91,61 @@ private:
 	 * Each atomic acts as a lock to ensure that threads do not try to use the same fiber at the same time
 	 */
 	std::atomic<bool> *m_freeFibers;
+	/**
+	 * The number of fibers that have been, or are being, created. Fibers are created in index order, so the rest of
+	 * m_fibers is default constructed. See SchedulerOptions::FiberCreation
+	 */
+	std::atomic<std::size_t> m_numCreatedFibers;
+	/* Idle threads create fibers until there are this many */
+	std::atomic<std::size_t> m_fiberCreationTarget;
+	/**
+	 * When SchedulerOptions::HugePages is on, the fiber stacks and m_tls live in these regions, instead of being
+	 * allocated one by one. See AllocateHugePages()
+	 */
+	void *m_stackRegion;
+	void *m_tlsRegion;
+	HugePageBacking m_hugePageBacking;
+	/* See SchedulerOptions::PrefaultStackBytes */
+	std::size_t m_prefaultStackBytes;
+	/* The number of threads that haven't finished faulting in their share of the fiber stacks */
+	std::atomic<uint> m_numPrefaultingThreads;
+
+	/* See SchedulerOptions::SharedPool */
+	SharedTaskPool *m_sharedPool;
+	/* Whether tasks are pushed to, and taken from, m_sharedPool. If not, shared tasks run as local tasks */
+	bool m_shareTasks;
+	/* See SchedulerOptions::Transport */
+	RemoteTaskTransport *m_transport;
+	/* See SchedulerOptions::RemoteOffloadThreshold */
+	uint m_remoteOffloadThreshold;
+
+	/* A shared task taken from the pool, or one that didn't fit in it. It's freed once it has run */
+	struct SharedTaskBundle {
+		SharedTask Task;
+		uint32 CounterIndex;
+	};
 	
 	std::atomic<bool> m_initialized;
 	std::atomic<bool> m_quit;
+	/**
+	 * The reclamation epoch for the arrays retired by the task queues. See WaitFreeQueue::ReclaimRetiredArrays()
+	 * Each thread publishes the value it last observed in ThreadLocalStorage::QuiescentEpoch
+	 */
+	std::atomic<uint64> m_epoch;
+
+	/**
+	 * Threads above m_minActiveThreads are parked after being idle for m_parkDelay. Threads are only woken if
+	 * fewer than m_maxActiveThreads are active. See SetActiveThreadLimits()
+	 */
+	std::atomic<uint> m_minActiveThreads;
+	std::atomic<uint> m_maxActiveThreads;
+	std::chrono::milliseconds m_parkDelay;
+	/* The number of threads that aren't parked. Only modified while holding m_parkingMutex */
+	std::atomic<uint> m_numActiveThreads;
+	/* The number of parked threads. Only modified while holding m_parkingMutex */
+	std::atomic<uint> m_numParkedThreads;
+	/* Guards parking and waking threads. Parking is rare, so a single lock is fine */
+	std::mutex m_parkingMutex;
 	
 	enum class FiberDestination {
 		None = 0,
@@ -82,10 +158,162 @@ private:
 	* Counter is the counter for the task(group). It will be decremented when the task completes
 	*/
 	struct TaskBundle {
+		/* Constructors, rather than default member initializers, so the bundle can still be brace initialized in C++11 */
+		TaskBundle()
+			: TaskToExecute(),
+			  Counter(nullptr),
+			  Id(0),
+			  ParentFunction(nullptr) {
+		}
+		TaskBundle(Task taskToExecute, AtomicCounter *counter)
+			: TaskToExecute(taskToExecute),
+			  Counter(counter),
+			  Id(0),
+			  ParentFunction(nullptr) {
+		}
+
 		Task TaskToExecute;
 		AtomicCounter *Counter;
+		/* Identifies the task in the schedule log. Only set while recording or replaying */
+		uint64 Id;
+		/* The function of the task that added this one. Only set with SchedulerOptions::TrackParentTasks */
+		TaskFunction ParentFunction;
+	};
+
+	/* The task a fiber is running, and the function of the task that added it */
+	struct TaskLink {
+		TaskFunction Function;
+		TaskFunction ParentFunction;
+	};
+
+	/* A fiber that is ready to resume, along with the flag that signals it has been fully switched out of */
+	struct ReadyFiberBundle {
+		std::size_t FiberIndex;
+		std::atomic<bool> *FiberStoredFlag;
 	};
 
+	/**
+	 * A queue of tasks given to a worker group or thread by other threads
+	 * Tasks that don't fit in Queue go to Overflow. Waiting for space instead could deadlock, if two threads were
+	 * both waiting to give each other work
+	 */
+	struct TaskInbox {
+		explicit TaskInbox(std::size_t capacity)
+			: Queue(capacity),
+			  OverflowSize(0) {
+		}
+
+		MpmcQueue<TaskBundle> Queue;
+		std::deque<TaskBundle> Overflow;
+		std::mutex OverflowLock;
+		std::atomic<std::size_t> OverflowSize;
+
+		/* Whether the inbox holds any tasks. The result is only a snapshot */
+		bool HasTasks() const {
+			return Queue.Size() != 0 || OverflowSize.load(std::memory_order_relaxed) != 0;
+		}
+	};
+
+	/**
+	 * A set of worker threads that share their work. See WorkerGroupOptions
+	 * The threads of a group have consecutive indices, starting at FirstThread
+	 */
+	struct WorkerGroup {
+		WorkerGroup(const WorkerGroupOptions &options, std::size_t firstThread, std::size_t numThreads, std::size_t readyFiberCapacity)
+			: Name(options.Name),
+			  FirstThread(firstThread),
+			  NumThreads(numThreads),
+			  StealFromOtherGroups(options.StealFromOtherGroups),
+			  Injections(FTL_INJECTION_QUEUE_SIZE),
+			  ReadyFibers(readyFiberCapacity) {
+		}
+
+		std::string Name;
+		std::size_t FirstThread;
+		std::size_t NumThreads;
+		bool StealFromOtherGroups;
+		/* Tasks added to this group by threads of other groups */
+		TaskInbox Injections;
+		/* Fibers that waited in this group, and were made ready by threads of other groups */
+		MpmcQueue<ReadyFiberBundle> ReadyFibers;
+
+		/* Whether other groups have given this group any tasks or fibers. The result is only a snapshot */
+		bool HasInjectedWork() const {
+			return Injections.HasTasks() || ReadyFibers.Size() != 0;
+		}
+	};
+	std::vector<std::unique_ptr<WorkerGroup> > m_groups;
+
+	/* The tasks sent to a specific worker thread. See Affinity */
+	struct Mailbox {
+		Mailbox()
+			: Preferred(FTL_MAILBOX_SIZE),
+			  Strict(FTL_MAILBOX_SIZE),
+			  ServicedAt(0) {
+		}
+
+		/* Tasks that other threads can steal after m_mailboxStealDelay */
+		TaskInbox Preferred;
+		/* Tasks that only the owner can run */
+		TaskInbox Strict;
+		/**
+		 * When the owner last took a task from Preferred, or when a task arrived in an empty Preferred, in
+		 * nanoseconds of steady_clock. Other threads only steal once this is m_mailboxStealDelay in the past
+		 */
+		std::atomic<int64> ServicedAt;
+	};
+	/* The mailbox of each thread. Indices correspond 1 to 1 with m_tls */
+	std::vector<std::unique_ptr<Mailbox> > m_mailboxes;
+	std::chrono::nanoseconds m_mailboxStealDelay;
+	/* The group each fiber was running in when it last waited on a counter. Indices correspond 1 to 1 with m_fibers */
+	uint *m_fiberGroups;
+	/* The number of tasks each fiber is running inside HelpUntilZero(). Indices correspond 1 to 1 with m_fibers */
+	uint *m_fiberHelpDepths;
+	/* The innermost task each fiber is running. Only kept with SchedulerOptions::TrackParentTasks */
+	bool m_trackParentTasks;
+	TaskLink *m_fiberTaskLinks;
+	/* What a thread does with the fibers its tasks make ready. See SchedulerOptions::Resume */
+	ResumePolicy m_resumePolicy;
+
+	/* The callbacks for profilers and other tools. See SchedulerOptions::Hooks */
+	SchedulerHooks m_hooks;
+
+	/* Whether the scheduling decisions are being recorded or replayed. See SchedulerOptions::Schedule */
+	ScheduleMode m_scheduleMode;
+	ScheduleLog *m_scheduleLog;
+	std::chrono::milliseconds m_replayTimeout;
+	/* Set once the replay gives up on the log. From then on, the replay hands out tasks and fibers freely */
+	std::atomic<bool> m_replayDiverged;
+	/* The number of replay events done by all the threads. The replay has only stalled if this stops changing */
+	std::atomic<uint64> m_replayProgress;
+	/**
+	 * While replaying, spawned tasks and ready fibers don't go in the queues. They wait here, by id, for the thread
+	 * the log assigns them to
+	 */
+	std::mutex m_replayLock;
+	struct ReplayTask {
+		TaskBundle Bundle;
+		/* The worker group the task was added to. Only matters once the replay has diverged */
+		uint Group;
+	};
+	std::unordered_map<uint64, ReplayTask> m_replayTasks;
+	std::unordered_map<uint64, ReadyFiberBundle> m_replayFibers;
+	/* The id of the wait each fiber is in. Only set while recording or replaying. Indices correspond 1 to 1 with m_fibers */
+	uint64 *m_fiberWaitIds;
+
+	/* A task added with AddDelayedTask(). It's moved to the queues once DueTime has passed */
+	struct DelayedTask {
+		std::chrono::steady_clock::time_point DueTime;
+		TaskBundle Bundle;
+		/* The worker group to add the task to */
+		uint Group;
+	};
+	/* A min-heap of the delayed tasks, ordered by DueTime */
+	std::vector<DelayedTask> m_delayedTasks;
+	std::mutex m_delayedTasksLock;
+	/* The size of m_delayedTasks. Lets GetNextTask() skip the lock when there's nothing to check */
+	std::atomic<std::size_t> m_numDelayedTasks;
+
 	struct PinnedWaitingFiberBundle {
 		PinnedWaitingFiberBundle(std::size_t fiberIndex, AtomicCounter *counter, uint targetValue)
 			: FiberIndex(fiberIndex), 
@@ -105,8 +333,22 @@ private:
 			  OldFiberIndex(FTL_INVALID_INDEX),
 			  OldFiberDestination(FiberDestination::None),
 			  TaskQueue(),
+			  TaskSlab(),
 			  LastSuccessfulSteal(1), 
-			  OldFiberStoredFlag(nullptr) { }
+			  FiberSearchStart(0),
+			  OldFiberStoredFlag(nullptr),
+			  HandoffFiber{FTL_INVALID_INDEX, nullptr},
+			  PendingCounter(nullptr),
+			  PendingDecrements(0),
+			  QuiescentEpoch(0),
+			  NextTaskIndex(Slab<TaskBundle>::kInvalidIndex),
+			  IsIdle(false),
+			  Parked(false),
+			  Group(0),
+			  NextScheduleId(0),
+			  ReplayCursor(0),
+			  ReplayStalled(false),
+			  ReplayStalledProgress(0) { }
 
 	public:
 		/**
@@ -124,14 +366,63 @@ private:
 		std::size_t OldFiberIndex;
 		/* Where OldFiber should be stored when we call CleanUpPoolAndWaiting() */
 		FiberDestination OldFiberDestination;
-		/* The queue of waiting tasks */
-		WaitFreeQueue<TaskBundle> TaskQueue;
+		/**
+		 * The queue of waiting tasks
+		 * The queue only holds indices into TaskSlab, so pushes and steals move 4 bytes instead of a whole TaskBundle
+		 * The queue implementation is picked at build time. See SchedulerPolicy
+		 */
+		SchedulerPolicy::Queue TaskQueue;
+		/* The storage for the tasks in TaskQueue. Thieves free the slots of the tasks they steal */
+		Slab<TaskBundle> TaskSlab;
+		/* The storage for the callables spawned by TaskGroups on this thread */
+		Slab<TaskClosure> ClosureSlab;
 		/* The last queue that we successfully stole from. This is an offset index from the current thread index */
 		std::size_t LastSuccessfulSteal;
+		/**
+		 * Where this thread starts looking for a free fiber. Each thread starts in its own share of the pool, so
+		 * threads mostly reuse the same fibers, and don't fight over the first few. See PrefaultFiberStacks()
+		 */
+		std::size_t FiberSearchStart;
 		/* List of pinned tasks to this thread */
 		std::vector<PinnedWaitingFiberBundle> PinnedTasks;
 		std::atomic<bool> *OldFiberStoredFlag;
 		std::vector<std::pair<std::size_t, std::atomic<bool> *> > ReadyFibers;
+		/* The fiber to switch to as soon as the current task returns. See ResumePolicy::Handoff */
+		ReadyFiberBundle HandoffFiber;
+		/* The fan-in counter whose task completions are currently being accumulated by this thread */
+		AtomicCounter *PendingCounter;
+		/* The number of completed tasks that haven't been subtracted from PendingCounter yet */
+		uint PendingDecrements;
+		/* The last value of m_epoch this thread observed while it wasn't stealing */
+		std::atomic<uint64> QuiescentEpoch;
+		/**
+		 * The index in TaskSlab of the most recently spawned task, which is the next one this thread will run, or
+		 * kInvalidIndex. It bypasses TaskQueue, since its data is the most likely to still be in cache. When a newer
+		 * task is spawned, this one is demoted to TaskQueue
+		 *
+		 * Thieves take it with an exchange once TaskQueue is empty. Otherwise a task that spawns work, and then spins
+		 * on it without yielding, would strand the work in the slot
+		 */
+		std::atomic<uint32> NextTaskIndex;
+		/* Whether the thread failed to find a task the last time it looked */
+		bool IsIdle;
+		/* When the thread started being idle */
+		std::chrono::steady_clock::time_point IdleSince;
+		/* Whether the thread is parked. Guarded by m_parkingMutex */
+		bool Parked;
+		/* Signaled when the thread should unpark */
+		std::condition_variable ParkCondition;
+		/* The index of the worker group this thread belongs to */
+		uint Group;
+		/* The number of schedule ids this thread has handed out. See ScheduleEvent */
+		uint64 NextScheduleId;
+		/* The index of the next event this thread has to replay */
+		std::size_t ReplayCursor;
+		/* Whether the thread is waiting for the task or fiber of the next replay event, and since when */
+		bool ReplayStalled;
+		std::chrono::steady_clock::time_point ReplayStalledSince;
+		/* The value of m_replayProgress when the thread last checked for a stall */
+		uint64 ReplayStalledProgress;
 
 	private:
 		/* Cache-line pad */
@@ -152,6 +443,10 @@ private:
 	 * This makes the public API cleaner
 	 */
 	friend class AtomicCounter;
+	/* And CoTask, so finished coroutines can use DecrementTaskCounter() */
+	friend class CoTask;
+	/* And TaskGroup, so it can spawn closures into a counter it has already incremented */
+	friend class TaskGroup;
 
 
 public:
@@ -162,12 +457,24 @@ public:
 	 * Therefore, the current thread will save it's current state, and then switch execution to the the 'mainTask' fiber. When 'mainTask'
 	 * finishes, the thread will switch back to the saved state, and Run() will return.
 	 *
+	 * Worker thread i, including the calling thread as worker 0, is pinned to the i-th CPU the process is allowed to run on.
+	 * Use the SchedulerOptions overload to pick a different PinningPolicy
+	 *
 	 * @param fiberPoolSize     The size of the fiber pool. The fiber pool is used to run new tasks when the current task is waiting on a counter
 	 * @param mainTask          The main task to run
 	 * @param mainTaskArg       The argument to pass to 'mainTask'
 	 * @param threadPoolSize    The size of the thread pool to run. 0 corresponds to NumHardwareThreads()
 	 */
 	void Run(uint fiberPoolSize, TaskFunction mainTask, void *mainTaskArg = nullptr, uint threadPoolSize = 0);
+	/**
+	 * Initializes the TaskScheduler and then starts executing 'mainTask'
+	 * See the overload above
+	 *
+	 * @param options           The options for the fiber pool and the worker threads
+	 * @param mainTask          The main task to run
+	 * @param mainTaskArg       The argument to pass to 'mainTask'
+	 */
+	void Run(const SchedulerOptions &options, TaskFunction mainTask, void *mainTaskArg = nullptr);
 
 	/**
 	 * Adds a task to the internal queue.
@@ -184,6 +491,125 @@ public:
 	 * @param counter     An atomic counter corresponding to the task group as a whole. Initially it will be set to numTasks. When each task completes, it will be decremented.
 	 */
 	void AddTasks(uint numTasks, Task *tasks, AtomicCounter *counter = nullptr);
+	/**
+	 * Adds a task to a worker group
+	 * If the group is the current thread's group, this is the same as AddTask(task, counter)
+	 *
+	 * @param task       The task to queue
+	 * @param counter    An atomic counter corresponding to this task. Initially it will be set to 1. When the task completes, it will be decremented.
+	 * @param group      The index of the worker group to run the task in. See GetWorkerGroup()
+	 */
+	void AddTask(Task task, AtomicCounter *counter, uint group);
+	/**
+	 * Adds a group of tasks to a worker group
+	 * If the group is the current thread's group, this is the same as AddTasks(numTasks, tasks, counter)
+	 *
+	 * @param numTasks    The number of tasks
+	 * @param tasks       The tasks to queue
+	 * @param counter     An atomic counter corresponding to the task group as a whole. Initially it will be set to numTasks. When each task completes, it will be decremented.
+	 * @param group       The index of the worker group to run the tasks in. See GetWorkerGroup()
+	 */
+	void AddTasks(uint numTasks, Task *tasks, AtomicCounter *counter, uint group);
+	/**
+	 * Sends a task to a specific worker thread's mailbox
+	 *
+	 * @param task        The task to queue
+	 * @param counter     An atomic counter corresponding to this task. Initially it will be set to 1. When the task completes, it will be decremented.
+	 * @param affinity    The worker to run the task on, and whether other workers may steal it
+	 */
+	void AddTask(Task task, AtomicCounter *counter, Affinity affinity);
+	/**
+	 * Sends each of a group of tasks to a specific worker thread's mailbox
+	 * Every worker has to exist. Otherwise, this prints an error and aborts
+	 *
+	 * @param numTasks      The number of tasks
+	 * @param tasks         The tasks to queue
+	 * @param counter       An atomic counter corresponding to the task group as a whole. Initially it will be set to numTasks. When each task completes, it will be decremented.
+	 * @param affinities    The worker of each task, and whether other workers may steal it
+	 */
+	void AddTasks(uint numTasks, Task *tasks, AtomicCounter *counter, const Affinity *affinities);
+	/**
+	 * Adds a task to the current thread's worker group once 'delay' has passed
+	 *
+	 * The task is added by the next thread that looks for work after the delay, so it may start late, but never early
+	 *
+	 * @param task       The task to queue
+	 * @param delay      How long to wait before adding the task
+	 * @param counter    An atomic counter corresponding to this task. Initially it will be set to 1. When the task completes, it will be decremented.
+	 */
+	void AddDelayedTask(Task task, std::chrono::steady_clock::duration delay, AtomicCounter *counter = nullptr);
+	/**
+	 * Adds 'count' tasks that all run 'function', each with one element of 'args' as its argument
+	 *
+	 * The batch is queued as a single task covering the whole range. The thread running it calls 'function' directly
+	 * for each element, and splits the upper half of what's left off into a new task whenever its own queue has run
+	 * dry, so idle threads have something to steal. That saves a task and a queue operation per element, compared
+	 * to AddTasks()
+	 *
+	 * While the schedule is recorded or replayed, batches aren't split
+	 *
+	 * @param function    The function to run for each element
+	 * @param args        The first element. Element i is passed as args + i * stride
+	 * @param stride      The size of each element, in bytes. With 0, every call gets 'args'
+	 * @param count       The number of elements
+	 * @param counter     Initially it will be set to count. It's decremented once per chunk of up to FTL_BATCH_GRAIN
+	 *                    elements, so it reaches 0 once every element has completed.
+	 *                    However, the counter will skip intermediate values, so WaitForCounter() should only
+	 *                    target 0
+	 */
+	void AddTaskBatch(TaskFunction function, void *args, std::size_t stride, uint count, AtomicCounter *counter = nullptr);
+	/**
+	 * The same as AddTaskBatch() above, but the function is a template argument, so it can be inlined into the loop
+	 * over the elements
+	 */
+	template <TaskFunction Function>
+	void AddTaskBatch(void *args, std::size_t stride, uint count, AtomicCounter *counter = nullptr) {
+		AddBatch(RunBatchElements<Function>, Function, args, stride, count, counter);
+	}
+	/**
+	 * Adds tasks to the shared task pool, so any process attached to it can run them. See SchedulerOptions::SharedPool
+	 * Tasks that don't fit in the pool, or all of them if there is no pool, are run by this process
+	 *
+	 * @param numTasks    The number of tasks
+	 * @param tasks       The tasks to add
+	 * @param counter     A counter allocated from the pool. Initially it will be set to numTasks. When each task completes, it will be decremented. Can be nullptr
+	 */
+	void AddSharedTasks(uint numTasks, const SharedTask *tasks, const SharedCounter *counter = nullptr);
+	/**
+	 * Yields execution to other tasks until counter == value
+	 *
+	 * Other processes can't wake a fiber, so the fiber sleeps, and checks the counter every FTL_SHARED_COUNTER_POLL_US
+	 * microseconds. See AddDelayedTask()
+	 *
+	 * @param counter    A counter allocated from the shared task pool
+	 * @param value      The value to wait for
+	 */
+	void WaitForSharedCounter(SharedCounter counter, uint value);
+	/**
+	 * Adds tasks that can run in this process, or in the worker processes of SchedulerOptions::Transport
+	 *
+	 * Tasks run locally until the task queue of this thread backs up past SchedulerOptions::RemoteOffloadThreshold.
+	 * After that, they're shipped to the workers. Either way, each task's result is copied to its Result, and then
+	 * the counter is decremented
+	 *
+	 * The functions are looked up in SchedulerOptions::Transport. Without one, this prints an error and aborts
+	 *
+	 * @param numTasks    The number of tasks
+	 * @param tasks       The tasks to add
+	 * @param counter     An atomic counter corresponding to the tasks. Initially it will be set to numTasks. When each task completes, it will be decremented.
+	 */
+	void AddRemoteTasks(uint numTasks, const RemoteTask *tasks, AtomicCounter *counter = nullptr);
+	/**
+	 * Adds a task from a thread that doesn't belong to the scheduler, like an IO thread
+	 *
+	 * Unlike AddTask(), the counter isn't set. It's only decremented once the task completes, so the caller has
+	 * to account for the task beforehand. The task isn't recorded in the schedule log
+	 *
+	 * @param task       The task to add
+	 * @param counter    The counter to decrement once the task completes. Can be nullptr
+	 * @param group      The worker group to run the task in
+	 */
+	void AddExternalTask(Task task, AtomicCounter *counter, uint group);
 
 	/**
 	 * Yields execution to another task until counter == value
@@ -201,8 +627,191 @@ public:
 	 * @return    The index of the current thread
 	 */
 	std::size_t GetCurrentThreadIndex();
+	/**
+	 * Gets the number of worker threads, including the main thread
+	 *
+	 * @return    The number of threads
+	 */
+	std::size_t GetNumThreads() const;
+
+	/**
+	 * Looks up a worker group by name
+	 *
+	 * @param name    The name given in WorkerGroupOptions::Name
+	 * @return        The index of the group. UINT_MAX if there is no group with that name
+	 */
+	uint GetWorkerGroup(const char *name) const;
+	/**
+	 * Gets the worker group of the current thread
+	 *
+	 * @return    The index of the current thread's group
+	 */
+	uint GetCurrentWorkerGroup();
+	/**
+	 * Gets the number of worker groups
+	 *
+	 * @return    The number of worker groups
+	 */
+	uint GetNumWorkerGroups() const;
+
+	/**
+	 * Gets the function of the task that added the task running on the calling fiber
+	 *
+	 * Profilers can call this from SchedulerHooks::TaskBegin, and chain the results to stitch logical stacks
+	 * together. See SchedulerOptions::TrackParentTasks
+	 *
+	 * @return    The parent's function. nullptr if the task was added from outside a task, like the main task, or
+	 *            if parent tasks aren't tracked
+	 */
+	TaskFunction GetParentTaskFunction();
+
+	/**
+	 * Changes how many worker threads may be active at once
+	 *
+	 * Idle threads above 'minActiveThreads' are parked after SchedulerOptions::ParkDelayMs. If more than
+	 * 'maxActiveThreads' threads are active, threads are parked as soon as they're idle. Parked threads are woken
+	 * when tasks back up in the queues, as long as fewer than 'maxActiveThreads' threads are active.
+	 * Both values are clamped to [1, number of threads]
+	 *
+	 * NOTE: This can only be called after Run() has started, ie. from inside a task
+	 * NOTE: This does nothing if the SchedulerPolicy has no parking
+	 *
+	 * @param minActiveThreads    The number of threads that are never parked
+	 * @param maxActiveThreads    The maximum number of threads that may be active
+	 */
+	void SetActiveThreadLimits(uint minActiveThreads, uint maxActiveThreads);
+	/**
+	 * Gets the number of worker threads that aren't parked
+	 *
+	 * @return    The number of active threads
+	 */
+	uint GetNumActiveThreads() const;
+
+	/**
+	 * Whether the last replay gave up on the log. See SchedulerOptions::ReplayTimeoutMs
+	 *
+	 * @return    True if the run stopped following the log at some point
+	 */
+	bool HasReplayDiverged() const;
+
+	/**
+	 * The kind of pages the fiber stacks ended up on. See SchedulerOptions::HugePages
+	 *
+	 * @return    The backing of the fiber stacks. HugePageBacking::None if huge pages were off, or unavailable
+	 */
+	HugePageBacking GetHugePageBacking() const;
+	/**
+	 * Gets the shared task pool the scheduler was run with. See SchedulerOptions::SharedPool
+	 *
+	 * @return    The pool, or nullptr if there is none
+	 */
+	SharedTaskPool *GetSharedPool() const {
+		return m_sharedPool;
+	}
+	/**
+	 * Gets the transport the scheduler was run with. See SchedulerOptions::Transport
+	 *
+	 * @return    The transport, or nullptr if there is none
+	 */
+	RemoteTaskTransport *GetTransport() const {
+		return m_transport;
+	}
 
 private:
+	/**
+	 * The schedule mode. Always ScheduleMode::Normal if the policy has no schedule log, so the compiler can drop
+	 * the recording and replaying code
+	 *
+	 * @return    Whether the schedule is being recorded or replayed
+	 */
+	ScheduleMode GetScheduleMode() const {
+		return SchedulerPolicy::kScheduleLog ? m_scheduleMode : ScheduleMode::Normal;
+	}
+	/**
+	 * Whether tasks are pushed to, and taken from, the shared task pool. Always false if the policy has no shared pool
+	 *
+	 * @return    True if tasks are shared with other processes
+	 */
+	bool SharesTasks() const {
+		return SchedulerPolicy::kSharedPool && m_shareTasks;
+	}
+	/**
+	 * Whether any threads are parked. Always false if the policy has no parking
+	 *
+	 * NOTE: The value is only a snapshot
+	 *
+	 * @return    True if a thread may need waking
+	 */
+	bool HasParkedThreads() const {
+		return SchedulerPolicy::kParking && m_numParkedThreads.load(std::memory_order_relaxed) != 0;
+	}
+
+	/**
+	 * Records the task running on the current fiber as the parent of 'bundle', if parent tasks are tracked
+	 *
+	 * @param tls       The tls of the current thread
+	 * @param bundle    The task being added
+	 */
+	void LinkParentTask(const ThreadLocalStorage &tls, TaskBundle *bundle) const {
+		if (m_trackParentTasks) {
+			bundle->ParentFunction = m_fiberTaskLinks[tls.CurrentFiberIndex].Function;
+		}
+	}
+	/**
+	 * Records the task a fiber is about to run, if parent tasks are tracked
+	 *
+	 * @param fiberIndex    The fiber
+	 * @param bundle        The task
+	 * @return              The task the fiber was running before. Restore it once the task returns, if it's nested
+	 */
+	TaskLink BeginTaskLink(std::size_t fiberIndex, const TaskBundle &bundle) {
+		TaskLink previous = {nullptr, nullptr};
+		if (m_trackParentTasks) {
+			previous = m_fiberTaskLinks[fiberIndex];
+			m_fiberTaskLinks[fiberIndex] = {bundle.TaskToExecute.Function, bundle.ParentFunction};
+		}
+		return previous;
+	}
+
+	/**
+	 * Calls a fiber hook, if it's set. Compiles to nothing if the policy has no hooks
+	 *
+	 * @param hook           The hook to call. Can be nullptr
+	 * @param threadIndex    The index of the current thread
+	 * @param fiberIndex     The fiber switching in or out
+	 */
+	void FireFiberHook(FiberHook hook, std::size_t threadIndex, std::size_t fiberIndex) const {
+		if (SchedulerPolicy::kHooks && hook != nullptr) {
+			hook(m_hooks.Context, threadIndex, fiberIndex);
+		}
+	}
+	/**
+	 * Calls a task hook, if it's set. Compiles to nothing if the policy has no hooks
+	 *
+	 * @param hook    The hook to call. Can be nullptr
+	 * @param task    The task beginning or ending
+	 */
+	void FireTaskHook(TaskHook hook, const Task &task) {
+		if (SchedulerPolicy::kHooks && hook != nullptr) {
+			// The task may have waited and resumed on a different thread, so we look the thread up every time
+			std::size_t threadIndex = GetCurrentThreadIndex();
+			hook(m_hooks.Context, threadIndex, m_tls[threadIndex].CurrentFiberIndex, task);
+		}
+	}
+	/**
+	 * Calls a wait hook, if it's set. Compiles to nothing if the policy has no hooks
+	 *
+	 * @param hook           The hook to call. Can be nullptr
+	 * @param threadIndex    The index of the current thread
+	 * @param fiberIndex     The waiting fiber
+	 * @param counter        The counter being waited on
+	 */
+	void FireWaitHook(WaitHook hook, std::size_t threadIndex, std::size_t fiberIndex, const AtomicCounter *counter) const {
+		if (SchedulerPolicy::kHooks && hook != nullptr) {
+			hook(m_hooks.Context, threadIndex, fiberIndex, counter);
+		}
+	}
+
 	/**
 	 * Pops the next task off the queue into nextTask. If there are no tasks in the
 	 * the queue, it will return false.
@@ -211,18 +820,359 @@ private:
 	 * @return            True: Successfully popped a task out of the queue
 	 */
 	bool GetNextTask(TaskBundle *nextTask);
+	/**
+	 * Pops the next task spawned by this thread, ie. NextTaskIndex, then the thread's own queue
+	 *
+	 * @param tls         The thread local storage of the current thread
+	 * @param nextTask    If there is a local task, will be filled with it
+	 * @return            True: Successfully popped a task
+	 */
+	bool PopLocalTask(ThreadLocalStorage &tls, TaskBundle *nextTask);
+	/**
+	 * Allocates a closure from the current thread's slab
+	 *
+	 * @return    The closure. Its Storage is uninitialized
+	 */
+	TaskClosure *AllocateClosure();
+	/**
+	 * Adds a task that runs a closure, without touching its counter. The caller must have already counted the task
+	 *
+	 * NOTE: This has to be called on the thread that allocated the closure
+	 *
+	 * @param closure     The closure, with its callable stored
+	 * @param counter     The counter the task decrements when it finishes
+	 * @param function    The TaskFunction that runs the closure
+	 */
+	void SpawnClosure(TaskClosure *closure, AtomicCounter *counter, TaskFunction function = RunClosure);
+	/**
+	 * The TaskFunction for closures. Runs the closure, and frees it
+	 *
+	 * @param taskScheduler    The TaskScheduler
+	 * @param arg              The TaskClosure
+	 */
+	static void RunClosure(TaskScheduler *taskScheduler, void *arg);
+	/**
+	 * Frees a closure back to the slab of the thread it was allocated on
+	 *
+	 * @param closure    The closure to free
+	 */
+	void FreeClosure(TaskClosure *closure);
+
+	/* Runs elements [begin, end) of a task batch */
+	typedef void (*BatchRunner)(TaskScheduler *taskScheduler, TaskFunction function, char *args, std::size_t stride, uint begin, uint end);
+	/* The part of a task batch one task runs. Stored in a TaskClosure */
+	struct TaskBatchRange {
+		BatchRunner Runner;
+		TaskFunction Function;
+		char *Args;
+		std::size_t Stride;
+		uint Begin;
+		uint End;
+		AtomicCounter *Counter;
+	};
+	static_assert(sizeof(TaskBatchRange) <= TaskClosure::kStorageSize, "A TaskBatchRange has to fit in a TaskClosure");
+
+	template <TaskFunction Function>
+	static void RunBatchElements(TaskScheduler *taskScheduler, TaskFunction, char *args, std::size_t stride, uint begin, uint end) {
+		for (uint i = begin; i < end; ++i) {
+			Function(taskScheduler, args + i * stride);
+		}
+	}
+	static void RunBatchElementsIndirect(TaskScheduler *taskScheduler, TaskFunction function, char *args, std::size_t stride, uint begin, uint end);
+	/**
+	 * Adds a task batch. See AddTaskBatch()
+	 *
+	 * @param runner      Runs the elements
+	 * @param function    The function to run for each element
+	 * @param args        The first element
+	 * @param stride      The size of each element, in bytes
+	 * @param count       The number of elements
+	 * @param counter     Set to count. Can be nullptr
+	 */
+	void AddBatch(BatchRunner runner, TaskFunction function, void *args, std::size_t stride, uint count, AtomicCounter *counter);
+	/**
+	 * The TaskFunction for task batches. Runs a TaskBatchRange, splitting it while other threads could use the work
+	 *
+	 * @param taskScheduler    The TaskScheduler
+	 * @param arg              The TaskClosure holding the TaskBatchRange
+	 */
+	static void RunTaskBatch(TaskScheduler *taskScheduler, void *arg);
+	/**
+	 * Moves the upper half of a range into a new task on the current thread's queue, where other threads can steal it
+	 *
+	 * @param tls      The tls of the current thread
+	 * @param range    The range to split. Keeps the lower half
+	 */
+	void SplitTaskBatch(ThreadLocalStorage &tls, TaskBatchRange *range);
+	/**
+	 * Waits for 'counter' to reach zero, running the tasks of 'counter' this thread has spawned while it waits
+	 *
+	 * Helped tasks run directly on the waiting fiber, which skips a fiber switch for every child. Since each one
+	 * nests on the fiber's stack, the nesting is limited to FTL_MAX_HELP_DEPTH. Only the thread's next local task
+	 * is helped with, and only if it decrements 'counter'. An unrelated task could wait on something the caller
+	 * only does after the wait, and deadlock on top of the caller's frame. Tasks of other threads aren't stolen,
+	 * so the wait doesn't end up running unrelated long tasks. Once there is nothing left to help with, this falls
+	 * back to WaitForCounter()
+	 *
+	 * @param counter    The counter to wait for
+	 */
+	void HelpUntilZero(AtomicCounter *counter);
 	/**
 	 * Gets the index of the next available fiber in the pool
 	 *
 	 * @return    The index of the next available fiber in the pool
 	 */
 	std::size_t GetNextFreeFiberIndex();
+	/**
+	 * Creates the next fiber in the pool. It isn't marked free, so the caller gets to use it, or put it in the pool
+	 *
+	 * @return    The index of the fiber, or FTL_INVALID_INDEX if every fiber has been created
+	 */
+	std::size_t CreateFiber();
+	/**
+	 * Creates a fiber if there are fewer than m_fiberCreationTarget. Called by threads that have no work
+	 *
+	 * @return    True if a fiber was created
+	 */
+	bool CreateFiberAhead();
+	/**
+	 * Creates the fiber pool and the thread local storage, on huge pages if the options ask for them
+	 *
+	 * @param options    The options passed to Run()
+	 */
+	void AllocateWorkerMemory(const SchedulerOptions &options);
+	/* Frees everything allocated by AllocateWorkerMemory() */
+	void FreeWorkerMemory();
+	/**
+	 * Faults in the stacks of a thread's share of the fiber pool. See SchedulerOptions::PrefaultStackBytes
+	 *
+	 * @param threadIndex    The index of the thread whose share to fault in
+	 */
+	void PrefaultFiberStacks(std::size_t threadIndex);
+	/**
+	 * Moves the delayed tasks whose DueTime has passed to the queues
+	 *
+	 * @param tls    The thread local storage of the current thread
+	 */
+	void AddDueDelayedTasks(ThreadLocalStorage &tls);
 	/**
 	 * If necessary, moves the old fiber to the fiber pool or the waiting list
 	 * The old fiber is the last fiber to run on the thread before the current fiber
 	 */
 	void CleanUpOldFiber();
 
+	/**
+	 * Signals that a task associated with 'counter' has finished
+	 *
+	 * Normal counters are decremented immediately. Fan-in counters accumulate the decrement in
+	 * thread local storage, so that large task groups don't ping-pong the counter's cache line
+	 * between all the worker threads. See FlushPendingDecrements()
+	 *
+	 * @param counter    The counter of the finished task
+	 */
+	void DecrementTaskCounter(AtomicCounter *counter);
+	/**
+	 * Subtracts any decrements accumulated by DecrementTaskCounter() from their fan-in counter
+	 *
+	 * @param tls    The thread local storage of the current thread
+	 */
+	void FlushPendingDecrements(ThreadLocalStorage &tls);
+	/**
+	 * Shrinks the thread's task queue and task slab if they have been mostly empty for a while, and frees any
+	 * of its retired arrays that can no longer be accessed by thieves
+	 *
+	 * @param tls    The thread local storage of the current thread
+	 */
+	void CollectTaskQueueGarbage(ThreadLocalStorage &tls);
+	/**
+	 * Takes a task from the shared task pool
+	 *
+	 * @param nextTask    Filled with a task that runs the shared task
+	 * @return            True: Successfully took a task
+	 */
+	bool PopSharedTask(TaskBundle *nextTask);
+	/**
+	 * The TaskFunction for shared tasks. Runs the task's function, and decrements its counter
+	 *
+	 * @param taskScheduler    The TaskScheduler
+	 * @param arg              The SharedTaskBundle. It's deleted afterwards
+	 */
+	static void RunSharedTask(TaskScheduler *taskScheduler, void *arg);
+	/**
+	 * The TaskFunction for remote tasks that run in this process
+	 *
+	 * @param taskScheduler    The TaskScheduler
+	 * @param arg              A copy of the RemoteTask. It's deleted afterwards
+	 */
+	static void RunRemoteTask(TaskScheduler *taskScheduler, void *arg);
+	/**
+	 * Stores a task in the thread's task slab, and pushes its index onto the thread's task queue
+	 *
+	 * @param tls       The thread local storage of the current thread
+	 * @param bundle    The task to push
+	 */
+	void PushTask(ThreadLocalStorage &tls, const TaskBundle &bundle);
+	/**
+	 * Stores a task in the thread's next task slot. Any task already in the slot is pushed onto the task queue
+	 *
+	 * @param tls       The thread local storage of the current thread
+	 * @param bundle    The newly spawned task
+	 */
+	void SetNextTask(ThreadLocalStorage &tls, const TaskBundle &bundle);
+	/**
+	 * Pushes a task onto an inbox's queue, or its overflow list if the queue is full
+	 *
+	 * @param inbox     The inbox to add the task to. A worker group's injections, or a mailbox
+	 * @param bundle    The task to add
+	 */
+	void InjectTask(TaskInbox &inbox, const TaskBundle &bundle);
+	/**
+	 * Pops a task from an inbox
+	 *
+	 * @param inbox       The inbox to take the task from
+	 * @param nextTask    Filled with the task on success
+	 * @return            True if there was a task
+	 */
+	bool PopInjectedTask(TaskInbox &inbox, TaskBundle *nextTask);
+	/**
+	 * Sends a task to a worker's mailbox, and wakes the worker if it's parked
+	 *
+	 * @param bundle      The task to send
+	 * @param affinity    The worker, and whether other workers may steal the task
+	 */
+	void PostToMailbox(const TaskBundle &bundle, Affinity affinity);
+	/**
+	 * Pops a task from the current thread's mailbox. Strict tasks come first
+	 *
+	 * @param tls            The thread local storage of the current thread
+	 * @param threadIndex    The index of the current thread
+	 * @param nextTask       Filled with the task on success
+	 * @return               True if there was a task
+	 */
+	bool PopMailboxTask(ThreadLocalStorage &tls, std::size_t threadIndex, TaskBundle *nextTask);
+	/**
+	 * Steals a task from the mailbox of a thread in the current thread's group, which the owner has left
+	 * alone for m_mailboxStealDelay. Only tasks that aren't Strict can be stolen
+	 *
+	 * @param tls            The thread local storage of the current thread
+	 * @param threadIndex    The index of the current thread
+	 * @param nextTask       Filled with the stolen task on success
+	 * @return               True if a task was stolen
+	 */
+	bool StealMailboxTask(ThreadLocalStorage &tls, std::size_t threadIndex, TaskBundle *nextTask);
+	/**
+	 * Tries to steal a task from any of the threads of a worker group
+	 *
+	 * @param tls                   The thread local storage of the current thread
+	 * @param group                 The group to steal from
+	 * @param includeInjections     Whether to also try the group's injection queue
+	 * @param nextTask              Filled with the stolen task on success
+	 * @return                      True if a task was stolen
+	 */
+	bool StealFromGroup(ThreadLocalStorage &tls, WorkerGroup &group, bool includeInjections, TaskBundle *nextTask);
+
+	/**
+	 * Hands out the next schedule id of the current thread
+	 *
+	 * @param tls    The thread local storage of the current thread
+	 * @return       The id
+	 */
+	uint64 NewScheduleId(ThreadLocalStorage &tls);
+	/**
+	 * Appends an event to the current thread's log, if we're recording
+	 *
+	 * @param tls       The thread local storage of the current thread
+	 * @param type      The type of the event
+	 * @param id        The task or wait the event is about
+	 * @param source    Where the task came from
+	 * @param victim    The thread or worker group the task came from
+	 */
+	void RecordEvent(ThreadLocalStorage &tls, ScheduleEventType type, uint64 id, TaskSource source = TaskSource::Replay, uint32 victim = 0);
+	/**
+	 * Gives a newly spawned task its schedule id. While replaying, the task is also taken out of the normal
+	 * flow, since the log decides which thread runs it
+	 *
+	 * NOTE: Only call this while recording or replaying
+	 *
+	 * @param tls       The thread local storage of the current thread
+	 * @param bundle    The task
+	 * @param group     The worker group the task is added to
+	 * @return          True if the replay took the task
+	 */
+	bool TrackSpawnedTask(ThreadLocalStorage &tls, TaskBundle *bundle, uint group);
+	/**
+	 * Gets the next event the current thread has to replay. Ready events are skipped, since they follow from the
+	 * other decisions
+	 *
+	 * @param tls    The thread local storage of the current thread
+	 * @return       The event. nullptr if the thread has replayed its whole log
+	 */
+	const ScheduleEvent *PeekReplayEvent(ThreadLocalStorage &tls);
+	/**
+	 * Marks the current replay event as done
+	 *
+	 * @param tls    The thread local storage of the current thread
+	 */
+	void AdvanceReplay(ThreadLocalStorage &tls);
+	/**
+	 * Called when a replaying thread can't make its next decision yet. Gives up on the log if none of the
+	 * threads have made any progress for m_replayTimeout
+	 *
+	 * @param tls    The thread local storage of the current thread
+	 */
+	void StallReplay(ThreadLocalStorage &tls);
+	/**
+	 * GetNextTask() for replays. Takes the task the log says this thread ran next
+	 *
+	 * @param tls         The thread local storage of the current thread
+	 * @param nextTask    Filled with the task on success
+	 * @return            True if the task was available
+	 */
+	bool GetNextReplayTask(ThreadLocalStorage &tls, TaskBundle *nextTask);
+	/**
+	 * Finds the fiber the log says this thread resumed next, if it's ready
+	 *
+	 * @param tls    The thread local storage of the current thread
+	 * @return       The index of the fiber. FTL_INVALID_INDEX if it isn't ready
+	 */
+	std::size_t GetNextReplayFiber(ThreadLocalStorage &tls);
+
+	/**
+	 * Called when the current thread couldn't find any work. Parks the thread if it has been idle long enough,
+	 * and there are more active threads than needed. Returns once the thread has been woken back up
+	 *
+	 * @param tls    The thread local storage of the current thread
+	 */
+	void ParkIfIdle(ThreadLocalStorage &tls);
+	/**
+	 * Wakes a parked thread if 'queueTLS' has a backlog of tasks, and the active thread limit allows it
+	 *
+	 * @param queueTLS    The thread local storage holding the queue that was just pushed to or stolen from
+	 */
+	void WakeThreadIfBacklogged(ThreadLocalStorage &queueTLS);
+	/**
+	 * Wakes a parked thread of 'group', if there are any
+	 *
+	 * @param group    The group that was just given work from outside
+	 */
+	void WakeGroupThread(WorkerGroup &group);
+	/**
+	 * Wakes a single parked thread, if the active thread limit allows it
+	 *
+	 * NOTE: m_parkingMutex must be held
+	 *
+	 * @param group    The group to wake a thread from. nullptr wakes a thread from any group
+	 * @return         True if a thread was woken
+	 */
+	bool WakeParkedThread(const WorkerGroup *group);
+	/**
+	 * Checks whether any of the task queues of a worker group has a backlog of tasks
+	 *
+	 * @param group    The group to check
+	 * @return         True if any queue holds more tasks than its thread can start right away
+	 */
+	bool HasBackloggedQueue(WorkerGroup &group);
+
 	/**
 	 * Add a fiber to the "ready list". Fibers in the ready list will be resumed the next time a fiber goes searching for a new task
 	 *
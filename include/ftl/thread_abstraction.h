@@ -142,7 +142,7 @@ inline ThreadType GetCurrentThread() {
  * @param coreAffinity    The requested core affinity
  */
 inline void SetCurrentThreadAffinity(size_t coreAffinity) {
-	SetThreadAffinityMask(::GetCurrentThread(), coreAffinity);
+	SetThreadAffinityMask(::GetCurrentThread(), static_cast<DWORD_PTR>(1) << coreAffinity);
 }
 
 /**
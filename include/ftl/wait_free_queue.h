@@ -45,10 +45,15 @@ public:
 	WaitFreeQueue()
 		: m_top(1), // m_top and m_bottom must start at 1
 		  m_bottom(1), // Otherwise, the first Pop on an empty queue will underflow m_bottom
-		  m_array(new CircularArray(32)) {
+		  m_array(new CircularArray(kMinArraySize)),
+		  m_peakOccupancy(0),
+		  m_shrinkChecks(0) {
 	}
 	~WaitFreeQueue() {
 		delete m_array.load(std::memory_order_relaxed);
+		for (auto &retired : m_retiredArrays) {
+			delete retired.Array;
+		}
 	}
 
 private:
@@ -61,7 +66,6 @@ private:
 
 	private:
 		std::vector<T> items;
-		std::unique_ptr<CircularArray> previous;
 
 	public:
 		std::size_t Size() const {
@@ -76,12 +80,11 @@ private:
 			items[index & (Size() - 1)] = x;
 		}
 
-		// Growing the array returns a new circular_array object and keeps a
-		// linked list of all previous arrays. This is done because other threads
-		// could still be accessing elements from the smaller arrays.
-		CircularArray *Grow(std::size_t top, std::size_t bottom) {
-			CircularArray *new_array = new CircularArray(Size() * 2);
-			new_array->previous.reset(this);
+		// Resizing the array returns a new circular_array object. The old array is left untouched,
+		// because other threads could still be accessing elements from it. The caller is
+		// responsible for retiring it. See WaitFreeQueue::RetireArray()
+		CircularArray *Resize(std::size_t top, std::size_t bottom, std::size_t newSize) {
+			CircularArray *new_array = new CircularArray(newSize);
 			for (std::size_t i = top; i != bottom; i++) {
 				new_array->Put(i, Get(i));
 			}
@@ -89,6 +92,22 @@ private:
 		}
 	};
 
+	/* An array that has been replaced, but may still be read by a thief */
+	struct RetiredArray {
+		CircularArray *Array;
+		/* The epoch the array was retired in. kUnstampedEpoch until the next call to ReclaimRetiredArrays() */
+		uint64 Epoch;
+	};
+
+	enum : std::size_t {
+		kMinArraySize = 32,
+		/* The array is only shrunk when the peak occupancy is below 1 / kShrinkOccupancyRatio of its size */
+		kShrinkOccupancyRatio = 4,
+		/* The number of calls to TryShrink() over which the peak occupancy is measured */
+		kShrinkCheckInterval = 64
+	};
+	static const uint64 kUnstampedEpoch = ~0ull;
+
 	std::atomic<uint64> m_top;
 	// Cache-line pad
 	char pad[64];
@@ -97,6 +116,13 @@ private:
 	char pad2[64];
 	std::atomic<CircularArray *> m_array;
 
+	/* The arrays replaced by growing or shrinking. Only accessed by the owner thread */
+	std::vector<RetiredArray> m_retiredArrays;
+	/* The highest number of items the queue has held since the last shrink check. Only accessed by the owner thread */
+	uint64 m_peakOccupancy;
+	/* The number of calls to TryShrink() since the last shrink check */
+	std::size_t m_shrinkChecks;
+
 
 public:
 	void Push(T value) {
@@ -106,8 +132,13 @@ public:
 
 		if (b - t > array->Size() - 1) {
 			/* Full queue. */
-			array = array->Grow(t, b);
-			m_array.store(array, std::memory_order_release);
+			CircularArray *newArray = array->Resize(t, b, array->Size() * 2);
+			m_array.store(newArray, std::memory_order_release);
+			RetireArray(array);
+			array = newArray;
+		}
+		if (b - t >= m_peakOccupancy) {
+			m_peakOccupancy = b - t + 1;
 		}
 		array->Put(b, value);
 
@@ -173,6 +204,118 @@ public:
 		
 		return false;
 	}
+
+	/**
+	 * Gets the number of items in the queue
+	 *
+	 * NOTE: The value is only a snapshot. Other threads may be pushing and stealing concurrently
+	 *
+	 * @return    The approximate number of items in the queue
+	 */
+	std::size_t Size() const {
+		uint64 b = m_bottom.load(std::memory_order_relaxed);
+		uint64 t = m_top.load(std::memory_order_relaxed);
+		return b > t ? static_cast<std::size_t>(b - t) : 0;
+	}
+
+	/**
+	 * Shrinks the array if the queue has stayed mostly empty for the last kShrinkCheckInterval calls
+	 * The new size leaves twice the peak occupancy of that interval as headroom
+	 *
+	 * NOTE: This can only be called by the owner thread. The replaced array is retired, and must
+	 *       be freed with ReclaimRetiredArrays()
+	 *
+	 * @return    True if the array was shrunk
+	 */
+	bool TryShrink() {
+		if (++m_shrinkChecks < kShrinkCheckInterval) {
+			return false;
+		}
+		m_shrinkChecks = 0;
+
+		CircularArray *array = m_array.load(std::memory_order_relaxed);
+		uint64 b = m_bottom.load(std::memory_order_relaxed);
+		uint64 t = m_top.load(std::memory_order_acquire);
+		uint64 peakOccupancy = m_peakOccupancy;
+		// Start the next interval with what's currently in the queue
+		m_peakOccupancy = b > t ? b - t : 0;
+
+		if (array->Size() <= kMinArraySize || peakOccupancy * kShrinkOccupancyRatio > array->Size()) {
+			return false;
+		}
+
+		std::size_t newSize = array->Size();
+		while (newSize > kMinArraySize && newSize / 2 >= peakOccupancy * 2) {
+			newSize /= 2;
+		}
+
+		// Thieves may be stealing while we copy. That's fine, since the old array keeps its contents,
+		// and a thief will fail its CAS on m_top if it raced with us on a stale element
+		CircularArray *newArray = array->Resize(t, b, newSize);
+		m_array.store(newArray, std::memory_order_release);
+		RetireArray(array);
+
+		return true;
+	}
+
+	/**
+	 * Whether there are retired arrays waiting to be freed
+	 *
+	 * NOTE: This can only be called by the owner thread
+	 *
+	 * @return    True if ReclaimRetiredArrays() has work to do
+	 */
+	bool HasRetiredArrays() const {
+		return !m_retiredArrays.empty();
+	}
+
+	/**
+	 * Frees the retired arrays that no thief can still be reading from
+	 *
+	 * This uses epoch-based reclamation. Every thread that calls Steal() must periodically publish the value of
+	 * 'globalEpoch' at a point where it isn't inside Steal() (a quiescent point). Newly retired arrays are stamped
+	 * with the current epoch, and the epoch is advanced. Once every thread has published an epoch greater than the
+	 * stamp, no thread can still hold a pointer to the array.
+	 *
+	 * NOTE: This can only be called by the owner thread
+	 *
+	 * @param globalEpoch    The epoch shared by all the threads that Steal() from this queue
+	 * @param safeEpoch      The minimum of the epochs published by those threads
+	 */
+	void ReclaimRetiredArrays(std::atomic<uint64> *globalEpoch, uint64 safeEpoch) {
+		bool needsStamp = false;
+		for (auto &retired : m_retiredArrays) {
+			if (retired.Epoch == kUnstampedEpoch) {
+				needsStamp = true;
+				break;
+			}
+		}
+		if (needsStamp) {
+			// Advance the epoch, so thieves publishing after this point are known to have seen the new array
+			uint64 epoch = globalEpoch->fetch_add(1, std::memory_order_acq_rel);
+			for (auto &retired : m_retiredArrays) {
+				if (retired.Epoch == kUnstampedEpoch) {
+					retired.Epoch = epoch;
+				}
+			}
+		}
+
+		for (std::size_t i = 0; i < m_retiredArrays.size();) {
+			if (m_retiredArrays[i].Epoch < safeEpoch) {
+				delete m_retiredArrays[i].Array;
+				m_retiredArrays[i] = m_retiredArrays.back();
+				m_retiredArrays.pop_back();
+			} else {
+				++i;
+			}
+		}
+	}
+
+private:
+	void RetireArray(CircularArray *array) {
+		RetiredArray retired = {array, kUnstampedEpoch};
+		m_retiredArrays.push_back(retired);
+	}
 };
 
 } // End of namespace ftl
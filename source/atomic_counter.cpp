@@ -79,6 +79,14 @@ bool AtomicCounter::AddFiberToWaitingList(std::size_t fiberIndex, uint targetVal
 }
 
 void AtomicCounter::CheckWaitingFibers(uint value) {
+	// A resumed fiber may destroy the counter right away, and with worker groups, it can be resumed by another
+	// thread before we return. So we free the slots first, and only hand the fibers over once we're done with
+	// the counter's memory
+	TaskScheduler *taskScheduler = m_taskScheduler;
+	std::size_t readyFiberIndices[NUM_WAITING_FIBER_SLOTS];
+	std::atomic<bool> *readyFiberStoredFlags[NUM_WAITING_FIBER_SLOTS];
+	uint numReadyFibers = 0;
+
 	for (uint i = 0; i < NUM_WAITING_FIBER_SLOTS; ++i) {
 		// Check if the slot is full
 		if (m_freeSlots[i].load(std::memory_order_acquire)) {
@@ -97,13 +105,78 @@ void AtomicCounter::CheckWaitingFibers(uint value) {
 				// Failed the race. Another thread got to it first
 				continue;
 			}
-			// Add the fiber to the TaskScheduler's ready list
-			m_taskScheduler->AddReadyFiber(m_waitingFibers[i].FiberIndex, m_waitingFibers[i].FiberStoredFlag);
+			// Copy the fiber out before the slot can be reused
+			readyFiberIndices[numReadyFibers] = m_waitingFibers[i].FiberIndex;
+			readyFiberStoredFlags[numReadyFibers] = m_waitingFibers[i].FiberStoredFlag;
+			++numReadyFibers;
 			// Signal that the slot is free
 			// Leave InUse == true
 			m_freeSlots[i].store(true, std::memory_order_release);
 		}
 	}
+
+	// Add the fibers to the TaskScheduler's ready list
+	for (uint i = 0; i < numReadyFibers; ++i) {
+		taskScheduler->AddReadyFiber(readyFiberIndices[i], readyFiberStoredFlags[i]);
+	}
+
+	// The list of waiting tasks is usually empty, so check before taking the lock
+	// m_value is modified with seq_cst, so either we see a newly linked waiter, or its re-check sees our value
+	if (m_taskWaiters.load(std::memory_order_seq_cst) != nullptr) {
+		CheckWaitingTasks(value);
+	}
+}
+
+bool AtomicCounter::AddTaskToWaitingList(TaskWaiter *waiter) {
+	LockTaskWaiters();
+	waiter->Next = m_taskWaiters.load(std::memory_order_relaxed);
+	m_taskWaiters.store(waiter, std::memory_order_seq_cst);
+
+	// Now we do a check of the value, to see if we reached the target value while we were linking the waiter
+	// We still hold the lock, so nobody else can have unlinked it. Once we let go of the lock, the waiter's task
+	// can be added and finish at any time, so we can't touch the waiter after that
+	if (m_value.load(std::memory_order_seq_cst) == waiter->TargetValue) {
+		m_taskWaiters.store(waiter->Next, std::memory_order_relaxed);
+		UnlockTaskWaiters();
+		return true;
+	}
+
+	UnlockTaskWaiters();
+	return false;
+}
+
+void AtomicCounter::CheckWaitingTasks(uint value) {
+	TaskScheduler *taskScheduler = m_taskScheduler;
+	TaskWaiter *readyWaiters = nullptr;
+
+	LockTaskWaiters();
+	TaskWaiter *prev = nullptr;
+	TaskWaiter *waiter = m_taskWaiters.load(std::memory_order_relaxed);
+	while (waiter != nullptr) {
+		TaskWaiter *next = waiter->Next;
+		if (waiter->TargetValue == value) {
+			if (prev == nullptr) {
+				m_taskWaiters.store(next, std::memory_order_relaxed);
+			} else {
+				prev->Next = next;
+			}
+
+			// Reuse Next to chain the ready waiters together
+			waiter->Next = readyWaiters;
+			readyWaiters = waiter;
+		} else {
+			prev = waiter;
+		}
+		waiter = next;
+	}
+	UnlockTaskWaiters();
+
+	// The task can free its waiter as soon as it's added, so read Next first
+	while (readyWaiters != nullptr) {
+		TaskWaiter *next = readyWaiters->Next;
+		taskScheduler->AddTask(readyWaiters->ResumeTask, nullptr, readyWaiters->Group);
+		readyWaiters = next;
+	}
 }
 
 
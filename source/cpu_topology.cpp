@@ -0,0 +1,282 @@
+/* FiberTaskingLib - A tasking library that uses fibers for efficient task switching
+ *
+ * This library was created as a proof of concept of the ideas presented by
+ * Christian Gyrling in his 2015 GDC Talk 'Parallelizing the Naughty Dog Engine Using Fibers'
+ *
+ * http://gdcvault.com/play/1022186/Parallelizing-the-Naughty-Dog-Engine
+ *
+ * FiberTaskingLib is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2015 - 2017
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ftl/cpu_topology.h"
+
+#include "ftl/config.h"
+#include "ftl/thread_abstraction.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#if defined(FTL_OS_LINUX)
+	#include <sched.h>
+#endif
+
+
+namespace ftl {
+
+std::vector<uint> GetAllowedCpus() {
+	std::vector<uint> cpus;
+
+	#if defined(FTL_OS_LINUX)
+		cpu_set_t cpuSet;
+		CPU_ZERO(&cpuSet);
+		if (sched_getaffinity(0, sizeof(cpu_set_t), &cpuSet) == 0) {
+			for (uint i = 0; i < CPU_SETSIZE; ++i) {
+				if (CPU_ISSET(i, &cpuSet)) {
+					cpus.push_back(i);
+				}
+			}
+		}
+	#elif defined(FTL_WIN32_THREADS)
+		DWORD_PTR processMask;
+		DWORD_PTR systemMask;
+		if (GetProcessAffinityMask(GetCurrentProcess(), &processMask, &systemMask)) {
+			for (uint i = 0; i < sizeof(DWORD_PTR) * 8; ++i) {
+				if ((processMask & (static_cast<DWORD_PTR>(1) << i)) != 0) {
+					cpus.push_back(i);
+				}
+			}
+		}
+	#endif
+
+	if (cpus.empty()) {
+		// hardware_concurrency() is allowed to return 0 if it can't tell
+		uint numCpus = GetNumHardwareThreads();
+		if (numCpus == 0) {
+			numCpus = 1;
+		}
+		for (uint i = 0; i < numCpus; ++i) {
+			cpus.push_back(i);
+		}
+	}
+
+	return cpus;
+}
+
+void SetCurrentThreadCpus(const std::vector<uint> &cpus) {
+	// TODO: OSX and MinGW Thread Affinity
+	#if defined(FTL_OS_LINUX)
+		cpu_set_t cpuSet;
+		CPU_ZERO(&cpuSet);
+		for (uint cpu : cpus) {
+			CPU_SET(cpu, &cpuSet);
+		}
+
+		pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuSet);
+	#elif defined(FTL_WIN32_THREADS)
+		DWORD_PTR mask = 0;
+		for (uint cpu : cpus) {
+			mask |= static_cast<DWORD_PTR>(1) << cpu;
+		}
+
+		SetThreadAffinityMask(::GetCurrentThread(), mask);
+	#endif
+}
+
+/**
+ * Reads the first line of a file
+ *
+ * @param path    The path of the file
+ * @param line    The line, without the trailing newline
+ * @return        True if the file could be read
+ */
+static bool ReadFirstLine(const std::string &path, std::string *line) {
+	FILE *file = fopen(path.c_str(), "r");
+	if (file == nullptr) {
+		return false;
+	}
+
+	char buffer[128];
+	bool success = fgets(buffer, sizeof(buffer), file) != nullptr;
+	fclose(file);
+
+	if (success) {
+		*line = buffer;
+		line->erase(line->find_last_not_of(" \n") + 1);
+	}
+	return success;
+}
+
+/**
+ * Converts a CPU quota to a number of CPUs, rounding up
+ *
+ * @param quota     The quota in microseconds. Negative means unlimited
+ * @param period    The period the quota applies to, in microseconds
+ * @return          The number of CPUs. 0 if unlimited or invalid
+ */
+static uint QuotaToCpus(long long quota, long long period) {
+	if (quota <= 0 || period <= 0) {
+		return 0;
+	}
+
+	return static_cast<uint>((quota + period - 1) / period);
+}
+
+uint GetCgroupCpuLimit(const char *cgroupRoot) {
+	std::string root(cgroupRoot);
+	std::string line;
+
+	// cgroup v2: "<quota> <period>", where the quota can be "max"
+	if (ReadFirstLine(root + "/cpu.max", &line)) {
+		char quota[32];
+		long long period = 0;
+		if (sscanf(line.c_str(), "%31s %lld", quota, &period) != 2 || strcmp(quota, "max") == 0) {
+			return 0;
+		}
+
+		return QuotaToCpus(atoll(quota), period);
+	}
+
+	// cgroup v1: The quota and period are separate files. The controller directory name depends on the distro
+	const char *controllerDirs[] = {"/cpu,cpuacct", "/cpu", ""};
+	for (const char *controllerDir : controllerDirs) {
+		std::string quotaLine;
+		std::string periodLine;
+		if (ReadFirstLine(root + controllerDir + "/cpu.cfs_quota_us", &quotaLine) &&
+		    ReadFirstLine(root + controllerDir + "/cpu.cfs_period_us", &periodLine)) {
+			return QuotaToCpus(atoll(quotaLine.c_str()), atoll(periodLine.c_str()));
+		}
+	}
+
+	return 0;
+}
+
+uint GetNumAvailableThreads(const char *cgroupRoot) {
+	uint numThreads = static_cast<uint>(GetAllowedCpus().size());
+
+	uint cpuLimit = GetCgroupCpuLimit(cgroupRoot);
+	if (cpuLimit != 0 && cpuLimit < numThreads) {
+		numThreads = cpuLimit;
+	}
+
+	return numThreads;
+}
+
+std::vector<CpuInfo> GetCpuTopology(const std::vector<uint> &cpus, const char *sysfsRoot) {
+	std::vector<CpuInfo> topology;
+	topology.reserve(cpus.size());
+
+	for (uint cpu : cpus) {
+		CpuInfo info = {cpu, 0, cpu};
+
+		std::string topologyDir = std::string(sysfsRoot) + "/cpu" + std::to_string(cpu) + "/topology";
+		std::string line;
+		if (ReadFirstLine(topologyDir + "/physical_package_id", &line)) {
+			info.Package = static_cast<uint>(atoi(line.c_str()));
+		}
+		if (ReadFirstLine(topologyDir + "/core_id", &line)) {
+			info.Core = static_cast<uint>(atoi(line.c_str()));
+		}
+
+		topology.push_back(info);
+	}
+
+	return topology;
+}
+
+/**
+ * Sorts CPUs by package, then core, then index
+ *
+ * @param cpus    The CPUs to sort
+ */
+static void SortCompact(std::vector<CpuInfo> *cpus) {
+	std::sort(cpus->begin(), cpus->end(), [](const CpuInfo &a, const CpuInfo &b) {
+		if (a.Package != b.Package) {
+			return a.Package < b.Package;
+		}
+		if (a.Core != b.Core) {
+			return a.Core < b.Core;
+		}
+		return a.Cpu < b.Cpu;
+	});
+}
+
+std::vector<uint> CompactCpuOrder(const std::vector<CpuInfo> &cpus) {
+	std::vector<CpuInfo> sorted(cpus);
+	SortCompact(&sorted);
+
+	std::vector<uint> order;
+	order.reserve(sorted.size());
+	for (const CpuInfo &info : sorted) {
+		order.push_back(info.Cpu);
+	}
+
+	return order;
+}
+
+std::vector<uint> ScatterCpuOrder(const std::vector<CpuInfo> &cpus) {
+	// Start from the compact order, so the siblings of each core, and the cores of each package, are adjacent
+	std::vector<CpuInfo> compact(cpus);
+	SortCompact(&compact);
+
+	// Rank each CPU by which sibling it is within its core, and which core it is within its package
+	struct ScatterKey {
+		uint SiblingRank;
+		uint CoreRank;
+		uint Package;
+		uint Cpu;
+	};
+	std::vector<ScatterKey> keys;
+	keys.reserve(compact.size());
+
+	uint siblingRank = 0;
+	uint coreRank = 0;
+	for (std::size_t i = 0; i < compact.size(); ++i) {
+		if (i != 0 && compact[i].Package != compact[i - 1].Package) {
+			siblingRank = 0;
+			coreRank = 0;
+		} else if (i != 0 && compact[i].Core != compact[i - 1].Core) {
+			siblingRank = 0;
+			++coreRank;
+		} else if (i != 0) {
+			++siblingRank;
+		}
+
+		keys.push_back({siblingRank, coreRank, compact[i].Package, compact[i].Cpu});
+	}
+
+	std::sort(keys.begin(), keys.end(), [](const ScatterKey &a, const ScatterKey &b) {
+		if (a.SiblingRank != b.SiblingRank) {
+			return a.SiblingRank < b.SiblingRank;
+		}
+		if (a.CoreRank != b.CoreRank) {
+			return a.CoreRank < b.CoreRank;
+		}
+		return a.Package < b.Package;
+	});
+
+	std::vector<uint> order;
+	order.reserve(keys.size());
+	for (const ScatterKey &key : keys) {
+		order.push_back(key.Cpu);
+	}
+
+	return order;
+}
+
+} // End of namespace ftl
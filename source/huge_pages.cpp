@@ -0,0 +1,173 @@
+/* FiberTaskingLib - A tasking library that uses fibers for efficient task switching
+ *
+ * This library was created as a proof of concept of the ideas presented by
+ * Christian Gyrling in his 2015 GDC Talk 'Parallelizing the Naughty Dog Engine Using Fibers'
+ *
+ * http://gdcvault.com/play/1022186/Parallelizing-the-Naughty-Dog-Engine
+ *
+ * FiberTaskingLib is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2015 - 2017
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "ftl/huge_pages.h"
+
+#include "ftl/config.h"
+
+#include <cstdio>
+
+#if defined(FTL_OS_WINDOWS)
+	#define WIN32_LEAN_AND_MEAN
+	#define NOMINMAX
+	#include <Windows.h>
+#else
+	#include <sys/mman.h>
+	#include <unistd.h>
+#endif
+
+
+namespace ftl {
+
+/* The huge page size used when the platform doesn't say */
+static const std::size_t kDefaultHugePageSize = 2 * 1024 * 1024;
+
+#if defined(FTL_OS_LINUX)
+	/**
+	 * Reads the default huge page size from /proc/meminfo
+	 *
+	 * @return    The size in bytes
+	 */
+	static std::size_t ReadHugePageSize() {
+		std::size_t size = kDefaultHugePageSize;
+		FILE *file = fopen("/proc/meminfo", "r");
+		if (file == nullptr) {
+			return size;
+		}
+
+		char line[256];
+		while (fgets(line, sizeof(line), file) != nullptr) {
+			unsigned long sizeKB;
+			if (sscanf(line, "Hugepagesize: %lu kB", &sizeKB) == 1) {
+				size = static_cast<std::size_t>(sizeKB) * 1024;
+				break;
+			}
+		}
+		fclose(file);
+
+		return size;
+	}
+#endif
+
+std::size_t GetHugePageSize() {
+	#if defined(FTL_OS_LINUX)
+		static const std::size_t hugePageSize = ReadHugePageSize();
+		return hugePageSize;
+	#elif defined(FTL_OS_WINDOWS)
+		return GetLargePageMinimum();
+	#else
+		return 0;
+	#endif
+}
+
+/**
+ * Rounds 'size' up to the granularity AllocateHugePages() allocates in
+ *
+ * @param size    The requested size
+ * @return        The size that's actually mapped
+ */
+static std::size_t AllocationSize(std::size_t size) {
+	std::size_t granularity = GetHugePageSize();
+	if (granularity == 0) {
+		granularity = kDefaultHugePageSize;
+	}
+
+	return (size + granularity - 1) / granularity * granularity;
+}
+
+void *AllocateHugePages(std::size_t size, HugePagePolicy policy, HugePageBacking *backing) {
+	const std::size_t allocationSize = AllocationSize(size);
+	HugePageBacking result = HugePageBacking::None;
+	void *memory = nullptr;
+
+	#if defined(FTL_OS_WINDOWS)
+		// Windows has no transparent huge pages. Large pages also need the 'Lock pages in memory' privilege
+		if (policy == HugePagePolicy::Explicit && GetLargePageMinimum() != 0) {
+			memory = VirtualAlloc(nullptr, allocationSize, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+			if (memory != nullptr) {
+				result = HugePageBacking::Explicit;
+			}
+		}
+		if (memory == nullptr) {
+			memory = VirtualAlloc(nullptr, allocationSize, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+		}
+	#else
+		#if defined(MAP_HUGETLB)
+			// This fails if there aren't enough huge pages reserved
+			if (policy == HugePagePolicy::Explicit) {
+				memory = mmap(nullptr, allocationSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+				if (memory != MAP_FAILED) {
+					result = HugePageBacking::Explicit;
+				} else {
+					memory = nullptr;
+				}
+			}
+		#endif
+
+		if (memory == nullptr) {
+			// Transparent huge pages are only used for aligned ranges, so map an extra huge page, and trim the ends
+			const std::size_t alignment = GetHugePageSize() != 0 ? GetHugePageSize() : static_cast<std::size_t>(getpagesize());
+			void *mapping = mmap(nullptr, allocationSize + alignment, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (mapping == MAP_FAILED) {
+				printf("Error: Failed to map %zu bytes\n", allocationSize);
+				return nullptr;
+			}
+
+			const std::size_t offset = (alignment - reinterpret_cast<std::size_t>(mapping) % alignment) % alignment;
+			if (offset != 0) {
+				munmap(mapping, offset);
+			}
+			if (alignment - offset != 0) {
+				munmap(static_cast<char *>(mapping) + offset + allocationSize, alignment - offset);
+			}
+			memory = static_cast<char *>(mapping) + offset;
+
+			#if defined(MADV_HUGEPAGE)
+				if (policy != HugePagePolicy::Off && madvise(memory, allocationSize, MADV_HUGEPAGE) == 0) {
+					result = HugePageBacking::Transparent;
+				}
+			#endif
+		}
+	#endif
+
+	if (backing != nullptr) {
+		*backing = result;
+	}
+	return memory;
+}
+
+void FreeHugePages(void *memory, std::size_t size) {
+	if (memory == nullptr) {
+		return;
+	}
+
+	#if defined(FTL_OS_WINDOWS)
+		(void)size;
+		VirtualFree(memory, 0, MEM_RELEASE);
+	#else
+		munmap(memory, AllocationSize(size));
+	#endif
+}
+
+} // End of namespace ftl
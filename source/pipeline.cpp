@@ -0,0 +1,289 @@
+/* FiberTaskingLib - A tasking library that uses fibers for efficient task switching
+ *
+ * This library was created as a proof of concept of the ideas presented by
+ * Christian Gyrling in his 2015 GDC Talk 'Parallelizing the Naughty Dog Engine Using Fibers'
+ *
+ * http://gdcvault.com/play/1022186/Parallelizing-the-Naughty-Dog-Engine
+ *
+ * FiberTaskingLib is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2015 - 2017
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+
+#include "ftl/pipeline.h"
+
+#include "ftl/task_scheduler.h"
+
+#include <cassert>
+
+
+namespace ftl {
+
+struct Pipeline::Item {
+	Pipeline *Owner;
+	/* The data returned by the input, or the last stage. nullptr if a stage dropped it */
+	void *Data;
+	/* The order the input produced the item in */
+	uint64 Sequence;
+	/* The stage to run next */
+	std::size_t NextStage;
+	/* Whether the item has already taken its turn in the serial stage NextStage */
+	bool HasTurn;
+	/* Links the items ProduceItems() has to add tasks for */
+	Item *Next;
+};
+
+struct Pipeline::Stage {
+	PipelineStageMode Mode;
+	PipelineStageFunction Function;
+	void *Arg;
+
+	/**
+	 * The items that arrived at a serial stage before their turn, indexed by Sequence % the number of tokens
+	 *
+	 * Every item from NextSequence on is still in flight, and there are only as many items in flight as tokens,
+	 * so two waiting items can never share a slot
+	 */
+	std::unique_ptr<Item *[]> WaitingItems;
+	/**
+	 * The Sequence + 1 of the item in each slot of WaitingItems, or 0 if it's empty. Items are claimed by their
+	 * Sequence rather than their address, since the address is reused once the item leaves the pipeline
+	 */
+	std::unique_ptr<std::atomic<uint64>[]> WaitingSequences;
+	/* The Sequence of the item whose turn it is */
+	std::atomic<uint64> NextSequence;
+};
+
+Pipeline::Pipeline(TaskScheduler *taskScheduler)
+	: m_taskScheduler(taskScheduler),
+	  m_input(nullptr),
+	  m_inputArg(nullptr),
+	  m_numTokens(0),
+	  m_freeTokens(0),
+	  m_inputBusy(false),
+	  m_inputDone(false),
+	  m_nextSequence(0),
+	  m_outstanding(0),
+	  m_finished(taskScheduler) {
+}
+
+Pipeline::~Pipeline() {
+}
+
+void Pipeline::SetInput(PipelineInputFunction input, void *arg) {
+	m_input = input;
+	m_inputArg = arg;
+}
+
+void Pipeline::AddStage(PipelineStageMode mode, PipelineStageFunction function, void *arg) {
+	std::unique_ptr<Stage> stage(new Stage());
+	stage->Mode = mode;
+	stage->Function = function;
+	stage->Arg = arg;
+	stage->NextSequence.store(0, std::memory_order_relaxed);
+	m_stages.push_back(std::move(stage));
+}
+
+void Pipeline::Run(uint maxTokens) {
+	assert(m_input != nullptr);
+	if (maxTokens == 0) {
+		maxTokens = 1;
+	}
+
+	m_numTokens = maxTokens;
+	m_freeTokens.store(maxTokens, std::memory_order_relaxed);
+	m_inputBusy.store(false, std::memory_order_relaxed);
+	m_inputDone = false;
+	m_nextSequence = 0;
+	for (auto &stage : m_stages) {
+		stage->NextSequence.store(0, std::memory_order_relaxed);
+		if (stage->Mode == PipelineStageMode::SerialInOrder) {
+			stage->WaitingItems.reset(new Item *[maxTokens]);
+			stage->WaitingSequences.reset(new std::atomic<uint64>[maxTokens]);
+			for (uint i = 0; i < maxTokens; ++i) {
+				stage->WaitingItems[i] = nullptr;
+				stage->WaitingSequences[i].store(0, std::memory_order_relaxed);
+			}
+		}
+	}
+	// The input holds one count until it's done, so we can't see 0 between items
+	m_outstanding.store(1, std::memory_order_relaxed);
+	m_finished.Store(1);
+
+	Item *first = ProduceItems(nullptr);
+	if (first != nullptr) {
+		m_taskScheduler->AddTask({CarryItemsTask, first});
+	}
+	m_taskScheduler->WaitForCounter(&m_finished, 0);
+}
+
+void Pipeline::ReleaseOutstanding() {
+	if (m_outstanding.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+		m_finished.FetchSub(1);
+	}
+}
+
+Pipeline::Item *Pipeline::ProduceItems(Item *spare) {
+	Item *first = nullptr;
+	Item *others = nullptr;
+	bool inputFinished = false;
+
+	for (;;) {
+		// Whoever holds the input will see the token we freed
+		if (m_inputBusy.exchange(true, std::memory_order_acquire)) {
+			break;
+		}
+
+		while (!m_inputDone && m_freeTokens.load(std::memory_order_relaxed) != 0) {
+			m_freeTokens.fetch_sub(1, std::memory_order_relaxed);
+
+			void *data = m_input(m_taskScheduler, m_inputArg);
+			if (data == nullptr) {
+				m_inputDone = true;
+				inputFinished = true;
+				m_freeTokens.fetch_add(1, std::memory_order_relaxed);
+				break;
+			}
+
+			Item *item = spare != nullptr ? spare : new Item();
+			spare = nullptr;
+			item->Owner = this;
+			item->Data = data;
+			item->Sequence = m_nextSequence++;
+			item->NextStage = 0;
+			item->HasTurn = false;
+			m_outstanding.fetch_add(1, std::memory_order_relaxed);
+
+			if (first == nullptr) {
+				first = item;
+			} else {
+				item->Next = others;
+				others = item;
+			}
+		}
+
+		const bool inputDone = m_inputDone;
+		m_inputBusy.store(false, std::memory_order_seq_cst);
+
+		// A token freed while we held the input was left to us. Pairs with the fetch_add in CarryItems()
+		if (inputDone || m_freeTokens.load(std::memory_order_seq_cst) == 0) {
+			break;
+		}
+	}
+
+	// The newest task runs first on this thread, so add them newest first. Then they reach the serial stages in order,
+	// rather than each waiting for the one before it
+	for (Item *item = others; item != nullptr;) {
+		Item *next = item->Next;
+		m_taskScheduler->AddTask({CarryItemsTask, item});
+		item = next;
+	}
+
+	delete spare;
+	if (inputFinished) {
+		ReleaseOutstanding();
+	}
+	return first;
+}
+
+void Pipeline::CarryItems(Item *item) {
+	while (item != nullptr) {
+		Item *handoff = nullptr;
+		if (!AdvanceItem(item, &handoff)) {
+			// It's waiting in a serial stage. Whoever finishes the item before it carries it on
+			item = handoff;
+			continue;
+		}
+
+		m_freeTokens.fetch_add(1, std::memory_order_seq_cst);
+		Item *next = ProduceItems(item);
+
+		// Keep going on the same worker, while the caches are still warm. An item that was handed a turn is
+		// holding up the items behind it, so it goes first
+		if (handoff != nullptr) {
+			if (next != nullptr) {
+				m_taskScheduler->AddTask({CarryItemsTask, next});
+			}
+			next = handoff;
+		}
+		item = next;
+
+		// This can let Run() return, so it has to come last. Unless we have another item, which keeps the count up
+		ReleaseOutstanding();
+	}
+}
+
+bool Pipeline::AdvanceItem(Item *item, Item **handoff) {
+	for (; item->NextStage < m_stages.size(); ++item->NextStage) {
+		Stage &stage = *m_stages[item->NextStage];
+
+		if (stage.Mode == PipelineStageMode::Parallel) {
+			if (item->Data != nullptr) {
+				item->Data = stage.Function(m_taskScheduler, item->Data, stage.Arg);
+			}
+			continue;
+		}
+
+		// Dropped items still take their turn, or the items after them would wait forever. If it's already our
+		// turn, no one else can hand it to us, so there's no need to park
+		if (!item->HasTurn && stage.NextSequence.load(std::memory_order_acquire) != item->Sequence) {
+			// Park the item, then check whether it's our turn. The task finishing the item before us does the
+			// opposite, so at least one of us sees the other. The exchange decides which one carries the item
+			const std::size_t slot = item->Sequence % m_numTokens;
+			uint64 parked = item->Sequence + 1;
+			stage.WaitingItems[slot] = item;
+			stage.WaitingSequences[slot].store(parked, std::memory_order_seq_cst);
+			if (stage.NextSequence.load(std::memory_order_seq_cst) != item->Sequence) {
+				return false;
+			}
+			if (!stage.WaitingSequences[slot].compare_exchange_strong(parked, 0, std::memory_order_seq_cst)) {
+				return false;
+			}
+		}
+		item->HasTurn = false;
+
+		if (item->Data != nullptr) {
+			item->Data = stage.Function(m_taskScheduler, item->Data, stage.Arg);
+		}
+
+		// Pass the turn on. If the next item is already waiting, it's up to us to get it going
+		const uint64 nextSequence = item->Sequence + 1;
+		stage.NextSequence.store(nextSequence, std::memory_order_seq_cst);
+		const std::size_t nextSlot = nextSequence % m_numTokens;
+		uint64 parked = nextSequence + 1;
+		if (stage.WaitingSequences[nextSlot].load(std::memory_order_seq_cst) == parked &&
+		    stage.WaitingSequences[nextSlot].compare_exchange_strong(parked, 0, std::memory_order_seq_cst)) {
+			Item *waiting = stage.WaitingItems[nextSlot];
+			waiting->HasTurn = true;
+			if (*handoff == nullptr) {
+				*handoff = waiting;
+			} else {
+				m_taskScheduler->AddTask({CarryItemsTask, waiting});
+			}
+		}
+	}
+
+	return true;
+}
+
+void Pipeline::CarryItemsTask(TaskScheduler *taskScheduler, void *arg) {
+	(void)taskScheduler;
+
+	Item *item = reinterpret_cast<Item *>(arg);
+	item->Owner->CarryItems(item);
+}
+
+} // End of namespace ftl
@@ -0,0 +1,672 @@
+/* FiberTaskingLib - A tasking library that uses fibers for efficient task switching
+ *
+ * This library was created as a proof of concept of the ideas presented by
+ * Christian Gyrling in his 2015 GDC Talk 'Parallelizing the Naughty Dog Engine Using Fibers'
+ *
+ * http://gdcvault.com/play/1022186/Parallelizing-the-Naughty-Dog-Engine
+ *
+ * FiberTaskingLib is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2015 - 2017
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "ftl/remote_task_transport.h"
+
+#include "ftl/config.h"
+#include "ftl/task_scheduler.h"
+#include "ftl/atomic_counter.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <unordered_map>
+
+#if defined(FTL_OS_LINUX) || defined(FTL_OS_MAC)
+	#define FTL_REMOTE_SOCKETS
+	#include <errno.h>
+	#include <netdb.h>
+	#include <netinet/in.h>
+	#include <netinet/tcp.h>
+	#include <sys/socket.h>
+	#include <sys/un.h>
+	#include <unistd.h>
+#endif
+
+#if defined(MSG_NOSIGNAL)
+	// A worker going away shouldn't take us down with a SIGPIPE
+	#define FTL_SEND_FLAGS MSG_NOSIGNAL
+#else
+	#define FTL_SEND_FLAGS 0
+#endif
+
+
+namespace ftl {
+
+/* A task that has been shipped to a worker, and is waiting for its result */
+struct RemoteTaskTransport::PendingTask {
+	TaskScheduler *Scheduler;
+	AtomicCounter *Counter;
+	uint Group;
+	/* Kept, so the task can run here if the worker goes away */
+	RemoteTask Task;
+};
+
+struct RemoteTaskTransport::Connection {
+	explicit Connection(int socket)
+		: Socket(socket),
+		  Outstanding(0),
+		  Connected(true),
+		  NextId(0) {
+	}
+
+	int Socket;
+	/* Frames are written whole, so writes from different threads can't interleave */
+	std::mutex SendLock;
+	/* Reads the results from a worker, or the requests from a client */
+	std::thread Receiver;
+	/* The number of tasks sent to a worker that haven't returned yet */
+	std::atomic<uint> Outstanding;
+	/* False once the connection to a worker has failed. Only changed with PendingLock held */
+	std::atomic<bool> Connected;
+
+	/* The tasks sent to a worker that haven't returned yet, by request id. Guarded by PendingLock */
+	std::unordered_map<uint64, PendingTask> Pending;
+	/* The id of the next request sent to a worker. Guarded by PendingLock */
+	uint64 NextId;
+	std::mutex PendingLock;
+};
+
+/* A task whose worker went away before returning its result */
+struct RemoteTaskTransport::OrphanedTask {
+	RemoteTaskTransport *Transport;
+	RemoteTask Task;
+};
+
+/* A task shipped to us by a client */
+struct RemoteTaskTransport::Request {
+	RemoteTaskTransport *Transport;
+	Connection *Client;
+	uint64 Id;
+	RemoteTask Task;
+};
+
+/**
+ * The header of a request. The args follow it
+ * The id is chosen by the process that sent the request, and only means something to that process
+ */
+struct RequestHeader {
+	uint64 Id;
+	uint32 FunctionId;
+	uint32 ArgsSize;
+};
+
+/* The header of a response. The result follows it */
+struct ResponseHeader {
+	uint64 Id;
+	uint32 ResultSize;
+	uint32 Padding;
+};
+
+struct RequestFrame {
+	RequestHeader Header;
+	char Args[RemoteTask::kMaxArgsSize];
+};
+
+struct ResponseFrame {
+	ResponseHeader Header;
+	char Result[RemoteTask::kMaxResultSize];
+};
+
+/* Does nothing. Decrements the counter of a task that ran remotely, once its result is back */
+static void CompleteRemoteTask(TaskScheduler *taskScheduler, void *arg) {
+	(void)taskScheduler;
+	(void)arg;
+}
+
+RemoteTaskTransport::RemoteTaskTransport()
+	: m_listenSocket(-1),
+	  m_taskScheduler(nullptr),
+	  m_numAcceptedClients(0),
+	  m_numConnectedClients(0),
+	  m_numRequestsInFlight(0),
+	  m_stopServing(false) {
+}
+
+RemoteTaskTransport::~RemoteTaskTransport() {
+	Close();
+}
+
+void RemoteTaskTransport::RegisterFunction(uint32 functionId, RemoteTaskFunction function) {
+	if (functionId >= m_functions.size()) {
+		m_functions.resize(functionId + 1, nullptr);
+	}
+	m_functions[functionId] = function;
+}
+
+uint32 RemoteTaskTransport::CallFunction(TaskScheduler *taskScheduler, uint32 functionId, const void *args, uint32 argsSize, void *result) const {
+	RemoteTaskFunction function = functionId < m_functions.size() ? m_functions[functionId] : nullptr;
+	if (function == nullptr) {
+		printf("Warning: No function is registered for remote task id %u\n", functionId);
+		return 0;
+	}
+
+	const uint32 resultSize = function(taskScheduler, args, std::min<uint32>(argsSize, RemoteTask::kMaxArgsSize), result, RemoteTask::kMaxResultSize);
+	return std::min<uint32>(resultSize, RemoteTask::kMaxResultSize);
+}
+
+void RemoteTaskTransport::RunTask(TaskScheduler *taskScheduler, const RemoteTask &task) const {
+	char result[RemoteTask::kMaxResultSize];
+	const uint32 resultSize = CallFunction(taskScheduler, task.FunctionId, task.Args, task.ArgsSize, result);
+	if (task.Result != nullptr) {
+		memcpy(task.Result, result, std::min(resultSize, task.ResultCapacity));
+	}
+}
+
+void RemoteTaskTransport::StopServing() {
+	m_stopServing.store(true, std::memory_order_release);
+}
+
+#if defined(FTL_REMOTE_SOCKETS)
+
+/**
+ * Opens a socket, and connects it to, or binds it to, an address
+ *
+ * @param address     "unix:/path" or "tcp:host:port"
+ * @param listen      Whether to bind and listen, rather than connect
+ * @param unixPath    Filled with the path of a Unix domain socket. Can be nullptr
+ * @return            The socket, or -1
+ */
+static int OpenSocket(const char *address, bool listen, std::string *unixPath) {
+	if (strncmp(address, "unix:", 5) == 0) {
+		const char *path = address + 5;
+		sockaddr_un socketAddress;
+		memset(&socketAddress, 0, sizeof(socketAddress));
+		if (strlen(path) >= sizeof(socketAddress.sun_path)) {
+			printf("Error: The socket path %s is too long\n", path);
+			return -1;
+		}
+		socketAddress.sun_family = AF_UNIX;
+		strcpy(socketAddress.sun_path, path);
+
+		int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (fd < 0) {
+			return -1;
+		}
+		if (listen) {
+			// A worker that died leaves its socket file behind
+			unlink(path);
+			if (bind(fd, reinterpret_cast<sockaddr *>(&socketAddress), sizeof(socketAddress)) != 0 || ::listen(fd, SOMAXCONN) != 0) {
+				close(fd);
+				return -1;
+			}
+			if (unixPath != nullptr) {
+				*unixPath = path;
+			}
+		} else if (connect(fd, reinterpret_cast<sockaddr *>(&socketAddress), sizeof(socketAddress)) != 0) {
+			close(fd);
+			return -1;
+		}
+		return fd;
+	}
+
+	if (strncmp(address, "tcp:", 4) == 0) {
+		std::string host = address + 4;
+		const std::size_t colon = host.rfind(':');
+		if (colon == std::string::npos) {
+			printf("Error: The address %s has no port\n", address);
+			return -1;
+		}
+		const std::string port = host.substr(colon + 1);
+		host.resize(colon);
+
+		addrinfo hints;
+		memset(&hints, 0, sizeof(hints));
+		hints.ai_family = AF_UNSPEC;
+		hints.ai_socktype = SOCK_STREAM;
+		hints.ai_flags = listen ? AI_PASSIVE : 0;
+		addrinfo *addresses = nullptr;
+		if (getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &addresses) != 0) {
+			printf("Error: Failed to resolve %s\n", address);
+			return -1;
+		}
+
+		int fd = -1;
+		for (addrinfo *info = addresses; info != nullptr; info = info->ai_next) {
+			fd = socket(info->ai_family, info->ai_socktype, info->ai_protocol);
+			if (fd < 0) {
+				continue;
+			}
+
+			int enable = 1;
+			if (listen) {
+				setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+				if (bind(fd, info->ai_addr, info->ai_addrlen) == 0 && ::listen(fd, SOMAXCONN) == 0) {
+					break;
+				}
+			} else if (connect(fd, info->ai_addr, info->ai_addrlen) == 0) {
+				// Requests are small, and latency matters more than packet count
+				setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+				break;
+			}
+			close(fd);
+			fd = -1;
+		}
+		freeaddrinfo(addresses);
+		return fd;
+	}
+
+	printf("Error: Unknown address %s. Addresses start with unix: or tcp:\n", address);
+	return -1;
+}
+
+static bool SendAll(int socket, const void *data, std::size_t size) {
+	const char *bytes = static_cast<const char *>(data);
+	while (size > 0) {
+		const ssize_t sent = send(socket, bytes, size, FTL_SEND_FLAGS);
+		if (sent < 0 && errno == EINTR) {
+			continue;
+		}
+		if (sent <= 0) {
+			return false;
+		}
+		bytes += sent;
+		size -= static_cast<std::size_t>(sent);
+	}
+
+	return true;
+}
+
+static bool ReceiveAll(int socket, void *data, std::size_t size) {
+	char *bytes = static_cast<char *>(data);
+	while (size > 0) {
+		const ssize_t received = recv(socket, bytes, size, 0);
+		if (received < 0 && errno == EINTR) {
+			continue;
+		}
+		if (received <= 0) {
+			return false;
+		}
+		bytes += received;
+		size -= static_cast<std::size_t>(received);
+	}
+
+	return true;
+}
+
+bool RemoteTaskTransport::Connect(const char *address) {
+	const int fd = OpenSocket(address, false, nullptr);
+	if (fd < 0) {
+		printf("Error: Failed to connect to %s\n", address);
+		return false;
+	}
+
+	m_workers.emplace_back(new Connection(fd));
+	Connection *worker = m_workers.back().get();
+	worker->Receiver = std::thread(&RemoteTaskTransport::ReceiveResults, this, worker);
+	return true;
+}
+
+bool RemoteTaskTransport::Listen(const char *address) {
+	if (m_listenSocket >= 0) {
+		printf("Error: The transport is already listening\n");
+		return false;
+	}
+
+	m_listenSocket = OpenSocket(address, true, &m_listenPath);
+	if (m_listenSocket < 0) {
+		printf("Error: Failed to listen on %s\n", address);
+		return false;
+	}
+	return true;
+}
+
+uint16 RemoteTaskTransport::GetListenPort() const {
+	if (m_listenSocket < 0) {
+		return 0;
+	}
+
+	sockaddr_storage socketAddress;
+	socklen_t length = sizeof(socketAddress);
+	if (getsockname(m_listenSocket, reinterpret_cast<sockaddr *>(&socketAddress), &length) != 0) {
+		return 0;
+	}
+	if (socketAddress.ss_family == AF_INET) {
+		return ntohs(reinterpret_cast<sockaddr_in *>(&socketAddress)->sin_port);
+	}
+	if (socketAddress.ss_family == AF_INET6) {
+		return ntohs(reinterpret_cast<sockaddr_in6 *>(&socketAddress)->sin6_port);
+	}
+	return 0;
+}
+
+void RemoteTaskTransport::Close() {
+	// The receivers see the shutdown as the end of the stream. The scheduler may be gone, so the tasks that haven't
+	// returned can't be run here instead
+	for (auto &worker : m_workers) {
+		{
+			std::lock_guard<std::mutex> lock(worker->PendingLock);
+			worker->Connected.store(false, std::memory_order_relaxed);
+			worker->Pending.clear();
+		}
+		shutdown(worker->Socket, SHUT_RDWR);
+		worker->Receiver.join();
+		close(worker->Socket);
+	}
+	m_workers.clear();
+
+	if (m_listenSocket >= 0) {
+		close(m_listenSocket);
+		m_listenSocket = -1;
+		if (!m_listenPath.empty()) {
+			unlink(m_listenPath.c_str());
+			m_listenPath.clear();
+		}
+	}
+}
+
+bool RemoteTaskTransport::Submit(TaskScheduler *taskScheduler, const RemoteTask &task, AtomicCounter *counter, uint group) {
+	if (m_workers.empty()) {
+		return false;
+	}
+
+	// Send to whoever has the least on their plate, so slower workers get less
+	Connection *worker = nullptr;
+	uint fewestOutstanding = 0;
+	for (auto &candidate : m_workers) {
+		if (!candidate->Connected.load(std::memory_order_relaxed)) {
+			continue;
+		}
+		const uint outstanding = candidate->Outstanding.load(std::memory_order_relaxed);
+		if (worker == nullptr || outstanding < fewestOutstanding) {
+			worker = candidate.get();
+			fewestOutstanding = outstanding;
+		}
+	}
+	if (worker == nullptr) {
+		return false;
+	}
+
+	RequestFrame frame;
+	{
+		// Checking Connected under the lock makes sure the receiver either orphans this task, or hasn't failed yet
+		std::lock_guard<std::mutex> lock(worker->PendingLock);
+		if (!worker->Connected.load(std::memory_order_relaxed)) {
+			return false;
+		}
+		frame.Header.Id = worker->NextId++;
+		worker->Pending.emplace(frame.Header.Id, PendingTask{taskScheduler, counter, group, task});
+		worker->Outstanding.fetch_add(1, std::memory_order_relaxed);
+	}
+	frame.Header.FunctionId = task.FunctionId;
+	frame.Header.ArgsSize = std::min<uint32>(task.ArgsSize, RemoteTask::kMaxArgsSize);
+	memcpy(frame.Args, task.Args, frame.Header.ArgsSize);
+
+	bool sent;
+	{
+		std::lock_guard<std::mutex> lock(worker->SendLock);
+		sent = SendAll(worker->Socket, &frame, sizeof(frame.Header) + frame.Header.ArgsSize);
+	}
+	if (!sent) {
+		// The receiver may have orphaned the task already, in which case it's taken care of
+		std::lock_guard<std::mutex> lock(worker->PendingLock);
+		worker->Connected.store(false, std::memory_order_relaxed);
+		if (worker->Pending.erase(frame.Header.Id) != 0) {
+			worker->Outstanding.fetch_sub(1, std::memory_order_relaxed);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void RemoteTaskTransport::ReceiveResults(Connection *worker) {
+	ResponseFrame frame;
+	for (;;) {
+		if (!ReceiveAll(worker->Socket, &frame.Header, sizeof(frame.Header)) || frame.Header.ResultSize > RemoteTask::kMaxResultSize) {
+			break;
+		}
+		if (!ReceiveAll(worker->Socket, frame.Result, frame.Header.ResultSize)) {
+			break;
+		}
+
+		PendingTask pending;
+		{
+			std::lock_guard<std::mutex> lock(worker->PendingLock);
+			auto iter = worker->Pending.find(frame.Header.Id);
+			if (iter == worker->Pending.end()) {
+				printf("Warning: A worker returned a result for unknown request %llu. Dropping it\n", static_cast<unsigned long long>(frame.Header.Id));
+				continue;
+			}
+			pending = iter->second;
+			worker->Pending.erase(iter);
+		}
+		if (pending.Task.Result != nullptr) {
+			memcpy(pending.Task.Result, frame.Result, std::min(frame.Header.ResultSize, pending.Task.ResultCapacity));
+		}
+		worker->Outstanding.fetch_sub(1, std::memory_order_relaxed);
+
+		// Counters can only be touched from the scheduler's threads. The completion task publishes the result as well
+		pending.Scheduler->AddExternalTask({CompleteRemoteTask, nullptr}, pending.Counter, pending.Group);
+	}
+
+	OrphanPendingTasks(worker);
+}
+
+void RemoteTaskTransport::OrphanPendingTasks(Connection *worker) {
+	std::unordered_map<uint64, PendingTask> orphans;
+	{
+		std::lock_guard<std::mutex> lock(worker->PendingLock);
+		worker->Connected.store(false, std::memory_order_relaxed);
+		orphans.swap(worker->Pending);
+	}
+	if (!orphans.empty()) {
+		printf("Warning: Lost the connection to a worker. Running its %u outstanding tasks locally\n", static_cast<uint>(orphans.size()));
+	}
+
+	for (auto &orphan : orphans) {
+		OrphanedTask *orphanedTask = new OrphanedTask{this, orphan.second.Task};
+		orphan.second.Scheduler->AddExternalTask({RunOrphanedTask, orphanedTask}, orphan.second.Counter, orphan.second.Group);
+		worker->Outstanding.fetch_sub(1, std::memory_order_relaxed);
+	}
+}
+
+void RemoteTaskTransport::RunOrphanedTask(TaskScheduler *taskScheduler, void *arg) {
+	OrphanedTask *orphanedTask = reinterpret_cast<OrphanedTask *>(arg);
+	orphanedTask->Transport->RunTask(taskScheduler, orphanedTask->Task);
+	delete orphanedTask;
+}
+
+void RemoteTaskTransport::Serve(TaskScheduler *taskScheduler) {
+	if (m_listenSocket < 0) {
+		printf("Error: The transport has to Listen() before it can Serve()\n");
+		return;
+	}
+
+	m_taskScheduler = taskScheduler;
+	m_stopServing.store(false, std::memory_order_relaxed);
+	m_acceptThread = std::thread(&RemoteTaskTransport::AcceptClients, this);
+
+	// The clients can't wake a fiber, so poll
+	auto sleep = [&]() {
+		AtomicCounter counter(taskScheduler);
+		taskScheduler->AddDelayedTask({CompleteRemoteTask, nullptr}, std::chrono::microseconds(kServePollUs), &counter);
+		taskScheduler->WaitForCounter(&counter, 0);
+	};
+	while (!m_stopServing.load(std::memory_order_acquire) &&
+	       (m_numAcceptedClients.load(std::memory_order_acquire) == 0 || m_numConnectedClients.load(std::memory_order_acquire) != 0)) {
+		sleep();
+	}
+
+	// Stop accepting. Shutting the socket down wakes up accept()
+	shutdown(m_listenSocket, SHUT_RDWR);
+	m_acceptThread.join();
+	close(m_listenSocket);
+	m_listenSocket = -1;
+	if (!m_listenPath.empty()) {
+		unlink(m_listenPath.c_str());
+		m_listenPath.clear();
+	}
+
+	// Stop receiving, then let the requests that made it in finish before we free their clients
+	{
+		std::lock_guard<std::mutex> lock(m_clientsLock);
+		for (auto &client : m_clients) {
+			shutdown(client->Socket, SHUT_RD);
+			client->Receiver.join();
+		}
+	}
+	while (m_numRequestsInFlight.load(std::memory_order_acquire) != 0) {
+		sleep();
+	}
+
+	std::lock_guard<std::mutex> lock(m_clientsLock);
+	for (auto &client : m_clients) {
+		close(client->Socket);
+	}
+	m_clients.clear();
+	m_numAcceptedClients.store(0, std::memory_order_relaxed);
+	m_taskScheduler = nullptr;
+}
+
+void RemoteTaskTransport::AcceptClients() {
+	for (;;) {
+		const int fd = accept(m_listenSocket, nullptr, nullptr);
+		if (fd < 0 && errno == EINTR) {
+			continue;
+		}
+		if (fd < 0) {
+			// The socket was shut down
+			break;
+		}
+
+		// Fails harmlessly on Unix domain sockets
+		int enable = 1;
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+
+		std::lock_guard<std::mutex> lock(m_clientsLock);
+		m_clients.emplace_back(new Connection(fd));
+		Connection *client = m_clients.back().get();
+		m_numConnectedClients.fetch_add(1, std::memory_order_relaxed);
+		m_numAcceptedClients.fetch_add(1, std::memory_order_release);
+		client->Receiver = std::thread(&RemoteTaskTransport::ReceiveRequests, this, client);
+	}
+}
+
+void RemoteTaskTransport::ReceiveRequests(Connection *client) {
+	RequestHeader header;
+	for (;;) {
+		if (!ReceiveAll(client->Socket, &header, sizeof(header)) || header.ArgsSize > RemoteTask::kMaxArgsSize) {
+			break;
+		}
+
+		Request *request = new Request();
+		request->Transport = this;
+		request->Client = client;
+		request->Id = header.Id;
+		request->Task.FunctionId = header.FunctionId;
+		request->Task.ArgsSize = header.ArgsSize;
+		request->Task.Result = nullptr;
+		request->Task.ResultCapacity = 0;
+		if (!ReceiveAll(client->Socket, request->Task.Args, header.ArgsSize)) {
+			delete request;
+			break;
+		}
+
+		m_numRequestsInFlight.fetch_add(1, std::memory_order_relaxed);
+		m_taskScheduler->AddExternalTask({RunRequest, request}, nullptr, 0);
+	}
+
+	m_numConnectedClients.fetch_sub(1, std::memory_order_release);
+}
+
+void RemoteTaskTransport::RunRequest(TaskScheduler *taskScheduler, void *arg) {
+	Request *request = reinterpret_cast<Request *>(arg);
+	RemoteTaskTransport *transport = request->Transport;
+
+	ResponseFrame frame;
+	frame.Header.Id = request->Id;
+	frame.Header.ResultSize = transport->CallFunction(taskScheduler, request->Task.FunctionId, request->Task.Args, request->Task.ArgsSize, frame.Result);
+	frame.Header.Padding = 0;
+	{
+		// If the client has gone, there's no one to tell
+		std::lock_guard<std::mutex> lock(request->Client->SendLock);
+		SendAll(request->Client->Socket, &frame, sizeof(frame.Header) + frame.Header.ResultSize);
+	}
+
+	delete request;
+	transport->m_numRequestsInFlight.fetch_sub(1, std::memory_order_release);
+}
+
+#else
+
+bool RemoteTaskTransport::Connect(const char *address) {
+	printf("Error: Remote task transports aren't supported on this platform. Failed to connect to %s\n", address);
+	return false;
+}
+
+bool RemoteTaskTransport::Listen(const char *address) {
+	printf("Error: Remote task transports aren't supported on this platform. Failed to listen on %s\n", address);
+	return false;
+}
+
+uint16 RemoteTaskTransport::GetListenPort() const {
+	return 0;
+}
+
+void RemoteTaskTransport::Close() {
+}
+
+bool RemoteTaskTransport::Submit(TaskScheduler *taskScheduler, const RemoteTask &task, AtomicCounter *counter, uint group) {
+	(void)taskScheduler;
+	(void)task;
+	(void)counter;
+	(void)group;
+	return false;
+}
+
+void RemoteTaskTransport::ReceiveResults(Connection *worker) {
+	(void)worker;
+}
+
+void RemoteTaskTransport::OrphanPendingTasks(Connection *worker) {
+	(void)worker;
+}
+
+void RemoteTaskTransport::RunOrphanedTask(TaskScheduler *taskScheduler, void *arg) {
+	(void)taskScheduler;
+	(void)arg;
+}
+
+void RemoteTaskTransport::Serve(TaskScheduler *taskScheduler) {
+	(void)taskScheduler;
+	printf("Error: Remote task transports aren't supported on this platform\n");
+}
+
+void RemoteTaskTransport::AcceptClients() {
+}
+
+void RemoteTaskTransport::ReceiveRequests(Connection *client) {
+	(void)client;
+}
+
+void RemoteTaskTransport::RunRequest(TaskScheduler *taskScheduler, void *arg) {
+	(void)taskScheduler;
+	(void)arg;
+}
+
+#endif
+
+} // End of namespace ftl
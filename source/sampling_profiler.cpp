@@ -0,0 +1,299 @@
+/* FiberTaskingLib - A tasking library that uses fibers for efficient task switching
+ *
+ * This library was created as a proof of concept of the ideas presented by
+ * Christian Gyrling in his 2015 GDC Talk 'Parallelizing the Naughty Dog Engine Using Fibers'
+ *
+ * http://gdcvault.com/play/1022186/Parallelizing-the-Naughty-Dog-Engine
+ *
+ * FiberTaskingLib is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2015 - 2017
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ftl/sampling_profiler.h"
+
+#include "ftl/scheduler_options.h"
+#include "ftl/scheduler_policy.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+
+namespace ftl {
+
+/**
+ * The slot of the fiber running on this thread, so SetCurrentTaskName() can find it without knowing the fiber index
+ *
+ * Set when a fiber switches in, and cleared when it switches out. A fiber can move to another thread while it waits,
+ * so this has to be read fresh every time, never cached across a wait
+ */
+static thread_local void *t_currentFiberSlot = nullptr;
+
+SamplingProfiler::SamplingProfiler(uint sampleIntervalUs, uint maxStacks)
+	: m_numFibers(0),
+	  m_sampleInterval(std::max(1u, sampleIntervalUs)),
+	  m_maxStacks(maxStacks),
+	  m_stopSampling(false),
+	  m_truncatedSamples(0),
+	  m_numSamples(0) {
+}
+
+SamplingProfiler::~SamplingProfiler() {
+	Stop();
+}
+
+bool SamplingProfiler::Attach(SchedulerOptions *options) {
+	if (!SchedulerPolicy::kHooks) {
+		printf("Warning: The scheduler was built without hooks. The SamplingProfiler can't take samples\n");
+		return false;
+	}
+
+	m_numFibers = options->FiberPoolSize;
+	m_fibers.reset(new FiberSlot[m_numFibers]);
+	for (std::size_t i = 0; i < m_numFibers; ++i) {
+		m_fibers[i].Running.store(false, std::memory_order_relaxed);
+		m_fibers[i].Depth.store(0, std::memory_order_relaxed);
+	}
+
+	m_nextHooks = options->Hooks;
+	options->Hooks.Context = this;
+	options->Hooks.FiberSwitchIn = OnFiberSwitchIn;
+	options->Hooks.FiberSwitchOut = OnFiberSwitchOut;
+	options->Hooks.TaskBegin = OnTaskBegin;
+	options->Hooks.TaskEnd = OnTaskEnd;
+	options->Hooks.WaitBegin = m_nextHooks.WaitBegin != nullptr ? OnWaitBegin : nullptr;
+	options->Hooks.WaitEnd = m_nextHooks.WaitEnd != nullptr ? OnWaitEnd : nullptr;
+
+	return true;
+}
+
+void SamplingProfiler::Start() {
+	if (m_samplingThread.joinable()) {
+		return;
+	}
+
+	m_stopSampling = false;
+	m_samplingThread = std::thread(&SamplingProfiler::SampleUntilStopped, this);
+}
+
+void SamplingProfiler::Stop() {
+	if (!m_samplingThread.joinable()) {
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_samplingLock);
+		m_stopSampling = true;
+	}
+	m_stopCondition.notify_one();
+	m_samplingThread.join();
+}
+
+void SamplingProfiler::Clear() {
+	std::lock_guard<std::mutex> lock(m_samplesLock);
+	m_samples.clear();
+	m_truncatedSamples = 0;
+	m_numSamples = 0;
+}
+
+void SamplingProfiler::NameTaskFunction(TaskFunction function, const char *name) {
+	std::lock_guard<std::mutex> lock(m_namesLock);
+	m_functionNames[function] = name;
+}
+
+void SamplingProfiler::SetCurrentTaskName(const char *name) {
+	FiberSlot *slot = reinterpret_cast<FiberSlot *>(t_currentFiberSlot);
+	if (slot == nullptr) {
+		return;
+	}
+
+	uint depth = slot->Depth.load(std::memory_order_relaxed);
+	if (depth != 0 && depth <= kMaxTaskDepth) {
+		slot->Names[depth - 1].store(name, std::memory_order_relaxed);
+	}
+}
+
+uint64 SamplingProfiler::GetNumSamples() const {
+	std::lock_guard<std::mutex> lock(m_samplesLock);
+	return m_numSamples;
+}
+
+uint64 SamplingProfiler::GetNumSamples(const char *name) const {
+	std::lock_guard<std::mutex> lock(m_samplesLock);
+	uint64 numSamples = 0;
+	for (auto &stack : m_samples) {
+		if (!stack.first.empty() && GetFrameName(stack.first.back()) == name) {
+			numSamples += stack.second;
+		}
+	}
+
+	return numSamples;
+}
+
+uint64 SamplingProfiler::GetNumSamples(TaskFunction function) const {
+	std::lock_guard<std::mutex> lock(m_samplesLock);
+	uint64 numSamples = 0;
+	for (auto &stack : m_samples) {
+		if (!stack.first.empty() && stack.first.back().Function == function) {
+			numSamples += stack.second;
+		}
+	}
+
+	return numSamples;
+}
+
+bool SamplingProfiler::WriteFoldedStacks(const char *path) const {
+	FILE *file = fopen(path, "w");
+	if (file == nullptr) {
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock(m_samplesLock);
+	bool success = true;
+	for (auto &stack : m_samples) {
+		std::string line;
+		if (stack.first.empty()) {
+			line = "[scheduler]";
+		}
+		for (const Frame &frame : stack.first) {
+			if (!line.empty()) {
+				line += ';';
+			}
+			line += GetFrameName(frame);
+		}
+
+		success = success && fprintf(file, "%s %llu\n", line.c_str(), static_cast<unsigned long long>(stack.second)) > 0;
+	}
+	if (m_truncatedSamples != 0) {
+		success = success && fprintf(file, "[truncated] %llu\n", static_cast<unsigned long long>(m_truncatedSamples)) > 0;
+	}
+
+	return fclose(file) == 0 && success;
+}
+
+void SamplingProfiler::SampleUntilStopped() {
+	std::unique_lock<std::mutex> lock(m_samplingLock);
+	while (!m_stopCondition.wait_for(lock, m_sampleInterval, [this]() { return m_stopSampling; })) {
+		TakeSample();
+	}
+}
+
+void SamplingProfiler::TakeSample() {
+	std::vector<Frame> stack;
+	std::lock_guard<std::mutex> lock(m_samplesLock);
+
+	for (std::size_t i = 0; i < m_numFibers; ++i) {
+		const FiberSlot &slot = m_fibers[i];
+		if (!slot.Running.load(std::memory_order_relaxed)) {
+			continue;
+		}
+
+		const uint depth = std::min<uint>(slot.Depth.load(std::memory_order_relaxed), kMaxTaskDepth);
+		stack.clear();
+		for (uint j = 0; j < depth; ++j) {
+			stack.push_back({slot.Functions[j].load(std::memory_order_relaxed), slot.Names[j].load(std::memory_order_relaxed)});
+		}
+
+		++m_numSamples;
+		auto iter = m_samples.find(stack);
+		if (iter != m_samples.end()) {
+			++iter->second;
+		} else if (m_samples.size() < m_maxStacks) {
+			m_samples.emplace(stack, 1);
+		} else {
+			++m_truncatedSamples;
+		}
+	}
+}
+
+std::string SamplingProfiler::GetFrameName(const Frame &frame) const {
+	if (frame.Name != nullptr) {
+		return frame.Name;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_namesLock);
+		auto iter = m_functionNames.find(frame.Function);
+		if (iter != m_functionNames.end()) {
+			return iter->second;
+		}
+	}
+
+	// Function pointers can't portably be printed with %p, so go through their bytes
+	char name[64];
+	uintptr_t address = 0;
+	memcpy(&address, &frame.Function, std::min(sizeof(address), sizeof(frame.Function)));
+	snprintf(name, sizeof(name), "task@0x%llx", static_cast<unsigned long long>(address));
+	return name;
+}
+
+void SamplingProfiler::OnFiberSwitchIn(void *context, std::size_t threadIndex, std::size_t fiberIndex) {
+	SamplingProfiler *profiler = reinterpret_cast<SamplingProfiler *>(context);
+	FiberSlot &slot = profiler->m_fibers[fiberIndex];
+	slot.Running.store(true, std::memory_order_relaxed);
+	t_currentFiberSlot = &slot;
+
+	if (profiler->m_nextHooks.FiberSwitchIn != nullptr) {
+		profiler->m_nextHooks.FiberSwitchIn(profiler->m_nextHooks.Context, threadIndex, fiberIndex);
+	}
+}
+
+void SamplingProfiler::OnFiberSwitchOut(void *context, std::size_t threadIndex, std::size_t fiberIndex) {
+	SamplingProfiler *profiler = reinterpret_cast<SamplingProfiler *>(context);
+	profiler->m_fibers[fiberIndex].Running.store(false, std::memory_order_relaxed);
+	t_currentFiberSlot = nullptr;
+
+	if (profiler->m_nextHooks.FiberSwitchOut != nullptr) {
+		profiler->m_nextHooks.FiberSwitchOut(profiler->m_nextHooks.Context, threadIndex, fiberIndex);
+	}
+}
+
+void SamplingProfiler::OnTaskBegin(void *context, std::size_t threadIndex, std::size_t fiberIndex, const Task &task) {
+	SamplingProfiler *profiler = reinterpret_cast<SamplingProfiler *>(context);
+	FiberSlot &slot = profiler->m_fibers[fiberIndex];
+	const uint depth = slot.Depth.load(std::memory_order_relaxed);
+	if (depth < kMaxTaskDepth) {
+		slot.Functions[depth].store(task.Function, std::memory_order_relaxed);
+		slot.Names[depth].store(nullptr, std::memory_order_relaxed);
+	}
+	slot.Depth.store(depth + 1, std::memory_order_relaxed);
+
+	if (profiler->m_nextHooks.TaskBegin != nullptr) {
+		profiler->m_nextHooks.TaskBegin(profiler->m_nextHooks.Context, threadIndex, fiberIndex, task);
+	}
+}
+
+void SamplingProfiler::OnTaskEnd(void *context, std::size_t threadIndex, std::size_t fiberIndex, const Task &task) {
+	SamplingProfiler *profiler = reinterpret_cast<SamplingProfiler *>(context);
+	FiberSlot &slot = profiler->m_fibers[fiberIndex];
+	slot.Depth.store(slot.Depth.load(std::memory_order_relaxed) - 1, std::memory_order_relaxed);
+
+	if (profiler->m_nextHooks.TaskEnd != nullptr) {
+		profiler->m_nextHooks.TaskEnd(profiler->m_nextHooks.Context, threadIndex, fiberIndex, task);
+	}
+}
+
+void SamplingProfiler::OnWaitBegin(void *context, std::size_t threadIndex, std::size_t fiberIndex, const AtomicCounter *counter) {
+	SamplingProfiler *profiler = reinterpret_cast<SamplingProfiler *>(context);
+	profiler->m_nextHooks.WaitBegin(profiler->m_nextHooks.Context, threadIndex, fiberIndex, counter);
+}
+
+void SamplingProfiler::OnWaitEnd(void *context, std::size_t threadIndex, std::size_t fiberIndex, const AtomicCounter *counter) {
+	SamplingProfiler *profiler = reinterpret_cast<SamplingProfiler *>(context);
+	profiler->m_nextHooks.WaitEnd(profiler->m_nextHooks.Context, threadIndex, fiberIndex, counter);
+}
+
+} // End of namespace ftl
@@ -0,0 +1,113 @@
+/* FiberTaskingLib - A tasking library that uses fibers for efficient task switching
+ *
+ * This library was created as a proof of concept of the ideas presented by
+ * Christian Gyrling in his 2015 GDC Talk 'Parallelizing the Naughty Dog Engine Using Fibers'
+ *
+ * http://gdcvault.com/play/1022186/Parallelizing-the-Naughty-Dog-Engine
+ *
+ * FiberTaskingLib is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2015 - 2017
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ftl/schedule_log.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+
+namespace ftl {
+
+/* Identifies the file format written by Save(). Bump the version if ScheduleEvent changes */
+static const char kScheduleLogMagic[4] = {'F', 'T', 'L', 'S'};
+static const uint32 kScheduleLogVersion = 1;
+
+void ScheduleLog::Reset(std::size_t numThreads) {
+	m_threads.clear();
+	m_threads.resize(numThreads);
+}
+
+std::size_t ScheduleLog::GetNumEvents() const {
+	std::size_t numEvents = 0;
+	for (const std::vector<ScheduleEvent> &events : m_threads) {
+		numEvents += events.size();
+	}
+
+	return numEvents;
+}
+
+bool ScheduleLog::Save(const char *path) const {
+	FILE *file = fopen(path, "wb");
+	if (file == nullptr) {
+		return false;
+	}
+
+	const uint32 numThreads = static_cast<uint32>(m_threads.size());
+	bool success = fwrite(kScheduleLogMagic, sizeof(kScheduleLogMagic), 1, file) == 1 &&
+	               fwrite(&kScheduleLogVersion, sizeof(kScheduleLogVersion), 1, file) == 1 &&
+	               fwrite(&numThreads, sizeof(numThreads), 1, file) == 1;
+
+	for (std::size_t i = 0; success && i < m_threads.size(); ++i) {
+		const uint64 numEvents = m_threads[i].size();
+		success = fwrite(&numEvents, sizeof(numEvents), 1, file) == 1 &&
+		          (numEvents == 0 || fwrite(m_threads[i].data(), sizeof(ScheduleEvent), numEvents, file) == numEvents);
+	}
+
+	return fclose(file) == 0 && success;
+}
+
+bool ScheduleLog::Load(const char *path) {
+	m_threads.clear();
+
+	FILE *file = fopen(path, "rb");
+	if (file == nullptr) {
+		return false;
+	}
+
+	char magic[sizeof(kScheduleLogMagic)];
+	uint32 version;
+	uint32 numThreads;
+	bool success = fread(magic, sizeof(magic), 1, file) == 1 && memcmp(magic, kScheduleLogMagic, sizeof(magic)) == 0 &&
+	               fread(&version, sizeof(version), 1, file) == 1 && version == kScheduleLogVersion &&
+	               fread(&numThreads, sizeof(numThreads), 1, file) == 1;
+
+	if (success) {
+		m_threads.resize(numThreads);
+	}
+	for (std::size_t i = 0; success && i < m_threads.size(); ++i) {
+		uint64 numEvents;
+		success = fread(&numEvents, sizeof(numEvents), 1, file) == 1;
+		if (!success) {
+			break;
+		}
+
+		// Read in chunks, so a corrupt count fails on the read instead of on a huge allocation
+		while (success && m_threads[i].size() < numEvents) {
+			const std::size_t chunkSize = static_cast<std::size_t>(std::min<uint64>(numEvents - m_threads[i].size(), 4096));
+			const std::size_t offset = m_threads[i].size();
+			m_threads[i].resize(offset + chunkSize);
+			success = fread(&m_threads[i][offset], sizeof(ScheduleEvent), chunkSize, file) == chunkSize;
+		}
+	}
+
+	fclose(file);
+	if (!success) {
+		m_threads.clear();
+	}
+
+	return success;
+}
+
+} // End of namespace ftl
@@ -0,0 +1,464 @@
+/* FiberTaskingLib - A tasking library that uses fibers for efficient task switching
+ *
+ * This library was created as a proof of concept of the ideas presented by
+ * Christian Gyrling in his 2015 GDC Talk 'Parallelizing the Naughty Dog Engine Using Fibers'
+ *
+ * http://gdcvault.com/play/1022186/Parallelizing-the-Naughty-Dog-Engine
+ *
+ * FiberTaskingLib is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2015 - 2017
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "ftl/shared_task_pool.h"
+
+#include "ftl/config.h"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <new>
+#include <thread>
+
+#if defined(FTL_OS_LINUX) || defined(FTL_OS_MAC)
+	#define FTL_SHARED_MEMORY
+	#include <errno.h>
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+
+namespace ftl {
+
+// The atomics in the segment are used by several processes, each through its own mapping. That only works if
+// they don't hide a lock inside the process
+static_assert(ATOMIC_INT_LOCK_FREE == 2 && ATOMIC_LLONG_LOCK_FREE == 2, "Shared memory needs lock free atomics");
+
+static const uint32 kSegmentMagic = 0x5354464Cu;
+static const uint32 kSegmentVersion = 1;
+static const uint32 kNoCounter = UINT_MAX;
+
+struct SharedTaskPool::SegmentHeader {
+	uint32 Magic;
+	uint32 Version;
+	uint32 QueueCapacity;
+	uint32 NumCounters;
+	/* Where each part of the segment starts, in bytes from the start of the segment */
+	uint64 QueuesOffset;
+	uint64 CellsOffset;
+	uint64 CounterValuesOffset;
+	uint64 CountersInUseOffset;
+	uint64 SegmentSize;
+	/* Set by the process that created the segment, once everything else is set up */
+	std::atomic<uint32> Initialized;
+	/* Whether each queue belongs to an attached process */
+	std::atomic<uint32> Attached[kMaxProcesses];
+};
+
+/**
+ * The positions of a queue. The queues are Dmitry Vyukov's bounded MPMC queue, like MpmcQueue. MpmcQueue keeps a
+ * pointer to its cells though, and the segment is mapped at a different address in every process
+ */
+struct SharedTaskPool::QueueHeader {
+	std::atomic<uint64> PushPosition;
+	/* Cache-line pad */
+	char pad[56];
+	std::atomic<uint64> PopPosition;
+	/* Cache-line pad */
+	char pad2[56];
+};
+
+struct SharedTaskPool::Cell {
+	/**
+	 * Equal to the position of the next push that can use this cell, or one past the position of the next pop
+	 * that can use it
+	 */
+	std::atomic<uint64> Sequence;
+	/* The index of the task's counter, or kNoCounter */
+	uint32 CounterIndex;
+	SharedTask Task;
+};
+
+/* Rounds a size up to a whole number of cache lines */
+static std::size_t CacheLineRoundUp(std::size_t size) {
+	return (size + 63) / 64 * 64;
+}
+
+SharedTaskPool::SharedTaskPool()
+	: m_segment(nullptr),
+	  m_segmentSize(0),
+	  m_header(nullptr),
+	  m_processIndex(0),
+	  m_nextVictim(0) {
+}
+
+SharedTaskPool::~SharedTaskPool() {
+	Close();
+}
+
+#if defined(FTL_SHARED_MEMORY)
+
+bool SharedTaskPool::Open(const char *name, uint32 queueCapacity, uint32 numCounters) {
+	if (IsOpen()) {
+		return true;
+	}
+	if (queueCapacity < 2 || (queueCapacity & (queueCapacity - 1)) != 0) {
+		printf("Error: The shared task queue capacity must be a power of 2\n");
+		return false;
+	}
+
+	bool created = true;
+	int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+	if (fd < 0 && errno == EEXIST) {
+		created = false;
+		fd = shm_open(name, O_RDWR, 0600);
+	}
+	if (fd < 0) {
+		printf("Error: Failed to open the shared memory segment %s\n", name);
+		return false;
+	}
+
+	std::size_t segmentSize;
+	if (created) {
+		SegmentHeader layout;
+		layout.QueuesOffset = CacheLineRoundUp(sizeof(SegmentHeader));
+		layout.CellsOffset = layout.QueuesOffset + CacheLineRoundUp(kMaxProcesses * sizeof(QueueHeader));
+		layout.CounterValuesOffset = layout.CellsOffset + CacheLineRoundUp(static_cast<std::size_t>(kMaxProcesses) * queueCapacity * sizeof(Cell));
+		layout.CountersInUseOffset = layout.CounterValuesOffset + CacheLineRoundUp(numCounters * sizeof(std::atomic<uint32>));
+		segmentSize = layout.CountersInUseOffset + CacheLineRoundUp(numCounters * sizeof(std::atomic<uint32>));
+
+		if (ftruncate(fd, static_cast<off_t>(segmentSize)) != 0) {
+			printf("Error: Failed to size the shared memory segment %s\n", name);
+			close(fd);
+			shm_unlink(name);
+			return false;
+		}
+		m_segment = mmap(nullptr, segmentSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		if (m_segment == MAP_FAILED) {
+			printf("Error: Failed to map the shared memory segment %s\n", name);
+			m_segment = nullptr;
+			close(fd);
+			shm_unlink(name);
+			return false;
+		}
+		m_segmentSize = segmentSize;
+
+		// The new segment is zero filled. Construct what needs more than that
+		m_header = new (m_segment) SegmentHeader();
+		m_header->Magic = kSegmentMagic;
+		m_header->Version = kSegmentVersion;
+		m_header->QueueCapacity = queueCapacity;
+		m_header->NumCounters = numCounters;
+		m_header->QueuesOffset = layout.QueuesOffset;
+		m_header->CellsOffset = layout.CellsOffset;
+		m_header->CounterValuesOffset = layout.CounterValuesOffset;
+		m_header->CountersInUseOffset = layout.CountersInUseOffset;
+		m_header->SegmentSize = segmentSize;
+		for (uint32 i = 0; i < kMaxProcesses; ++i) {
+			m_header->Attached[i].store(0, std::memory_order_relaxed);
+
+			new (GetQueue(i)) QueueHeader();
+			GetQueue(i)->PushPosition.store(0, std::memory_order_relaxed);
+			GetQueue(i)->PopPosition.store(0, std::memory_order_relaxed);
+			Cell *cells = GetCells(i);
+			for (uint32 j = 0; j < queueCapacity; ++j) {
+				new (&cells[j]) Cell();
+				cells[j].Sequence.store(j, std::memory_order_relaxed);
+			}
+		}
+		for (uint32 i = 0; i < numCounters; ++i) {
+			new (&GetCounterValues()[i]) std::atomic<uint32>(0);
+			new (&GetCountersInUse()[i]) std::atomic<uint32>(0);
+		}
+
+		m_header->Initialized.store(1, std::memory_order_release);
+	} else {
+		// The creator may still be sizing the segment. Wait for the header to be set up, then map the rest
+		SegmentHeader *header = nullptr;
+		const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+		for (;;) {
+			struct stat status;
+			if (header == nullptr && fstat(fd, &status) == 0 && static_cast<std::size_t>(status.st_size) >= sizeof(SegmentHeader)) {
+				void *mapping = mmap(nullptr, sizeof(SegmentHeader), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+				if (mapping != MAP_FAILED) {
+					header = static_cast<SegmentHeader *>(mapping);
+				}
+			}
+			if (header != nullptr && header->Initialized.load(std::memory_order_acquire) != 0) {
+				break;
+			}
+			if (std::chrono::steady_clock::now() > deadline) {
+				printf("Error: The shared memory segment %s was never initialized\n", name);
+				if (header != nullptr) {
+					munmap(header, sizeof(SegmentHeader));
+				}
+				close(fd);
+				return false;
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+
+		const bool compatible = header->Magic == kSegmentMagic && header->Version == kSegmentVersion;
+		segmentSize = static_cast<std::size_t>(header->SegmentSize);
+		munmap(header, sizeof(SegmentHeader));
+		if (!compatible) {
+			printf("Error: %s isn't a shared task pool of this version\n", name);
+			close(fd);
+			return false;
+		}
+
+		m_segment = mmap(nullptr, segmentSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		if (m_segment == MAP_FAILED) {
+			printf("Error: Failed to map the shared memory segment %s\n", name);
+			m_segment = nullptr;
+			close(fd);
+			return false;
+		}
+		m_segmentSize = segmentSize;
+		m_header = static_cast<SegmentHeader *>(m_segment);
+	}
+	// The mapping keeps the segment alive
+	close(fd);
+
+	// Claim a queue
+	for (uint32 i = 0; i < kMaxProcesses; ++i) {
+		uint32 expected = 0;
+		if (m_header->Attached[i].compare_exchange_strong(expected, 1, std::memory_order_acq_rel)) {
+			m_processIndex = i;
+			m_nextVictim.store((i + 1) % kMaxProcesses, std::memory_order_relaxed);
+			return true;
+		}
+	}
+
+	printf("Error: Too many processes are attached to %s\n", name);
+	munmap(m_segment, m_segmentSize);
+	m_segment = nullptr;
+	m_segmentSize = 0;
+	m_header = nullptr;
+	return false;
+}
+
+void SharedTaskPool::Close() {
+	if (!IsOpen()) {
+		return;
+	}
+
+	m_header->Attached[m_processIndex].store(0, std::memory_order_release);
+	munmap(m_segment, m_segmentSize);
+	m_segment = nullptr;
+	m_segmentSize = 0;
+	m_header = nullptr;
+}
+
+void SharedTaskPool::Unlink(const char *name) {
+	shm_unlink(name);
+}
+
+#else
+
+bool SharedTaskPool::Open(const char *name, uint32 queueCapacity, uint32 numCounters) {
+	(void)queueCapacity;
+	(void)numCounters;
+	printf("Error: Shared task pools aren't supported on this platform. Failed to open %s\n", name);
+	return false;
+}
+
+void SharedTaskPool::Close() {
+}
+
+void SharedTaskPool::Unlink(const char *name) {
+	(void)name;
+}
+
+#endif
+
+void SharedTaskPool::RegisterFunction(uint32 functionId, SharedTaskFunction function) {
+	if (functionId >= m_functions.size()) {
+		m_functions.resize(functionId + 1, nullptr);
+	}
+	m_functions[functionId] = function;
+}
+
+SharedTaskFunction SharedTaskPool::GetFunction(uint32 functionId) const {
+	return functionId < m_functions.size() ? m_functions[functionId] : nullptr;
+}
+
+bool SharedTaskPool::AllocateCounter(uint32 initialValue, SharedCounter *counter) {
+	std::atomic<uint32> *inUse = GetCountersInUse();
+	for (uint32 i = 0; i < m_header->NumCounters; ++i) {
+		uint32 expected = 0;
+		if (inUse[i].load(std::memory_order_relaxed) == 0 && inUse[i].compare_exchange_strong(expected, 1, std::memory_order_acquire)) {
+			GetCounterValues()[i].store(initialValue, std::memory_order_release);
+			counter->Index = i;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void SharedTaskPool::FreeCounter(SharedCounter counter) {
+	GetCountersInUse()[counter.Index].store(0, std::memory_order_release);
+}
+
+uint32 SharedTaskPool::LoadCounter(SharedCounter counter) const {
+	return GetCounterValues()[counter.Index].load(std::memory_order_acquire);
+}
+
+void SharedTaskPool::StoreCounter(SharedCounter counter, uint32 value) {
+	GetCounterValues()[counter.Index].store(value, std::memory_order_release);
+}
+
+uint32 SharedTaskPool::FetchSubCounter(SharedCounter counter, uint32 value) {
+	return GetCounterValues()[counter.Index].fetch_sub(value, std::memory_order_acq_rel);
+}
+
+bool SharedTaskPool::TryPush(const SharedTask &task, const SharedCounter *counter) {
+	assert(task.PayloadSize <= SharedTask::kMaxPayloadSize && "The payload doesn't fit in a SharedTask");
+
+	QueueHeader *queue = GetQueue(m_processIndex);
+	Cell *cells = GetCells(m_processIndex);
+	const uint64 mask = m_header->QueueCapacity - 1;
+
+	Cell *cell;
+	uint64 position = queue->PushPosition.load(std::memory_order_relaxed);
+	for (;;) {
+		cell = &cells[position & mask];
+		uint64 sequence = cell->Sequence.load(std::memory_order_acquire);
+		int64 difference = static_cast<int64>(sequence) - static_cast<int64>(position);
+
+		if (difference == 0) {
+			if (queue->PushPosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+				break;
+			}
+		} else if (difference < 0) {
+			// The cell still holds the task from the previous lap
+			return false;
+		} else {
+			// Another producer took this position
+			position = queue->PushPosition.load(std::memory_order_relaxed);
+		}
+	}
+
+	const uint32 payloadSize = std::min<uint32>(task.PayloadSize, SharedTask::kMaxPayloadSize);
+	cell->CounterIndex = counter != nullptr ? counter->Index : kNoCounter;
+	cell->Task.FunctionId = task.FunctionId;
+	cell->Task.PayloadSize = payloadSize;
+	memcpy(cell->Task.Payload, task.Payload, payloadSize);
+	cell->Sequence.store(position + 1, std::memory_order_release);
+
+	return true;
+}
+
+bool SharedTaskPool::TryPop(SharedTask *task, uint32 *counterIndex, uint32 *process) {
+	// Our own tasks first
+	if (TryPopFrom(m_processIndex, task, counterIndex)) {
+		if (process != nullptr) {
+			*process = m_processIndex;
+		}
+		return true;
+	}
+
+	// Then steal from the other processes. Tasks left behind by detached processes can still be taken
+	const uint32 start = m_nextVictim.load(std::memory_order_relaxed);
+	for (uint32 i = 0; i < kMaxProcesses; ++i) {
+		const uint32 victim = (start + i) % kMaxProcesses;
+		if (victim == m_processIndex) {
+			continue;
+		}
+		if (TryPopFrom(victim, task, counterIndex)) {
+			m_nextVictim.store(victim, std::memory_order_relaxed);
+			if (process != nullptr) {
+				*process = victim;
+			}
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool SharedTaskPool::HasTasks() const {
+	for (uint32 i = 0; i < kMaxProcesses; ++i) {
+		const QueueHeader *queue = GetQueue(i);
+		if (queue->PushPosition.load(std::memory_order_relaxed) > queue->PopPosition.load(std::memory_order_relaxed)) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool SharedTaskPool::TryPopFrom(uint32 process, SharedTask *task, uint32 *counterIndex) {
+	QueueHeader *queue = GetQueue(process);
+	// Skip empty queues without touching their cells
+	if (queue->PushPosition.load(std::memory_order_relaxed) <= queue->PopPosition.load(std::memory_order_relaxed)) {
+		return false;
+	}
+
+	Cell *cells = GetCells(process);
+	const uint64 mask = m_header->QueueCapacity - 1;
+
+	Cell *cell;
+	uint64 position = queue->PopPosition.load(std::memory_order_relaxed);
+	for (;;) {
+		cell = &cells[position & mask];
+		uint64 sequence = cell->Sequence.load(std::memory_order_acquire);
+		int64 difference = static_cast<int64>(sequence) - static_cast<int64>(position + 1);
+
+		if (difference == 0) {
+			if (queue->PopPosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+				break;
+			}
+		} else if (difference < 0) {
+			// The cell hasn't been filled yet
+			return false;
+		} else {
+			// Another consumer took this position
+			position = queue->PopPosition.load(std::memory_order_relaxed);
+		}
+	}
+
+	*counterIndex = cell->CounterIndex;
+	task->FunctionId = cell->Task.FunctionId;
+	task->PayloadSize = cell->Task.PayloadSize;
+	memcpy(task->Payload, cell->Task.Payload, cell->Task.PayloadSize);
+	cell->Sequence.store(position + mask + 1, std::memory_order_release);
+
+	return true;
+}
+
+SharedTaskPool::QueueHeader *SharedTaskPool::GetQueue(uint32 process) const {
+	return reinterpret_cast<QueueHeader *>(static_cast<char *>(m_segment) + m_header->QueuesOffset) + process;
+}
+
+SharedTaskPool::Cell *SharedTaskPool::GetCells(uint32 process) const {
+	return reinterpret_cast<Cell *>(static_cast<char *>(m_segment) + m_header->CellsOffset) + static_cast<std::size_t>(process) * m_header->QueueCapacity;
+}
+
+std::atomic<uint32> *SharedTaskPool::GetCounterValues() const {
+	return reinterpret_cast<std::atomic<uint32> *>(static_cast<char *>(m_segment) + m_header->CounterValuesOffset);
+}
+
+std::atomic<uint32> *SharedTaskPool::GetCountersInUse() const {
+	return reinterpret_cast<std::atomic<uint32> *>(static_cast<char *>(m_segment) + m_header->CountersInUseOffset);
+}
+
+} // End of namespace ftl
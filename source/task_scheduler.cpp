@@ -24,6 +24,13 @@
 #include "ftl/task_scheduler.h"
 
 #include "ftl/atomic_counter.h"
+#include "ftl/cpu_topology.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <new>
+#include <thread>
 
 
 namespace ftl {
@@ -41,6 +48,12 @@ FTL_THREAD_FUNC_RETURN_TYPE TaskScheduler::ThreadStart(void *arg) {
 	// Clean up
 	delete threadArgs;
 
+	// Warm up our share of the fiber stacks, in parallel with the other threads
+	if (taskScheduler->m_prefaultStackBytes != 0) {
+		taskScheduler->PrefaultFiberStacks(index);
+		taskScheduler->m_numPrefaultingThreads.fetch_sub(1, std::memory_order_release);
+	}
+
 	// Spin wait until everything is initialized
 	while (!taskScheduler->m_initialized.load(std::memory_order_acquire)) {
 		// Spin
@@ -63,6 +76,63 @@ FTL_THREAD_FUNC_RETURN_TYPE TaskScheduler::ThreadStart(void *arg) {
 	FTL_THREAD_FUNC_END;
 }
 
+/**
+ * Picks the CPUs to pin the worker threads to
+ *
+ * @param options        The options passed to Run()
+ * @param allowedCpus    The CPUs the process is allowed to run on
+ * @return               The CPU for each worker thread, in thread order. Never empty
+ */
+static std::vector<uint> GetWorkerCpus(const SchedulerOptions &options, const std::vector<uint> &allowedCpus) {
+	auto isUsable = [&](uint cpu) {
+		return std::find(allowedCpus.begin(), allowedCpus.end(), cpu) != allowedCpus.end() &&
+		       std::find(options.ExcludedCpus.begin(), options.ExcludedCpus.end(), cpu) == options.ExcludedCpus.end();
+	};
+
+	std::vector<uint> cpus;
+	switch (options.Pinning) {
+	case PinningPolicy::Explicit:
+		for (uint cpu : options.PinnedCpus) {
+			if (isUsable(cpu)) {
+				cpus.push_back(cpu);
+			}
+		}
+		break;
+	case PinningPolicy::Sequential:
+		for (uint cpu : allowedCpus) {
+			if (isUsable(cpu)) {
+				cpus.push_back(cpu);
+			}
+		}
+		break;
+	case PinningPolicy::Compact:
+	case PinningPolicy::Scatter:
+	{
+		std::vector<uint> usableCpus;
+		for (uint cpu : allowedCpus) {
+			if (isUsable(cpu)) {
+				usableCpus.push_back(cpu);
+			}
+		}
+
+		std::vector<CpuInfo> topology = GetCpuTopology(usableCpus);
+		cpus = options.Pinning == PinningPolicy::Compact ? CompactCpuOrder(topology) : ScatterCpuOrder(topology);
+		break;
+	}
+	case PinningPolicy::None:
+	default:
+		cpus = allowedCpus;
+		break;
+	}
+
+	// Everything was excluded. Fall back to the allowed CPUs rather than not running at all
+	if (cpus.empty()) {
+		cpus = allowedCpus;
+	}
+
+	return cpus;
+}
+
 struct MainFiberStartArgs {
 	TaskFunction MainTask;
 	void *Arg;
@@ -73,15 +143,36 @@ void TaskScheduler::MainFiberStart(void *arg) {
 	MainFiberStartArgs *mainFiberArgs = reinterpret_cast<MainFiberStartArgs *>(arg);
 	TaskScheduler *taskScheduler = mainFiberArgs->taskScheduler;
 
+	// We came straight from the thread fiber, so there's nothing to clean up. CleanUpOldFiber() would have fired this
+	taskScheduler->FireFiberHook(taskScheduler->m_hooks.FiberSwitchIn, 0, taskScheduler->m_tls[0].CurrentFiberIndex);
+
 	// Call the main task procedure
-	mainFiberArgs->MainTask(taskScheduler, mainFiberArgs->Arg);
+	Task mainTask = {mainFiberArgs->MainTask, mainFiberArgs->Arg};
+	taskScheduler->BeginTaskLink(taskScheduler->m_tls[0].CurrentFiberIndex, {mainTask, nullptr});
+	taskScheduler->FireTaskHook(taskScheduler->m_hooks.TaskBegin, mainTask);
+	mainTask.Function(taskScheduler, mainTask.ArgData);
+	taskScheduler->FireTaskHook(taskScheduler->m_hooks.TaskEnd, mainTask);
 
 
 	// Request that all the threads quit
 	taskScheduler->m_quit.store(true, std::memory_order_release);
 
+	// Parked threads have to be woken up to see the request
+	{
+		std::lock_guard<std::mutex> lock(taskScheduler->m_parkingMutex);
+		for (std::size_t i = 0; i < taskScheduler->m_numThreads; ++i) {
+			ThreadLocalStorage &otherTLS = taskScheduler->m_tls[i];
+			if (otherTLS.Parked) {
+				otherTLS.Parked = false;
+				otherTLS.ParkCondition.notify_one();
+			}
+		}
+	}
+
 	// Switch to the thread fibers
-	ThreadLocalStorage &tls = taskScheduler->m_tls[taskScheduler->GetCurrentThreadIndex()];
+	std::size_t threadIndex = taskScheduler->GetCurrentThreadIndex();
+	ThreadLocalStorage &tls = taskScheduler->m_tls[threadIndex];
+	taskScheduler->FireFiberHook(taskScheduler->m_hooks.FiberSwitchOut, threadIndex, tls.CurrentFiberIndex);
 	taskScheduler->m_fibers[tls.CurrentFiberIndex].SwitchToFiber(&tls.ThreadFiber);
 
 
@@ -96,42 +187,66 @@ void TaskScheduler::FiberStart(void *arg) {
 	taskScheduler->CleanUpOldFiber();
 
 	while (!taskScheduler->m_quit.load(std::memory_order_acquire)) {
-		// Check if there are any pinned fibers that are ready
 		std::size_t waitingFiberIndex = FTL_INVALID_INDEX;
-		ThreadLocalStorage &tls = taskScheduler->m_tls[taskScheduler->GetCurrentThreadIndex()];
-
-		for (std::size_t i = 0; i < tls.PinnedTasks.size(); i++) {
-			const PinnedWaitingFiberBundle *bundle = &tls.PinnedTasks[i];
-			if (bundle->Counter->Load() == bundle->TargetValue) {
-				waitingFiberIndex = bundle->FiberIndex;
-				tls.PinnedTasks.erase(tls.PinnedTasks.begin() + i);
-				
-				break;
+		std::size_t threadIndex = taskScheduler->GetCurrentThreadIndex();
+		ThreadLocalStorage &tls = taskScheduler->m_tls[threadIndex];
+
+		if (taskScheduler->GetScheduleMode() == ScheduleMode::Replay) {
+			// The log decides which fiber we resume, and when
+			waitingFiberIndex = taskScheduler->GetNextReplayFiber(tls);
+		} else if (tls.HandoffFiber.FiberIndex != FTL_INVALID_INDEX) {
+			// The task we just ran made a fiber ready. Go straight to it, unless its old thread is still switching out of it
+			ReadyFiberBundle handoffFiber = tls.HandoffFiber;
+			tls.HandoffFiber.FiberIndex = FTL_INVALID_INDEX;
+			if (handoffFiber.FiberStoredFlag->load(std::memory_order_relaxed)) {
+				waitingFiberIndex = handoffFiber.FiberIndex;
+				delete handoffFiber.FiberStoredFlag;
+			} else {
+				tls.ReadyFibers.emplace_back(handoffFiber.FiberIndex, handoffFiber.FiberStoredFlag);
+			}
+		} else {
+			// Check if there are any pinned fibers that are ready
+			for (std::size_t i = 0; i < tls.PinnedTasks.size(); i++) {
+				const PinnedWaitingFiberBundle *bundle = &tls.PinnedTasks[i];
+				if (bundle->Counter->Load() == bundle->TargetValue) {
+					waitingFiberIndex = bundle->FiberIndex;
+					tls.PinnedTasks.erase(tls.PinnedTasks.begin() + i);
+					
+					break;
+				}
 			}
-		}
 
-		// If there aren't any pinned fibers, check if there are any ready fibers
-		if (waitingFiberIndex == FTL_INVALID_INDEX) {
-			for (auto iter = tls.ReadyFibers.begin(); iter != tls.ReadyFibers.end(); ++iter) {
-				if (!iter->second->load(std::memory_order_relaxed)) {
-					continue;
+			// If there aren't any pinned fibers, check if there are any ready fibers
+			if (waitingFiberIndex == FTL_INVALID_INDEX) {
+				// Pick up the fibers of our group that were made ready by other groups
+				ReadyFiberBundle readyFiber;
+				while (taskScheduler->m_groups[tls.Group]->ReadyFibers.TryPop(&readyFiber)) {
+					tls.ReadyFibers.emplace_back(readyFiber.FiberIndex, readyFiber.FiberStoredFlag);
 				}
 
-				waitingFiberIndex = iter->first;
-				delete iter->second;
-				tls.ReadyFibers.erase(iter);
-				break;
+				for (auto iter = tls.ReadyFibers.begin(); iter != tls.ReadyFibers.end(); ++iter) {
+					if (!iter->second->load(std::memory_order_relaxed)) {
+						continue;
+					}
+
+					waitingFiberIndex = iter->first;
+					delete iter->second;
+					tls.ReadyFibers.erase(iter);
+					break;
+				}
 			}
 		}
 
 		if (waitingFiberIndex != FTL_INVALID_INDEX) {
 			// Found a waiting task that is ready to continue
+			taskScheduler->RecordEvent(tls, ScheduleEventType::Resume, taskScheduler->m_fiberWaitIds[waitingFiberIndex]);
 
 			tls.OldFiberIndex = tls.CurrentFiberIndex;
 			tls.CurrentFiberIndex = waitingFiberIndex;
 			tls.OldFiberDestination = FiberDestination::ToPool;
 			
 			// Switch
+			taskScheduler->FireFiberHook(taskScheduler->m_hooks.FiberSwitchOut, threadIndex, tls.OldFiberIndex);
 			taskScheduler->m_fibers[tls.OldFiberIndex].SwitchToFiber(&taskScheduler->m_fibers[tls.CurrentFiberIndex]);
 
 			// And we're back
@@ -140,11 +255,24 @@ void TaskScheduler::FiberStart(void *arg) {
 			// Get a new task from the queue, and execute it
 			TaskBundle nextTask;
 			if (!taskScheduler->GetNextTask(&nextTask)) {
-				// Spin
+				// Create fibers before a wait needs them. Otherwise, spin, or park if we've been idle for long enough
+				if (!taskScheduler->CreateFiberAhead() && SchedulerPolicy::kParking) {
+					taskScheduler->ParkIfIdle(tls);
+				}
 			} else {
+				tls.IsIdle = false;
+
+				// Don't let a batch of decrements sit in tls while we run a task from a different group
+				if (tls.PendingCounter != nullptr && tls.PendingCounter != nextTask.Counter) {
+					taskScheduler->FlushPendingDecrements(tls);
+				}
+
+				taskScheduler->BeginTaskLink(tls.CurrentFiberIndex, nextTask);
+				taskScheduler->FireTaskHook(taskScheduler->m_hooks.TaskBegin, nextTask.TaskToExecute);
 				nextTask.TaskToExecute.Function(taskScheduler, nextTask.TaskToExecute.ArgData);
+				taskScheduler->FireTaskHook(taskScheduler->m_hooks.TaskEnd, nextTask.TaskToExecute);
 				if (nextTask.Counter != nullptr) {
-					nextTask.Counter->FetchSub(1);
+					taskScheduler->DecrementTaskCounter(nextTask.Counter);
 				}
 			}
 		}
@@ -154,7 +282,9 @@ void TaskScheduler::FiberStart(void *arg) {
 	// Start the quit sequence
 	
 	// Switch to the thread fibers
-	ThreadLocalStorage &tls = taskScheduler->m_tls[taskScheduler->GetCurrentThreadIndex()];
+	std::size_t threadIndex = taskScheduler->GetCurrentThreadIndex();
+	ThreadLocalStorage &tls = taskScheduler->m_tls[threadIndex];
+	taskScheduler->FireFiberHook(taskScheduler->m_hooks.FiberSwitchOut, threadIndex, tls.CurrentFiberIndex);
 	taskScheduler->m_fibers[tls.CurrentFiberIndex].SwitchToFiber(&tls.ThreadFiber);
 
 
@@ -167,43 +297,187 @@ TaskScheduler::TaskScheduler()
 	  m_fiberPoolSize(0), 
 	  m_fibers(nullptr), 
 	  m_freeFibers(nullptr), 
+	  m_numCreatedFibers(0),
+	  m_fiberCreationTarget(0),
+	  m_stackRegion(nullptr),
+	  m_tlsRegion(nullptr),
+	  m_hugePageBacking(HugePageBacking::None),
+	  m_prefaultStackBytes(0),
+	  m_numPrefaultingThreads(0),
+	  m_sharedPool(nullptr),
+	  m_shareTasks(false),
+	  m_transport(nullptr),
+	  m_remoteOffloadThreshold(0),
+	  m_epoch(0),
+	  m_minActiveThreads(0),
+	  m_maxActiveThreads(0),
+	  m_parkDelay(0),
+	  m_numActiveThreads(0),
+	  m_numParkedThreads(0),
+	  m_mailboxStealDelay(0),
+	  m_fiberGroups(nullptr),
+	  m_fiberHelpDepths(nullptr),
+	  m_trackParentTasks(false),
+	  m_fiberTaskLinks(nullptr),
+	  m_resumePolicy(ResumePolicy::Deferred),
+	  m_scheduleMode(ScheduleMode::Normal),
+	  m_scheduleLog(nullptr),
+	  m_replayTimeout(0),
+	  m_replayDiverged(false),
+	  m_replayProgress(0),
+	  m_fiberWaitIds(nullptr),
+	  m_numDelayedTasks(0),
 	  m_tls(nullptr) {
 }
 
 TaskScheduler::~TaskScheduler() {
-	delete[] m_fibers;
-	delete[] m_freeFibers;
-	delete[] m_tls;
+	FreeWorkerMemory();
+	delete[] m_fiberGroups;
+	delete[] m_fiberHelpDepths;
+	delete[] m_fiberTaskLinks;
+	delete[] m_fiberWaitIds;
 }
 
 void TaskScheduler::Run(uint fiberPoolSize, TaskFunction mainTask, void *mainTaskArg, uint threadPoolSize) {
+	SchedulerOptions options;
+	options.FiberPoolSize = fiberPoolSize;
+	options.ThreadPoolSize = threadPoolSize;
+	options.Pinning = PinningPolicy::Sequential;
+
+	Run(options, mainTask, mainTaskArg);
+}
+
+void TaskScheduler::Run(const SchedulerOptions &options, TaskFunction mainTask, void *mainTaskArg) {
+	const uint fiberPoolSize = options.FiberPoolSize;
+	const uint threadPoolSize = options.ThreadPoolSize;
+
 	// Initialize the flags
-	m_initialized.store(false, std::memory_order::memory_order_release);
+	m_initialized.store(false, std::memory_order_release);
 	m_quit.store(false, std::memory_order_release);
 
-	// Create and populate the fiber pool
 	m_fiberPoolSize = fiberPoolSize;
-	m_fibers = new Fiber[fiberPoolSize];
-	m_freeFibers = new std::atomic<bool>[fiberPoolSize];
 
-	for (uint i = 0; i < fiberPoolSize; ++i) {
-		m_fibers[i] = std::move(Fiber(512000, FiberStart, this));
-		m_freeFibers[i].store(true, std::memory_order_release);
-	}
+	// Only pin threads to the CPUs we're allowed to use. In a container, core i may not be ours
+	const std::vector<uint> allowedCpus = GetAllowedCpus();
+	const std::vector<uint> workerCpus = GetWorkerCpus(options, allowedCpus);
+	const bool pinThreads = options.Pinning != PinningPolicy::None;
 
-	if (threadPoolSize == 0) {
-		// 1 thread for each logical processor
-		m_numThreads = GetNumHardwareThreads();
+	if (!options.Groups.empty()) {
+		m_numThreads = 0;
+		for (const WorkerGroupOptions &groupOptions : options.Groups) {
+			m_numThreads += std::max(1u, groupOptions.NumThreads);
+		}
+	} else if (threadPoolSize == 0) {
+		// 1 thread for each logical processor we can actually use
+		m_numThreads = std::min<std::size_t>(GetNumAvailableThreads(), pinThreads ? workerCpus.size() : allowedCpus.size());
 	} else {
 		m_numThreads = threadPoolSize;
 	}
 
-	// Initialize threads and TLS
+	// All the threads start out active
+	m_numActiveThreads.store(m_numThreads, std::memory_order_relaxed);
+	m_numParkedThreads.store(0, std::memory_order_relaxed);
+	m_maxActiveThreads.store(m_numThreads, std::memory_order_relaxed);
+	if (!SchedulerPolicy::kParking && options.MinActiveThreads != 0) {
+		printf("Warning: The scheduler was built without parking. MinActiveThreads is ignored\n");
+	}
+	if (!SchedulerPolicy::kParking || options.MinActiveThreads == 0 || options.MinActiveThreads > m_numThreads) {
+		m_minActiveThreads.store(m_numThreads, std::memory_order_relaxed);
+	} else {
+		m_minActiveThreads.store(options.MinActiveThreads, std::memory_order_relaxed);
+	}
+	m_parkDelay = std::chrono::milliseconds(options.ParkDelayMs);
+	m_mailboxStealDelay = std::chrono::microseconds(options.MailboxStealDelayUs);
+	if (SchedulerPolicy::kHooks) {
+		m_hooks = options.Hooks;
+	} else if (options.Hooks.FiberSwitchIn != nullptr || options.Hooks.FiberSwitchOut != nullptr ||
+	           options.Hooks.TaskBegin != nullptr || options.Hooks.TaskEnd != nullptr ||
+	           options.Hooks.WaitBegin != nullptr || options.Hooks.WaitEnd != nullptr) {
+		printf("Warning: The scheduler was built without hooks. The SchedulerHooks won't be called\n");
+	}
+
+	// Initialize threads, TLS, and the fiber pool
 	m_threads.resize(m_numThreads);
-	m_tls = new ThreadLocalStorage[m_numThreads];
+	AllocateWorkerMemory(options);
+	for (std::size_t i = 0; i < m_numThreads; ++i) {
+		m_tls[i].FiberSearchStart = i * m_fiberPoolSize / m_numThreads;
+	}
+	m_prefaultStackBytes = options.PrefaultStackBytes;
+	m_numPrefaultingThreads.store(static_cast<uint>(m_numThreads), std::memory_order_relaxed);
+
+	// Create the worker groups. Each fiber can only be in one ReadyFibers queue at a time, so a queue the size of
+	// the fiber pool can never fill up
+	std::size_t readyFiberCapacity = 2;
+	while (readyFiberCapacity < fiberPoolSize) {
+		readyFiberCapacity *= 2;
+	}
+	for (std::size_t i = 0; i < m_numThreads; ++i) {
+		m_mailboxes.emplace_back(new Mailbox());
+	}
+	m_fiberGroups = new uint[fiberPoolSize]();
+	m_fiberHelpDepths = new uint[fiberPoolSize]();
+	m_trackParentTasks = options.TrackParentTasks;
+	m_fiberTaskLinks = m_trackParentTasks ? new TaskLink[fiberPoolSize]() : nullptr;
+	m_resumePolicy = options.Resume;
+	m_fiberWaitIds = new uint64[fiberPoolSize]();
+
+	// Set up recording or replaying the schedule
+	if (!SchedulerPolicy::kScheduleLog && options.Log != nullptr && options.Schedule != ScheduleMode::Normal) {
+		printf("Warning: The scheduler was built without the schedule log. The schedule won't be recorded or replayed\n");
+	}
+	m_scheduleMode = options.Log != nullptr ? options.Schedule : ScheduleMode::Normal;
+	m_scheduleLog = options.Log;
+	m_replayTimeout = std::chrono::milliseconds(options.ReplayTimeoutMs);
+	m_replayDiverged.store(false, std::memory_order_relaxed);
+	m_replayProgress.store(0, std::memory_order_relaxed);
+	// Tasks from other processes would make the schedule impossible to replay
+	m_sharedPool = options.SharedPool;
+	m_shareTasks = m_sharedPool != nullptr && m_sharedPool->IsOpen() && GetScheduleMode() == ScheduleMode::Normal;
+	m_transport = options.Transport;
+	m_remoteOffloadThreshold = options.RemoteOffloadThreshold;
+	if (!SchedulerPolicy::kSharedPool && m_sharedPool != nullptr) {
+		printf("Warning: The scheduler was built without the shared task pool. Shared tasks will run locally\n");
+	} else if (m_sharedPool != nullptr && !m_shareTasks) {
+		printf("Warning: The shared task pool isn't open, or the schedule is being recorded or replayed. Shared tasks will run locally\n");
+	}
+	if (GetScheduleMode() == ScheduleMode::Record) {
+		m_scheduleLog->Reset(m_numThreads);
+	} else if (GetScheduleMode() == ScheduleMode::Replay && m_scheduleLog->GetNumThreads() != m_numThreads) {
+		printf("Warning: The schedule log was recorded with a different number of threads. It can't be replayed\n");
+		m_replayDiverged.store(true, std::memory_order_relaxed);
+	}
+
+	// The CPU for each thread, or FTL_INVALID_INDEX to leave it unpinned
+	std::vector<uint> threadCpus(m_numThreads, FTL_INVALID_INDEX);
+	if (options.Groups.empty()) {
+		m_groups.emplace_back(new WorkerGroup(WorkerGroupOptions("default", static_cast<uint>(m_numThreads)), 0, m_numThreads, readyFiberCapacity));
+	} else {
+		std::size_t firstThread = 0;
+		for (const WorkerGroupOptions &groupOptions : options.Groups) {
+			std::size_t numThreads = std::max(1u, groupOptions.NumThreads);
+			m_groups.emplace_back(new WorkerGroup(groupOptions, firstThread, numThreads, readyFiberCapacity));
+
+			for (std::size_t i = 0; i < numThreads; ++i) {
+				m_tls[firstThread + i].Group = static_cast<uint>(m_groups.size() - 1);
+				if (!groupOptions.Cpus.empty()) {
+					threadCpus[firstThread + i] = groupOptions.Cpus[i % groupOptions.Cpus.size()];
+				}
+			}
+			firstThread += numThreads;
+		}
+	}
+	if (pinThreads) {
+		for (std::size_t i = 0; i < m_numThreads; ++i) {
+			if (threadCpus[i] == FTL_INVALID_INDEX) {
+				threadCpus[i] = workerCpus[i % workerCpus.size()];
+			}
+		}
+	}
 
 	// Set the properties for the current thread
-	SetCurrentThreadAffinity(1);
+	if (threadCpus[0] != FTL_INVALID_INDEX) {
+		SetCurrentThreadAffinity(threadCpus[0]);
+	}
 	m_threads[0] = GetCurrentThread();
 
 	// Create the remaining threads
@@ -212,12 +486,23 @@ void TaskScheduler::Run(uint fiberPoolSize, TaskFunction mainTask, void *mainTas
 		threadArgs->taskScheduler = this;
 		threadArgs->threadIndex = i;
 
-		if (!CreateThread(524288, ThreadStart, threadArgs, i, &m_threads[i])) {
+		bool created = threadCpus[i] != FTL_INVALID_INDEX ? CreateThread(524288, ThreadStart, threadArgs, threadCpus[i], &m_threads[i]) :
+		                                                    CreateThread(524288, ThreadStart, threadArgs, &m_threads[i]);
+		if (!created) {
 			printf("Error: Failed to create all the worker threads");
 			return;
 		}
 	}
 
+	// Warm up our own share of the fiber stacks, and wait for the other threads to finish theirs
+	if (m_prefaultStackBytes != 0) {
+		PrefaultFiberStacks(0);
+		m_numPrefaultingThreads.fetch_sub(1, std::memory_order_release);
+		while (m_numPrefaultingThreads.load(std::memory_order_acquire) != 0) {
+			std::this_thread::yield();
+		}
+	}
+
 	// Signal the worker threads that we're fully initialized
 	m_initialized.store(true, std::memory_order_release);
 
@@ -246,14 +531,32 @@ void TaskScheduler::Run(uint fiberPoolSize, TaskFunction mainTask, void *mainTas
 	}
 
 	// Cleanup
-	delete[] m_fibers;
-	m_fibers = nullptr;
-	delete[] m_freeFibers;
-	m_freeFibers = nullptr;
-	delete[] m_tls;
-	m_tls = nullptr;
+	FreeWorkerMemory();
+	delete[] m_fiberGroups;
+	m_fiberGroups = nullptr;
+	delete[] m_fiberHelpDepths;
+	m_fiberHelpDepths = nullptr;
+	delete[] m_fiberTaskLinks;
+	m_fiberTaskLinks = nullptr;
+	delete[] m_fiberWaitIds;
+	m_fiberWaitIds = nullptr;
+	m_replayTasks.clear();
+	for (auto &readyFiber : m_replayFibers) {
+		delete readyFiber.second.FiberStoredFlag;
+	}
+	m_replayFibers.clear();
+	// Any delayed tasks that weren't due yet are dropped
+	m_delayedTasks.clear();
+	m_numDelayedTasks.store(0, std::memory_order_relaxed);
 
 	m_threads.clear();
+	m_groups.clear();
+	m_mailboxes.clear();
+
+	// Give the calling thread its original affinity back
+	if (threadCpus[0] != FTL_INVALID_INDEX) {
+		SetCurrentThreadCpus(allowedCpus);
+	}
 
 	return;
 }
@@ -265,7 +568,86 @@ void TaskScheduler::AddTask(Task task, AtomicCounter *counter) {
 
 	TaskBundle bundle = {task, counter};
 	ThreadLocalStorage &tls = m_tls[GetCurrentThreadIndex()];
-	tls.TaskQueue.Push(bundle);
+	LinkParentTask(tls, &bundle);
+	if (GetScheduleMode() != ScheduleMode::Normal && TrackSpawnedTask(tls, &bundle, tls.Group)) {
+		return;
+	}
+
+	CollectTaskQueueGarbage(tls);
+	SetNextTask(tls, bundle);
+	WakeThreadIfBacklogged(tls);
+}
+
+void TaskScheduler::AddTask(Task task, AtomicCounter *counter, uint group) {
+	if (group == GetCurrentWorkerGroup()) {
+		AddTask(task, counter);
+		return;
+	}
+
+	if (counter != nullptr) {
+		counter->Store(1);
+	}
+
+	TaskBundle bundle = {task, counter};
+	ThreadLocalStorage &tls = m_tls[GetCurrentThreadIndex()];
+	LinkParentTask(tls, &bundle);
+	if (GetScheduleMode() != ScheduleMode::Normal && TrackSpawnedTask(tls, &bundle, group)) {
+		return;
+	}
+
+	InjectTask(m_groups[group]->Injections, bundle);
+	WakeGroupThread(*m_groups[group]);
+}
+
+void TaskScheduler::AddTasks(uint numTasks, Task *tasks, AtomicCounter *counter, uint group) {
+	if (group == GetCurrentWorkerGroup()) {
+		AddTasks(numTasks, tasks, counter);
+		return;
+	}
+
+	if (counter != nullptr) {
+		counter->Store(numTasks);
+	}
+
+	const bool tracked = GetScheduleMode() != ScheduleMode::Normal;
+	ThreadLocalStorage &tls = m_tls[GetCurrentThreadIndex()];
+	for (uint i = 0; i < numTasks; ++i) {
+		TaskBundle bundle = {tasks[i], counter};
+		LinkParentTask(tls, &bundle);
+		if (tracked && TrackSpawnedTask(tls, &bundle, group)) {
+			continue;
+		}
+		InjectTask(m_groups[group]->Injections, bundle);
+	}
+	WakeGroupThread(*m_groups[group]);
+}
+
+void TaskScheduler::AddTask(Task task, AtomicCounter *counter, Affinity affinity) {
+	AddTasks(1, &task, counter, &affinity);
+}
+
+void TaskScheduler::AddTasks(uint numTasks, Task *tasks, AtomicCounter *counter, const Affinity *affinities) {
+	for (uint i = 0; i < numTasks; ++i) {
+		if (affinities[i].Worker >= m_numThreads) {
+			printf("Error: Task %u has an affinity for worker %u, but there are only %u workers\n", i, affinities[i].Worker, static_cast<uint>(m_numThreads));
+			std::abort();
+		}
+	}
+
+	if (counter != nullptr) {
+		counter->Store(numTasks);
+	}
+
+	ThreadLocalStorage &tls = m_tls[GetCurrentThreadIndex()];
+	const bool tracked = GetScheduleMode() != ScheduleMode::Normal;
+	for (uint i = 0; i < numTasks; ++i) {
+		TaskBundle bundle = {tasks[i], counter};
+		LinkParentTask(tls, &bundle);
+		if (tracked && TrackSpawnedTask(tls, &bundle, m_tls[affinities[i].Worker].Group)) {
+			continue;
+		}
+		PostToMailbox(bundle, affinities[i]);
+	}
 }
 
 void TaskScheduler::AddTasks(uint numTasks, Task *tasks, AtomicCounter *counter) {
@@ -274,10 +656,51 @@ void TaskScheduler::AddTasks(uint numTasks, Task *tasks, AtomicCounter *counter)
 	}
 
 	ThreadLocalStorage &tls = m_tls[GetCurrentThreadIndex()];
+	CollectTaskQueueGarbage(tls);
+	const bool tracked = GetScheduleMode() != ScheduleMode::Normal;
 	for (uint i = 0; i < numTasks; ++i) {
 		TaskBundle bundle = {tasks[i], counter};
-		tls.TaskQueue.Push(bundle);
+		LinkParentTask(tls, &bundle);
+		if (tracked && TrackSpawnedTask(tls, &bundle, tls.Group)) {
+			continue;
+		}
+		// Only the last task would stay in the slot, so don't pay for the exchange on the others
+		if (i + 1 < numTasks) {
+			PushTask(tls, bundle);
+		} else {
+			SetNextTask(tls, bundle);
+		}
+	}
+	WakeThreadIfBacklogged(tls);
+}
+
+/* Does nothing. WaitForSharedCounter() sleeps by waiting for it */
+static void EmptySharedPollTask(TaskScheduler *taskScheduler, void *arg) {
+	(void)taskScheduler;
+	(void)arg;
+}
+
+/* Orders the delayed task heap so the earliest DueTime is at the front */
+template <typename T>
+static bool IsDueLater(const T &a, const T &b) {
+	return a.DueTime > b.DueTime;
+}
+
+void TaskScheduler::AddDelayedTask(Task task, std::chrono::steady_clock::duration delay, AtomicCounter *counter) {
+	if (counter != nullptr) {
+		counter->Store(1);
 	}
+
+	DelayedTask delayedTask;
+	delayedTask.DueTime = std::chrono::steady_clock::now() + delay;
+	delayedTask.Bundle = {task, counter};
+	LinkParentTask(m_tls[GetCurrentThreadIndex()], &delayedTask.Bundle);
+	delayedTask.Group = GetCurrentWorkerGroup();
+
+	std::lock_guard<std::mutex> lock(m_delayedTasksLock);
+	m_delayedTasks.push_back(delayedTask);
+	std::push_heap(m_delayedTasks.begin(), m_delayedTasks.end(), IsDueLater<DelayedTask>);
+	m_numDelayedTasks.store(m_delayedTasks.size(), std::memory_order_release);
 }
 
 std::size_t TaskScheduler::GetCurrentThreadIndex() {
@@ -300,25 +723,197 @@ std::size_t TaskScheduler::GetCurrentThreadIndex() {
 	return FTL_INVALID_INDEX;
 }
 
+void TaskScheduler::SetActiveThreadLimits(uint minActiveThreads, uint maxActiveThreads) {
+	if (!SchedulerPolicy::kParking) {
+		printf("Warning: The scheduler was built without parking. SetActiveThreadLimits() has no effect\n");
+		return;
+	}
+
+	minActiveThreads = std::max(1u, std::min(minActiveThreads, static_cast<uint>(m_numThreads)));
+	maxActiveThreads = std::max(minActiveThreads, std::min(maxActiveThreads, static_cast<uint>(m_numThreads)));
+
+	std::lock_guard<std::mutex> lock(m_parkingMutex);
+	m_minActiveThreads.store(minActiveThreads, std::memory_order_relaxed);
+	m_maxActiveThreads.store(maxActiveThreads, std::memory_order_relaxed);
+
+	// Bring the active count back up to the new minimum right away
+	// Threads above the new maximum will park themselves the next time they're idle
+	while (m_numActiveThreads.load(std::memory_order_relaxed) < minActiveThreads) {
+		if (!WakeParkedThread(nullptr)) {
+			break;
+		}
+	}
+}
+
+uint TaskScheduler::GetWorkerGroup(const char *name) const {
+	for (std::size_t i = 0; i < m_groups.size(); ++i) {
+		if (m_groups[i]->Name == name) {
+			return static_cast<uint>(i);
+		}
+	}
+
+	return UINT_MAX;
+}
+
+uint TaskScheduler::GetCurrentWorkerGroup() {
+	return m_tls[GetCurrentThreadIndex()].Group;
+}
+
+TaskFunction TaskScheduler::GetParentTaskFunction() {
+	if (!m_trackParentTasks) {
+		return nullptr;
+	}
+
+	return m_fiberTaskLinks[m_tls[GetCurrentThreadIndex()].CurrentFiberIndex].ParentFunction;
+}
+
+uint TaskScheduler::GetNumWorkerGroups() const {
+	return static_cast<uint>(m_groups.size());
+}
+
+std::size_t TaskScheduler::GetNumThreads() const {
+	return m_numThreads;
+}
+
+uint TaskScheduler::GetNumActiveThreads() const {
+	return m_numActiveThreads.load(std::memory_order_relaxed);
+}
+
+HugePageBacking TaskScheduler::GetHugePageBacking() const {
+	return m_hugePageBacking;
+}
+
+bool TaskScheduler::HasReplayDiverged() const {
+	return m_replayDiverged.load(std::memory_order_acquire);
+}
+
 bool TaskScheduler::GetNextTask(TaskBundle *nextTask) {
 	std::size_t currentThreadIndex = GetCurrentThreadIndex();
 	ThreadLocalStorage &tls = m_tls[currentThreadIndex];
 
-	// Try to pop from our own queue
-	if (tls.TaskQueue.Pop(nextTask)) {
+	// We don't hold any pointers into the other queues' arrays between calls, so this is a quiescent point
+	tls.QuiescentEpoch.store(m_epoch.load(std::memory_order_acquire), std::memory_order_release);
+
+	if (m_numDelayedTasks.load(std::memory_order_acquire) != 0) {
+		AddDueDelayedTasks(tls);
+	}
+
+	// The log decides which task we run next
+	if (GetScheduleMode() == ScheduleMode::Replay) {
+		return GetNextReplayTask(tls, nextTask);
+	}
+
+	if (PopLocalTask(tls, nextTask)) {
 		return true;
 	}
 
-	// Ours is empty, try to steal from the others'
-	std::size_t threadIndex = tls.LastSuccessfulSteal;
-	for (std::size_t i = 0; i < m_numThreads; ++i) {
-		const std::size_t threadIndexToStealFrom = (threadIndex + i) % m_numThreads;
-		if (threadIndexToStealFrom == currentThreadIndex) {
+	// Then the tasks sent to this thread in particular
+	if (PopMailboxTask(tls, currentThreadIndex, nextTask)) {
+		return true;
+	}
+
+	// Then take any tasks other groups have given us
+	WorkerGroup &group = *m_groups[tls.Group];
+	if (PopInjectedTask(group.Injections, nextTask)) {
+		RecordEvent(tls, ScheduleEventType::Task, nextTask->Id, TaskSource::Injection, tls.Group);
+		return true;
+	}
+
+	// We're about to go idle or steal. Either way, publish any task completions we've been holding on to
+	FlushPendingDecrements(tls);
+	// And give back any memory left over from the last burst of tasks
+	CollectTaskQueueGarbage(tls);
+
+	// Ours is empty, try to steal from the rest of our group
+	bool success = StealFromGroup(tls, group, false, nextTask);
+
+	// Then take over any mailboxes their owners haven't gotten to in a while
+	if (!success) {
+		success = StealMailboxTask(tls, currentThreadIndex, nextTask);
+	}
+
+	// And if we're allowed to, from the other groups
+	if (!success && group.StealFromOtherGroups) {
+		for (std::size_t i = 1; i < m_groups.size(); ++i) {
+			WorkerGroup &otherGroup = *m_groups[(tls.Group + i) % m_groups.size()];
+			if (StealFromGroup(tls, otherGroup, true, nextTask)) {
+				success = true;
+				break;
+			}
+		}
+	}
+
+	// Finally, help out the other processes
+	if (!success && SharesTasks()) {
+		success = PopSharedTask(nextTask);
+	}
+
+	// We're done touching the other queues' arrays, so this is a quiescent point as well.
+	// Publishing it here keeps a thread that goes on to run a long task from holding back reclamation
+	tls.QuiescentEpoch.store(m_epoch.load(std::memory_order_acquire), std::memory_order_release);
+
+	return success;
+}
+
+bool TaskScheduler::PopLocalTask(ThreadLocalStorage &tls, TaskBundle *nextTask) {
+	// The most recently spawned task is first in line
+	uint32 taskIndex = tls.NextTaskIndex.load(std::memory_order_relaxed);
+	if (taskIndex != Slab<TaskBundle>::kInvalidIndex) {
+		taskIndex = tls.NextTaskIndex.exchange(Slab<TaskBundle>::kInvalidIndex, std::memory_order_acquire);
+	}
+	if (taskIndex != Slab<TaskBundle>::kInvalidIndex) {
+		*nextTask = tls.TaskSlab.Get(taskIndex);
+		tls.TaskSlab.Free(taskIndex);
+		RecordEvent(tls, ScheduleEventType::Task, nextTask->Id, TaskSource::NextTask);
+		return true;
+	}
+
+	// Then our own queue
+	if (tls.TaskQueue.Pop(&taskIndex)) {
+		*nextTask = tls.TaskSlab.Get(taskIndex);
+		tls.TaskSlab.Free(taskIndex);
+		RecordEvent(tls, ScheduleEventType::Task, nextTask->Id, TaskSource::OwnQueue);
+		return true;
+	}
+
+	return false;
+}
+
+bool TaskScheduler::StealFromGroup(ThreadLocalStorage &tls, WorkerGroup &group, bool includeInjections, TaskBundle *nextTask) {
+	if (includeInjections && PopInjectedTask(group.Injections, nextTask)) {
+		RecordEvent(tls, ScheduleEventType::Task, nextTask->Id, TaskSource::Injection, m_tls[group.FirstThread].Group);
+		return true;
+	}
+
+	// LastSuccessfulSteal is only tracked for our own group
+	const bool ownGroup = &group == m_groups[tls.Group].get();
+	const std::size_t startOffset = ownGroup ? tls.LastSuccessfulSteal : 0;
+	for (std::size_t i = 0; i < group.NumThreads; ++i) {
+		const std::size_t offset = (startOffset + i) % group.NumThreads;
+		ThreadLocalStorage &otherTLS = m_tls[group.FirstThread + offset];
+		if (&otherTLS == &tls) {
 			continue;
 		}
-		ThreadLocalStorage &otherTLS = m_tls[threadIndexToStealFrom];
-		if (otherTLS.TaskQueue.Steal(nextTask)) {
-			tls.LastSuccessfulSteal = i;
+
+		// Take the owner's next task slot only once its queue is empty. It's the task the owner is most likely
+		// to get to soon, with the data in its cache
+		uint32 taskIndex;
+		bool stolen = otherTLS.TaskQueue.Steal(&taskIndex);
+		if (!stolen && otherTLS.NextTaskIndex.load(std::memory_order_relaxed) != Slab<TaskBundle>::kInvalidIndex) {
+			taskIndex = otherTLS.NextTaskIndex.exchange(Slab<TaskBundle>::kInvalidIndex, std::memory_order_acquire);
+			stolen = taskIndex != Slab<TaskBundle>::kInvalidIndex;
+		}
+		if (stolen) {
+			// Copy the task out, so we can hand the slot straight back to its owner
+			*nextTask = otherTLS.TaskSlab.Get(taskIndex);
+			otherTLS.TaskSlab.RemoteFree(taskIndex);
+			if (ownGroup) {
+				tls.LastSuccessfulSteal = offset;
+			}
+			RecordEvent(tls, ScheduleEventType::Task, nextTask->Id, TaskSource::Steal, static_cast<uint32>(group.FirstThread + offset));
+
+			// If there's still plenty left to steal, the active threads can't keep up. Get some help
+			WakeThreadIfBacklogged(otherTLS);
 			return true;
 		}
 	}
@@ -326,38 +921,718 @@ bool TaskScheduler::GetNextTask(TaskBundle *nextTask) {
 	return false;
 }
 
-std::size_t TaskScheduler::GetNextFreeFiberIndex() {
-	for (uint j = 0; ; ++j) {
-		for (std::size_t i = 0; i < m_fiberPoolSize; ++i) {
-			// Double lock
-			if (!m_freeFibers[i].load(std::memory_order_relaxed)) {
-				continue;
-			}
+void TaskScheduler::InjectTask(TaskInbox &inbox, const TaskBundle &bundle) {
+	if (inbox.Queue.TryPush(bundle)) {
+		return;
+	}
 
-			if (!m_freeFibers[i].load(std::memory_order_acquire)) {
-				continue;
-			}
+	std::lock_guard<std::mutex> lock(inbox.OverflowLock);
+	inbox.Overflow.push_back(bundle);
+	inbox.OverflowSize.store(inbox.Overflow.size(), std::memory_order_release);
+}
 
-			bool expected = true;
-			if (std::atomic_compare_exchange_weak_explicit(&m_freeFibers[i], &expected, false, std::memory_order_release, std::memory_order_relaxed)) {
-				return i;
-			}
-		}
+bool TaskScheduler::PopInjectedTask(TaskInbox &inbox, TaskBundle *nextTask) {
+	if (inbox.Queue.TryPop(nextTask)) {
+		return true;
+	}
+	if (inbox.OverflowSize.load(std::memory_order_acquire) == 0) {
+		return false;
+	}
 
-		if (j > 10) {
-			printf("No free fibers in the pool. Possible deadlock");
-		}
+	std::lock_guard<std::mutex> lock(inbox.OverflowLock);
+	if (inbox.Overflow.empty()) {
+		return false;
 	}
+	*nextTask = inbox.Overflow.front();
+	inbox.Overflow.pop_front();
+	inbox.OverflowSize.store(inbox.Overflow.size(), std::memory_order_release);
+
+	return true;
 }
 
-void TaskScheduler::CleanUpOldFiber() {
-	// Clean up from the last Fiber to run on this thread
-	//
-	// Explanation:
-	// When switching between fibers, there's the innate problem of tracking the fibers.
-	// For example, let's say we discover a waiting fiber that's ready. We need to put the currently 
-	// running fiber back into the fiber pool, and then switch to the waiting fiber. However, we can't 
-	// just do the equivalent of:
+/* The current time of steady_clock, in nanoseconds. See Mailbox::ServicedAt */
+static int64 SteadyNowNs() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void TaskScheduler::PostToMailbox(const TaskBundle &bundle, Affinity affinity) {
+	Mailbox &mailbox = *m_mailboxes[affinity.Worker];
+	if (affinity.Strict) {
+		InjectTask(mailbox.Strict, bundle);
+	} else {
+		// Start the steal delay when work arrives at an empty mailbox, so it isn't measured from whenever
+		// the owner last happened to take something
+		if (!mailbox.Preferred.HasTasks()) {
+			mailbox.ServicedAt.store(SteadyNowNs(), std::memory_order_relaxed);
+		}
+		InjectTask(mailbox.Preferred, bundle);
+	}
+
+	// Pairs with the fence in ParkIfIdle(). Either we see the owner parked, or it sees the task in its mailbox
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (!HasParkedThreads()) {
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(m_parkingMutex);
+	ThreadLocalStorage &ownerTLS = m_tls[affinity.Worker];
+	if (ownerTLS.Parked && m_numActiveThreads.load(std::memory_order_relaxed) < m_maxActiveThreads.load(std::memory_order_relaxed)) {
+		ownerTLS.Parked = false;
+		m_numActiveThreads.fetch_add(1, std::memory_order_relaxed);
+		m_numParkedThreads.fetch_sub(1, std::memory_order_relaxed);
+		ownerTLS.ParkCondition.notify_one();
+	}
+}
+
+bool TaskScheduler::PopMailboxTask(ThreadLocalStorage &tls, std::size_t threadIndex, TaskBundle *nextTask) {
+	Mailbox &mailbox = *m_mailboxes[threadIndex];
+	if (PopInjectedTask(mailbox.Strict, nextTask)) {
+		RecordEvent(tls, ScheduleEventType::Task, nextTask->Id, TaskSource::Mailbox, static_cast<uint32>(threadIndex));
+		return true;
+	}
+	if (!mailbox.Preferred.HasTasks() || !PopInjectedTask(mailbox.Preferred, nextTask)) {
+		return false;
+	}
+
+	// Hold off the thieves for the rest of the mailbox
+	mailbox.ServicedAt.store(SteadyNowNs(), std::memory_order_relaxed);
+	RecordEvent(tls, ScheduleEventType::Task, nextTask->Id, TaskSource::Mailbox, static_cast<uint32>(threadIndex));
+	return true;
+}
+
+bool TaskScheduler::StealMailboxTask(ThreadLocalStorage &tls, std::size_t threadIndex, TaskBundle *nextTask) {
+	const WorkerGroup &group = *m_groups[tls.Group];
+	int64 now = 0;
+	for (std::size_t i = group.FirstThread; i < group.FirstThread + group.NumThreads; ++i) {
+		Mailbox &mailbox = *m_mailboxes[i];
+		if (i == threadIndex || !mailbox.Preferred.HasTasks()) {
+			continue;
+		}
+
+		// Only look at the clock once there's something to steal
+		if (now == 0) {
+			now = SteadyNowNs();
+		}
+		if (now - mailbox.ServicedAt.load(std::memory_order_relaxed) < m_mailboxStealDelay.count()) {
+			continue;
+		}
+
+		if (PopInjectedTask(mailbox.Preferred, nextTask)) {
+			RecordEvent(tls, ScheduleEventType::Task, nextTask->Id, TaskSource::Mailbox, static_cast<uint32>(i));
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void TaskScheduler::PushTask(ThreadLocalStorage &tls, const TaskBundle &bundle) {
+	uint32 taskIndex = tls.TaskSlab.Allocate();
+	tls.TaskSlab.Get(taskIndex) = bundle;
+	tls.TaskQueue.Push(taskIndex);
+}
+
+void TaskScheduler::SetNextTask(ThreadLocalStorage &tls, const TaskBundle &bundle) {
+	uint32 taskIndex = tls.TaskSlab.Allocate();
+	tls.TaskSlab.Get(taskIndex) = bundle;
+
+	// Release, so a thief that takes the slot sees the task. The previous task may have been stolen already
+	uint32 previousIndex = tls.NextTaskIndex.exchange(taskIndex, std::memory_order_acq_rel);
+	if (previousIndex != Slab<TaskBundle>::kInvalidIndex) {
+		tls.TaskQueue.Push(previousIndex);
+	}
+}
+
+void TaskScheduler::AddDueDelayedTasks(ThreadLocalStorage &tls) {
+	// Every idle thread polls this. If someone else is already checking, leave it to them
+	std::unique_lock<std::mutex> lock(m_delayedTasksLock, std::try_to_lock);
+	if (!lock.owns_lock()) {
+		return;
+	}
+
+	const auto now = std::chrono::steady_clock::now();
+	while (!m_delayedTasks.empty() && m_delayedTasks.front().DueTime <= now) {
+		std::pop_heap(m_delayedTasks.begin(), m_delayedTasks.end(), IsDueLater<DelayedTask>);
+		DelayedTask delayedTask = m_delayedTasks.back();
+		m_delayedTasks.pop_back();
+
+		// The task only becomes known to the log once it's due, so the thread that spawns it can differ between
+		// the recording and the replay. Either way, it ends up in the right group once the replay diverges
+		if (GetScheduleMode() != ScheduleMode::Normal && TrackSpawnedTask(tls, &delayedTask.Bundle, delayedTask.Group)) {
+			continue;
+		}
+		if (delayedTask.Group == tls.Group) {
+			SetNextTask(tls, delayedTask.Bundle);
+		} else {
+			InjectTask(m_groups[delayedTask.Group]->Injections, delayedTask.Bundle);
+			WakeGroupThread(*m_groups[delayedTask.Group]);
+		}
+	}
+	m_numDelayedTasks.store(m_delayedTasks.size(), std::memory_order_release);
+}
+
+void TaskScheduler::AddSharedTasks(uint numTasks, const SharedTask *tasks, const SharedCounter *counter) {
+	if (counter != nullptr) {
+		m_sharedPool->StoreCounter(*counter, numTasks);
+	}
+
+	for (uint i = 0; i < numTasks; ++i) {
+		if (SharesTasks() && m_sharedPool->TryPush(tasks[i], counter)) {
+			continue;
+		}
+
+		// The pool is full, or we aren't sharing. Run it ourselves
+		SharedTaskBundle *bundle = new SharedTaskBundle();
+		bundle->Task = tasks[i];
+		bundle->CounterIndex = counter != nullptr ? counter->Index : UINT_MAX;
+		AddTask({RunSharedTask, bundle});
+	}
+}
+
+void TaskScheduler::WaitForSharedCounter(SharedCounter counter, uint value) {
+	while (m_sharedPool->LoadCounter(counter) != value) {
+		AtomicCounter sleepCounter(this);
+		AddDelayedTask({EmptySharedPollTask, nullptr}, std::chrono::microseconds(FTL_SHARED_COUNTER_POLL_US), &sleepCounter);
+		WaitForCounter(&sleepCounter, 0);
+	}
+}
+
+void TaskScheduler::AddRemoteTasks(uint numTasks, const RemoteTask *tasks, AtomicCounter *counter) {
+	if (m_transport == nullptr) {
+		printf("Error: Remote tasks need SchedulerOptions::Transport, to look up their functions\n");
+		std::abort();
+	}
+
+	if (counter != nullptr) {
+		counter->Store(numTasks);
+	}
+
+	ThreadLocalStorage &tls = m_tls[GetCurrentThreadIndex()];
+	CollectTaskQueueGarbage(tls);
+	// Remote completions can't be recorded, so remote tasks only run locally while recording or replaying
+	const bool tracked = GetScheduleMode() != ScheduleMode::Normal;
+	for (uint i = 0; i < numTasks; ++i) {
+		if (!tracked && tls.TaskQueue.Size() >= m_remoteOffloadThreshold && m_transport->Submit(this, tasks[i], counter, tls.Group)) {
+			continue;
+		}
+
+		TaskBundle bundle = {{RunRemoteTask, new RemoteTask(tasks[i])}, counter};
+		LinkParentTask(tls, &bundle);
+		if (tracked && TrackSpawnedTask(tls, &bundle, tls.Group)) {
+			continue;
+		}
+		SetNextTask(tls, bundle);
+	}
+	WakeThreadIfBacklogged(tls);
+}
+
+void TaskScheduler::AddExternalTask(Task task, AtomicCounter *counter, uint group) {
+	TaskBundle bundle = {task, counter};
+	InjectTask(m_groups[group]->Injections, bundle);
+	WakeGroupThread(*m_groups[group]);
+}
+
+void TaskScheduler::RunRemoteTask(TaskScheduler *taskScheduler, void *arg) {
+	RemoteTask *task = reinterpret_cast<RemoteTask *>(arg);
+	taskScheduler->m_transport->RunTask(taskScheduler, *task);
+	delete task;
+}
+
+bool TaskScheduler::PopSharedTask(TaskBundle *nextTask) {
+	// Most passes find the pool empty, so only allocate once we have a task
+	SharedTask task;
+	uint32 counterIndex;
+	if (!m_sharedPool->TryPop(&task, &counterIndex)) {
+		return false;
+	}
+
+	nextTask->TaskToExecute = {RunSharedTask, new SharedTaskBundle{task, counterIndex}};
+	nextTask->Counter = nullptr;
+	nextTask->Id = 0;
+	return true;
+}
+
+void TaskScheduler::RunSharedTask(TaskScheduler *taskScheduler, void *arg) {
+	SharedTaskBundle *bundle = reinterpret_cast<SharedTaskBundle *>(arg);
+	SharedTaskPool *sharedPool = taskScheduler->m_sharedPool;
+
+	SharedTaskFunction function = sharedPool->GetFunction(bundle->Task.FunctionId);
+	if (function != nullptr) {
+		function(taskScheduler, bundle->Task.Payload, bundle->Task.PayloadSize);
+	} else {
+		printf("Warning: No function is registered for shared task id %u\n", bundle->Task.FunctionId);
+	}
+
+	if (bundle->CounterIndex != UINT_MAX) {
+		sharedPool->FetchSubCounter(SharedCounter{bundle->CounterIndex}, 1);
+	}
+	delete bundle;
+}
+
+void TaskScheduler::CollectTaskQueueGarbage(ThreadLocalStorage &tls) {
+	tls.TaskQueue.TryShrink();
+	tls.TaskSlab.TryShrink();
+	tls.ClosureSlab.TryShrink();
+	if (!tls.TaskQueue.HasRetiredArrays()) {
+		return;
+	}
+
+	// Pairs with the fence in ParkIfIdle(), so we can't miss a thread that is coming out of parking
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+
+	uint64 safeEpoch = UINT64_MAX;
+	for (std::size_t i = 0; i < m_numThreads; ++i) {
+		uint64 epoch = m_tls[i].QuiescentEpoch.load(std::memory_order_acquire);
+		if (epoch < safeEpoch) {
+			safeEpoch = epoch;
+		}
+	}
+
+	tls.TaskQueue.ReclaimRetiredArrays(&m_epoch, safeEpoch);
+}
+
+uint64 TaskScheduler::NewScheduleId(ThreadLocalStorage &tls) {
+	// The top bits hold the thread index, so ids are unique across threads
+	return (static_cast<uint64>(&tls - m_tls) << 40) | tls.NextScheduleId++;
+}
+
+void TaskScheduler::RecordEvent(ThreadLocalStorage &tls, ScheduleEventType type, uint64 id, TaskSource source, uint32 victim) {
+	if (GetScheduleMode() != ScheduleMode::Record) {
+		return;
+	}
+
+	// Each thread only appends to its own log, so this doesn't need a lock
+	ScheduleEvent event = {id, victim, type, source};
+	m_scheduleLog->m_threads[&tls - m_tls].push_back(event);
+}
+
+bool TaskScheduler::TrackSpawnedTask(ThreadLocalStorage &tls, TaskBundle *bundle, uint group) {
+	bundle->Id = NewScheduleId(tls);
+	if (GetScheduleMode() != ScheduleMode::Replay) {
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock(m_replayLock);
+	m_replayTasks.emplace(bundle->Id, ReplayTask{*bundle, group});
+	return true;
+}
+
+const ScheduleEvent *TaskScheduler::PeekReplayEvent(ThreadLocalStorage &tls) {
+	const std::vector<ScheduleEvent> &events = m_scheduleLog->m_threads[&tls - m_tls];
+	while (tls.ReplayCursor < events.size() && events[tls.ReplayCursor].Type == ScheduleEventType::Ready) {
+		++tls.ReplayCursor;
+	}
+
+	return tls.ReplayCursor < events.size() ? &events[tls.ReplayCursor] : nullptr;
+}
+
+void TaskScheduler::AdvanceReplay(ThreadLocalStorage &tls) {
+	++tls.ReplayCursor;
+	tls.ReplayStalled = false;
+	m_replayProgress.fetch_add(1, std::memory_order_relaxed);
+}
+
+void TaskScheduler::StallReplay(ThreadLocalStorage &tls) {
+	// Another thread may just be running a long task. We've only diverged if the whole replay is stuck
+	const auto now = std::chrono::steady_clock::now();
+	const uint64 progress = m_replayProgress.load(std::memory_order_relaxed);
+	if (!tls.ReplayStalled || tls.ReplayStalledProgress != progress) {
+		tls.ReplayStalled = true;
+		tls.ReplayStalledSince = now;
+		tls.ReplayStalledProgress = progress;
+		return;
+	}
+
+	if (now - tls.ReplayStalledSince >= m_replayTimeout && !m_replayDiverged.exchange(true, std::memory_order_acq_rel)) {
+		printf("Warning: The run diverged from the schedule log. Scheduling freely from now on\n");
+	}
+}
+
+bool TaskScheduler::GetNextReplayTask(ThreadLocalStorage &tls, TaskBundle *nextTask) {
+	if (m_replayDiverged.load(std::memory_order_acquire)) {
+		// Take any task of our group
+		std::unique_lock<std::mutex> lock(m_replayLock);
+		for (auto iter = m_replayTasks.begin(); iter != m_replayTasks.end(); ++iter) {
+			if (iter->second.Group == tls.Group) {
+				*nextTask = iter->second.Bundle;
+				m_replayTasks.erase(iter);
+				return true;
+			}
+		}
+	} else {
+		const ScheduleEvent *event = PeekReplayEvent(tls);
+		if (event != nullptr && event->Type == ScheduleEventType::Task) {
+			std::unique_lock<std::mutex> lock(m_replayLock);
+			auto iter = m_replayTasks.find(event->Id);
+			if (iter != m_replayTasks.end()) {
+				*nextTask = iter->second.Bundle;
+				m_replayTasks.erase(iter);
+				lock.unlock();
+
+				AdvanceReplay(tls);
+				return true;
+			}
+		}
+
+		// Once a thread has replayed its whole log, it only has to watch for work that no log accounts for
+		bool stalled = event != nullptr;
+		if (!stalled) {
+			std::lock_guard<std::mutex> lock(m_replayLock);
+			stalled = !m_replayTasks.empty() || !m_replayFibers.empty();
+		}
+		if (stalled) {
+			StallReplay(tls);
+		}
+	}
+
+	// The task we're waiting for may depend on our own pending fan-in decrements
+	FlushPendingDecrements(tls);
+	return false;
+}
+
+std::size_t TaskScheduler::GetNextReplayFiber(ThreadLocalStorage &tls) {
+	const bool diverged = m_replayDiverged.load(std::memory_order_acquire);
+	const ScheduleEvent *event = diverged ? nullptr : PeekReplayEvent(tls);
+	if (!diverged && (event == nullptr || event->Type != ScheduleEventType::Resume)) {
+		return FTL_INVALID_INDEX;
+	}
+
+	// Once the replay has diverged, any fiber that is ready will do, as long as it's in our group
+	for (std::size_t i = 0; i < tls.PinnedTasks.size(); ++i) {
+		const PinnedWaitingFiberBundle &bundle = tls.PinnedTasks[i];
+		if ((diverged || m_fiberWaitIds[bundle.FiberIndex] == event->Id) && bundle.Counter->Load() == bundle.TargetValue) {
+			const std::size_t fiberIndex = bundle.FiberIndex;
+			tls.PinnedTasks.erase(tls.PinnedTasks.begin() + i);
+			if (!diverged) {
+				AdvanceReplay(tls);
+			}
+			return fiberIndex;
+		}
+	}
+
+	{
+		std::unique_lock<std::mutex> lock(m_replayLock);
+		auto iter = diverged ? m_replayFibers.begin() : m_replayFibers.find(event->Id);
+		for (; iter != m_replayFibers.end(); ++iter) {
+			const ReadyFiberBundle &readyFiber = iter->second;
+			if (readyFiber.FiberStoredFlag->load(std::memory_order_relaxed) && m_fiberGroups[readyFiber.FiberIndex] == tls.Group) {
+				const std::size_t fiberIndex = readyFiber.FiberIndex;
+				delete readyFiber.FiberStoredFlag;
+				m_replayFibers.erase(iter);
+				lock.unlock();
+
+				if (!diverged) {
+					AdvanceReplay(tls);
+				}
+				return fiberIndex;
+			}
+
+			// Only the fiber of the event will do
+			if (!diverged) {
+				break;
+			}
+		}
+	}
+
+	if (!diverged) {
+		StallReplay(tls);
+	}
+	return FTL_INVALID_INDEX;
+}
+
+void TaskScheduler::ParkIfIdle(ThreadLocalStorage &tls) {
+	// Replays hand out work through m_replayTasks and m_replayFibers, which never wake parked threads
+	if (GetScheduleMode() == ScheduleMode::Replay) {
+		return;
+	}
+
+	const uint numActiveThreads = m_numActiveThreads.load(std::memory_order_relaxed);
+	if (numActiveThreads <= m_minActiveThreads.load(std::memory_order_relaxed)) {
+		tls.IsIdle = false;
+		return;
+	}
+
+	// Fibers that are ready to resume can only be picked up by this thread. The next task slot is best run here too
+	if (!tls.PinnedTasks.empty() || !tls.ReadyFibers.empty() || tls.HandoffFiber.FiberIndex != FTL_INVALID_INDEX || tls.NextTaskIndex.load(std::memory_order_relaxed) != Slab<TaskBundle>::kInvalidIndex) {
+		tls.IsIdle = false;
+		return;
+	}
+
+	// The first thread of each group never parks, so every group can always make progress
+	WorkerGroup &group = *m_groups[tls.Group];
+	const Mailbox &mailbox = *m_mailboxes[&tls - m_tls];
+	if (&tls == &m_tls[group.FirstThread] || group.HasInjectedWork() || mailbox.Strict.HasTasks() || mailbox.Preferred.HasTasks()) {
+		tls.IsIdle = false;
+		return;
+	}
+
+	// Other processes can't wake us up
+	if (SharesTasks() && m_sharedPool->HasTasks()) {
+		tls.IsIdle = false;
+		return;
+	}
+
+	const auto now = std::chrono::steady_clock::now();
+	if (!tls.IsIdle) {
+		tls.IsIdle = true;
+		tls.IdleSince = now;
+	}
+
+	// If we're over the limit, park right away. Otherwise, wait until we've been idle for a while
+	if (numActiveThreads <= m_maxActiveThreads.load(std::memory_order_relaxed) && now - tls.IdleSince < m_parkDelay) {
+		return;
+	}
+
+	std::unique_lock<std::mutex> lock(m_parkingMutex);
+	// Another thread may have parked in the meantime
+	if (m_numActiveThreads.load(std::memory_order_relaxed) <= m_minActiveThreads.load(std::memory_order_relaxed) || m_quit.load(std::memory_order_acquire)) {
+		return;
+	}
+
+	m_numActiveThreads.fetch_sub(1, std::memory_order_relaxed);
+	m_numParkedThreads.fetch_add(1, std::memory_order_relaxed);
+	tls.Parked = true;
+	// We won't touch any of the queues while we're parked, so don't hold back reclamation
+	tls.QuiescentEpoch.store(UINT64_MAX, std::memory_order_release);
+
+	// Pairs with the fence in PostToMailbox(). Either the poster sees us parked, and wakes us once we wait,
+	// or we see its task here
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (mailbox.Strict.HasTasks() || mailbox.Preferred.HasTasks()) {
+		tls.Parked = false;
+		m_numActiveThreads.fetch_add(1, std::memory_order_relaxed);
+		m_numParkedThreads.fetch_sub(1, std::memory_order_relaxed);
+	}
+
+	while (tls.Parked) {
+		// A wake up can race with the timeout, so check the flag rather than the return value
+		tls.ParkCondition.wait_for(lock, m_parkDelay);
+		if (!tls.Parked) {
+			break;
+		}
+
+		// The backlog check in WakeThreadIfBacklogged() is racy, so we could have missed a wake up
+		// Check for ourselves every so often
+		if (m_quit.load(std::memory_order_acquire) || 
+		    (m_numActiveThreads.load(std::memory_order_relaxed) < m_maxActiveThreads.load(std::memory_order_relaxed) && (HasBackloggedQueue(group) || mailbox.Strict.HasTasks() || (SharesTasks() && m_sharedPool->HasTasks())))) {
+			tls.Parked = false;
+			m_numActiveThreads.fetch_add(1, std::memory_order_relaxed);
+			m_numParkedThreads.fetch_sub(1, std::memory_order_relaxed);
+		}
+	}
+	lock.unlock();
+
+	tls.IsIdle = false;
+	// Re-join the epoch before we touch the queues again. The fence makes sure that either a reclaiming
+	// thread sees our epoch, or we see the arrays it published before reclaiming the old ones
+	tls.QuiescentEpoch.store(m_epoch.load(std::memory_order_acquire), std::memory_order_seq_cst);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+void TaskScheduler::WakeThreadIfBacklogged(ThreadLocalStorage &queueTLS) {
+	if (!HasParkedThreads() || queueTLS.TaskQueue.Size() < FTL_BACKLOG_SIZE) {
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(m_parkingMutex);
+	WakeParkedThread(m_groups[queueTLS.Group].get());
+}
+
+void TaskScheduler::WakeGroupThread(WorkerGroup &group) {
+	if (!HasParkedThreads()) {
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(m_parkingMutex);
+	WakeParkedThread(&group);
+}
+
+bool TaskScheduler::WakeParkedThread(const WorkerGroup *group) {
+	if (m_numActiveThreads.load(std::memory_order_relaxed) >= m_maxActiveThreads.load(std::memory_order_relaxed)) {
+		return false;
+	}
+
+	const std::size_t firstThread = group != nullptr ? group->FirstThread : 0;
+	const std::size_t numThreads = group != nullptr ? group->NumThreads : m_numThreads;
+	for (std::size_t i = firstThread; i < firstThread + numThreads; ++i) {
+		ThreadLocalStorage &otherTLS = m_tls[i];
+		if (!otherTLS.Parked) {
+			continue;
+		}
+
+		otherTLS.Parked = false;
+		m_numActiveThreads.fetch_add(1, std::memory_order_relaxed);
+		m_numParkedThreads.fetch_sub(1, std::memory_order_relaxed);
+		otherTLS.ParkCondition.notify_one();
+		return true;
+	}
+
+	return false;
+}
+
+bool TaskScheduler::HasBackloggedQueue(WorkerGroup &group) {
+	if (group.HasInjectedWork()) {
+		return true;
+	}
+
+	for (std::size_t i = group.FirstThread; i < group.FirstThread + group.NumThreads; ++i) {
+		if (m_tls[i].TaskQueue.Size() >= FTL_BACKLOG_SIZE) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void TaskScheduler::AllocateWorkerMemory(const SchedulerOptions &options) {
+	m_fibers = new Fiber[m_fiberPoolSize];
+	m_freeFibers = new std::atomic<bool>[m_fiberPoolSize];
+
+	// All the stacks go in one region, so they can share huge pages. If huge pages are off, or the region can't be
+	// allocated at all, each fiber allocates its own stack
+	m_hugePageBacking = HugePageBacking::None;
+	if (options.HugePages != HugePagePolicy::Off) {
+		m_stackRegion = AllocateHugePages(m_fiberPoolSize * FTL_FIBER_STACK_SIZE, options.HugePages, &m_hugePageBacking);
+		m_tlsRegion = AllocateHugePages(m_numThreads * sizeof(ThreadLocalStorage), options.HugePages);
+	}
+
+	for (std::size_t i = 0; i < m_fiberPoolSize; ++i) {
+		m_freeFibers[i].store(false, std::memory_order_relaxed);
+	}
+	m_numCreatedFibers.store(0, std::memory_order_relaxed);
+	if (options.FiberCreation == FiberCreationPolicy::Eager) {
+		m_fiberCreationTarget.store(m_fiberPoolSize, std::memory_order_relaxed);
+		for (std::size_t i = 0; i < m_fiberPoolSize; ++i) {
+			CreateFiber();
+			m_freeFibers[i].store(true, std::memory_order_release);
+		}
+	} else {
+		// Enough for every thread to start, and to wait once, before a wait has to create a fiber
+		m_fiberCreationTarget.store(std::min<std::size_t>(m_fiberPoolSize, 2 * m_numThreads), std::memory_order_relaxed);
+	}
+
+	if (m_tlsRegion != nullptr) {
+		m_tls = static_cast<ThreadLocalStorage *>(m_tlsRegion);
+		for (std::size_t i = 0; i < m_numThreads; ++i) {
+			new (&m_tls[i]) ThreadLocalStorage();
+		}
+	} else {
+		m_tls = new ThreadLocalStorage[m_numThreads];
+	}
+}
+
+void TaskScheduler::FreeWorkerMemory() {
+	// Fibers don't own stacks in m_stackRegion, so the region has to outlive them
+	delete[] m_fibers;
+	m_fibers = nullptr;
+	delete[] m_freeFibers;
+	m_freeFibers = nullptr;
+	FreeHugePages(m_stackRegion, m_fiberPoolSize * FTL_FIBER_STACK_SIZE);
+	m_stackRegion = nullptr;
+
+	if (m_tlsRegion != nullptr) {
+		for (std::size_t i = 0; i < m_numThreads; ++i) {
+			m_tls[i].~ThreadLocalStorage();
+		}
+		FreeHugePages(m_tlsRegion, m_numThreads * sizeof(ThreadLocalStorage));
+		m_tlsRegion = nullptr;
+	} else {
+		delete[] m_tls;
+	}
+	m_tls = nullptr;
+}
+
+void TaskScheduler::PrefaultFiberStacks(std::size_t threadIndex) {
+	const std::size_t begin = m_tls[threadIndex].FiberSearchStart;
+	const std::size_t end = threadIndex + 1 < m_numThreads ? m_tls[threadIndex + 1].FiberSearchStart : m_fiberPoolSize;
+	for (std::size_t i = begin; i < end; ++i) {
+		m_fibers[i].PrefaultStack(m_prefaultStackBytes);
+	}
+}
+
+std::size_t TaskScheduler::GetNextFreeFiberIndex() {
+	const std::size_t searchStart = m_tls[GetCurrentThreadIndex()].FiberSearchStart;
+	for (uint j = 0; ; ++j) {
+		// The fibers that haven't been created yet are never free
+		const std::size_t numFibers = m_numCreatedFibers.load(std::memory_order_acquire);
+		for (std::size_t k = 0; k < numFibers; ++k) {
+			const std::size_t i = (searchStart + k) % numFibers;
+			// Double lock
+			if (!m_freeFibers[i].load(std::memory_order_relaxed)) {
+				continue;
+			}
+
+			if (!m_freeFibers[i].load(std::memory_order_acquire)) {
+				continue;
+			}
+
+			bool expected = true;
+			if (std::atomic_compare_exchange_weak_explicit(&m_freeFibers[i], &expected, false, std::memory_order_release, std::memory_order_relaxed)) {
+				return i;
+			}
+		}
+
+		// Every fiber created so far is in use. Create one ourselves, and have the idle threads create more ahead
+		const std::size_t fiberIndex = CreateFiber();
+		if (fiberIndex != FTL_INVALID_INDEX) {
+			const std::size_t target = std::min(m_fiberPoolSize, 2 * (fiberIndex + 1));
+			std::size_t currentTarget = m_fiberCreationTarget.load(std::memory_order_relaxed);
+			while (currentTarget < target && !m_fiberCreationTarget.compare_exchange_weak(currentTarget, target, std::memory_order_relaxed)) {
+				// Retry
+			}
+			return fiberIndex;
+		}
+
+		if (j > 10) {
+			printf("No free fibers in the pool. Possible deadlock");
+		}
+	}
+}
+
+std::size_t TaskScheduler::CreateFiber() {
+	std::size_t fiberIndex = m_numCreatedFibers.load(std::memory_order_relaxed);
+	do {
+		if (fiberIndex >= m_fiberPoolSize) {
+			return FTL_INVALID_INDEX;
+		}
+	} while (!m_numCreatedFibers.compare_exchange_weak(fiberIndex, fiberIndex + 1, std::memory_order_relaxed));
+
+	if (m_stackRegion != nullptr) {
+		m_fibers[fiberIndex] = Fiber(static_cast<char *>(m_stackRegion) + fiberIndex * FTL_FIBER_STACK_SIZE, FTL_FIBER_STACK_SIZE, FiberStart, this);
+	} else {
+		m_fibers[fiberIndex] = Fiber(FTL_FIBER_STACK_SIZE, FiberStart, this);
+	}
+
+	return fiberIndex;
+}
+
+bool TaskScheduler::CreateFiberAhead() {
+	if (m_numCreatedFibers.load(std::memory_order_relaxed) >= m_fiberCreationTarget.load(std::memory_order_relaxed)) {
+		return false;
+	}
+
+	const std::size_t fiberIndex = CreateFiber();
+	if (fiberIndex == FTL_INVALID_INDEX) {
+		return false;
+	}
+
+	// Nobody else can run the fiber until it's marked free, so this is the time to fault its stack in
+	if (m_prefaultStackBytes != 0) {
+		m_fibers[fiberIndex].PrefaultStack(m_prefaultStackBytes);
+	}
+	m_freeFibers[fiberIndex].store(true, std::memory_order_release);
+
+	return true;
+}
+
+void TaskScheduler::CleanUpOldFiber() {
+	// Clean up from the last Fiber to run on this thread
+	//
+	// Explanation:
+	// When switching between fibers, there's the innate problem of tracking the fibers.
+	// For example, let's say we discover a waiting fiber that's ready. We need to put the currently 
+	// running fiber back into the fiber pool, and then switch to the waiting fiber. However, we can't 
+	// just do the equivalent of:
 	//     m_fibers.Push(currentFiber)
 	//     currentFiber.SwitchToFiber(waitingFiber)
 	// In the time between us adding the current fiber to the fiber pool and switching to the waiting fiber, another
@@ -393,7 +1668,11 @@ void TaskScheduler::CleanUpOldFiber() {
 	// QED
 
 	
-	ThreadLocalStorage &tls = m_tls[GetCurrentThreadIndex()];
+	std::size_t threadIndex = GetCurrentThreadIndex();
+	ThreadLocalStorage &tls = m_tls[threadIndex];
+	// Every fiber comes through here right after it's switched in, except the main task fiber
+	FireFiberHook(m_hooks.FiberSwitchIn, threadIndex, tls.CurrentFiberIndex);
+
 	switch (tls.OldFiberDestination) {
 	case FiberDestination::ToPool:
 		// In this specific implementation, the fiber pool is a flat array signaled by atomics
@@ -416,38 +1695,132 @@ void TaskScheduler::CleanUpOldFiber() {
 	}
 }
 
+void TaskScheduler::DecrementTaskCounter(AtomicCounter *counter) {
+	if (!counter->IsFanIn()) {
+		counter->FetchSub(1);
+		return;
+	}
+
+	// The task may have waited and resumed on a different thread, so we have to look up tls again
+	ThreadLocalStorage &tls = m_tls[GetCurrentThreadIndex()];
+	if (tls.PendingCounter != counter) {
+		FlushPendingDecrements(tls);
+		tls.PendingCounter = counter;
+	}
+	++tls.PendingDecrements;
+
+	// The counter value includes every decrement that hasn't been flushed yet, so if we're holding all
+	// of them, we just finished the last task of the group. Flush now, so the waiters don't have to wait
+	// for us to go idle
+	if (tls.PendingDecrements >= counter->Load(std::memory_order_relaxed)) {
+		FlushPendingDecrements(tls);
+	}
+}
+
+void TaskScheduler::FlushPendingDecrements(ThreadLocalStorage &tls) {
+	if (tls.PendingCounter == nullptr) {
+		return;
+	}
+
+	// Clear tls before subtracting. FetchSub() can wake fibers, which modifies tls.ReadyFibers and tls.HandoffFiber
+	AtomicCounter *counter = tls.PendingCounter;
+	uint decrements = tls.PendingDecrements;
+	tls.PendingCounter = nullptr;
+	tls.PendingDecrements = 0;
+
+	counter->FetchSub(decrements);
+}
+
 void TaskScheduler::AddReadyFiber(std::size_t fiberIndex, std::atomic<bool> *fiberStoredFlag) {
 	ThreadLocalStorage &tls = m_tls[GetCurrentThreadIndex()];
+
+	// Fibers have to resume in the group they waited in
+	uint group = m_fiberGroups[fiberIndex];
+
+	if (GetScheduleMode() != ScheduleMode::Normal) {
+		RecordEvent(tls, ScheduleEventType::Ready, m_fiberWaitIds[fiberIndex], TaskSource::Replay, group);
+
+		// The log decides which thread resumes the fiber
+		if (GetScheduleMode() == ScheduleMode::Replay) {
+			std::lock_guard<std::mutex> lock(m_replayLock);
+			m_replayFibers.emplace(m_fiberWaitIds[fiberIndex], ReadyFiberBundle{fiberIndex, fiberStoredFlag});
+			return;
+		}
+	}
+
+	if (group != tls.Group) {
+		ReadyFiberBundle readyFiber = {fiberIndex, fiberStoredFlag};
+		bool success = m_groups[group]->ReadyFibers.TryPush(readyFiber);
+		assert(success && "ReadyFibers can hold every fiber in the pool");
+		(void)success;
+
+		WakeGroupThread(*m_groups[group]);
+		return;
+	}
+
+	// Only the first fiber gets handed off. The rest wait their turn, like they would without handoff
+	if (m_resumePolicy == ResumePolicy::Handoff && tls.HandoffFiber.FiberIndex == FTL_INVALID_INDEX) {
+		tls.HandoffFiber = {fiberIndex, fiberStoredFlag};
+		return;
+	}
+
 	tls.ReadyFibers.emplace_back(fiberIndex, fiberStoredFlag);
 }
 
 void TaskScheduler::WaitForCounter(AtomicCounter *counter, uint value, bool pinToCurrentThread) {
+	// Every wait gets an id while recording or replaying, even if it doesn't end up waiting. Otherwise the ids
+	// would shift whenever a replayed wait finishes earlier, or later, than it did when it was recorded
+	uint64 waitId = 0;
+	bool forceWait = false;
+	if (GetScheduleMode() != ScheduleMode::Normal) {
+		ThreadLocalStorage &tls = m_tls[GetCurrentThreadIndex()];
+		waitId = NewScheduleId(tls);
+
+		// If the recorded run had to wait here, so do we
+		if (GetScheduleMode() == ScheduleMode::Replay && !m_replayDiverged.load(std::memory_order_acquire)) {
+			const ScheduleEvent *event = PeekReplayEvent(tls);
+			forceWait = event != nullptr && event->Type == ScheduleEventType::Wait && event->Id == waitId;
+		}
+	}
+
 	// Fast out
-	if (counter->Load(std::memory_order_relaxed) == value) {
+	// Acquire, so the counter's destructor sees any check started by the thread that set the value
+	if (!forceWait && counter->Load(std::memory_order_acquire) == value) {
 		return;
 	}
 
-	ThreadLocalStorage &tls = m_tls[GetCurrentThreadIndex()];
+	std::size_t threadIndex = GetCurrentThreadIndex();
+	ThreadLocalStorage &tls = m_tls[threadIndex];
 	std::size_t currentFiberIndex = tls.CurrentFiberIndex;
 
 	// Get a free fiber
 	std::size_t freeFiberIndex = GetNextFreeFiberIndex();
+	m_fiberWaitIds[currentFiberIndex] = waitId;
 
 	if (pinToCurrentThread) {
 		// If task is pinned, put WaitingBundle in local array
 		tls.PinnedTasks.emplace_back(currentFiberIndex, counter, value);
+
+		// Only this thread can resume it, so there's nothing to clean up. But the free fiber is the current one now
+		tls.CurrentFiberIndex = freeFiberIndex;
 	} else {
 		// If not pinned, ask the counter to track it
+		m_fiberGroups[currentFiberIndex] = tls.Group;
 		std::atomic<bool> *fiberStoredFlag = new std::atomic<bool>(false);
 		bool alreadyDone = counter->AddFiberToWaitingList(tls.CurrentFiberIndex, value, fiberStoredFlag);
 
 		// The counter finished while we were trying to put it in the waiting list
 		// Just clean up and trivially return
-		if (alreadyDone) {
+		if (alreadyDone && !forceWait) {
 			delete fiberStoredFlag;
 			m_freeFibers[freeFiberIndex].store(true, std::memory_order_release);
 			return;
 		}
+		if (alreadyDone) {
+			// Switch out anyway, and let the replay resume us where the log says
+			std::lock_guard<std::mutex> lock(m_replayLock);
+			m_replayFibers.emplace(waitId, ReadyFiberBundle{currentFiberIndex, fiberStoredFlag});
+		}
 
 		// Fill in tls
 		tls.OldFiberIndex = currentFiberIndex;
@@ -456,11 +1829,181 @@ void TaskScheduler::WaitForCounter(AtomicCounter *counter, uint value, bool pinT
 		tls.OldFiberStoredFlag = fiberStoredFlag;
 	}
 
+	if (forceWait) {
+		AdvanceReplay(tls);
+	}
+	RecordEvent(tls, ScheduleEventType::Wait, waitId);
+
 	// Switch
+	FireWaitHook(m_hooks.WaitBegin, threadIndex, currentFiberIndex, counter);
+	FireFiberHook(m_hooks.FiberSwitchOut, threadIndex, currentFiberIndex);
 	m_fibers[currentFiberIndex].SwitchToFiber(&m_fibers[freeFiberIndex]);
 
 	// And we're back
 	CleanUpOldFiber();
+	// Possibly on a different thread
+	FireWaitHook(m_hooks.WaitEnd, GetCurrentThreadIndex(), currentFiberIndex, counter);
+}
+
+void TaskScheduler::HelpUntilZero(AtomicCounter *counter) {
+	// Helping changes which tasks run where, so the log would no longer line up
+	if (GetScheduleMode() != ScheduleMode::Normal) {
+		WaitForCounter(counter, 0);
+		return;
+	}
+
+	while (counter->Load(std::memory_order_acquire) != 0) {
+		ThreadLocalStorage &tls = m_tls[GetCurrentThreadIndex()];
+		std::size_t fiberIndex = tls.CurrentFiberIndex;
+		if (m_fiberHelpDepths[fiberIndex] >= FTL_MAX_HELP_DEPTH) {
+			break;
+		}
+
+		TaskBundle nextTask;
+		if (!PopLocalTask(tls, &nextTask)) {
+			break;
+		}
+		// Any other task could wait on something the caller only does once we return, with the caller's frame
+		// stuck underneath it. Put it back where it was, at the front of the line
+		if (nextTask.Counter != counter) {
+			SetNextTask(tls, nextTask);
+			break;
+		}
+
+		if (tls.PendingCounter != nullptr && tls.PendingCounter != nextTask.Counter) {
+			FlushPendingDecrements(tls);
+		}
+
+		// The task may wait, and come back on another thread, so the depth is kept per fiber
+		++m_fiberHelpDepths[fiberIndex];
+		TaskLink helpedLink = BeginTaskLink(fiberIndex, nextTask);
+		FireTaskHook(m_hooks.TaskBegin, nextTask.TaskToExecute);
+		nextTask.TaskToExecute.Function(this, nextTask.TaskToExecute.ArgData);
+		FireTaskHook(m_hooks.TaskEnd, nextTask.TaskToExecute);
+		if (m_trackParentTasks) {
+			m_fiberTaskLinks[fiberIndex] = helpedLink;
+		}
+		--m_fiberHelpDepths[fiberIndex];
+		if (nextTask.Counter != nullptr) {
+			DecrementTaskCounter(nextTask.Counter);
+		}
+	}
+
+	WaitForCounter(counter, 0);
+}
+
+void TaskScheduler::SpawnClosure(TaskClosure *closure, AtomicCounter *counter, TaskFunction function) {
+	TaskBundle bundle = {{function, closure}, counter};
+	// The closure was just allocated from the current thread's slab, so we don't have to look the thread up again
+	ThreadLocalStorage &tls = m_tls[closure->OwnerThread];
+	LinkParentTask(tls, &bundle);
+	if (GetScheduleMode() != ScheduleMode::Normal && TrackSpawnedTask(tls, &bundle, tls.Group)) {
+		return;
+	}
+
+	CollectTaskQueueGarbage(tls);
+	SetNextTask(tls, bundle);
+	WakeThreadIfBacklogged(tls);
+}
+
+void TaskScheduler::RunClosure(TaskScheduler *taskScheduler, void *arg) {
+	TaskClosure *closure = reinterpret_cast<TaskClosure *>(arg);
+	closure->InvokeAndDestroy(closure->Storage);
+
+	// The callable may have waited, so we could be on a different thread than the one that spawned it
+	taskScheduler->FreeClosure(closure);
+}
+
+void TaskScheduler::AddTaskBatch(TaskFunction function, void *args, std::size_t stride, uint count, AtomicCounter *counter) {
+	AddBatch(RunBatchElementsIndirect, function, args, stride, count, counter);
+}
+
+void TaskScheduler::RunBatchElementsIndirect(TaskScheduler *taskScheduler, TaskFunction function, char *args, std::size_t stride, uint begin, uint end) {
+	for (uint i = begin; i < end; ++i) {
+		function(taskScheduler, args + i * stride);
+	}
+}
+
+void TaskScheduler::AddBatch(BatchRunner runner, TaskFunction function, void *args, std::size_t stride, uint count, AtomicCounter *counter) {
+	if (counter != nullptr) {
+		counter->Store(count);
+	}
+	if (count == 0) {
+		return;
+	}
+
+	TaskClosure *closure = AllocateClosure();
+	new (closure->Storage) TaskBatchRange{runner, function, static_cast<char *>(args), stride, 0, count, counter};
+	SpawnClosure(closure, counter, RunTaskBatch);
+}
+
+void TaskScheduler::RunTaskBatch(TaskScheduler *taskScheduler, void *arg) {
+	// Copy the range out, so the closure can go back to its slab right away
+	TaskClosure *closure = reinterpret_cast<TaskClosure *>(arg);
+	TaskBatchRange range = *reinterpret_cast<TaskBatchRange *>(closure->Storage);
+	taskScheduler->FreeClosure(closure);
+
+	// Splits depend on the timing of the other threads, so they can't be replayed
+	const bool canSplit = taskScheduler->m_numThreads > 1 && taskScheduler->GetScheduleMode() == ScheduleMode::Normal;
+	while (range.Begin != range.End) {
+		if (canSplit && range.End - range.Begin > FTL_BATCH_GRAIN) {
+			// An element may have waited, so we could be on a different thread than last time
+			ThreadLocalStorage &tls = taskScheduler->m_tls[taskScheduler->GetCurrentThreadIndex()];
+			if (tls.TaskQueue.Size() == 0) {
+				taskScheduler->SplitTaskBatch(tls, &range);
+			}
+		}
+
+		const uint end = std::min<uint>(range.Begin + FTL_BATCH_GRAIN, range.End);
+		range.Runner(taskScheduler, range.Function, range.Args, range.Stride, range.Begin, end);
+		uint numRun = end - range.Begin;
+		range.Begin = end;
+
+		// Decrement once per chunk, so the counter doesn't stall until the whole range is done
+		// The task's own decrement covers the last element
+		if (range.Begin == range.End) {
+			--numRun;
+		}
+		if (range.Counter != nullptr && numRun > 0) {
+			range.Counter->FetchSub(numRun);
+		}
+	}
+}
+
+void TaskScheduler::SplitTaskBatch(ThreadLocalStorage &tls, TaskBatchRange *range) {
+	TaskClosure *closure = AllocateClosure();
+	TaskBatchRange *upper = new (closure->Storage) TaskBatchRange(*range);
+	upper->Begin = range->Begin + (range->End - range->Begin) / 2;
+	range->End = upper->Begin;
+
+	TaskBundle bundle = {{RunTaskBatch, closure}, range->Counter};
+	LinkParentTask(tls, &bundle);
+	CollectTaskQueueGarbage(tls);
+	PushTask(tls, bundle);
+	WakeThreadIfBacklogged(tls);
+}
+
+TaskClosure *TaskScheduler::AllocateClosure() {
+	std::size_t threadIndex = GetCurrentThreadIndex();
+	ThreadLocalStorage &tls = m_tls[threadIndex];
+
+	uint32 slabIndex = tls.ClosureSlab.Allocate();
+	TaskClosure *closure = &tls.ClosureSlab.Get(slabIndex);
+	closure->SlabIndex = slabIndex;
+	closure->OwnerThread = static_cast<uint32>(threadIndex);
+	return closure;
+}
+
+void TaskScheduler::FreeClosure(TaskClosure *closure) {
+	// Read everything we need before the slot can be reused
+	uint32 slabIndex = closure->SlabIndex;
+	uint32 ownerThread = closure->OwnerThread;
+
+	if (ownerThread == GetCurrentThreadIndex()) {
+		m_tls[ownerThread].ClosureSlab.Free(slabIndex);
+	} else {
+		m_tls[ownerThread].ClosureSlab.RemoteFree(slabIndex);
+	}
 }
 
 } // End of namespace ftl
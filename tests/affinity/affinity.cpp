@@ -0,0 +1,163 @@
+/* FiberTaskingLib - A tasking library that uses fibers for efficient task switching
+ *
+ * This library was created as a proof of concept of the ideas presented by
+ * Christian Gyrling in his 2015 GDC Talk 'Parallelizing the Naughty Dog Engine Using Fibers'
+ *
+ * http://gdcvault.com/play/1022186/Parallelizing-the-Naughty-Dog-Engine
+ *
+ * FiberTaskingLib is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2015 - 2017
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "ftl/task_scheduler.h"
+#include "ftl/atomic_counter.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <vector>
+
+
+const uint kNumAffinityThreads = 4u;
+const uint kNumStrictTasks = 400u;
+const uint kNumPreferredTasks = 32u;
+
+
+struct AffinityTestArgs {
+	/* The worker each strict task was sent to, and the one it ran on */
+	std::vector<uint> ExpectedWorker;
+	std::vector<std::size_t> ActualWorker;
+	std::atomic<bool> ReleaseBlocker;
+	std::atomic<uint> PreferredOnBlockedWorker;
+	std::atomic<uint> PreferredDone;
+};
+
+struct StrictTaskArg {
+	AffinityTestArgs *Args;
+	uint Index;
+};
+
+void RecordWorker(ftl::TaskScheduler *taskScheduler, void *arg) {
+	StrictTaskArg *strictArg = reinterpret_cast<StrictTaskArg *>(arg);
+	strictArg->Args->ActualWorker[strictArg->Index] = taskScheduler->GetCurrentThreadIndex();
+}
+
+/* Keeps worker 1 busy until the preferred tasks sent to it have been stolen */
+void BlockWorker(ftl::TaskScheduler *taskScheduler, void *arg) {
+	(void)taskScheduler;
+	AffinityTestArgs *args = reinterpret_cast<AffinityTestArgs *>(arg);
+	while (!args->ReleaseBlocker.load()) {
+		// Spin
+	}
+}
+
+void PreferredTask(ftl::TaskScheduler *taskScheduler, void *arg) {
+	AffinityTestArgs *args = reinterpret_cast<AffinityTestArgs *>(arg);
+	if (taskScheduler->GetCurrentThreadIndex() == 1) {
+		args->PreferredOnBlockedWorker.fetch_add(1);
+	}
+	args->PreferredDone.fetch_add(1);
+}
+
+void AffinityMainTask(ftl::TaskScheduler *taskScheduler, void *arg) {
+	AffinityTestArgs *args = reinterpret_cast<AffinityTestArgs *>(arg);
+	GTEST_ASSERT_EQ(kNumAffinityThreads, taskScheduler->GetNumThreads());
+
+	// Strict tasks only ever run on their worker
+	std::vector<ftl::Task> tasks(kNumStrictTasks);
+	std::vector<ftl::Affinity> affinities(kNumStrictTasks);
+	std::vector<StrictTaskArg> strictArgs(kNumStrictTasks);
+	for (uint i = 0; i < kNumStrictTasks; ++i) {
+		strictArgs[i] = {args, i};
+		tasks[i] = {RecordWorker, &strictArgs[i]};
+		affinities[i] = {(i * 7) % kNumAffinityThreads, true};
+		args->ExpectedWorker[i] = affinities[i].Worker;
+	}
+
+	ftl::AtomicCounter strictCounter(taskScheduler);
+	taskScheduler->AddTasks(kNumStrictTasks, tasks.data(), &strictCounter, affinities.data());
+	taskScheduler->WaitForCounter(&strictCounter, 0);
+
+	// Preferred tasks get stolen when their worker is stuck
+	ftl::AtomicCounter blockerCounter(taskScheduler);
+	taskScheduler->AddTask({BlockWorker, args}, &blockerCounter, ftl::Affinity{1, true});
+
+	std::vector<ftl::Task> preferredTasks(kNumPreferredTasks, {PreferredTask, args});
+	std::vector<ftl::Affinity> preferredAffinities(kNumPreferredTasks, {1, false});
+	ftl::AtomicCounter preferredCounter(taskScheduler);
+	taskScheduler->AddTasks(kNumPreferredTasks, preferredTasks.data(), &preferredCounter, preferredAffinities.data());
+	taskScheduler->WaitForCounter(&preferredCounter, 0);
+
+	args->ReleaseBlocker.store(true);
+	taskScheduler->WaitForCounter(&blockerCounter, 0);
+}
+
+/**
+ * Tests that strict tasks run on the worker they were sent to, and that other workers steal preferred tasks
+ * from a worker that is busy
+ */
+TEST(FunctionalTests, Affinity) {
+	AffinityTestArgs args;
+	args.ExpectedWorker.resize(kNumStrictTasks);
+	args.ActualWorker.resize(kNumStrictTasks);
+	args.ReleaseBlocker.store(false);
+	args.PreferredOnBlockedWorker.store(0);
+	args.PreferredDone.store(0);
+
+	ftl::SchedulerOptions options;
+	options.ThreadPoolSize = kNumAffinityThreads;
+	options.MailboxStealDelayUs = 50;
+
+	ftl::TaskScheduler taskScheduler;
+	taskScheduler.Run(options, AffinityMainTask, &args);
+
+	for (uint i = 0; i < kNumStrictTasks; ++i) {
+		GTEST_ASSERT_EQ(args.ExpectedWorker[i], args.ActualWorker[i]);
+	}
+	GTEST_ASSERT_EQ(kNumPreferredTasks, args.PreferredDone.load());
+	GTEST_ASSERT_EQ(0u, args.PreferredOnBlockedWorker.load());
+}
+
+void EmptyAffinityTask(ftl::TaskScheduler *taskScheduler, void *arg) {
+	(void)taskScheduler;
+	(void)arg;
+}
+
+void OutOfRangeMainTask(ftl::TaskScheduler *taskScheduler, void *arg) {
+	(void)arg;
+
+	// The counter is left over from earlier work, so it has to be set, or the wait below would never end
+	ftl::AtomicCounter counter(taskScheduler, 3);
+	ftl::Task tasks[2] = {{EmptyAffinityTask, nullptr}, {EmptyAffinityTask, nullptr}};
+	ftl::Affinity affinities[2] = {{0, true}, {kNumAffinityThreads, true}};
+	taskScheduler->AddTasks(2, tasks, &counter, affinities);
+	taskScheduler->WaitForCounter(&counter, 0);
+}
+
+/**
+ * Tests that a task for a worker that doesn't exist aborts, rather than being dropped
+ */
+TEST(FunctionalTests, AffinityOutOfRange) {
+	::testing::GTEST_FLAG(death_test_style) = "threadsafe";
+
+	ftl::SchedulerOptions options;
+	options.ThreadPoolSize = kNumAffinityThreads;
+
+	ASSERT_DEATH_IF_SUPPORTED({
+		ftl::TaskScheduler taskScheduler;
+		taskScheduler.Run(options, OutOfRangeMainTask);
+	}, "");
+}
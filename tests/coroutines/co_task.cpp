@@ -0,0 +1,126 @@
+/* FiberTaskingLib - A tasking library that uses fibers for efficient task switching
+ *
+ * This library was created as a proof of concept of the ideas presented by
+ * Christian Gyrling in his 2015 GDC Talk 'Parallelizing the Naughty Dog Engine Using Fibers'
+ *
+ * http://gdcvault.com/play/1022186/Parallelizing-the-Naughty-Dog-Engine
+ *
+ * FiberTaskingLib is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2015 - 2017
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "ftl/co_task.h"
+#include "ftl/task_scheduler.h"
+#include "ftl/atomic_counter.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <vector>
+
+
+// Many more than the fiber pool, and the waiting fiber slots of a counter
+const uint kNumWaitingCoTasks = 10000u;
+const uint kNumFiberTasks = 100u;
+
+
+ftl::CoTask WaitForGate(ftl::AtomicCounter *gate, std::atomic_uint *numPassed) {
+	co_await ftl::CoWaitForCounter(gate, 0);
+	numPassed->fetch_add(1);
+}
+
+void CountTask(ftl::TaskScheduler *taskScheduler, void *arg) {
+	(void)taskScheduler;
+	reinterpret_cast<std::atomic_uint *>(arg)->fetch_add(1);
+}
+
+/**
+ * Waits on normal tasks from inside a CoTask
+ */
+ftl::CoTask WaitForFiberTasks(ftl::TaskScheduler *taskScheduler, std::atomic_uint *numRun, bool *sawAllTasks) {
+	std::vector<ftl::Task> tasks(kNumFiberTasks, ftl::Task{CountTask, numRun});
+
+	ftl::AtomicCounter counter(taskScheduler);
+	taskScheduler->AddTasks(kNumFiberTasks, tasks.data(), &counter);
+	co_await ftl::CoWaitForCounter(&counter, 0);
+
+	*sawAllTasks = numRun->load() == kNumFiberTasks;
+}
+
+void CoTaskMainTask(ftl::TaskScheduler *taskScheduler, void *arg) {
+	(void)arg;
+
+	// Suspend a lot of CoTasks on a single counter
+	ftl::AtomicCounter gate(taskScheduler, 1);
+	std::atomic_uint numPassed(0);
+	std::vector<ftl::CoTask> waiters;
+	for (uint i = 0; i < kNumWaitingCoTasks; ++i) {
+		waiters.push_back(WaitForGate(&gate, &numPassed));
+	}
+
+	ftl::AtomicCounter waitersDone(taskScheduler);
+	ftl::AddCoTasks(taskScheduler, kNumWaitingCoTasks, waiters.data(), &waitersDone);
+	GTEST_ASSERT_EQ(false, waiters[0].IsValid());
+
+	// Let them all through, and wait for them from a fiber
+	gate.Store(0);
+	taskScheduler->WaitForCounter(&waitersDone, 0);
+	GTEST_ASSERT_EQ(kNumWaitingCoTasks, numPassed.load());
+
+	// And the other way around. A CoTask waiting on normal tasks
+	std::atomic_uint numRun(0);
+	bool sawAllTasks = false;
+	ftl::AtomicCounter coTaskDone(taskScheduler);
+	ftl::AddCoTask(taskScheduler, WaitForFiberTasks(taskScheduler, &numRun, &sawAllTasks), &coTaskDone);
+	taskScheduler->WaitForCounter(&coTaskDone, 0);
+	GTEST_ASSERT_EQ(true, sawAllTasks);
+}
+
+
+/**
+ * Tests that CoTasks and fibers can wait on each other, and that far more CoTasks than fibers can be suspended at once
+ */
+TEST(FunctionalTests, CoTaskInterop) {
+	ftl::TaskScheduler taskScheduler;
+	taskScheduler.Run(400, CoTaskMainTask);
+}
+
+
+ftl::CoTask Sleep(ftl::TaskScheduler *taskScheduler, std::chrono::steady_clock::duration *elapsed) {
+	const auto start = std::chrono::steady_clock::now();
+	co_await ftl::CoSleep(taskScheduler, std::chrono::milliseconds(20));
+	*elapsed = std::chrono::steady_clock::now() - start;
+}
+
+void CoSleepMainTask(ftl::TaskScheduler *taskScheduler, void *arg) {
+	(void)arg;
+
+	std::chrono::steady_clock::duration elapsed(0);
+	ftl::AtomicCounter counter(taskScheduler);
+	ftl::AddCoTask(taskScheduler, Sleep(taskScheduler, &elapsed), &counter);
+	taskScheduler->WaitForCounter(&counter, 0);
+
+	GTEST_ASSERT_EQ(true, elapsed >= std::chrono::milliseconds(20));
+}
+
+/**
+ * Tests that CoSleep() suspends a CoTask for at least the requested time
+ */
+TEST(FunctionalTests, CoSleep) {
+	ftl::TaskScheduler taskScheduler;
+	taskScheduler.Run(400, CoSleepMainTask);
+}
@@ -0,0 +1,73 @@
+/* FiberTaskingLib - A tasking library that uses fibers for efficient task switching
+ *
+ * This library was created as a proof of concept of the ideas presented by
+ * Christian Gyrling in his 2015 GDC Talk 'Parallelizing the Naughty Dog Engine Using Fibers'
+ *
+ * http://gdcvault.com/play/1022186/Parallelizing-the-Naughty-Dog-Engine
+ *
+ * FiberTaskingLib is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2015 - 2017
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "ftl/task_scheduler.h"
+#include "ftl/atomic_counter.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+
+
+const uint kNumLifetimeIterations = 50000u;
+const uint kNumLifetimeTasks = 8u;
+
+void LifetimeDecrementTask(ftl::TaskScheduler *taskScheduler, void *arg) {
+	(void)taskScheduler;
+	reinterpret_cast<std::atomic<uint> *>(arg)->fetch_add(1, std::memory_order_relaxed);
+}
+
+void CounterLifetimeMainTask(ftl::TaskScheduler *taskScheduler, void *arg) {
+	std::atomic<uint> *tasksRun = reinterpret_cast<std::atomic<uint> *>(arg);
+
+	ftl::Task tasks[kNumLifetimeTasks];
+	for (uint i = 0; i < kNumLifetimeTasks; ++i) {
+		tasks[i] = {LifetimeDecrementTask, tasksRun};
+	}
+
+	for (uint i = 0; i < kNumLifetimeIterations; ++i) {
+		// The counter is freed as soon as the wait returns. A thread still checking its waiting fibers would
+		// touch freed memory, which the allocator can hand right back to the next iteration
+		ftl::AtomicCounter *counter = new ftl::AtomicCounter(taskScheduler);
+		taskScheduler->AddTasks(kNumLifetimeTasks, tasks, counter);
+		taskScheduler->WaitForCounter(counter, 0);
+		delete counter;
+	}
+}
+
+/**
+ * Tests that a counter can be destroyed as soon as a wait on it returns, while the thread that brought it to
+ * the target value may still be checking its waiting fibers
+ */
+TEST(FunctionalTests, CounterLifetime) {
+	std::atomic<uint> tasksRun(0);
+
+	ftl::SchedulerOptions options;
+	options.ThreadPoolSize = 4;
+
+	ftl::TaskScheduler taskScheduler;
+	taskScheduler.Run(options, CounterLifetimeMainTask, &tasksRun);
+
+	GTEST_ASSERT_EQ(kNumLifetimeIterations * kNumLifetimeTasks, tasksRun.load());
+}
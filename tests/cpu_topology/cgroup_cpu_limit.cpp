@@ -0,0 +1,122 @@
+/* FiberTaskingLib - A tasking library that uses fibers for efficient task switching
+ *
+ * This library was created as a proof of concept of the ideas presented by
+ * Christian Gyrling in his 2015 GDC Talk 'Parallelizing the Naughty Dog Engine Using Fibers'
+ *
+ * http://gdcvault.com/play/1022186/Parallelizing-the-Naughty-Dog-Engine
+ *
+ * FiberTaskingLib is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2015 - 2017
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ftl/cpu_topology.h"
+#include "ftl/config.h"
+
+#include <gtest/gtest.h>
+
+#if defined(FTL_OS_LINUX)
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+/**
+ * A fake cgroup filesystem in a temporary directory
+ */
+class FakeCgroup {
+public:
+	FakeCgroup() {
+		char rootTemplate[] = "/tmp/ftl-cgroup-XXXXXX";
+		Root = mkdtemp(rootTemplate);
+	}
+	~FakeCgroup() {
+		for (const std::string &path : m_files) {
+			unlink(path.c_str());
+		}
+		for (auto iter = m_dirs.rbegin(); iter != m_dirs.rend(); ++iter) {
+			rmdir(iter->c_str());
+		}
+		rmdir(Root.c_str());
+	}
+
+public:
+	std::string Root;
+
+private:
+	std::vector<std::string> m_files;
+	std::vector<std::string> m_dirs;
+
+public:
+	void MakeDir(const std::string &dir) {
+		std::string path = Root + "/" + dir;
+		mkdir(path.c_str(), 0700);
+		m_dirs.push_back(path);
+	}
+	void WriteFile(const std::string &file, const char *contents) {
+		std::string path = Root + "/" + file;
+		FILE *handle = fopen(path.c_str(), "w");
+		ASSERT_NE(nullptr, handle);
+		fputs(contents, handle);
+		fclose(handle);
+		m_files.push_back(path);
+	}
+};
+
+TEST(CpuTopology, CgroupV2CpuLimit) {
+	FakeCgroup cgroup;
+	cgroup.WriteFile("cpu.max", "400000 100000\n");
+	GTEST_ASSERT_EQ(4u, ftl::GetCgroupCpuLimit(cgroup.Root.c_str()));
+
+	// Fractional limits round up
+	cgroup.WriteFile("cpu.max", "150000 100000\n");
+	GTEST_ASSERT_EQ(2u, ftl::GetCgroupCpuLimit(cgroup.Root.c_str()));
+
+	cgroup.WriteFile("cpu.max", "max 100000\n");
+	GTEST_ASSERT_EQ(0u, ftl::GetCgroupCpuLimit(cgroup.Root.c_str()));
+}
+
+TEST(CpuTopology, CgroupV1CpuLimit) {
+	FakeCgroup cgroup;
+	cgroup.MakeDir("cpu,cpuacct");
+	cgroup.WriteFile("cpu,cpuacct/cpu.cfs_quota_us", "300000\n");
+	cgroup.WriteFile("cpu,cpuacct/cpu.cfs_period_us", "100000\n");
+	GTEST_ASSERT_EQ(3u, ftl::GetCgroupCpuLimit(cgroup.Root.c_str()));
+
+	cgroup.WriteFile("cpu,cpuacct/cpu.cfs_quota_us", "-1\n");
+	GTEST_ASSERT_EQ(0u, ftl::GetCgroupCpuLimit(cgroup.Root.c_str()));
+}
+
+TEST(CpuTopology, NumAvailableThreads) {
+	std::size_t numAllowedCpus = ftl::GetAllowedCpus().size();
+	GTEST_ASSERT_GE(numAllowedCpus, 1u);
+
+	// No cgroup files at all means no limit
+	FakeCgroup cgroup;
+	GTEST_ASSERT_EQ(0u, ftl::GetCgroupCpuLimit(cgroup.Root.c_str()));
+	GTEST_ASSERT_EQ(numAllowedCpus, ftl::GetNumAvailableThreads(cgroup.Root.c_str()));
+
+	// The quota can only lower the thread count
+	cgroup.WriteFile("cpu.max", "100000 100000\n");
+	GTEST_ASSERT_EQ(1u, ftl::GetNumAvailableThreads(cgroup.Root.c_str()));
+
+	cgroup.WriteFile("cpu.max", "100000000 100000\n");
+	GTEST_ASSERT_EQ(numAllowedCpus, ftl::GetNumAvailableThreads(cgroup.Root.c_str()));
+}
+
+#endif
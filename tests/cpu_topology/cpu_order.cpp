@@ -0,0 +1,66 @@
+/* FiberTaskingLib - A tasking library that uses fibers for efficient task switching
+ *
+ * This library was created as a proof of concept of the ideas presented by
+ * Christian Gyrling in his 2015 GDC Talk 'Parallelizing the Naughty Dog Engine Using Fibers'
+ *
+ * http://gdcvault.com/play/1022186/Parallelizing-the-Naughty-Dog-Engine
+ *
+ * FiberTaskingLib is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2015 - 2017
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ftl/cpu_topology.h"
+#include "ftl/scheduler_options.h"
+
+#include <gtest/gtest.h>
+
+
+/**
+ * A machine with 2 sockets, 2 cores per socket, and 2 SMT threads per core
+ * CPUs are numbered the way Linux usually does it: the first thread of every core, then all the siblings
+ */
+static std::vector<ftl::CpuInfo> GetTwoSocketTopology() {
+	return {
+		{0, 0, 0}, {1, 0, 1}, {2, 1, 0}, {3, 1, 1},
+		{4, 0, 0}, {5, 0, 1}, {6, 1, 0}, {7, 1, 1}
+	};
+}
+
+TEST(CpuTopology, CompactOrder) {
+	std::vector<uint> expected = {0, 4, 1, 5, 2, 6, 3, 7};
+	GTEST_ASSERT_EQ(expected, ftl::CompactCpuOrder(GetTwoSocketTopology()));
+}
+
+TEST(CpuTopology, ScatterOrder) {
+	std::vector<uint> expected = {0, 2, 1, 3, 4, 6, 5, 7};
+	GTEST_ASSERT_EQ(expected, ftl::ScatterCpuOrder(GetTwoSocketTopology()));
+}
+
+TEST(CpuTopology, MissingTopology) {
+	// Without topology information, every CPU is its own core on a single socket
+	std::vector<ftl::CpuInfo> topology = ftl::GetCpuTopology({2, 5}, "/nonexistent");
+	GTEST_ASSERT_EQ(2u, topology.size());
+	GTEST_ASSERT_EQ(0u, topology[1].Package);
+	GTEST_ASSERT_EQ(5u, topology[1].Core);
+
+	std::vector<uint> expected = {2, 5};
+	GTEST_ASSERT_EQ(expected, ftl::ScatterCpuOrder(topology));
+}
+
+TEST(CpuTopology, DefaultPinning) {
+	// Run() pinned thread i to the i-th allowed CPU before there were pinning policies. Keep that as the default
+	ftl::SchedulerOptions options;
+	GTEST_ASSERT_EQ(true, options.Pinning == ftl::PinningPolicy::Sequential);
+}
@@ -0,0 +1,97 @@
+/* FiberTaskingLib - A tasking library that uses fibers for efficient task switching
+ *
+ * This library was created as a proof of concept of the ideas presented by
+ * Christian Gyrling in his 2015 GDC Talk 'Parallelizing the Naughty Dog Engine Using Fibers'
+ *
+ * http://gdcvault.com/play/1022186/Parallelizing-the-Naughty-Dog-Engine
+ *
+ * FiberTaskingLib is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2015 - 2017
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "ftl/fiber.h"
+#include "ftl/task_scheduler.h"
+#include "ftl/atomic_counter.h"
+
+#include <atomic>
+
+#include <gtest/gtest.h>
+
+
+struct PrefaultFiberArg {
+	std::atomic_long Counter;
+	ftl::Fiber MainFiber;
+	ftl::Fiber OtherFiber;
+};
+
+void PrefaultFiberStart(void *arg) {
+	PrefaultFiberArg *prefaultFiberArg = reinterpret_cast<PrefaultFiberArg *>(arg);
+
+	prefaultFiberArg->Counter.fetch_add(1);
+
+	prefaultFiberArg->OtherFiber.SwitchToFiber(&prefaultFiberArg->MainFiber);
+
+	// We should never get here
+	FAIL();
+}
+
+/**
+ * Tests that faulting in a stack leaves the fiber's initial context intact
+ */
+TEST(FiberAbstraction, PrefaultStack) {
+	PrefaultFiberArg prefaultFiberArg;
+	prefaultFiberArg.Counter.store(0);
+	prefaultFiberArg.OtherFiber = ftl::Fiber(512000, PrefaultFiberStart, &prefaultFiberArg);
+
+	// More than the whole stack, which should be clamped
+	prefaultFiberArg.OtherFiber.PrefaultStack(1024 * 1024);
+	prefaultFiberArg.MainFiber.SwitchToFiber(&prefaultFiberArg.OtherFiber);
+
+	GTEST_ASSERT_EQ(1, prefaultFiberArg.Counter.load());
+}
+
+
+void IncrementTask(ftl::TaskScheduler *taskScheduler, void *arg) {
+	(void)taskScheduler;
+	reinterpret_cast<std::atomic_uint *>(arg)->fetch_add(1);
+}
+
+void PrefaultMainTask(ftl::TaskScheduler *taskScheduler, void *arg) {
+	(void)arg;
+
+	std::atomic_uint numRun(0);
+	ftl::Task tasks[100];
+	for (uint i = 0; i < 100; ++i) {
+		tasks[i] = {IncrementTask, &numRun};
+	}
+
+	ftl::AtomicCounter counter(taskScheduler);
+	taskScheduler->AddTasks(100, tasks, &counter);
+	taskScheduler->WaitForCounter(&counter, 0);
+
+	GTEST_ASSERT_EQ(100u, numRun.load());
+}
+
+/**
+ * Tests that the scheduler starts normally after warming up the fiber pool
+ */
+TEST(FiberAbstraction, PrefaultFiberPool) {
+	ftl::SchedulerOptions options;
+	options.PrefaultStackBytes = 64 * 1024;
+
+	ftl::TaskScheduler taskScheduler;
+	taskScheduler.Run(options, PrefaultMainTask);
+}
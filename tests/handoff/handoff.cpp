@@ -0,0 +1,112 @@
+/* FiberTaskingLib - A tasking library that uses fibers for efficient task switching
+ *
+ * This library was created as a proof of concept of the ideas presented by
+ * Christian Gyrling in his 2015 GDC Talk 'Parallelizing the Naughty Dog Engine Using Fibers'
+ *
+ * http://gdcvault.com/play/1022186/Parallelizing-the-Naughty-Dog-Engine
+ *
+ * FiberTaskingLib is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2015 - 2017
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "ftl/task_scheduler.h"
+#include "ftl/atomic_counter.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+
+
+const uint kNumChainLinks = 10000;
+const uint kNumWaiters = 32;
+
+struct HandoffTestArgs {
+	/* The number of links that have run. Each link checks it runs after the one before it */
+	uint LinksRun;
+	bool LinksInOrder;
+	ftl::AtomicCounter *Gate;
+	std::atomic<uint> WaitersDone;
+};
+
+void ChainLink(ftl::TaskScheduler *taskScheduler, void *arg) {
+	HandoffTestArgs *args = reinterpret_cast<HandoffTestArgs *>(arg);
+	++args->LinksRun;
+}
+
+void GateWaiter(ftl::TaskScheduler *taskScheduler, void *arg) {
+	HandoffTestArgs *args = reinterpret_cast<HandoffTestArgs *>(arg);
+	taskScheduler->WaitForCounter(args->Gate, 0);
+	args->WaitersDone.fetch_add(1, std::memory_order_relaxed);
+}
+
+void OpenGate(ftl::TaskScheduler *taskScheduler, void *arg) {
+	HandoffTestArgs *args = reinterpret_cast<HandoffTestArgs *>(arg);
+	args->Gate->Store(0);
+}
+
+void HandoffMainTask(ftl::TaskScheduler *taskScheduler, void *arg) {
+	HandoffTestArgs *args = reinterpret_cast<HandoffTestArgs *>(arg);
+
+	// A chain of dependent tasks. Each link is waited on before the next is added
+	ftl::AtomicCounter counter(taskScheduler);
+	for (uint i = 0; i < kNumChainLinks; ++i) {
+		uint linksRun = args->LinksRun;
+		taskScheduler->AddTask({ChainLink, args}, &counter);
+		taskScheduler->WaitForCounter(&counter, 0);
+		if (args->LinksRun != linksRun + 1) {
+			args->LinksInOrder = false;
+		}
+	}
+
+	// One task that makes many fibers ready at once. Only one of them can be handed off, the rest still have to resume
+	ftl::AtomicCounter gate(taskScheduler, 1);
+	args->Gate = &gate;
+	ftl::Task tasks[kNumWaiters + 1];
+	for (uint i = 0; i < kNumWaiters; ++i) {
+		tasks[i] = {GateWaiter, args};
+	}
+	tasks[kNumWaiters] = {OpenGate, args};
+	taskScheduler->AddTasks(kNumWaiters + 1, tasks, &counter);
+	taskScheduler->WaitForCounter(&counter, 0);
+}
+
+void RunHandoffTest(uint threadPoolSize) {
+	HandoffTestArgs args;
+	args.LinksRun = 0;
+	args.LinksInOrder = true;
+	args.Gate = nullptr;
+	args.WaitersDone.store(0);
+
+	ftl::SchedulerOptions options;
+	options.FiberPoolSize = 64;
+	options.ThreadPoolSize = threadPoolSize;
+	options.Resume = ftl::ResumePolicy::Handoff;
+
+	ftl::TaskScheduler taskScheduler;
+	taskScheduler.Run(options, HandoffMainTask, &args);
+
+	GTEST_ASSERT_EQ(kNumChainLinks, args.LinksRun);
+	GTEST_ASSERT_EQ(true, args.LinksInOrder);
+	GTEST_ASSERT_EQ(kNumWaiters, args.WaitersDone.load());
+}
+
+/**
+ * Runs a long chain of dependent tasks, and a task that makes many fibers ready at once, with ResumePolicy::Handoff
+ */
+TEST(FunctionalTests, Handoff) {
+	RunHandoffTest(1);
+	RunHandoffTest(4);
+}
@@ -0,0 +1,107 @@
+/* FiberTaskingLib - A tasking library that uses fibers for efficient task switching
+ *
+ * This library was created as a proof of concept of the ideas presented by
+ * Christian Gyrling in his 2015 GDC Talk 'Parallelizing the Naughty Dog Engine Using Fibers'
+ *
+ * http://gdcvault.com/play/1022186/Parallelizing-the-Naughty-Dog-Engine
+ *
+ * FiberTaskingLib is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2015 - 2017
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "ftl/huge_pages.h"
+#include "ftl/task_scheduler.h"
+#include "ftl/atomic_counter.h"
+
+#include <gtest/gtest.h>
+
+#include <cstring>
+
+
+/**
+ * Tests that every policy gives usable memory, whatever the machine has available
+ */
+TEST(HugePages, Allocate) {
+	const std::size_t size = 3 * 1024 * 1024 + 123;
+	const ftl::HugePagePolicy policies[] = {ftl::HugePagePolicy::Off, ftl::HugePagePolicy::Transparent, ftl::HugePagePolicy::Explicit};
+
+	for (ftl::HugePagePolicy policy : policies) {
+		ftl::HugePageBacking backing = ftl::HugePageBacking::Explicit;
+		char *memory = static_cast<char *>(ftl::AllocateHugePages(size, policy, &backing));
+		GTEST_ASSERT_EQ(true, memory != nullptr);
+
+		// We never get better pages than we asked for
+		if (policy == ftl::HugePagePolicy::Off) {
+			GTEST_ASSERT_EQ(ftl::HugePageBacking::None, backing);
+		} else if (policy == ftl::HugePagePolicy::Transparent) {
+			GTEST_ASSERT_NE(ftl::HugePageBacking::Explicit, backing);
+		}
+		if (ftl::GetHugePageSize() != 0) {
+			GTEST_ASSERT_EQ(0u, reinterpret_cast<std::size_t>(memory) % ftl::GetHugePageSize());
+		}
+
+		memset(memory, 0xAB, size);
+		GTEST_ASSERT_EQ(static_cast<char>(0xAB), memory[size - 1]);
+		ftl::FreeHugePages(memory, size);
+	}
+}
+
+
+const uint kNumWaitingTasks = 200;
+
+void EmptyTask(ftl::TaskScheduler *taskScheduler, void *arg) {
+	(void)taskScheduler;
+	(void)arg;
+}
+
+void WaitingTask(ftl::TaskScheduler *taskScheduler, void *arg) {
+	std::atomic_uint *numFinished = reinterpret_cast<std::atomic_uint *>(arg);
+
+	// Each wait switches to another fiber, so this touches a lot of stacks
+	for (uint i = 0; i < 10; ++i) {
+		ftl::AtomicCounter counter(taskScheduler);
+		taskScheduler->AddTask({EmptyTask, nullptr}, &counter);
+		taskScheduler->WaitForCounter(&counter, 0);
+	}
+	numFinished->fetch_add(1);
+}
+
+void HugePageStacksMainTask(ftl::TaskScheduler *taskScheduler, void *arg) {
+	(void)arg;
+
+	std::atomic_uint numFinished(0);
+	ftl::Task tasks[kNumWaitingTasks];
+	for (uint i = 0; i < kNumWaitingTasks; ++i) {
+		tasks[i] = {WaitingTask, &numFinished};
+	}
+
+	ftl::AtomicCounter counter(taskScheduler);
+	taskScheduler->AddTasks(kNumWaitingTasks, tasks, &counter);
+	taskScheduler->WaitForCounter(&counter, 0);
+
+	GTEST_ASSERT_EQ(kNumWaitingTasks, numFinished.load());
+}
+
+/**
+ * Tests that the scheduler runs with its fiber stacks and thread local storage in huge page regions
+ */
+TEST(HugePages, FiberStacks) {
+	ftl::SchedulerOptions options;
+	options.HugePages = ftl::HugePagePolicy::Explicit;
+
+	ftl::TaskScheduler taskScheduler;
+	taskScheduler.Run(options, HugePageStacksMainTask);
+}
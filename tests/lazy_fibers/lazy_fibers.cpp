@@ -0,0 +1,96 @@
+/* FiberTaskingLib - A tasking library that uses fibers for efficient task switching
+ *
+ * This library was created as a proof of concept of the ideas presented by
+ * Christian Gyrling in his 2015 GDC Talk 'Parallelizing the Naughty Dog Engine Using Fibers'
+ *
+ * http://gdcvault.com/play/1022186/Parallelizing-the-Naughty-Dog-Engine
+ *
+ * FiberTaskingLib is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2015 - 2017
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "ftl/task_scheduler.h"
+#include "ftl/atomic_counter.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+
+
+const uint kNumWaitingTasks = 300;
+
+struct LazyFiberTestArgs {
+	ftl::AtomicCounter *Started;
+	ftl::AtomicCounter *Gate;
+	std::atomic<uint> TasksDone;
+};
+
+void GrowingPoolTask(ftl::TaskScheduler *taskScheduler, void *arg) {
+	LazyFiberTestArgs *args = reinterpret_cast<LazyFiberTestArgs *>(arg);
+
+	// Hold on to the fiber until all the tasks have started, so the pool has to grow to one fiber per task
+	// Pinned waits don't use the counter's waiting fiber slots, so any number of fibers can wait
+	args->Started->FetchSub(1);
+	taskScheduler->WaitForCounter(args->Gate, 0, true);
+	args->TasksDone.fetch_add(1, std::memory_order_relaxed);
+}
+
+void LazyFiberMainTask(ftl::TaskScheduler *taskScheduler, void *arg) {
+	LazyFiberTestArgs *args = reinterpret_cast<LazyFiberTestArgs *>(arg);
+
+	ftl::AtomicCounter started(taskScheduler, kNumWaitingTasks);
+	ftl::AtomicCounter gate(taskScheduler, 1);
+	args->Started = &started;
+	args->Gate = &gate;
+
+	ftl::Task *tasks = new ftl::Task[kNumWaitingTasks];
+	for (uint i = 0; i < kNumWaitingTasks; ++i) {
+		tasks[i] = {GrowingPoolTask, args};
+	}
+
+	ftl::AtomicCounter counter(taskScheduler);
+	taskScheduler->AddTasks(kNumWaitingTasks, tasks, &counter);
+	taskScheduler->WaitForCounter(&started, 0);
+	gate.Store(0);
+	taskScheduler->WaitForCounter(&counter, 0);
+
+	delete[] tasks;
+}
+
+void RunLazyFiberTest(uint threadPoolSize, uint prefaultStackBytes) {
+	LazyFiberTestArgs args;
+	args.TasksDone.store(0);
+
+	ftl::SchedulerOptions options;
+	options.FiberPoolSize = kNumWaitingTasks + 20;
+	options.ThreadPoolSize = threadPoolSize;
+	options.PrefaultStackBytes = prefaultStackBytes;
+	options.FiberCreation = ftl::FiberCreationPolicy::Lazy;
+
+	ftl::TaskScheduler taskScheduler;
+	taskScheduler.Run(options, LazyFiberMainTask, &args);
+
+	GTEST_ASSERT_EQ(kNumWaitingTasks, args.TasksDone.load());
+}
+
+/**
+ * Grows a lazily created fiber pool from nothing to almost its full size, with and without prefaulting
+ */
+TEST(FunctionalTests, LazyFibers) {
+	RunLazyFiberTest(1, 0);
+	RunLazyFiberTest(4, 0);
+	RunLazyFiberTest(4, 16 * 1024);
+}
@@ -0,0 +1,73 @@
+/* FiberTaskingLib - A tasking library that uses fibers for efficient task switching
+ *
+ * This library was created as a proof of concept of the ideas presented by
+ * Christian Gyrling in his 2015 GDC Talk 'Parallelizing the Naughty Dog Engine Using Fibers'
+ *
+ * http://gdcvault.com/play/1022186/Parallelizing-the-Naughty-Dog-Engine
+ *
+ * FiberTaskingLib is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2015 - 2017
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "ftl/task_scheduler.h"
+#include "ftl/atomic_counter.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+
+
+const uint kNumSpinTasks = 100;
+
+void CountSpunTask(ftl::TaskScheduler *taskScheduler, void *arg) {
+	reinterpret_cast<std::atomic<uint> *>(arg)->fetch_add(1, std::memory_order_relaxed);
+}
+
+void SpinningMainTask(ftl::TaskScheduler *taskScheduler, void *arg) {
+	std::atomic<uint> *tasksRun = reinterpret_cast<std::atomic<uint> *>(arg);
+
+	// Spin, instead of waiting, so the other thread has to steal every task. Including the ones in our next task slot
+	ftl::AtomicCounter counter(taskScheduler);
+	taskScheduler->AddTask({CountSpunTask, tasksRun}, &counter);
+	while (counter.Load(std::memory_order_relaxed) != 0) {
+		// Spin
+	}
+
+	ftl::Task tasks[kNumSpinTasks];
+	for (uint i = 0; i < kNumSpinTasks; ++i) {
+		tasks[i] = {CountSpunTask, tasksRun};
+	}
+	taskScheduler->AddTasks(kNumSpinTasks, tasks, &counter);
+	while (counter.Load(std::memory_order_relaxed) != 0) {
+		// Spin
+	}
+}
+
+/**
+ * A task that spawns work and spins on it never goes back to the scheduler. The work can't be stranded on its thread
+ */
+TEST(FunctionalTests, NextTaskStealable) {
+	std::atomic<uint> tasksRun(0);
+
+	ftl::SchedulerOptions options;
+	options.FiberPoolSize = 20;
+	options.ThreadPoolSize = 2;
+
+	ftl::TaskScheduler taskScheduler;
+	taskScheduler.Run(options, SpinningMainTask, &tasksRun);
+
+	GTEST_ASSERT_EQ(kNumSpinTasks + 1, tasksRun.load());
+}
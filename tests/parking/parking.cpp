@@ -0,0 +1,229 @@
+/* FiberTaskingLib - A tasking library that uses fibers for efficient task switching
+ *
+ * This library was created as a proof of concept of the ideas presented by
+ * Christian Gyrling in his 2015 GDC Talk 'Parallelizing the Naughty Dog Engine Using Fibers'
+ *
+ * http://gdcvault.com/play/1022186/Parallelizing-the-Naughty-Dog-Engine
+ *
+ * FiberTaskingLib is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2015 - 2017
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "ftl/task_scheduler.h"
+#include "ftl/atomic_counter.h"
+#include "skip_test.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+
+const uint kNumParkingThreads = 4u;
+const uint kNumParkingTasks = 64u;
+
+/**
+ * Waits until exactly 'numThreads' worker threads are active, or gives up after a few seconds
+ * Blocks the calling thread, so it only makes sense from the main task, whose thread never parks
+ */
+bool WaitForActiveThreads(ftl::TaskScheduler *taskScheduler, uint numThreads) {
+	const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+	while (taskScheduler->GetNumActiveThreads() != numThreads) {
+		if (std::chrono::steady_clock::now() > deadline) {
+			return false;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	return true;
+}
+
+struct ParkingTestArgs {
+	/* Which threads ran a ParkingTask. One flag per thread */
+	std::atomic<bool> RanOn[kNumParkingThreads];
+	/* The most threads a ParkingTask saw active at once */
+	std::atomic<uint> MaxActiveThreads;
+
+	void Reset() {
+		for (uint i = 0; i < kNumParkingThreads; ++i) {
+			RanOn[i].store(false);
+		}
+		MaxActiveThreads.store(0);
+	}
+
+	uint NumThreadsRanOn() const {
+		uint numThreads = 0;
+		for (uint i = 0; i < kNumParkingThreads; ++i) {
+			numThreads += RanOn[i].load() ? 1 : 0;
+		}
+		return numThreads;
+	}
+};
+
+void ParkingTask(ftl::TaskScheduler *taskScheduler, void *arg) {
+	ParkingTestArgs *args = reinterpret_cast<ParkingTestArgs *>(arg);
+	args->RanOn[taskScheduler->GetCurrentThreadIndex()].store(true);
+
+	uint numActive = taskScheduler->GetNumActiveThreads();
+	uint maxActive = args->MaxActiveThreads.load();
+	while (numActive > maxActive && !args->MaxActiveThreads.compare_exchange_weak(maxActive, numActive)) {
+		// Retry with the new maximum
+	}
+
+	// Take long enough that the queue backs up
+	std::this_thread::sleep_for(std::chrono::microseconds(200));
+}
+
+/* Adds the tasks, then spins instead of waiting, so the work can only finish if other threads wake up for it */
+void AddParkingTasksAndSpin(ftl::TaskScheduler *taskScheduler, ParkingTestArgs *args) {
+	ftl::Task tasks[kNumParkingTasks];
+	for (uint i = 0; i < kNumParkingTasks; ++i) {
+		tasks[i] = {ParkingTask, args};
+	}
+
+	ftl::AtomicCounter counter(taskScheduler);
+	taskScheduler->AddTasks(kNumParkingTasks, tasks, &counter);
+	while (counter.Load() != 0) {
+		// Spin
+	}
+}
+
+void ParkAndWakeMainTask(ftl::TaskScheduler *taskScheduler, void *arg) {
+	ParkingTestArgs *args = reinterpret_cast<ParkingTestArgs *>(arg);
+
+	// Nothing else is running, so every thread but ours parks
+	GTEST_ASSERT_EQ(true, WaitForActiveThreads(taskScheduler, 1));
+
+	AddParkingTasksAndSpin(taskScheduler, args);
+	GTEST_ASSERT_GT(args->MaxActiveThreads.load(), 1u);
+	GTEST_ASSERT_GT(args->NumThreadsRanOn(), 1u);
+
+	// Once the work is done, they park again
+	GTEST_ASSERT_EQ(true, WaitForActiveThreads(taskScheduler, 1));
+}
+
+/**
+ * Tests that idle threads park, and that they're woken up when work backs up
+ */
+TEST(FunctionalTests, ParkAndWake) {
+	if (!ftl::SchedulerPolicy::kParking) {
+		FTL_SKIP_TEST("The scheduler policy leaves parking out");
+	}
+
+	ParkingTestArgs args;
+	args.Reset();
+
+	ftl::SchedulerOptions options;
+	options.ThreadPoolSize = kNumParkingThreads;
+	options.MinActiveThreads = 1;
+	options.ParkDelayMs = 1;
+
+	ftl::TaskScheduler taskScheduler;
+	taskScheduler.Run(options, ParkAndWakeMainTask, &args);
+}
+
+void ActiveThreadLimitsMainTask(ftl::TaskScheduler *taskScheduler, void *arg) {
+	ParkingTestArgs *args = reinterpret_cast<ParkingTestArgs *>(arg);
+
+	// Parking starts out disabled
+	GTEST_ASSERT_EQ(kNumParkingThreads, taskScheduler->GetNumActiveThreads());
+
+	// Over the maximum, idle threads park right away, and nothing wakes them
+	taskScheduler->SetActiveThreadLimits(1, 1);
+	GTEST_ASSERT_EQ(true, WaitForActiveThreads(taskScheduler, 1));
+
+	ftl::Task tasks[kNumParkingTasks];
+	for (uint i = 0; i < kNumParkingTasks; ++i) {
+		tasks[i] = {ParkingTask, args};
+	}
+	ftl::AtomicCounter counter(taskScheduler);
+	taskScheduler->AddTasks(kNumParkingTasks, tasks, &counter);
+	taskScheduler->WaitForCounter(&counter, 0);
+	GTEST_ASSERT_EQ(1u, args->NumThreadsRanOn());
+	GTEST_ASSERT_EQ(1u, args->MaxActiveThreads.load());
+
+	// Raising the minimum wakes the parked threads right away
+	taskScheduler->SetActiveThreadLimits(kNumParkingThreads, kNumParkingThreads);
+	GTEST_ASSERT_EQ(kNumParkingThreads, taskScheduler->GetNumActiveThreads());
+
+	args->Reset();
+	AddParkingTasksAndSpin(taskScheduler, args);
+	GTEST_ASSERT_GT(args->NumThreadsRanOn(), 1u);
+}
+
+/**
+ * Tests that the active thread limits can be lowered, and raised again, while the scheduler runs
+ */
+TEST(FunctionalTests, ActiveThreadLimits) {
+	if (!ftl::SchedulerPolicy::kParking) {
+		FTL_SKIP_TEST("The scheduler policy leaves parking out");
+	}
+
+	ParkingTestArgs args;
+	args.Reset();
+
+	ftl::SchedulerOptions options;
+	options.ThreadPoolSize = kNumParkingThreads;
+
+	ftl::TaskScheduler taskScheduler;
+	taskScheduler.Run(options, ActiveThreadLimitsMainTask, &args);
+}
+
+void RecordParkedThreadTask(ftl::TaskScheduler *taskScheduler, void *arg) {
+	*reinterpret_cast<std::size_t *>(arg) = taskScheduler->GetCurrentThreadIndex();
+}
+
+void WaitWhileParkedMainTask(ftl::TaskScheduler *taskScheduler, void *arg) {
+	(void)arg;
+	GTEST_ASSERT_EQ(true, WaitForActiveThreads(taskScheduler, 1));
+
+	// Only our thread is active, so it runs the task while we wait
+	std::size_t threadIndex = kNumParkingThreads;
+	ftl::AtomicCounter counter(taskScheduler);
+	taskScheduler->AddTask({RecordParkedThreadTask, &threadIndex}, &counter);
+	taskScheduler->WaitForCounter(&counter, 0);
+	GTEST_ASSERT_EQ(0u, threadIndex);
+
+	// Delayed tasks are picked up by our thread too
+	threadIndex = kNumParkingThreads;
+	taskScheduler->AddDelayedTask({RecordParkedThreadTask, &threadIndex}, std::chrono::milliseconds(5), &counter);
+	taskScheduler->WaitForCounter(&counter, 0);
+	GTEST_ASSERT_EQ(0u, threadIndex);
+
+	// A strict task can only run on its worker, which is parked, so the wait depends on waking it
+	GTEST_ASSERT_EQ(true, WaitForActiveThreads(taskScheduler, 1));
+	const uint lastThread = kNumParkingThreads - 1;
+	taskScheduler->AddTask({RecordParkedThreadTask, &threadIndex}, &counter, ftl::Affinity{lastThread, true});
+	taskScheduler->WaitForCounter(&counter, 0);
+	GTEST_ASSERT_EQ(lastThread, threadIndex);
+}
+
+/**
+ * Tests that WaitForCounter() completes while the other threads are parked
+ */
+TEST(FunctionalTests, WaitWhileParked) {
+	if (!ftl::SchedulerPolicy::kParking) {
+		FTL_SKIP_TEST("The scheduler policy leaves parking out");
+	}
+
+	ftl::SchedulerOptions options;
+	options.ThreadPoolSize = kNumParkingThreads;
+	options.MinActiveThreads = 1;
+	options.ParkDelayMs = 1;
+
+	ftl::TaskScheduler taskScheduler;
+	taskScheduler.Run(options, WaitWhileParkedMainTask);
+}
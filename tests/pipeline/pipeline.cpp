@@ -0,0 +1,151 @@
+/* FiberTaskingLib - A tasking library that uses fibers for efficient task switching
+ *
+ * This library was created as a proof of concept of the ideas presented by
+ * Christian Gyrling in his 2015 GDC Talk 'Parallelizing the Naughty Dog Engine Using Fibers'
+ *
+ * http://gdcvault.com/play/1022186/Parallelizing-the-Naughty-Dog-Engine
+ *
+ * FiberTaskingLib is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2015 - 2017
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "ftl/pipeline.h"
+#include "ftl/task_scheduler.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <vector>
+
+
+const uint64 kNumPipelineItems = 20000;
+const uint kNumPipelineTokens = 16;
+
+struct PipelineTestState {
+	uint64 NextInput;
+	/* The number of items between the input and the output. It can never exceed the number of tokens */
+	std::atomic<uint> InFlight;
+	std::atomic<uint> MaxInFlight;
+	std::vector<uint64> Output;
+	/* Whether two items were ever in the serial stage at once */
+	std::atomic<bool> InSerialStage;
+	bool Overlapped;
+};
+
+void *PipelineInput(ftl::TaskScheduler *taskScheduler, void *arg) {
+	(void)taskScheduler;
+	PipelineTestState *state = reinterpret_cast<PipelineTestState *>(arg);
+	if (state->NextInput == kNumPipelineItems) {
+		return nullptr;
+	}
+
+	const uint inFlight = state->InFlight.fetch_add(1) + 1;
+	uint maxInFlight = state->MaxInFlight.load();
+	while (inFlight > maxInFlight && !state->MaxInFlight.compare_exchange_weak(maxInFlight, inFlight)) {
+	}
+
+	return new uint64(state->NextInput++);
+}
+
+void *SquareStage(ftl::TaskScheduler *taskScheduler, void *item, void *arg) {
+	(void)taskScheduler;
+	(void)arg;
+	uint64 *value = reinterpret_cast<uint64 *>(item);
+
+	// Make the items take different amounts of time, so they finish the parallel stage out of order
+	volatile uint spins = 0;
+	for (uint64 i = 0; i < (*value * 7919) % 500; ++i) {
+		spins = spins + 1;
+	}
+
+	*value = *value * *value;
+	return value;
+}
+
+void *DropMultiplesOfThreeStage(ftl::TaskScheduler *taskScheduler, void *item, void *arg) {
+	(void)taskScheduler;
+	PipelineTestState *state = reinterpret_cast<PipelineTestState *>(arg);
+	uint64 *value = reinterpret_cast<uint64 *>(item);
+
+	if (*value % 3 == 0) {
+		delete value;
+		state->InFlight.fetch_sub(1);
+		return nullptr;
+	}
+	return value;
+}
+
+void *OutputStage(ftl::TaskScheduler *taskScheduler, void *item, void *arg) {
+	(void)taskScheduler;
+	PipelineTestState *state = reinterpret_cast<PipelineTestState *>(arg);
+	uint64 *value = reinterpret_cast<uint64 *>(item);
+
+	if (state->InSerialStage.exchange(true)) {
+		state->Overlapped = true;
+	}
+	state->Output.push_back(*value);
+	state->InSerialStage.store(false);
+
+	delete value;
+	state->InFlight.fetch_sub(1);
+	return nullptr;
+}
+
+void PipelineMainTask(ftl::TaskScheduler *taskScheduler, void *arg) {
+	PipelineTestState *state = reinterpret_cast<PipelineTestState *>(arg);
+
+	ftl::Pipeline pipeline(taskScheduler);
+	pipeline.SetInput(PipelineInput, state);
+	pipeline.AddStage(ftl::PipelineStageMode::Parallel, SquareStage);
+	pipeline.AddStage(ftl::PipelineStageMode::Parallel, DropMultiplesOfThreeStage, state);
+	pipeline.AddStage(ftl::PipelineStageMode::SerialInOrder, OutputStage, state);
+	pipeline.Run(kNumPipelineTokens);
+}
+
+/**
+ * Tests that a serial stage sees the items one at a time, in input order, even when some of them are dropped,
+ * and that the number of items in flight stays within the tokens
+ */
+TEST(FunctionalTests, PipelineOrder) {
+	PipelineTestState state;
+	state.NextInput = 0;
+	state.InFlight.store(0);
+	state.MaxInFlight.store(0);
+	state.InSerialStage.store(false);
+	state.Overlapped = false;
+
+	// Make sure items really do pass each other, even on small machines
+	ftl::SchedulerOptions options;
+	options.ThreadPoolSize = 4;
+
+	ftl::TaskScheduler taskScheduler;
+	taskScheduler.Run(options, PipelineMainTask, &state);
+
+	GTEST_ASSERT_EQ(false, state.Overlapped);
+	GTEST_ASSERT_EQ(0u, state.InFlight.load());
+	GTEST_ASSERT_EQ(true, state.MaxInFlight.load() <= kNumPipelineTokens);
+
+	std::size_t next = 0;
+	for (uint64 i = 0; i < kNumPipelineItems; ++i) {
+		if ((i * i) % 3 == 0) {
+			continue;
+		}
+		GTEST_ASSERT_EQ(true, next < state.Output.size());
+		GTEST_ASSERT_EQ(i * i, state.Output[next]);
+		++next;
+	}
+	GTEST_ASSERT_EQ(next, state.Output.size());
+}
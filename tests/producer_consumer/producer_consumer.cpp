@@ -50,16 +50,31 @@ void Producer(ftl::TaskScheduler *taskScheduler, void *arg) {
 	taskScheduler->WaitForCounter(&counter, 0);
 }
 
+void FanInProducer(ftl::TaskScheduler *taskScheduler, void *arg) {
+	ftl::Task *tasks = new ftl::Task[kNumConsumerTasks];
+	for (uint i = 0; i < kNumConsumerTasks; ++i) {
+		tasks[i] = { Consumer, arg };
+	}
+
+	ftl::AtomicCounter counter(taskScheduler, 0, true);
+	taskScheduler->AddTasks(kNumConsumerTasks, tasks, &counter);
+	delete[] tasks;
+
+	taskScheduler->WaitForCounter(&counter, 0);
+}
+
 
 void ProducerConsumerMainTask(ftl::TaskScheduler *taskScheduler, void *arg) {
 	std::atomic_uint globalCounter(0u);
+	bool fanIn = arg != nullptr && *reinterpret_cast<bool *>(arg);
+	ftl::TaskFunction producer = fanIn ? FanInProducer : Producer;
 
 	ftl::Task tasks[kNumProducerTasks];
 	for (uint i = 0; i < kNumProducerTasks; ++i) {
-		tasks[i] = { Producer, &globalCounter };
+		tasks[i] = { producer, &globalCounter };
 	}
 
-	ftl::AtomicCounter counter(taskScheduler);
+	ftl::AtomicCounter counter(taskScheduler, 0, fanIn);
 	taskScheduler->AddTasks(kNumProducerTasks, tasks, &counter);
 	taskScheduler->WaitForCounter(&counter, 0);
 
@@ -78,3 +93,13 @@ TEST(FunctionalTests, ProducerConsumer) {
 	ftl::TaskScheduler taskScheduler;
 	taskScheduler.Run(400, ProducerConsumerMainTask);
 }
+
+/**
+ * Tests that fan-in counters wake their waiters once every task has finished
+ */
+TEST(FunctionalTests, ProducerConsumerFanIn) {
+	bool fanIn = true;
+
+	ftl::TaskScheduler taskScheduler;
+	taskScheduler.Run(400, ProducerConsumerMainTask, &fanIn);
+}
@@ -0,0 +1,295 @@
+/* FiberTaskingLib - A tasking library that uses fibers for efficient task switching
+ *
+ * This library was created as a proof of concept of the ideas presented by
+ * Christian Gyrling in his 2015 GDC Talk 'Parallelizing the Naughty Dog Engine Using Fibers'
+ *
+ * http://gdcvault.com/play/1022186/Parallelizing-the-Naughty-Dog-Engine
+ *
+ * FiberTaskingLib is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2015 - 2017
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "ftl/remote_task_transport.h"
+#include "ftl/task_scheduler.h"
+#include "ftl/atomic_counter.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <cstring>
+
+#if defined(FTL_OS_LINUX) || defined(FTL_OS_MAC)
+#	include <sys/socket.h>
+#	include <sys/un.h>
+#	include <sys/wait.h>
+#	include <unistd.h>
+#endif
+
+
+int32 GetProcessId() {
+#if defined(FTL_OS_LINUX) || defined(FTL_OS_MAC)
+	return static_cast<int32>(getpid());
+#else
+	return 0;
+#endif
+}
+
+const uint32 kSquareFunctionId = 3;
+const uint kNumRemoteTasks = 300;
+
+/* The result of SquareTask */
+struct SquareResult {
+	uint64 Square;
+	/* The process that ran the task */
+	int32 Process;
+};
+
+uint32 SquareTask(ftl::TaskScheduler *taskScheduler, const void *args, uint32 argsSize, void *result, uint32 resultCapacity) {
+	(void)taskScheduler;
+	(void)argsSize;
+	(void)resultCapacity;
+
+	uint32 value;
+	memcpy(&value, args, sizeof(value));
+
+	SquareResult square;
+	square.Square = static_cast<uint64>(value) * value;
+	square.Process = GetProcessId();
+	memcpy(result, &square, sizeof(square));
+	return sizeof(square);
+}
+
+struct RemoteTasksTestArgs {
+	/* The number of tasks that ran in another process */
+	uint NumRemote;
+};
+
+void RemoteTasksMainTask(ftl::TaskScheduler *taskScheduler, void *arg) {
+	RemoteTasksTestArgs *testArgs = reinterpret_cast<RemoteTasksTestArgs *>(arg);
+
+	SquareResult *results = new SquareResult[kNumRemoteTasks];
+	ftl::RemoteTask *tasks = new ftl::RemoteTask[kNumRemoteTasks];
+	for (uint32 i = 0; i < kNumRemoteTasks; ++i) {
+		tasks[i].FunctionId = kSquareFunctionId;
+		tasks[i].ArgsSize = sizeof(i);
+		memcpy(tasks[i].Args, &i, sizeof(i));
+		tasks[i].Result = &results[i];
+		tasks[i].ResultCapacity = sizeof(SquareResult);
+	}
+
+	ftl::AtomicCounter counter(taskScheduler);
+	taskScheduler->AddRemoteTasks(kNumRemoteTasks, tasks, &counter);
+	taskScheduler->WaitForCounter(&counter, 0);
+
+	testArgs->NumRemote = 0;
+	for (uint i = 0; i < kNumRemoteTasks; ++i) {
+		GTEST_ASSERT_EQ(static_cast<uint64>(i) * i, results[i].Square);
+		if (results[i].Process != GetProcessId()) {
+			++testArgs->NumRemote;
+		}
+	}
+
+	delete[] tasks;
+	delete[] results;
+}
+
+/**
+ * Tests that remote tasks run in this process when there are no workers to ship them to
+ */
+TEST(RemoteTasks, NoWorkers) {
+	ftl::RemoteTaskTransport transport;
+	transport.RegisterFunction(kSquareFunctionId, SquareTask);
+
+	ftl::SchedulerOptions options;
+	options.Transport = &transport;
+	options.RemoteOffloadThreshold = 0;
+
+	RemoteTasksTestArgs args;
+	ftl::TaskScheduler taskScheduler;
+	taskScheduler.Run(options, RemoteTasksMainTask, &args);
+
+	GTEST_ASSERT_EQ(0u, args.NumRemote);
+}
+
+/**
+ * Tests that remote tasks abort without a transport to look up their functions, rather than being dropped
+ */
+TEST(RemoteTasks, NoTransport) {
+	::testing::GTEST_FLAG(death_test_style) = "threadsafe";
+
+	ftl::SchedulerOptions options;
+	options.RemoteOffloadThreshold = 0;
+
+	ASSERT_DEATH_IF_SUPPORTED({
+		RemoteTasksTestArgs args;
+		ftl::TaskScheduler taskScheduler;
+		taskScheduler.Run(options, RemoteTasksMainTask, &args);
+	}, "");
+}
+
+#if defined(FTL_OS_LINUX) || defined(FTL_OS_MAC)
+
+void ServeMainTask(ftl::TaskScheduler *taskScheduler, void *arg) {
+	ftl::RemoteTaskTransport *transport = reinterpret_cast<ftl::RemoteTaskTransport *>(arg);
+	transport->Serve(taskScheduler);
+}
+
+/**
+ * Forks a worker listening on listenAddress, ships every task to it, and checks the results came back
+ *
+ * @param listenAddress    The address for the worker to listen on
+ * @param tcp              Whether listenAddress is a TCP address, with port 0
+ */
+void RunOffloadTest(const char *listenAddress, bool tcp) {
+	int ready[2];
+	GTEST_ASSERT_EQ(0, pipe(ready));
+
+	const pid_t child = fork();
+	GTEST_ASSERT_NE(-1, child);
+	if (child == 0) {
+		close(ready[0]);
+		ftl::RemoteTaskTransport transport;
+		transport.RegisterFunction(kSquareFunctionId, SquareTask);
+		if (!transport.Listen(listenAddress)) {
+			_exit(1);
+		}
+
+		// Tell the parent where to connect. With port 0, only we know the port
+		uint16 port = transport.GetListenPort();
+		if (write(ready[1], &port, sizeof(port)) != sizeof(port)) {
+			_exit(1);
+		}
+		close(ready[1]);
+
+		ftl::SchedulerOptions options;
+		options.ThreadPoolSize = 2;
+		ftl::TaskScheduler taskScheduler;
+		taskScheduler.Run(options, ServeMainTask, &transport);
+		_exit(0);
+	}
+
+	close(ready[1]);
+	uint16 port = 0;
+	GTEST_ASSERT_EQ(static_cast<ssize_t>(sizeof(port)), read(ready[0], &port, sizeof(port)));
+	close(ready[0]);
+
+	char address[128];
+	if (tcp) {
+		snprintf(address, sizeof(address), "tcp:127.0.0.1:%u", static_cast<uint>(port));
+	} else {
+		snprintf(address, sizeof(address), "%s", listenAddress);
+	}
+
+	ftl::RemoteTaskTransport transport;
+	transport.RegisterFunction(kSquareFunctionId, SquareTask);
+	GTEST_ASSERT_EQ(true, transport.Connect(address));
+
+	ftl::SchedulerOptions options;
+	options.ThreadPoolSize = 2;
+	options.Transport = &transport;
+	options.RemoteOffloadThreshold = 0;
+
+	RemoteTasksTestArgs args;
+	ftl::TaskScheduler taskScheduler;
+	taskScheduler.Run(options, RemoteTasksMainTask, &args);
+	GTEST_ASSERT_EQ(kNumRemoteTasks, args.NumRemote);
+
+	// Disconnecting lets the worker return from Serve()
+	transport.Close();
+	int status = 0;
+	waitpid(child, &status, 0);
+	GTEST_ASSERT_EQ(true, WIFEXITED(status));
+	GTEST_ASSERT_EQ(0, WEXITSTATUS(status));
+}
+
+/**
+ * Tests shipping tasks to a worker process over a Unix domain socket
+ */
+TEST(RemoteTasks, UnixSocketWorker) {
+	char address[128];
+	snprintf(address, sizeof(address), "unix:/tmp/ftl-test-%d.sock", static_cast<int>(getpid()));
+	RunOffloadTest(address, false);
+}
+
+/**
+ * Tests shipping tasks to a worker process over TCP
+ */
+TEST(RemoteTasks, TcpWorker) {
+	RunOffloadTest("tcp:127.0.0.1:0", true);
+}
+
+/**
+ * Tests that the tasks of a worker that goes away still complete, here. The fake worker answers a request that
+ * was never sent, and then hangs up without answering any of the real ones
+ */
+TEST(RemoteTasks, LostWorker) {
+	char path[128];
+	snprintf(path, sizeof(path), "/tmp/ftl-test-lost-%d.sock", static_cast<int>(getpid()));
+	unlink(path);
+
+	sockaddr_un socketAddress;
+	memset(&socketAddress, 0, sizeof(socketAddress));
+	socketAddress.sun_family = AF_UNIX;
+	strcpy(socketAddress.sun_path, path);
+	const int listenSocket = socket(AF_UNIX, SOCK_STREAM, 0);
+	GTEST_ASSERT_NE(-1, listenSocket);
+	GTEST_ASSERT_EQ(0, bind(listenSocket, reinterpret_cast<sockaddr *>(&socketAddress), sizeof(socketAddress)));
+	GTEST_ASSERT_EQ(0, listen(listenSocket, 1));
+
+	const pid_t child = fork();
+	GTEST_ASSERT_NE(-1, child);
+	if (child == 0) {
+		const int fd = accept(listenSocket, nullptr, nullptr);
+		char request[16];
+		if (fd < 0 || recv(fd, request, sizeof(request), MSG_WAITALL) != sizeof(request)) {
+			_exit(1);
+		}
+
+		// A response header with an id that was never handed out, and no result
+		uint64 response[2] = {0xdeadbeefdeadbeefull, 0};
+		if (send(fd, response, sizeof(response), 0) != sizeof(response)) {
+			_exit(1);
+		}
+		close(fd);
+		_exit(0);
+	}
+	close(listenSocket);
+
+	char address[160];
+	snprintf(address, sizeof(address), "unix:%s", path);
+	ftl::RemoteTaskTransport transport;
+	transport.RegisterFunction(kSquareFunctionId, SquareTask);
+	GTEST_ASSERT_EQ(true, transport.Connect(address));
+
+	ftl::SchedulerOptions options;
+	options.ThreadPoolSize = 2;
+	options.Transport = &transport;
+	options.RemoteOffloadThreshold = 0;
+
+	RemoteTasksTestArgs args;
+	ftl::TaskScheduler taskScheduler;
+	taskScheduler.Run(options, RemoteTasksMainTask, &args);
+	GTEST_ASSERT_EQ(0u, args.NumRemote);
+
+	transport.Close();
+	unlink(path);
+	int status = 0;
+	waitpid(child, &status, 0);
+	GTEST_ASSERT_EQ(true, WIFEXITED(status));
+	GTEST_ASSERT_EQ(0, WEXITSTATUS(status));
+}
+
+#endif
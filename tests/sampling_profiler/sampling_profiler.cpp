@@ -0,0 +1,119 @@
+/* FiberTaskingLib - A tasking library that uses fibers for efficient task switching
+ *
+ * This library was created as a proof of concept of the ideas presented by
+ * Christian Gyrling in his 2015 GDC Talk 'Parallelizing the Naughty Dog Engine Using Fibers'
+ *
+ * http://gdcvault.com/play/1022186/Parallelizing-the-Naughty-Dog-Engine
+ *
+ * FiberTaskingLib is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2015 - 2017
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "ftl/sampling_profiler.h"
+#include "ftl/task_scheduler.h"
+#include "ftl/atomic_counter.h"
+#include "skip_test.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+
+void SpinFor(std::chrono::milliseconds duration) {
+	auto end = std::chrono::steady_clock::now() + duration;
+	while (std::chrono::steady_clock::now() < end) {
+		// Spin
+	}
+}
+
+void ProfiledFunctionNamedTask(ftl::TaskScheduler *taskScheduler, void *arg) {
+	SpinFor(std::chrono::milliseconds(30));
+}
+
+void ProfiledSelfNamedTask(ftl::TaskScheduler *taskScheduler, void *arg) {
+	ftl::SamplingProfiler::SetCurrentTaskName("self_named");
+	SpinFor(std::chrono::milliseconds(30));
+}
+
+void ProfilerTestMainTask(ftl::TaskScheduler *taskScheduler, void *arg) {
+	ftl::Task tasks[] = {
+		{ProfiledFunctionNamedTask, nullptr},
+		{ProfiledSelfNamedTask, nullptr},
+	};
+
+	ftl::AtomicCounter counter(taskScheduler);
+	taskScheduler->AddTasks(2, tasks, &counter);
+	taskScheduler->WaitForCounter(&counter, 0);
+}
+
+void CountTaskBegin(void *context, std::size_t threadIndex, std::size_t fiberIndex, const ftl::Task &task) {
+	reinterpret_cast<std::atomic<uint> *>(context)->fetch_add(1);
+}
+
+/**
+ * Checks that samples are attributed to the right task names, and that hooks set before attaching still run
+ */
+TEST(FunctionalTests, SamplingProfiler) {
+	if (!ftl::SchedulerPolicy::kHooks) {
+		FTL_SKIP_TEST("The scheduler was built without hooks");
+	}
+
+	std::atomic<uint> taskBegins(0);
+
+	ftl::SchedulerOptions options;
+	options.ThreadPoolSize = 2;
+	options.Hooks.Context = &taskBegins;
+	options.Hooks.TaskBegin = CountTaskBegin;
+
+	ftl::SamplingProfiler profiler(200);
+	GTEST_ASSERT_EQ(true, profiler.Attach(&options));
+	profiler.NameTaskFunction(ProfiledFunctionNamedTask, "function_named");
+	profiler.Start();
+
+	ftl::TaskScheduler taskScheduler;
+	taskScheduler.Run(options, ProfilerTestMainTask, nullptr);
+
+	profiler.Stop();
+
+	// The main task and the two children
+	GTEST_ASSERT_EQ(3u, taskBegins.load());
+
+	GTEST_ASSERT_GT(profiler.GetNumSamples("function_named"), 0u);
+	GTEST_ASSERT_GT(profiler.GetNumSamples("self_named"), 0u);
+	GTEST_ASSERT_EQ(profiler.GetNumSamples("self_named"), profiler.GetNumSamples(ProfiledSelfNamedTask));
+	GTEST_ASSERT_LE(profiler.GetNumSamples("function_named") + profiler.GetNumSamples("self_named"), profiler.GetNumSamples());
+
+	// The children are never nested in anything, so their stacks are a single frame
+	const char *path = "sampling_profiler_test.folded";
+	GTEST_ASSERT_EQ(true, profiler.WriteFoldedStacks(path));
+	FILE *file = fopen(path, "r");
+	GTEST_ASSERT_NE(nullptr, file);
+	bool foundFunctionNamed = false;
+	bool foundSelfNamed = false;
+	char line[256];
+	while (fgets(line, sizeof(line), file) != nullptr) {
+		foundFunctionNamed |= strncmp(line, "function_named ", 15) == 0;
+		foundSelfNamed |= strncmp(line, "self_named ", 11) == 0;
+	}
+	fclose(file);
+	remove(path);
+
+	GTEST_ASSERT_EQ(true, foundFunctionNamed);
+	GTEST_ASSERT_EQ(true, foundSelfNamed);
+}
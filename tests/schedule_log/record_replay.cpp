@@ -0,0 +1,185 @@
+/* FiberTaskingLib - A tasking library that uses fibers for efficient task switching
+ *
+ * This library was created as a proof of concept of the ideas presented by
+ * Christian Gyrling in his 2015 GDC Talk 'Parallelizing the Naughty Dog Engine Using Fibers'
+ *
+ * http://gdcvault.com/play/1022186/Parallelizing-the-Naughty-Dog-Engine
+ *
+ * FiberTaskingLib is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2015 - 2017
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ftl/task_scheduler.h"
+#include "ftl/atomic_counter.h"
+#include "ftl/schedule_log.h"
+#include "skip_test.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+
+
+const uint kNumThreads = 4u;
+const uint kNumParents = 40u;
+const uint kNumChildren = 10u;
+
+
+struct RecordReplayTestArgs {
+	RecordReplayTestArgs(uint numChildren)
+		: NumChildren(numChildren),
+		  Traces(kNumThreads) {
+	}
+
+	uint NumChildren;
+	/* The labels of the work each thread did, in order. Each thread only appends to its own trace */
+	std::vector<std::vector<uint> > Traces;
+};
+
+struct TracedTask {
+	RecordReplayTestArgs *Args;
+	uint Label;
+};
+
+void Trace(ftl::TaskScheduler *taskScheduler, RecordReplayTestArgs *args, uint label) {
+	args->Traces[taskScheduler->GetCurrentThreadIndex()].push_back(label);
+
+	// Give the other threads a chance to steal
+	volatile uint spins = 0;
+	for (uint i = 0; i < 2000; ++i) {
+		spins = spins + 1;
+	}
+}
+
+void ChildTask(ftl::TaskScheduler *taskScheduler, void *arg) {
+	TracedTask *task = reinterpret_cast<TracedTask *>(arg);
+	Trace(taskScheduler, task->Args, task->Label);
+}
+
+void ParentTask(ftl::TaskScheduler *taskScheduler, void *arg) {
+	TracedTask *task = reinterpret_cast<TracedTask *>(arg);
+	Trace(taskScheduler, task->Args, task->Label);
+
+	const uint numChildren = task->Args->NumChildren;
+	std::vector<TracedTask> children(numChildren);
+	std::vector<ftl::Task> tasks(numChildren);
+	for (uint i = 0; i < numChildren; ++i) {
+		children[i] = {task->Args, task->Label + i + 1};
+		tasks[i] = {ChildTask, &children[i]};
+	}
+
+	// Mix pinned and unpinned waits, and normal and fan-in counters
+	const bool fanIn = task->Label % 200 == 0;
+	ftl::AtomicCounter counter(taskScheduler, 0, fanIn);
+	taskScheduler->AddTasks(numChildren, tasks.data(), &counter);
+	taskScheduler->WaitForCounter(&counter, 0, task->Label % 300 == 0);
+
+	Trace(taskScheduler, task->Args, task->Label + 50);
+}
+
+void RecordReplayMainTask(ftl::TaskScheduler *taskScheduler, void *arg) {
+	RecordReplayTestArgs *args = reinterpret_cast<RecordReplayTestArgs *>(arg);
+
+	std::vector<TracedTask> parents(kNumParents);
+	std::vector<ftl::Task> tasks(kNumParents);
+	for (uint i = 0; i < kNumParents; ++i) {
+		parents[i] = {args, (i + 1) * 100};
+		tasks[i] = {ParentTask, &parents[i]};
+	}
+
+	ftl::AtomicCounter counter(taskScheduler);
+	taskScheduler->AddTasks(kNumParents, tasks.data(), &counter);
+	taskScheduler->WaitForCounter(&counter, 0);
+}
+
+ftl::SchedulerOptions ScheduleOptions(ftl::ScheduleMode mode, ftl::ScheduleLog *log) {
+	ftl::SchedulerOptions options;
+	options.FiberPoolSize = 100;
+	options.ThreadPoolSize = kNumThreads;
+	options.Pinning = ftl::PinningPolicy::None;
+	options.Schedule = mode;
+	options.Log = log;
+
+	return options;
+}
+
+
+/**
+ * Tests that a replay runs the same work on the same threads, in the same order, as the recorded run
+ */
+TEST(FunctionalTests, RecordReplay) {
+	if (!ftl::SchedulerPolicy::kScheduleLog) {
+		FTL_SKIP_TEST("The scheduler policy leaves the schedule log out");
+	}
+
+	ftl::ScheduleLog log;
+	RecordReplayTestArgs recorded(kNumChildren);
+	{
+		ftl::TaskScheduler taskScheduler;
+		taskScheduler.Run(ScheduleOptions(ftl::ScheduleMode::Record, &log), RecordReplayMainTask, &recorded);
+	}
+	GTEST_ASSERT_EQ(kNumThreads, log.GetNumThreads());
+	// Every task runs once, and every parent waits once
+	GTEST_ASSERT_LE(kNumParents * (kNumChildren + 1), log.GetNumEvents());
+
+	// Go through a file, like a real investigation would
+	const char *path = "ftl_record_replay_test.log";
+	GTEST_ASSERT_EQ(true, log.Save(path));
+	ftl::ScheduleLog loaded;
+	GTEST_ASSERT_EQ(true, loaded.Load(path));
+	std::remove(path);
+	GTEST_ASSERT_EQ(log.GetNumEvents(), loaded.GetNumEvents());
+
+	for (uint run = 0; run < 3; ++run) {
+		RecordReplayTestArgs replayed(kNumChildren);
+		ftl::TaskScheduler taskScheduler;
+		taskScheduler.Run(ScheduleOptions(ftl::ScheduleMode::Replay, &loaded), RecordReplayMainTask, &replayed);
+
+		GTEST_ASSERT_EQ(false, taskScheduler.HasReplayDiverged());
+		for (uint i = 0; i < kNumThreads; ++i) {
+			GTEST_ASSERT_EQ(recorded.Traces[i], replayed.Traces[i]);
+		}
+	}
+}
+
+/**
+ * Tests that a replay of a different workload gives up on the log, and still runs everything
+ */
+TEST(FunctionalTests, ReplayDivergence) {
+	if (!ftl::SchedulerPolicy::kScheduleLog) {
+		FTL_SKIP_TEST("The scheduler policy leaves the schedule log out");
+	}
+
+	ftl::ScheduleLog log;
+	RecordReplayTestArgs recorded(kNumChildren);
+	{
+		ftl::TaskScheduler taskScheduler;
+		taskScheduler.Run(ScheduleOptions(ftl::ScheduleMode::Record, &log), RecordReplayMainTask, &recorded);
+	}
+
+	// Each parent spawns fewer children, so the ids stop matching
+	RecordReplayTestArgs replayed(kNumChildren / 2);
+	ftl::SchedulerOptions options = ScheduleOptions(ftl::ScheduleMode::Replay, &log);
+	options.ReplayTimeoutMs = 50;
+
+	ftl::TaskScheduler taskScheduler;
+	taskScheduler.Run(options, RecordReplayMainTask, &replayed);
+	GTEST_ASSERT_EQ(true, taskScheduler.HasReplayDiverged());
+
+	std::size_t numTraces = 0;
+	for (uint i = 0; i < kNumThreads; ++i) {
+		numTraces += replayed.Traces[i].size();
+	}
+	GTEST_ASSERT_EQ(kNumParents * (kNumChildren / 2 + 2), numTraces);
+}
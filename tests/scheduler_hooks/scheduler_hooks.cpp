@@ -0,0 +1,174 @@
+/* FiberTaskingLib - A tasking library that uses fibers for efficient task switching
+ *
+ * This library was created as a proof of concept of the ideas presented by
+ * Christian Gyrling in his 2015 GDC Talk 'Parallelizing the Naughty Dog Engine Using Fibers'
+ *
+ * http://gdcvault.com/play/1022186/Parallelizing-the-Naughty-Dog-Engine
+ *
+ * FiberTaskingLib is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2015 - 2017
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "ftl/task_scheduler.h"
+#include "ftl/atomic_counter.h"
+#include "skip_test.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <cstdint>
+
+
+const uint kNumHookThreads = 4;
+const uint kNumHookTasks = 200;
+/* RunningFiber when the thread is on its own fiber */
+const std::size_t kNoFiber = SIZE_MAX;
+
+struct HookTestState {
+	HookTestState()
+		: SwitchIns(0),
+		  SwitchOuts(0),
+		  TaskBegins(0),
+		  TaskEnds(0),
+		  WaitBegins(0),
+		  WaitEnds(0),
+		  Errors(0) {
+		for (uint i = 0; i < kNumHookThreads; ++i) {
+			RunningFiber[i] = kNoFiber;
+		}
+	}
+
+	/* The fiber running on each thread, according to the hooks. Only touched by the thread itself */
+	std::size_t RunningFiber[kNumHookThreads];
+
+	std::atomic<uint> SwitchIns;
+	std::atomic<uint> SwitchOuts;
+	std::atomic<uint> TaskBegins;
+	std::atomic<uint> TaskEnds;
+	std::atomic<uint> WaitBegins;
+	std::atomic<uint> WaitEnds;
+	/* Hooks that fired out of order, or with the wrong fiber */
+	std::atomic<uint> Errors;
+};
+
+void OnFiberSwitchIn(void *context, std::size_t threadIndex, std::size_t fiberIndex) {
+	HookTestState *state = reinterpret_cast<HookTestState *>(context);
+	if (state->RunningFiber[threadIndex] != kNoFiber) {
+		state->Errors.fetch_add(1);
+	}
+	state->RunningFiber[threadIndex] = fiberIndex;
+	state->SwitchIns.fetch_add(1);
+}
+
+void OnFiberSwitchOut(void *context, std::size_t threadIndex, std::size_t fiberIndex) {
+	HookTestState *state = reinterpret_cast<HookTestState *>(context);
+	if (state->RunningFiber[threadIndex] != fiberIndex) {
+		state->Errors.fetch_add(1);
+	}
+	state->RunningFiber[threadIndex] = kNoFiber;
+	state->SwitchOuts.fetch_add(1);
+}
+
+void OnTaskBegin(void *context, std::size_t threadIndex, std::size_t fiberIndex, const ftl::Task &task) {
+	HookTestState *state = reinterpret_cast<HookTestState *>(context);
+	if (state->RunningFiber[threadIndex] != fiberIndex) {
+		state->Errors.fetch_add(1);
+	}
+	state->TaskBegins.fetch_add(1);
+}
+
+void OnTaskEnd(void *context, std::size_t threadIndex, std::size_t fiberIndex, const ftl::Task &task) {
+	HookTestState *state = reinterpret_cast<HookTestState *>(context);
+	if (state->RunningFiber[threadIndex] != fiberIndex) {
+		state->Errors.fetch_add(1);
+	}
+	state->TaskEnds.fetch_add(1);
+}
+
+void OnWaitBegin(void *context, std::size_t threadIndex, std::size_t fiberIndex, const ftl::AtomicCounter *counter) {
+	HookTestState *state = reinterpret_cast<HookTestState *>(context);
+	// The fiber hasn't switched out yet
+	if (state->RunningFiber[threadIndex] != fiberIndex || counter == nullptr) {
+		state->Errors.fetch_add(1);
+	}
+	state->WaitBegins.fetch_add(1);
+}
+
+void OnWaitEnd(void *context, std::size_t threadIndex, std::size_t fiberIndex, const ftl::AtomicCounter *counter) {
+	HookTestState *state = reinterpret_cast<HookTestState *>(context);
+	// The fiber has already switched back in
+	if (state->RunningFiber[threadIndex] != fiberIndex || counter == nullptr) {
+		state->Errors.fetch_add(1);
+	}
+	state->WaitEnds.fetch_add(1);
+}
+
+void HookSleepTask(ftl::TaskScheduler *taskScheduler, void *arg) {
+	// Wait on a delayed task, so the fiber has to switch out, and may come back on another thread
+	ftl::AtomicCounter counter(taskScheduler);
+	taskScheduler->AddDelayedTask({[](ftl::TaskScheduler *, void *) {}, nullptr}, std::chrono::microseconds(20), &counter);
+	taskScheduler->WaitForCounter(&counter, 0);
+}
+
+void HookTestMainTask(ftl::TaskScheduler *taskScheduler, void *arg) {
+	ftl::Task *tasks = new ftl::Task[kNumHookTasks];
+	for (uint i = 0; i < kNumHookTasks; ++i) {
+		tasks[i] = {HookSleepTask, nullptr};
+	}
+
+	ftl::AtomicCounter counter(taskScheduler);
+	taskScheduler->AddTasks(kNumHookTasks, tasks, &counter);
+	taskScheduler->WaitForCounter(&counter, 0);
+
+	delete[] tasks;
+}
+
+/**
+ * Checks that the hooks see every task and wait, and that the fiber switches on each thread pair up
+ */
+TEST(FunctionalTests, SchedulerHooks) {
+	if (!ftl::SchedulerPolicy::kHooks) {
+		FTL_SKIP_TEST("The scheduler was built without hooks");
+	}
+
+	HookTestState state;
+
+	ftl::SchedulerOptions options;
+	options.ThreadPoolSize = kNumHookThreads;
+	options.Hooks.Context = &state;
+	options.Hooks.FiberSwitchIn = OnFiberSwitchIn;
+	options.Hooks.FiberSwitchOut = OnFiberSwitchOut;
+	options.Hooks.TaskBegin = OnTaskBegin;
+	options.Hooks.TaskEnd = OnTaskEnd;
+	options.Hooks.WaitBegin = OnWaitBegin;
+	options.Hooks.WaitEnd = OnWaitEnd;
+
+	ftl::TaskScheduler taskScheduler;
+	taskScheduler.Run(options, HookTestMainTask, nullptr);
+
+	GTEST_ASSERT_EQ(0u, state.Errors.load());
+	// Every thread ended up back on its own fiber
+	for (uint i = 0; i < kNumHookThreads; ++i) {
+		GTEST_ASSERT_EQ(kNoFiber, state.RunningFiber[i]);
+	}
+	GTEST_ASSERT_EQ(state.SwitchIns.load(), state.SwitchOuts.load());
+	// The main task, every child, and every child's delayed task
+	GTEST_ASSERT_EQ(2 * kNumHookTasks + 1, state.TaskBegins.load());
+	GTEST_ASSERT_EQ(2 * kNumHookTasks + 1, state.TaskEnds.load());
+	// The children wait on their delayed tasks. A wait that finishes before the fiber switches out isn't reported
+	GTEST_ASSERT_GT(state.WaitBegins.load(), 0u);
+	GTEST_ASSERT_EQ(state.WaitBegins.load(), state.WaitEnds.load());
+}
@@ -0,0 +1,205 @@
+/* FiberTaskingLib - A tasking library that uses fibers for efficient task switching
+ *
+ * This library was created as a proof of concept of the ideas presented by
+ * Christian Gyrling in his 2015 GDC Talk 'Parallelizing the Naughty Dog Engine Using Fibers'
+ *
+ * http://gdcvault.com/play/1022186/Parallelizing-the-Naughty-Dog-Engine
+ *
+ * FiberTaskingLib is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2015 - 2017
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "ftl/shared_task_pool.h"
+#include "ftl/task_scheduler.h"
+#include "skip_test.h"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+
+#if defined(FTL_OS_LINUX) || defined(FTL_OS_MAC)
+#	include <sys/wait.h>
+#	include <unistd.h>
+#endif
+
+
+/* Gives each test run its own segment, so runs in parallel don't collide */
+void MakeSegmentName(char *name, std::size_t size) {
+#if defined(FTL_OS_LINUX) || defined(FTL_OS_MAC)
+	snprintf(name, size, "/ftl-test-%d", static_cast<int>(getpid()));
+#else
+	snprintf(name, size, "/ftl-test");
+#endif
+}
+
+const uint32 kSubtractFunctionId = 1;
+const uint kNumSharedTasks = 500;
+
+/* The payload of SubtractTask */
+struct SubtractPayload {
+	ftl::SharedCounter Total;
+	uint32 Value;
+};
+
+void SubtractTask(ftl::TaskScheduler *taskScheduler, const void *payload, uint32 payloadSize) {
+	GTEST_ASSERT_EQ(sizeof(SubtractPayload), payloadSize);
+
+	SubtractPayload subtract;
+	memcpy(&subtract, payload, sizeof(subtract));
+	taskScheduler->GetSharedPool()->FetchSubCounter(subtract.Total, subtract.Value);
+}
+
+/* Fills tasks with SubtractTasks that subtract 1 to kNumSharedTasks from total */
+void MakeSubtractTasks(ftl::SharedCounter total, ftl::SharedTask *tasks) {
+	for (uint i = 0; i < kNumSharedTasks; ++i) {
+		SubtractPayload subtract = {total, i + 1};
+		tasks[i].FunctionId = kSubtractFunctionId;
+		tasks[i].PayloadSize = sizeof(subtract);
+		memcpy(tasks[i].Payload, &subtract, sizeof(subtract));
+	}
+}
+
+const uint32 kSumOfTasks = kNumSharedTasks * (kNumSharedTasks + 1) / 2;
+
+void SharedTasksMainTask(ftl::TaskScheduler *taskScheduler, void *arg) {
+	(void)arg;
+	ftl::SharedTaskPool *pool = taskScheduler->GetSharedPool();
+
+	ftl::SharedCounter total;
+	ftl::SharedCounter counter;
+	GTEST_ASSERT_EQ(true, pool->AllocateCounter(kSumOfTasks, &total));
+	GTEST_ASSERT_EQ(true, pool->AllocateCounter(0, &counter));
+
+	ftl::SharedTask *tasks = new ftl::SharedTask[kNumSharedTasks];
+	MakeSubtractTasks(total, tasks);
+	taskScheduler->AddSharedTasks(kNumSharedTasks, tasks, &counter);
+	delete[] tasks;
+
+	taskScheduler->WaitForSharedCounter(counter, 0);
+	GTEST_ASSERT_EQ(0u, pool->LoadCounter(total));
+
+	pool->FreeCounter(total);
+	pool->FreeCounter(counter);
+}
+
+/**
+ * Tests that shared tasks run, and signal their counter, within one process
+ * The queue only holds 64 tasks, so most of them have to fall back to running as local tasks
+ */
+TEST(SharedMemory, SingleProcess) {
+	char name[64];
+	MakeSegmentName(name, sizeof(name));
+
+	ftl::SharedTaskPool pool;
+	if (!pool.Open(name, 64, 16)) {
+		FTL_SKIP_TEST("Shared memory isn't available");
+	}
+	pool.RegisterFunction(kSubtractFunctionId, SubtractTask);
+
+	ftl::SchedulerOptions options;
+	options.SharedPool = &pool;
+
+	ftl::TaskScheduler taskScheduler;
+	taskScheduler.Run(options, SharedTasksMainTask);
+
+	pool.Close();
+	ftl::SharedTaskPool::Unlink(name);
+}
+
+#if defined(FTL_OS_LINUX) || defined(FTL_OS_MAC)
+
+struct HelperArg {
+	ftl::SharedCounter Counter;
+};
+
+void HelperMainTask(ftl::TaskScheduler *taskScheduler, void *arg) {
+	HelperArg *helperArg = reinterpret_cast<HelperArg *>(arg);
+
+	// Our own queue is empty, so every task we run is stolen from the parent
+	taskScheduler->WaitForSharedCounter(helperArg->Counter, 0);
+}
+
+/**
+ * Tests that a process with nothing to do runs the tasks another process shares
+ * The parent doesn't run a TaskScheduler at all, so the child has to steal every task
+ */
+TEST(SharedMemory, StealAcrossProcesses) {
+	if (!ftl::SchedulerPolicy::kSharedPool) {
+		FTL_SKIP_TEST("The scheduler policy leaves the shared pool out");
+	}
+
+	char name[64];
+	MakeSegmentName(name, sizeof(name));
+
+	ftl::SharedTaskPool pool;
+	if (!pool.Open(name, 1024, 16)) {
+		FTL_SKIP_TEST("Shared memory isn't available");
+	}
+	pool.RegisterFunction(kSubtractFunctionId, SubtractTask);
+
+	ftl::SharedCounter total;
+	ftl::SharedCounter counter;
+	GTEST_ASSERT_EQ(true, pool.AllocateCounter(kSumOfTasks, &total));
+	GTEST_ASSERT_EQ(true, pool.AllocateCounter(kNumSharedTasks, &counter));
+
+	ftl::SharedTask *tasks = new ftl::SharedTask[kNumSharedTasks];
+	MakeSubtractTasks(total, tasks);
+	for (uint i = 0; i < kNumSharedTasks; ++i) {
+		GTEST_ASSERT_EQ(true, pool.TryPush(tasks[i], &counter));
+	}
+	delete[] tasks;
+
+	const pid_t child = fork();
+	GTEST_ASSERT_NE(-1, child);
+	if (child == 0) {
+		// The child gets a copy of the parent's mapping, but it needs its own process slot
+		ftl::SharedTaskPool childPool;
+		if (!childPool.Open(name)) {
+			_exit(1);
+		}
+		childPool.RegisterFunction(kSubtractFunctionId, SubtractTask);
+
+		ftl::SchedulerOptions options;
+		options.SharedPool = &childPool;
+		options.ThreadPoolSize = 2;
+
+		HelperArg helperArg = {counter};
+		ftl::TaskScheduler taskScheduler;
+		taskScheduler.Run(options, HelperMainTask, &helperArg);
+		childPool.Close();
+		_exit(0);
+	}
+
+	const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(30);
+	while (pool.LoadCounter(counter) != 0 && std::chrono::steady_clock::now() < deadline) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+	int status = 0;
+	waitpid(child, &status, 0);
+	GTEST_ASSERT_EQ(true, WIFEXITED(status));
+	GTEST_ASSERT_EQ(0, WEXITSTATUS(status));
+	GTEST_ASSERT_EQ(0u, pool.LoadCounter(counter));
+	GTEST_ASSERT_EQ(0u, pool.LoadCounter(total));
+
+	pool.Close();
+	ftl::SharedTaskPool::Unlink(name);
+}
+
+#endif
@@ -0,0 +1,47 @@
+/* FiberTaskingLib - A tasking library that uses fibers for efficient task switching
+ *
+ * This library was created as a proof of concept of the ideas presented by
+ * Christian Gyrling in his 2015 GDC Talk 'Parallelizing the Naughty Dog Engine Using Fibers'
+ *
+ * http://gdcvault.com/play/1022186/Parallelizing-the-Naughty-Dog-Engine
+ *
+ * FiberTaskingLib is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2015 - 2017
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+
+
+/**
+ * Skips the rest of the current test, and says why
+ *
+ * Older versions of gtest have no GTEST_SKIP(). There, the test prints the same marker and returns, and CTest
+ * reports it as skipped through the SKIP_REGULAR_EXPRESSION that GTEST_ADD_TESTS() sets
+ *
+ * @param reason    A string literal explaining what's missing
+ */
+#if defined(GTEST_SKIP)
+#	define FTL_SKIP_TEST(reason) GTEST_SKIP() << reason
+#else
+#	define FTL_SKIP_TEST(reason) \
+		do { \
+			printf("[  SKIPPED ] %s\n", reason); \
+			return; \
+		} while (false)
+#endif
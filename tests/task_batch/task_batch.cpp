@@ -0,0 +1,128 @@
+/* FiberTaskingLib - A tasking library that uses fibers for efficient task switching
+ *
+ * This library was created as a proof of concept of the ideas presented by
+ * Christian Gyrling in his 2015 GDC Talk 'Parallelizing the Naughty Dog Engine Using Fibers'
+ *
+ * http://gdcvault.com/play/1022186/Parallelizing-the-Naughty-Dog-Engine
+ *
+ * FiberTaskingLib is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2015 - 2017
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "ftl/task_scheduler.h"
+#include "ftl/atomic_counter.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <vector>
+
+
+/* A batch element. Padded, so the stride isn't the size of what the task touches */
+struct BatchElement {
+	uint64 Value;
+	std::atomic<uint> TimesRun;
+	char Padding[40];
+};
+
+void SquareElement(ftl::TaskScheduler *taskScheduler, void *arg) {
+	BatchElement *element = reinterpret_cast<BatchElement *>(arg);
+	element->Value *= element->Value;
+	element->TimesRun.fetch_add(1, std::memory_order_relaxed);
+}
+
+void SleepingElement(ftl::TaskScheduler *taskScheduler, void *arg) {
+	// Waiting inside a batch moves the rest of the batch to whichever thread resumes it
+	ftl::AtomicCounter counter(taskScheduler);
+	taskScheduler->AddDelayedTask({[](ftl::TaskScheduler *, void *) {}, nullptr}, std::chrono::microseconds(10), &counter);
+	taskScheduler->WaitForCounter(&counter, 0);
+
+	SquareElement(taskScheduler, arg);
+}
+
+struct TaskBatchTestArgs {
+	std::vector<BatchElement> Indirect;
+	std::vector<BatchElement> Inlined;
+	std::vector<BatchElement> Sleeping;
+	std::atomic<uint> SharedRuns;
+	bool EmptyBatchDone;
+};
+
+void CountSharedRun(ftl::TaskScheduler *taskScheduler, void *arg) {
+	reinterpret_cast<std::atomic<uint> *>(arg)->fetch_add(1, std::memory_order_relaxed);
+}
+
+void TaskBatchMainTask(ftl::TaskScheduler *taskScheduler, void *arg) {
+	TaskBatchTestArgs *args = reinterpret_cast<TaskBatchTestArgs *>(arg);
+
+	ftl::AtomicCounter counter(taskScheduler);
+	taskScheduler->AddTaskBatch(SquareElement, args->Indirect.data(), sizeof(BatchElement), static_cast<uint>(args->Indirect.size()), &counter);
+	taskScheduler->WaitForCounter(&counter, 0);
+
+	taskScheduler->AddTaskBatch<SquareElement>(args->Inlined.data(), sizeof(BatchElement), static_cast<uint>(args->Inlined.size()), &counter);
+	taskScheduler->WaitForCounter(&counter, 0);
+
+	taskScheduler->AddTaskBatch(SleepingElement, args->Sleeping.data(), sizeof(BatchElement), static_cast<uint>(args->Sleeping.size()), &counter);
+	taskScheduler->WaitForCounter(&counter, 0);
+
+	// A stride of 0 passes the same argument to every call
+	taskScheduler->AddTaskBatch<CountSharedRun>(&args->SharedRuns, 0, 1000, &counter);
+	taskScheduler->WaitForCounter(&counter, 0);
+
+	taskScheduler->AddTaskBatch(SquareElement, nullptr, sizeof(BatchElement), 0, &counter);
+	taskScheduler->WaitForCounter(&counter, 0);
+	args->EmptyBatchDone = true;
+}
+
+void FillBatch(std::vector<BatchElement> &elements, std::size_t count) {
+	elements = std::vector<BatchElement>(count);
+	for (std::size_t i = 0; i < count; ++i) {
+		elements[i].Value = i;
+		elements[i].TimesRun.store(0);
+	}
+}
+
+void CheckBatch(const std::vector<BatchElement> &elements) {
+	for (std::size_t i = 0; i < elements.size(); ++i) {
+		GTEST_ASSERT_EQ(1u, elements[i].TimesRun.load());
+		GTEST_ASSERT_EQ(i * i, elements[i].Value);
+	}
+}
+
+/**
+ * Runs batches that split, batches with waiting elements, and empty batches. Every element has to run exactly once
+ */
+TEST(FunctionalTests, TaskBatch) {
+	TaskBatchTestArgs args;
+	// Sizes that aren't a multiple of the split grain
+	FillBatch(args.Indirect, 100003);
+	FillBatch(args.Inlined, 65000);
+	FillBatch(args.Sleeping, 300);
+	args.SharedRuns.store(0);
+	args.EmptyBatchDone = false;
+
+	ftl::SchedulerOptions options;
+	options.ThreadPoolSize = 4;
+
+	ftl::TaskScheduler taskScheduler;
+	taskScheduler.Run(options, TaskBatchMainTask, &args);
+
+	CheckBatch(args.Indirect);
+	CheckBatch(args.Inlined);
+	CheckBatch(args.Sleeping);
+	GTEST_ASSERT_EQ(1000u, args.SharedRuns.load());
+	GTEST_ASSERT_EQ(true, args.EmptyBatchDone);
+}
@@ -0,0 +1,183 @@
+/* FiberTaskingLib - A tasking library that uses fibers for efficient task switching
+ *
+ * This library was created as a proof of concept of the ideas presented by
+ * Christian Gyrling in his 2015 GDC Talk 'Parallelizing the Naughty Dog Engine Using Fibers'
+ *
+ * http://gdcvault.com/play/1022186/Parallelizing-the-Naughty-Dog-Engine
+ *
+ * FiberTaskingLib is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2015 - 2017
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "ftl/task_group.h"
+#include "ftl/task_scheduler.h"
+
+#include <gtest/gtest.h>
+
+#include <array>
+#include <atomic>
+
+
+uint64 TaskGroupFib(ftl::TaskScheduler *taskScheduler, uint64 n) {
+	if (n < 2) {
+		return n;
+	}
+
+	uint64 x;
+	uint64 y;
+	ftl::TaskGroup group(taskScheduler);
+	group.Run([taskScheduler, n, &x]() {
+		x = TaskGroupFib(taskScheduler, n - 1);
+	});
+	group.Run([taskScheduler, n, &y]() {
+		y = TaskGroupFib(taskScheduler, n - 2);
+	});
+	group.Wait();
+
+	return x + y;
+}
+
+struct TaskGroupTestState {
+	uint64 Fib;
+	std::atomic<uint> Visited;
+	std::atomic<uint64> HeapSum;
+	std::atomic<uint> WaitedTasks;
+};
+
+/* Spawns the next level of a tree into the same group as its parent, while the group's other tasks are running */
+void SpawnTreeLevel(ftl::TaskScheduler *taskScheduler, ftl::TaskGroup *group, TaskGroupTestState *state, uint depth) {
+	state->Visited.fetch_add(1);
+	if (depth == 0) {
+		return;
+	}
+
+	for (uint i = 0; i < 3; ++i) {
+		group->Run([taskScheduler, group, state, depth]() {
+			SpawnTreeLevel(taskScheduler, group, state, depth - 1);
+		});
+	}
+}
+
+void TaskGroupMainTask(ftl::TaskScheduler *taskScheduler, void *arg) {
+	TaskGroupTestState *state = reinterpret_cast<TaskGroupTestState *>(arg);
+
+	// Nested groups
+	state->Fib = TaskGroupFib(taskScheduler, 20);
+
+	// Incremental spawns into one group. 1 + 3 + 9 + ... + 3^7 tasks
+	{
+		ftl::TaskGroup group(taskScheduler);
+		SpawnTreeLevel(taskScheduler, &group, state, 7);
+	}
+
+	// Callables too big to store in place
+	{
+		ftl::TaskGroup group(taskScheduler);
+		for (uint64 i = 0; i < 100; ++i) {
+			std::array<uint64, 32> values;
+			values.fill(i);
+			group.Run([state, values]() {
+				state->HeapSum.fetch_add(values[0] + values[31]);
+			});
+		}
+	}
+
+	// Tasks that switch fibers, and may free their closure from another thread
+	{
+		ftl::TaskGroup group(taskScheduler);
+		for (uint i = 0; i < 64; ++i) {
+			group.Run([taskScheduler, state]() {
+				ftl::TaskGroup inner(taskScheduler);
+				inner.Run([taskScheduler]() {
+					ftl::AtomicCounter counter(taskScheduler);
+					taskScheduler->AddDelayedTask({[](ftl::TaskScheduler *, void *) {}, nullptr}, std::chrono::microseconds(50), &counter);
+					taskScheduler->WaitForCounter(&counter, 0);
+				});
+				inner.Wait();
+				state->WaitedTasks.fetch_add(1);
+			});
+		}
+	}
+}
+
+/**
+ * Tests nested groups, spawning into a group from its own tasks, heap-stored callables, and tasks that wait
+ */
+TEST(FunctionalTests, TaskGroup) {
+	TaskGroupTestState state;
+	state.Fib = 0;
+	state.Visited.store(0);
+	state.HeapSum.store(0);
+	state.WaitedTasks.store(0);
+
+	ftl::SchedulerOptions options;
+	options.ThreadPoolSize = 4;
+
+	ftl::TaskScheduler taskScheduler;
+	taskScheduler.Run(options, TaskGroupMainTask, &state);
+
+	GTEST_ASSERT_EQ(6765u, state.Fib);
+	GTEST_ASSERT_EQ(3280u, state.Visited.load());
+	GTEST_ASSERT_EQ(9900u, state.HeapSum.load());
+	GTEST_ASSERT_EQ(64u, state.WaitedTasks.load());
+}
+
+struct UnrelatedWaitState {
+	ftl::AtomicCounter *Signal;
+	bool GroupTaskRan;
+};
+
+void WaitForSignalTask(ftl::TaskScheduler *taskScheduler, void *arg) {
+	UnrelatedWaitState *state = reinterpret_cast<UnrelatedWaitState *>(arg);
+	taskScheduler->WaitForCounter(state->Signal, 0);
+}
+
+void UnrelatedWaitMainTask(ftl::TaskScheduler *taskScheduler, void *arg) {
+	UnrelatedWaitState *state = reinterpret_cast<UnrelatedWaitState *>(arg);
+
+	ftl::AtomicCounter signal(taskScheduler, 1);
+	state->Signal = &signal;
+
+	// The unrelated task is spawned last, so it's the next one this thread would run. It waits on a signal we only
+	// give once Wait() returns. If Wait() ran it nested on our stack, neither could ever finish
+	ftl::TaskGroup group(taskScheduler);
+	group.Run([state]() {
+		state->GroupTaskRan = true;
+	});
+	ftl::AtomicCounter unrelated(taskScheduler);
+	taskScheduler->AddTask({WaitForSignalTask, state}, &unrelated);
+	group.Wait();
+
+	signal.Store(0);
+	taskScheduler->WaitForCounter(&unrelated, 0);
+}
+
+/**
+ * Tests that Wait() doesn't run tasks of other counters on the waiting fiber
+ */
+TEST(FunctionalTests, TaskGroupUnrelatedWait) {
+	UnrelatedWaitState state;
+	state.Signal = nullptr;
+	state.GroupTaskRan = false;
+
+	ftl::SchedulerOptions options;
+	options.ThreadPoolSize = 1;
+
+	ftl::TaskScheduler taskScheduler;
+	taskScheduler.Run(options, UnrelatedWaitMainTask, &state);
+
+	GTEST_ASSERT_EQ(true, state.GroupTaskRan);
+}
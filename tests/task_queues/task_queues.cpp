@@ -0,0 +1,207 @@
+/* FiberTaskingLib - A tasking library that uses fibers for efficient task switching
+ *
+ * This library was created as a proof of concept of the ideas presented by
+ * Christian Gyrling in his 2015 GDC Talk 'Parallelizing the Naughty Dog Engine Using Fibers'
+ *
+ * http://gdcvault.com/play/1022186/Parallelizing-the-Naughty-Dog-Engine
+ *
+ * FiberTaskingLib is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2015 - 2017
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "ftl/task_queue.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+
+const uint kNumStressItems = 100000u;
+const uint kNumStressThieves = 3u;
+
+TEST(TaskQueues, BoundedDequeOrder) {
+	ftl::BoundedDeque<uint, 8> queue;
+	uint value;
+
+	// The owner pops the newest item, thieves steal the oldest
+	for (uint i = 1; i <= 4; ++i) {
+		queue.Push(i);
+	}
+	GTEST_ASSERT_EQ(4u, queue.Size());
+	GTEST_ASSERT_EQ(true, queue.Pop(&value));
+	GTEST_ASSERT_EQ(4u, value);
+	GTEST_ASSERT_EQ(true, queue.Steal(&value));
+	GTEST_ASSERT_EQ(1u, value);
+	GTEST_ASSERT_EQ(true, queue.Pop(&value));
+	GTEST_ASSERT_EQ(3u, value);
+	GTEST_ASSERT_EQ(true, queue.Steal(&value));
+	GTEST_ASSERT_EQ(2u, value);
+
+	GTEST_ASSERT_EQ(0u, queue.Size());
+	GTEST_ASSERT_EQ(false, queue.Pop(&value));
+	GTEST_ASSERT_EQ(false, queue.Steal(&value));
+
+	// The indices keep going past the end of the array
+	for (uint i = 0; i < 20; ++i) {
+		queue.Push(i);
+		GTEST_ASSERT_EQ(true, queue.Pop(&value));
+		GTEST_ASSERT_EQ(i, value);
+	}
+}
+
+TEST(TaskQueues, BoundedDequeOverflow) {
+	ftl::BoundedDeque<uint, 4> queue;
+	uint value;
+
+	// 5 and 6 don't fit in the array
+	for (uint i = 1; i <= 6; ++i) {
+		queue.Push(i);
+	}
+	GTEST_ASSERT_EQ(6u, queue.Size());
+
+	// Stealing frees a slot in the array, but 7 still goes to the overflow behind 5 and 6, so Pop() stays LIFO
+	GTEST_ASSERT_EQ(true, queue.Steal(&value));
+	GTEST_ASSERT_EQ(1u, value);
+	queue.Push(7);
+	GTEST_ASSERT_EQ(6u, queue.Size());
+
+	for (uint expected = 7; expected >= 2; --expected) {
+		GTEST_ASSERT_EQ(true, queue.Pop(&value));
+		GTEST_ASSERT_EQ(expected, value);
+	}
+	GTEST_ASSERT_EQ(false, queue.Pop(&value));
+
+	// Thieves drain the array first, then the overflow, oldest first
+	for (uint i = 1; i <= 6; ++i) {
+		queue.Push(i);
+	}
+	for (uint expected = 1; expected <= 6; ++expected) {
+		GTEST_ASSERT_EQ(true, queue.Steal(&value));
+		GTEST_ASSERT_EQ(expected, value);
+	}
+	GTEST_ASSERT_EQ(false, queue.Steal(&value));
+	GTEST_ASSERT_EQ(0u, queue.Size());
+}
+
+TEST(TaskQueues, MpmcTaskQueueOrder) {
+	ftl::MpmcTaskQueue<uint, 8> queue;
+	uint value;
+
+	// The owner and the thieves both take the oldest item
+	for (uint i = 1; i <= 4; ++i) {
+		queue.Push(i);
+	}
+	GTEST_ASSERT_EQ(4u, queue.Size());
+	GTEST_ASSERT_EQ(true, queue.Pop(&value));
+	GTEST_ASSERT_EQ(1u, value);
+	GTEST_ASSERT_EQ(true, queue.Steal(&value));
+	GTEST_ASSERT_EQ(2u, value);
+	GTEST_ASSERT_EQ(true, queue.Pop(&value));
+	GTEST_ASSERT_EQ(3u, value);
+	GTEST_ASSERT_EQ(true, queue.Steal(&value));
+	GTEST_ASSERT_EQ(4u, value);
+
+	GTEST_ASSERT_EQ(0u, queue.Size());
+	GTEST_ASSERT_EQ(false, queue.Pop(&value));
+	GTEST_ASSERT_EQ(false, queue.Steal(&value));
+}
+
+TEST(TaskQueues, MpmcTaskQueueOverflow) {
+	ftl::MpmcTaskQueue<uint, 4> queue;
+	uint value;
+
+	// 5 and 6 don't fit in the queue. They come out after the items that did
+	for (uint i = 1; i <= 6; ++i) {
+		queue.Push(i);
+	}
+	GTEST_ASSERT_EQ(6u, queue.Size());
+
+	for (uint expected = 1; expected <= 6; ++expected) {
+		GTEST_ASSERT_EQ(true, queue.Pop(&value));
+		GTEST_ASSERT_EQ(expected, value);
+	}
+	GTEST_ASSERT_EQ(false, queue.Pop(&value));
+	GTEST_ASSERT_EQ(0u, queue.Size());
+}
+
+/**
+ * The owner pushes kNumStressItems items, popping every third push, while kNumStressThieves threads steal
+ * Every item has to come out exactly once
+ *
+ * The capacity is small, so the items regularly spill into the overflow list
+ */
+template<typename Queue>
+static void RunStealStress() {
+	Queue *queue = new Queue();
+	std::atomic<bool> done(false);
+	std::vector<std::vector<uint> > taken(kNumStressThieves + 1);
+
+	std::vector<std::thread> thieves;
+	for (uint i = 0; i < kNumStressThieves; ++i) {
+		std::vector<uint> *stolen = &taken[i + 1];
+		thieves.emplace_back([queue, &done, stolen]() {
+			uint value;
+			// A failed steal can just be a lost race, so check the size before giving up
+			while (!done.load(std::memory_order_acquire) || queue->Size() != 0) {
+				if (queue->Steal(&value)) {
+					stolen->push_back(value);
+				} else {
+					std::this_thread::yield();
+				}
+			}
+		});
+	}
+
+	uint value;
+	for (uint i = 0; i < kNumStressItems; ++i) {
+		queue->Push(i);
+		if (i % 3 == 0 && queue->Pop(&value)) {
+			taken[0].push_back(value);
+		}
+	}
+	while (queue->Size() != 0) {
+		if (queue->Pop(&value)) {
+			taken[0].push_back(value);
+		}
+	}
+	done.store(true, std::memory_order_release);
+
+	for (std::thread &thief : thieves) {
+		thief.join();
+	}
+	delete queue;
+
+	std::vector<uint> counts(kNumStressItems, 0);
+	for (const std::vector<uint> &values : taken) {
+		for (uint item : values) {
+			GTEST_ASSERT_LT(item, kNumStressItems);
+			++counts[item];
+		}
+	}
+	for (uint i = 0; i < kNumStressItems; ++i) {
+		GTEST_ASSERT_EQ(1u, counts[i]) << "Item " << i;
+	}
+}
+
+TEST(TaskQueues, BoundedDequeStealStress) {
+	RunStealStress<ftl::BoundedDeque<uint, 64> >();
+}
+
+TEST(TaskQueues, MpmcTaskQueueStealStress) {
+	RunStealStress<ftl::MpmcTaskQueue<uint, 64> >();
+}
@@ -0,0 +1,161 @@
+/* FiberTaskingLib - A tasking library that uses fibers for efficient task switching
+ *
+ * This library was created as a proof of concept of the ideas presented by
+ * Christian Gyrling in his 2015 GDC Talk 'Parallelizing the Naughty Dog Engine Using Fibers'
+ *
+ * http://gdcvault.com/play/1022186/Parallelizing-the-Naughty-Dog-Engine
+ *
+ * FiberTaskingLib is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2015 - 2017
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "ftl/task_scheduler.h"
+#include "ftl/atomic_counter.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <cstdint>
+
+#if defined(__GLIBC__)
+	#include <execinfo.h>
+#endif
+
+
+#if defined(__GLIBC__)
+
+const int kMaxUnwindFrames = 64;
+
+struct UnwindTestResult {
+	int NumFrames;
+	bool FirstFrameInTask;
+};
+
+/* Unwinds from the current frame, and checks the innermost frame is in 'function' */
+template <typename T>
+__attribute__((noinline)) void UnwindFrom(T function, UnwindTestResult *result) {
+	void *frames[kMaxUnwindFrames];
+	result->NumFrames = backtrace(frames, kMaxUnwindFrames);
+
+	// frames[0] is in this function. frames[1] is the return address into the caller
+	const uintptr_t start = reinterpret_cast<uintptr_t>(function);
+	const uintptr_t returnAddress = reinterpret_cast<uintptr_t>(frames[1]);
+	result->FirstFrameInTask = result->NumFrames > 1 && returnAddress > start && returnAddress - start < 4096;
+}
+
+__attribute__((noinline)) void UnwindingTask(ftl::TaskScheduler *taskScheduler, void *arg) {
+	UnwindTestResult *results = reinterpret_cast<UnwindTestResult *>(arg);
+	UnwindFrom(UnwindingTask, &results[0]);
+
+	// Switch out, so we resume on a fiber that was suspended, maybe on another thread
+	ftl::AtomicCounter counter(taskScheduler);
+	taskScheduler->AddDelayedTask({[](ftl::TaskScheduler *, void *) {}, nullptr}, std::chrono::microseconds(50), &counter);
+	taskScheduler->WaitForCounter(&counter, 0);
+
+	UnwindFrom(UnwindingTask, &results[1]);
+}
+
+void UnwindingMainTask(ftl::TaskScheduler *taskScheduler, void *arg) {
+	UnwindTestResult *results = reinterpret_cast<UnwindTestResult *>(arg);
+	UnwindFrom(UnwindingMainTask, &results[2]);
+
+	ftl::AtomicCounter counter(taskScheduler);
+	taskScheduler->AddTask({UnwindingTask, results}, &counter);
+	taskScheduler->WaitForCounter(&counter, 0);
+}
+
+/**
+ * Unwinds from inside tasks, before and after a wait. The unwinder has to stop cleanly at the fiber entry,
+ * instead of walking off the top of the fiber stack
+ */
+TEST(FunctionalTests, UnwindFromTask) {
+	UnwindTestResult results[3] = {};
+
+	ftl::SchedulerOptions options;
+	options.ThreadPoolSize = 2;
+
+	ftl::TaskScheduler taskScheduler;
+	taskScheduler.Run(options, UnwindingMainTask, results);
+
+	for (const UnwindTestResult &result : results) {
+		GTEST_ASSERT_EQ(true, result.FirstFrameInTask);
+		// UnwindFrom(), the task, and the fiber entry. Then it has to stop
+		GTEST_ASSERT_GE(result.NumFrames, 3);
+		GTEST_ASSERT_LE(result.NumFrames, 8);
+	}
+}
+
+#endif
+
+struct ParentTaskTestArgs {
+	std::atomic<ftl::TaskFunction> ChildParent;
+	std::atomic<ftl::TaskFunction> GrandchildParent;
+	std::atomic<ftl::TaskFunction> MainParent;
+};
+
+void ParentTestGrandchildTask(ftl::TaskScheduler *taskScheduler, void *arg) {
+	ParentTaskTestArgs *args = reinterpret_cast<ParentTaskTestArgs *>(arg);
+	args->GrandchildParent.store(taskScheduler->GetParentTaskFunction());
+}
+
+void ParentTestChildTask(ftl::TaskScheduler *taskScheduler, void *arg) {
+	ParentTaskTestArgs *args = reinterpret_cast<ParentTaskTestArgs *>(arg);
+	args->ChildParent.store(taskScheduler->GetParentTaskFunction());
+
+	ftl::AtomicCounter counter(taskScheduler);
+	taskScheduler->AddTask({ParentTestGrandchildTask, args}, &counter);
+	taskScheduler->WaitForCounter(&counter, 0);
+
+	// Waiting doesn't lose the link, even if we come back on another thread
+	if (taskScheduler->GetParentTaskFunction() != args->ChildParent.load()) {
+		args->ChildParent.store(nullptr);
+	}
+}
+
+void ParentTestMainTask(ftl::TaskScheduler *taskScheduler, void *arg) {
+	ParentTaskTestArgs *args = reinterpret_cast<ParentTaskTestArgs *>(arg);
+	args->MainParent.store(taskScheduler->GetParentTaskFunction());
+
+	ftl::AtomicCounter counter(taskScheduler);
+	taskScheduler->AddTask({ParentTestChildTask, args}, &counter);
+	taskScheduler->WaitForCounter(&counter, 0);
+}
+
+/**
+ * Checks that each task can find the task that added it
+ */
+TEST(FunctionalTests, ParentTasks) {
+	ParentTaskTestArgs args;
+	args.MainParent.store(ParentTestMainTask);
+
+	ftl::SchedulerOptions options;
+	options.ThreadPoolSize = 2;
+	options.TrackParentTasks = true;
+
+	ftl::TaskScheduler taskScheduler;
+	taskScheduler.Run(options, ParentTestMainTask, &args);
+
+	GTEST_ASSERT_EQ(nullptr, args.MainParent.load());
+	GTEST_ASSERT_EQ(&ParentTestMainTask, args.ChildParent.load());
+	GTEST_ASSERT_EQ(&ParentTestChildTask, args.GrandchildParent.load());
+
+	// Without tracking, there's no parent
+	options.TrackParentTasks = false;
+	taskScheduler.Run(options, ParentTestMainTask, &args);
+
+	GTEST_ASSERT_EQ(nullptr, args.ChildParent.load());
+	GTEST_ASSERT_EQ(nullptr, args.GrandchildParent.load());
+}
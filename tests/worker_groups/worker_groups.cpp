@@ -0,0 +1,113 @@
+/* FiberTaskingLib - A tasking library that uses fibers for efficient task switching
+ *
+ * This library was created as a proof of concept of the ideas presented by
+ * Christian Gyrling in his 2015 GDC Talk 'Parallelizing the Naughty Dog Engine Using Fibers'
+ *
+ * http://gdcvault.com/play/1022186/Parallelizing-the-Naughty-Dog-Engine
+ *
+ * FiberTaskingLib is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2015 - 2017
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ftl/task_scheduler.h"
+#include "ftl/atomic_counter.h"
+
+#include <gtest/gtest.h>
+
+
+const uint kNumBackgroundTasks = 1000u;
+const uint kNumForegroundTasks = 100u;
+
+
+struct WorkerGroupTestArgs {
+	uint ForegroundGroup;
+	uint BackgroundGroup;
+	std::atomic_uint NumTasksInForeground;
+	std::atomic_uint NumTasksInBackground;
+};
+
+void CountWorkerGroup(ftl::TaskScheduler *taskScheduler, void *arg) {
+	WorkerGroupTestArgs *args = reinterpret_cast<WorkerGroupTestArgs *>(arg);
+
+	if (taskScheduler->GetCurrentWorkerGroup() == args->ForegroundGroup) {
+		args->NumTasksInForeground.fetch_add(1);
+	} else if (taskScheduler->GetCurrentWorkerGroup() == args->BackgroundGroup) {
+		args->NumTasksInBackground.fetch_add(1);
+	}
+}
+
+/**
+ * Runs in the background group, and hands some work back to the foreground group
+ */
+void BackgroundProducer(ftl::TaskScheduler *taskScheduler, void *arg) {
+	WorkerGroupTestArgs *args = reinterpret_cast<WorkerGroupTestArgs *>(arg);
+	CountWorkerGroup(taskScheduler, arg);
+
+	ftl::Task *tasks = new ftl::Task[kNumForegroundTasks];
+	for (uint i = 0; i < kNumForegroundTasks; ++i) {
+		tasks[i] = {CountWorkerGroup, arg};
+	}
+
+	ftl::AtomicCounter counter(taskScheduler);
+	taskScheduler->AddTasks(kNumForegroundTasks, tasks, &counter, args->ForegroundGroup);
+	delete[] tasks;
+
+	// The foreground threads will make us ready again. We have to resume in the background group
+	taskScheduler->WaitForCounter(&counter, 0);
+	CountWorkerGroup(taskScheduler, arg);
+}
+
+void WorkerGroupsMainTask(ftl::TaskScheduler *taskScheduler, void *arg) {
+	WorkerGroupTestArgs args;
+	args.ForegroundGroup = taskScheduler->GetWorkerGroup("foreground");
+	args.BackgroundGroup = taskScheduler->GetWorkerGroup("background");
+	args.NumTasksInForeground.store(0);
+	args.NumTasksInBackground.store(0);
+
+	GTEST_ASSERT_EQ(2u, taskScheduler->GetNumWorkerGroups());
+	GTEST_ASSERT_EQ(UINT_MAX, taskScheduler->GetWorkerGroup("nonexistent"));
+	// The main task runs in the first group
+	GTEST_ASSERT_EQ(args.ForegroundGroup, taskScheduler->GetCurrentWorkerGroup());
+
+	ftl::Task *tasks = new ftl::Task[kNumBackgroundTasks];
+	for (uint i = 0; i < kNumBackgroundTasks; ++i) {
+		tasks[i] = {i % 10 == 0 ? BackgroundProducer : CountWorkerGroup, &args};
+	}
+
+	ftl::AtomicCounter counter(taskScheduler);
+	taskScheduler->AddTasks(kNumBackgroundTasks, tasks, &counter, args.BackgroundGroup);
+	delete[] tasks;
+
+	taskScheduler->WaitForCounter(&counter, 0);
+	GTEST_ASSERT_EQ(args.ForegroundGroup, taskScheduler->GetCurrentWorkerGroup());
+
+	// Every producer counts itself twice. Once before it waits, and once after
+	const uint numProducers = kNumBackgroundTasks / 10;
+	GTEST_ASSERT_EQ(kNumBackgroundTasks + numProducers, args.NumTasksInBackground.load());
+	GTEST_ASSERT_EQ(numProducers * kNumForegroundTasks, args.NumTasksInForeground.load());
+}
+
+
+/**
+ * Tests that tasks run in the worker group they were added to, and waiting fibers resume in their own group
+ */
+TEST(FunctionalTests, WorkerGroups) {
+	ftl::SchedulerOptions options;
+	options.Groups.emplace_back("foreground", 1);
+	options.Groups.emplace_back("background", 2);
+
+	ftl::TaskScheduler taskScheduler;
+	taskScheduler.Run(options, WorkerGroupsMainTask);
+}